@@ -0,0 +1,249 @@
+/*
+ * State beacon benchmark: fixed full dumps vs. change-driven deltas
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Replays a day of a plug with a cycling load (a fridge-like 0/120 W duty
+ * cycle with mains and measurement noise) and relay switching at random,
+ * including bursts of rapid toggles. The plug's state goes out two ways:
+ *   - as before: a full DEVICE_STATE every ESPNOW_BROADCAST_INTERVAL, on
+ *     every relay change, and a heartbeat every 30 s (v1 JSON and v2 sizes)
+ *   - through BeaconScheduler (beacon.h), polled each 100 ms loop() pass
+ *     and on every relay change, sending MSG_STATE_DELTA with only the
+ *     fields that changed
+ * It reports frames, bytes and airtime per day, the most frames sent in
+ * any one second, how long a peer could see a stale relay state, and how
+ * far the power a peer last heard was from the actual power (p50/p99).
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -std=c++17 -Ibench/host -Isonoff_s31_main \
+ *       bench/beacon.cpp sonoff_s31_main/beacon.cpp sonoff_s31_main/espnow_wire.cpp \
+ *       -o beacon
+ *
+ * Usage:
+ *   beacon [--hours N] [--toggles-per-hour N] [--seed N]
+ */
+
+#include <Arduino.h>
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <vector>
+#include "beacon.h"
+#include "espnow_wire.h"
+
+static const double FRAME_OVERHEAD_BYTES = 24 + 15 + 4;
+static const double PREAMBLE_US = 192;
+static const uint32_t LOOP_MS = 100;
+static const uint32_t HEARTBEAT_MS = 30000;
+static const size_t LEGACY_BYTES = sizeof(ESPNOWMessage);
+
+static double airtimeUs(size_t payload) {
+  return PREAMBLE_US + (payload + FRAME_OVERHEAD_BYTES) * 8;
+}
+
+struct Event {
+  uint32_t at;
+  bool toggle;
+};
+
+struct Result {
+  unsigned long frames = 0;
+  unsigned long bytes = 0;
+  double airtimeUs = 0;
+  unsigned long peakPerSecond = 0;
+  uint32_t relayStaleMaxMs = 0;
+  std::vector<float> powerError;
+
+  std::deque<uint32_t> window;
+  bool peerRelay = false;
+  float peerPower = 0;
+  uint32_t staleSince = 0;
+  bool stale = false;
+
+  void send(uint32_t now, size_t len) {
+    frames++;
+    bytes += len;
+    airtimeUs += ::airtimeUs(len);
+    window.push_back(now);
+    while (now - window.front() >= 1000) window.pop_front();
+    peakPerSecond = std::max(peakPerSecond, (unsigned long)window.size());
+  }
+
+  void observe(uint32_t now, bool relay, float power) {
+    if (peerRelay != relay && !stale) {
+      stale = true;
+      staleSince = now;
+    } else if (peerRelay == relay && stale) {
+      stale = false;
+      relayStaleMaxMs = std::max(relayStaleMaxMs, now - staleSince);
+    }
+    powerError.push_back(fabs(peerPower - power));
+  }
+};
+
+struct Plug {
+  bool relay = false;
+  BeaconSnapshot state;
+};
+
+// Load and relay events for the whole run, at 1 ms resolution
+static std::vector<Event> makeEvents(uint32_t durationMs, double togglesPerHour, std::mt19937& rng) {
+  std::vector<Event> events;
+  std::exponential_distribution<double> gap(togglesPerHour / 3600000.0);
+  std::uniform_int_distribution<int> percent(0, 99);
+  std::uniform_int_distribution<int> burstLen(3, 8);
+  std::uniform_int_distribution<uint32_t> burstGap(50, 400);
+
+  for (double t = gap(rng); t < durationMs; t += gap(rng)) {
+    uint32_t at = (uint32_t)t;
+    events.push_back(Event{at, true});
+    if (percent(rng) < 10) {
+      // Someone playing with the button or a flapping automation
+      int n = burstLen(rng);
+      for (int i = 0; i < n; i++) {
+        at += burstGap(rng);
+        events.push_back(Event{at, true});
+      }
+    }
+  }
+  std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) { return a.at < b.at; });
+  return events;
+}
+
+static Result run(bool scheduled, bool legacy, uint32_t durationMs, const std::vector<Event>& events,
+                  unsigned int seed) {
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> mainsNoise(0.0f, 0.4f);
+  std::normal_distribution<float> powerNoise(0.0f, 1.5f);
+  Result r;
+  Plug plug;
+  BeaconScheduler beacon;
+  uint8_t buf[ESPNOW_MAX_PAYLOAD];
+  float mains = 230;
+
+  auto fullSize = [&] {
+    if (legacy) return LEGACY_BYTES;
+    WireMessage msg;
+    msg.type = MSG_DEVICE_STATE;
+    wireSetString(msg.deviceId, "sonoff-s31-a1b2c3");
+    return wireEncode(msg, buf, sizeof(buf));
+  };
+  auto heartbeatSize = [&] {
+    if (legacy) return LEGACY_BYTES;
+    WireMessage msg;
+    msg.type = MSG_HEARTBEAT;
+    wireSetString(msg.deviceId, "sonoff-s31-a1b2c3");
+    return wireEncode(msg, buf, sizeof(buf));
+  };
+  auto deliverFull = [&](uint32_t now) {
+    r.send(now, fullSize());
+    r.peerRelay = plug.state.relay;
+    r.peerPower = plug.state.power;
+  };
+  auto pollBeacon = [&](uint32_t now) {
+    uint8_t fields = beacon.poll(now, plug.state);
+    if (fields == 0) return;
+    if (fields == BEACON_HEARTBEAT) {
+      r.send(now, heartbeatSize());
+      return;
+    }
+    if (fields == BEACON_ALL) {
+      deliverFull(now);
+      return;
+    }
+    WireMessage msg;
+    msg.type = MSG_STATE_DELTA;
+    msg.fields = fields;
+    msg.relay = plug.state.relay;
+    msg.wifi = plug.state.wifi;
+    msg.voltage = plug.state.voltage;
+    msg.current = plug.state.current;
+    msg.power = plug.state.power;
+    msg.energy = plug.state.energy;
+    wireSetString(msg.deviceId, "sonoff-s31-a1b2c3");
+    r.send(now, wireEncode(msg, buf, sizeof(buf)));
+    if (fields & BEACON_RELAY) r.peerRelay = plug.state.relay;
+    if (fields & BEACON_POWER) r.peerPower = plug.state.power;
+  };
+
+  plug.state.wifi = true;
+  uint32_t lastFull = 0;
+  uint32_t lastHeartbeat = 0;
+  size_t next = 0;
+  for (uint32_t now = 0; now < durationMs; now++) {
+    while (next < events.size() && events[next].at <= now) {
+      plug.relay = !plug.relay;
+      plug.state.relay = plug.relay;
+      next++;
+      if (scheduled) pollBeacon(now);
+      else deliverFull(now);
+    }
+
+    if (now % LOOP_MS == 0) {
+      // Sensor readings, refreshed each loop() pass
+      mains += mainsNoise(rng) * 0.05f;
+      mains = std::min(245.0f, std::max(215.0f, mains));
+      bool compressor = plug.relay && (now / 60000) % 20 < 7;
+      float load = compressor ? 120.0f + powerNoise(rng) : 0.0f;
+      plug.state.voltage = plug.relay ? mains + mainsNoise(rng) : 0;
+      plug.state.power = std::max(0.0f, load);
+      plug.state.current = plug.state.voltage > 1 ? plug.state.power / plug.state.voltage : 0;
+      plug.state.energy += plug.state.power * LOOP_MS / 3600000.0f;
+
+      if (scheduled) {
+        pollBeacon(now);
+      } else {
+        if (now - lastFull > ESPNOW_BROADCAST_INTERVAL) {
+          deliverFull(now);
+          lastFull = now;
+        }
+        if (now - lastHeartbeat > HEARTBEAT_MS) {
+          r.send(now, heartbeatSize());
+          lastHeartbeat = now;
+        }
+      }
+    }
+    r.observe(now, plug.state.relay, plug.state.power);
+  }
+  return r;
+}
+
+static void report(const char* name, Result& r, double hours) {
+  std::sort(r.powerError.begin(), r.powerError.end());
+  float p50 = r.powerError[r.powerError.size() / 2];
+  float p99 = r.powerError[(size_t)(0.99 * (r.powerError.size() - 1))];
+  printf("%-16s %8.0f %9.1f %9.2f %6lu %10u %8.1f %8.1f\n", name, r.frames / hours * 24,
+         r.bytes / hours * 24 / 1024.0, r.airtimeUs / hours * 24 / 1e6, r.peakPerSecond,
+         r.relayStaleMaxMs, p50, p99);
+}
+
+int main(int argc, char** argv) {
+  double hours = 24;
+  double togglesPerHour = 4;
+  unsigned int seed = 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--hours") && i + 1 < argc) hours = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--toggles-per-hour") && i + 1 < argc) togglesPerHour = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (unsigned int)atoi(argv[++i]);
+    else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  uint32_t durationMs = (uint32_t)(hours * 3600000);
+  std::mt19937 rng(seed);
+  std::vector<Event> events = makeEvents(durationMs, togglesPerHour, rng);
+  printf("%.1f h, %zu relay changes\n", hours, events.size());
+  printf("%-16s %8s %9s %9s %6s %10s %8s %8s\n", "Scheme", "frames/d", "KiB/d", "air s/d",
+         "peak/s", "stale ms", "p50 W", "p99 W");
+
+  Result fixedV1 = run(false, true, durationMs, events, seed);
+  report("Fixed, v1 JSON", fixedV1, hours);
+  Result fixedV2 = run(false, false, durationMs, events, seed);
+  report("Fixed, v2", fixedV2, hours);
+  Result sched = run(true, false, durationMs, events, seed);
+  report("Beacon, v2", sched, hours);
+  return 0;
+}
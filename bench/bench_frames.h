@@ -0,0 +1,61 @@
+/*
+ * Shared helpers for the CSE7766 host benchmarks
+ * For SONOFF S31 ESP8266 Project
+ */
+
+#ifndef BENCH_FRAMES_H
+#define BENCH_FRAMES_H
+
+#include <Arduino.h>
+#include <stdlib.h>
+#include <deque>
+
+// Unbounded in-memory stream: whatever is written is immediately available
+class BufferStream : public Stream {
+public:
+  void write(const uint8_t* data, size_t len) { _bytes.insert(_bytes.end(), data, data + len); }
+  int available() override { return (int)_bytes.size(); }
+  int read() override {
+    if (_bytes.empty()) return -1;
+    int byte = _bytes.front();
+    _bytes.pop_front();
+    return byte;
+  }
+
+private:
+  std::deque<uint8_t> _bytes;
+};
+
+static inline unsigned long randomRange(unsigned long low, unsigned long high) {
+  return low + ((unsigned long)rand() * RAND_MAX + rand()) % (high - low + 1);
+}
+
+static inline void put24(uint8_t* p, unsigned long value) {
+  p[0] = (value >> 16) & 0xFF;
+  p[1] = (value >> 8) & 0xFF;
+  p[2] = value & 0xFF;
+}
+
+static inline void setChecksum(uint8_t* frame) {
+  unsigned char checksum = 0;
+  for (int i = 2; i < 23; i++) checksum += frame[i];
+  frame[23] = checksum;
+}
+
+// A valid frame around realistic coefficients with a random load
+static inline void makeFrame(uint8_t* frame, unsigned int cf) {
+  frame[0] = 0x55;
+  frame[1] = 0x5A;
+  put24(frame + 2, randomRange(180000, 200000));    // coefV
+  put24(frame + 5, randomRange(700, 1000));         // voltage cycle
+  put24(frame + 8, randomRange(15000, 17000));      // coefC
+  put24(frame + 11, randomRange(3000, 2000000));    // current cycle
+  put24(frame + 14, randomRange(5000000, 5400000)); // coefP
+  put24(frame + 17, randomRange(4000, 8000000));    // power cycle
+  frame[20] = 0x70 | (rand() & 0x01);               // voltage, current and power valid
+  frame[21] = (cf >> 8) & 0xFF;
+  frame[22] = cf & 0xFF;
+  setChecksum(frame);
+}
+
+#endif // BENCH_FRAMES_H
@@ -0,0 +1,334 @@
+/*
+ * Button benchmark: polled handleButton() vs. interrupt edges and decoder
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Plays a random run of taps, double presses, long presses, 10 s holds and
+ * flicks (shorter than BUTTON_MIN_PRESS_MS) on a simulated pin, each edge a
+ * burst of contact bounce, against a model of the scheduled loop(): task
+ * runs of random cost (mostly short, some web requests, the odd long
+ * stall), sleeps between them, and the button task due every
+ * TASK_INPUT_MS. Two ways to read the button:
+ *   - polled: handleButton() as before, sampling the pin in the button task
+ *   - edges: ButtonEdgeQueue fed by an interrupt at every bounce
+ *     transition, drained into ButtonDecoder after any task run that left
+ *     an edge queued, and polled in the button task (button.h)
+ * and reports the presses each saw out of those made, the actions decoded
+ * exactly as made (a double press is a press then BUTTON_DOUBLE_PRESS, a
+ * flick nothing), and the latency from a press's release to its relay
+ * toggle (p50/p99/max).
+ *
+ * The clock starts just before micros() wraps. Fails if the edge decoder
+ * gets an action wrong, or if the latency it measures from its edge times
+ * strays from the true one.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -std=c++17 -Ibench/host -Isonoff_s31_main \
+ *       bench/button.cpp sonoff_s31_main/button.cpp -o button
+ *
+ * Usage:
+ *   button [--actions N] [--bounce-ms N] [--stall-ms N] [--seed N]
+ */
+
+#include <Arduino.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "button.h"
+
+static const uint64_t START_US = 0xFFFFFFFFULL - 2000000;
+static const uint32_t ISR_DELAY_US = 3;          // edge to digitalRead() in the interrupt
+
+enum Action { ACTION_TAP, ACTION_DOUBLE, ACTION_LONG, ACTION_HOLD, ACTION_FLICK, ACTIONS };
+static const char* const ACTION_NAMES[ACTIONS] = {"tap", "double", "long", "hold", "flick"};
+
+struct Transition {
+  uint64_t at;
+  bool pressed;
+};
+
+struct Made {
+  Action action;
+  uint64_t start;
+  std::vector<uint64_t> releases;                // clean release edge of each press
+  std::vector<ButtonGesture> expected;
+};
+
+struct Seen {
+  uint64_t at;
+  ButtonGesture gesture;
+  uint32_t reportedUs;                           // decoder's own latency, edges only
+};
+
+static std::vector<Transition> pin;              // every level change, bounce included
+static std::vector<Made> made;
+
+static bool levelAt(uint64_t t) {
+  auto it = std::upper_bound(pin.begin(), pin.end(), t,
+                             [](uint64_t v, const Transition& e) { return v < e.at; });
+  return it == pin.begin() ? false : (it - 1)->pressed;
+}
+
+// One clean edge at t and the bounce after it, settling at pressed
+static void addEdge(std::mt19937& rng, uint64_t t, bool pressed, double bounceMs) {
+  std::uniform_int_distribution<int> bounces(0, 6);
+  std::uniform_real_distribution<double> gap(0.05, 1.0);
+  int n = bounces(rng) & ~1;                     // even, so it ends where it started
+  pin.push_back({t, pressed});
+  double at = 0;
+  double spread = bounceMs * 1000 / (n + 1);
+  for (int i = 0; i < n; i++) {
+    at += gap(rng) * spread;
+    pin.push_back({t + (uint64_t)at + 1, i % 2 == 0 ? !pressed : pressed});
+  }
+}
+
+static uint64_t addPress(std::mt19937& rng, Made& m, uint64_t t, double heldMs, double bounceMs) {
+  addEdge(rng, t, true, bounceMs);
+  uint64_t up = t + (uint64_t)(heldMs * 1000);
+  addEdge(rng, up, false, bounceMs);
+  m.releases.push_back(up);
+  return up;
+}
+
+static void makeActions(std::mt19937& rng, int count, double bounceMs, uint64_t& end) {
+  std::uniform_real_distribution<double> u(0, 1);
+  std::discrete_distribution<int> pick({50, 25, 10, 5, 10});
+  uint64_t t = START_US + 500000;
+  for (int i = 0; i < count; i++) {
+    Made m;
+    m.action = (Action)pick(rng);
+    m.start = t;
+    switch (m.action) {
+      case ACTION_TAP:
+        t = addPress(rng, m, t, 60 + 240 * u(rng), bounceMs);
+        m.expected = {BUTTON_PRESS};
+        break;
+      case ACTION_DOUBLE:
+        t = addPress(rng, m, t, 60 + 140 * u(rng), bounceMs);
+        t = addPress(rng, m, t + (uint64_t)(80000 + 220000 * u(rng)), 60 + 140 * u(rng), bounceMs);
+        m.expected = {BUTTON_PRESS, BUTTON_DOUBLE_PRESS};
+        break;
+      case ACTION_LONG:
+        t = addPress(rng, m, t, BUTTON_LONG_PRESS_MS + 500 + 5000 * u(rng), bounceMs);
+        m.expected = {BUTTON_LONG_PRESS};
+        break;
+      case ACTION_HOLD:
+        t = addPress(rng, m, t, PAIRING_BUTTON_HOLD_TIME + 1000 * u(rng), bounceMs);
+        m.expected = {BUTTON_HOLD};
+        break;
+      case ACTION_FLICK:
+        t = addPress(rng, m, t, 25 + 20 * u(rng), bounceMs);
+        break;
+      case ACTIONS:
+        break;
+    }
+    made.push_back(m);
+    t += (uint64_t)((1.5 + 2.5 * u(rng)) * 1e6);
+  }
+  end = t;
+}
+
+// ---------------------------------------------------------------------
+// The loop: task runs and sleeps, the button task every TASK_INPUT_MS
+// ---------------------------------------------------------------------
+
+struct LoopModel {
+  std::mt19937 rng;
+  double stallMs;
+  uint64_t buttonDue = START_US;
+
+  // Cost of the next task run, microseconds
+  uint32_t taskCost() {
+    double p = std::uniform_real_distribution<double>(0, 1)(rng);
+    if (p < 0.00005) return (uint32_t)(stallMs * 1000);     // MQTT connect timeout, flash write
+    if (p < 0.04) return 6000;                             // web request
+    if (p < 0.12) return 1000 + rng() % 1500;              // peers, power log
+    return 20 + rng() % 300;
+  }
+
+  uint32_t sleepUs() {
+    return rng() % 3 == 0 ? 0 : rng() % 9000;
+  }
+};
+
+// The handleButton() this replaced, gestures by what it did
+struct PolledButton {
+  bool pressed = false;
+  unsigned long pressTime = 0;
+  bool pairingMode = false;
+
+  void poll(std::vector<Seen>& seen) {
+    bool current = levelAt(hostMicros);
+    if (current && !pressed) {
+      pressed = true;
+      pressTime = millis();
+    } else if (!current && pressed) {
+      pressed = false;
+      unsigned long duration = millis() - pressTime;
+      if (duration > 50 && duration < 3000) {
+        seen.push_back({hostMicros, BUTTON_PRESS, 0});
+      } else if (duration >= 3000 && duration < PAIRING_BUTTON_HOLD_TIME) {
+        seen.push_back({hostMicros, BUTTON_LONG_PRESS, 0});
+      } else if (duration >= PAIRING_BUTTON_HOLD_TIME) {
+        seen.push_back({hostMicros, BUTTON_HOLD, 0});      // enterPairingMode() again
+      }
+      pairingMode = false;
+    }
+    if (current && pressed && !pairingMode && millis() - pressTime >= PAIRING_BUTTON_HOLD_TIME) {
+      pairingMode = true;
+      seen.push_back({hostMicros, BUTTON_HOLD, 0});
+    }
+  }
+};
+
+struct EdgeButton {
+  ButtonEdgeQueue queue;
+  ButtonDecoder decoder;
+  size_t nextTransition = 0;
+
+  // Interrupts for the transitions up to now
+  void interrupts() {
+    while (nextTransition < pin.size() && pin[nextTransition].at + ISR_DELAY_US <= hostMicros) {
+      uint64_t at = pin[nextTransition].at + ISR_DELAY_US;
+      queue.push(levelAt(at), (uint32_t)at);
+      nextTransition++;
+    }
+  }
+
+  void handle(ButtonGesture gesture, std::vector<Seen>& seen) {
+    if (gesture == BUTTON_NONE) return;
+    uint32_t reported = (uint32_t)micros() - decoder.gestureTime();
+    seen.push_back({hostMicros, gesture, reported});
+  }
+
+  void poll(std::vector<Seen>& seen) {
+    interrupts();
+    ButtonEdge edge;
+    while (queue.pop(edge)) {
+      handle(decoder.edge(edge.pressed, edge.time), seen);
+    }
+    handle(decoder.poll(levelAt(hostMicros), micros(), queue.lastEdge()), seen);
+  }
+};
+
+static void run(bool edges, uint64_t end, unsigned int seed, double stallMs, std::vector<Seen>& seen,
+                EdgeButton& edgeButton) {
+  LoopModel loop{std::mt19937(seed), stallMs};
+  PolledButton polled;
+  hostMicros = START_US;
+  while (hostMicros < end) {
+    if (hostMicros >= loop.buttonDue) {
+      // The button task; a period behind, the runs missed are dropped
+      if (edges) edgeButton.poll(seen);
+      else polled.poll(seen);
+      hostAdvanceMicros(10);
+      loop.buttonDue += TASK_INPUT_MS * 1000UL;
+      if (loop.buttonDue < hostMicros) loop.buttonDue = hostMicros + TASK_INPUT_MS * 1000UL;
+    } else {
+      hostAdvanceMicros(loop.taskCost());
+    }
+    if (edges) {
+      edgeButton.interrupts();
+      if (edgeButton.queue.pending()) edgeButton.poll(seen);
+    }
+    uint64_t sleep = std::min<uint64_t>(loop.sleepUs(), loop.buttonDue > hostMicros ? loop.buttonDue - hostMicros : 0);
+    hostAdvanceMicros(sleep + 5);
+  }
+}
+
+static double percentile(std::vector<uint64_t> v, double p) {
+  if (v.empty()) return 0;
+  size_t k = std::min(v.size() - 1, (size_t)(p / 100 * v.size()));
+  std::nth_element(v.begin(), v.begin() + k, v.end());
+  return v[k] / 1000.0;
+}
+
+// Gestures by action, presses seen, latencies; false if any action was decoded wrong
+static bool report(const char* scheme, const std::vector<Seen>& seen, uint64_t end, bool check) {
+  uint32_t exact[ACTIONS] = {};
+  uint32_t total[ACTIONS] = {};
+  uint32_t pressesMade = 0;
+  uint32_t pressesSeen = 0;
+  uint32_t latencyErrors = 0;
+  std::vector<uint64_t> latency;
+  size_t s = 0;
+  for (size_t i = 0; i < made.size(); i++) {
+    uint64_t until = i + 1 < made.size() ? made[i + 1].start : end;
+    const Made& m = made[i];
+    std::vector<ButtonGesture> got;
+    for (; s < seen.size() && seen[s].at < until; s++) {
+      got.push_back(seen[s].gesture);
+      if (seen[s].gesture != BUTTON_PRESS && seen[s].gesture != BUTTON_DOUBLE_PRESS) continue;
+      // The n-th toggle of an action follows its n-th press
+      size_t n = got.size() - 1;
+      if (n >= m.releases.size()) continue;
+      pressesSeen++;
+      uint64_t trueUs = seen[s].at - m.releases[n];
+      latency.push_back(trueUs);
+      if (check && (seen[s].reportedUs > trueUs + 1000 || seen[s].reportedUs + 1000 < trueUs)) {
+        latencyErrors++;
+      }
+    }
+    total[m.action]++;
+    if (got == m.expected) exact[m.action]++;
+    else if (check && total[m.action] - exact[m.action] == 1) {
+      printf("  %s at %.3f s: %zu gestures, first %s\n", ACTION_NAMES[m.action],
+             (m.start - START_US) / 1e6, got.size(), got.empty() ? "-" : buttonGestureName(got[0]));
+    }
+    pressesMade += m.action == ACTION_TAP ? 1 : m.action == ACTION_DOUBLE ? 2 : 0;
+  }
+
+  uint64_t worst = latency.empty() ? 0 : *std::max_element(latency.begin(), latency.end());
+  printf("%-7s %6u/%-6u", scheme, pressesSeen, pressesMade);
+  uint32_t wrong = 0;
+  for (int a = 0; a < ACTIONS; a++) {
+    printf(" %6.1f%%", total[a] ? 100.0 * exact[a] / total[a] : 100.0);
+    wrong += total[a] - exact[a];
+  }
+  printf(" %8.2f %8.2f %8.2f\n", percentile(latency, 50), percentile(latency, 99), worst / 1000.0);
+  if (check && latencyErrors) {
+    printf("  FAIL: %u latencies off the true ones by over 1 ms\n", latencyErrors);
+  }
+  return wrong == 0 && latencyErrors == 0;
+}
+
+int main(int argc, char** argv) {
+  int actions = 2000;
+  double bounceMs = 5;
+  double stallMs = 500;
+  unsigned int seed = 1;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--actions") && i + 1 < argc) actions = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--bounce-ms") && i + 1 < argc) bounceMs = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--stall-ms") && i + 1 < argc) stallMs = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (unsigned int)atoi(argv[++i]);
+    else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  std::mt19937 rng(seed);
+  uint64_t end = 0;
+  makeActions(rng, actions, bounceMs, end);
+
+  printf("%d actions over %.0f s, bounce up to %.1f ms, stalls of %.0f ms\n", actions,
+         (end - START_US) / 1e6, bounceMs, stallMs);
+  std::vector<Seen> polledSeen;
+  std::vector<Seen> edgeSeen;
+  EdgeButton edgeButton;
+  run(false, end, seed, stallMs, polledSeen, edgeButton);
+  run(true, end, seed, stallMs, edgeSeen, edgeButton);
+
+  printf("\n%-7s %13s", "Button", "presses");
+  for (int a = 0; a < ACTIONS; a++) printf(" %7s", ACTION_NAMES[a]);
+  printf(" %8s %8s %8s\n", "p50 ms", "p99 ms", "max ms");
+  report("polled", polledSeen, end, false);
+  bool ok = report("edges", edgeSeen, end, true);
+
+  const ButtonStats& s = edgeButton.decoder.stats();
+  printf("\nedges %u, bounces %u, dropped %u, resyncs %u, noise %u\n", edgeButton.queue.edges(),
+         edgeButton.queue.bounces(), edgeButton.queue.dropped(), s.resyncs, s.noise);
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+/*
+ * CSE7766 batch decoder benchmark
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Decodes a large buffer of frame-aligned frames (mostly valid, with some
+ * bad checksums and chip error headers mixed in) with CSE7766Batch and with
+ * CSE7766::_process one frame at a time, compares the results and reports
+ * the cost of each.
+ *
+ * Build (from the repository root):
+ *   g++ -O3 -march=native -std=c++17 -Ibench/host -Isonoff_s31_main \
+ *       bench/cse7766_batch.cpp sonoff_s31_main/CSE7766.cpp \
+ *       sonoff_s31_main/CSE7766Batch.cpp -o cse7766_batch
+ *
+ * Usage:
+ *   cse7766_batch [--frames N] [--bad PCT] [--repeat N] [--seed N]
+ */
+
+#include <Arduino.h>
+#include <chrono>
+#include <vector>
+#include "CSE7766.h"
+#include "CSE7766Batch.h"
+#include "bench_frames.h"
+
+int main(int argc, char** argv) {
+  unsigned long frames = 1000000;
+  int badPct = 2;
+  int repeat = 5;
+  unsigned int seed = 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--frames") && i + 1 < argc) frames = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--bad") && i + 1 < argc) badPct = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--repeat") && i + 1 < argc) repeat = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (unsigned int)atoi(argv[++i]);
+    else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+  srand(seed);
+
+  std::vector<uint8_t> capture(frames * CSE7766_FRAME_SIZE);
+  unsigned int cf = 1;
+  for (unsigned long n = 0; n < frames; n++) {
+    uint8_t* frame = &capture[n * CSE7766_FRAME_SIZE];
+    cf += rand() % 64;
+    makeFrame(frame, cf & 0xFFFF);
+    if (rand() % 100 < badPct) {
+      // 0xAA (not calibrated) is left out: _read() never syncs on it, so
+      // the per-frame path would not see those frames at all
+      if (rand() & 1) frame[2 + rand() % 21] ^= 0x10;       // bad checksum
+      else frame[0] = 0xF4;                                 // current cycle out of range
+    }
+  }
+
+  // Batch: structure-of-arrays output
+  std::vector<uint8_t> error(frames);
+  std::vector<float> voltage(frames), current(frames), power(frames), energy(frames);
+  std::vector<uint16_t> cfPulses(frames);
+  CSE7766Columns out = {error.data(), voltage.data(), current.data(), power.data(),
+                        cfPulses.data(), energy.data()};
+  double batchSeconds = 0;
+  uint64_t batchCycles = 0;
+  size_t good = 0;
+  for (int r = 0; r < repeat; r++) {
+    CSE7766Batch batch;
+    auto start = std::chrono::steady_clock::now();
+    uint32_t startCycles = ESP.getCycleCount();
+    good = batch.decode(capture.data(), frames, out);
+    uint32_t cycles = ESP.getCycleCount() - startCycles;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (r == 0 || seconds < batchSeconds) {
+      batchSeconds = seconds;
+      batchCycles = cycles;
+    }
+  }
+
+  // One frame at a time through handle() -> _read() -> _process()
+  double frameSeconds = 0;
+  uint64_t processCycles = 0;
+  unsigned long mismatches = 0;
+  double worst = 0;
+  double frameEnergy = 0;
+  for (int r = 0; r < repeat; r++) {
+    BufferStream stream;
+    CSE7766 sensor;
+    sensor.setSerial(&stream);
+    sensor.setFixedPoint(false);
+    sensor.begin();
+    uint64_t cycles = 0;
+    bool check = r == 0;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long n = 0; n < frames; n++) {
+      stream.write(&capture[n * CSE7766_FRAME_SIZE], CSE7766_FRAME_SIZE);
+      sensor.handle();
+      cycles += sensor.getDecodeCycles();
+      if (!check) continue;
+      if (sensor.getError() != error[n]) {
+        mismatches++;
+      } else if (SENSOR_ERROR_OK == error[n]) {
+        const double values[3] = {sensor.getVoltage(), sensor.getCurrent(), sensor.getActivePower()};
+        const float batched[3] = {voltage[n], current[n], power[n]};
+        for (int c = 0; c < 3; c++) {
+          double err = fabs(values[c] - batched[c]) / (fabs(values[c]) > 1e-3 ? fabs(values[c]) : 1e-3);
+          worst = std::max(worst, err);
+        }
+      }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (check) frameEnergy = sensor.getEnergy();
+    if (r == 0 || seconds < frameSeconds) {
+      frameSeconds = seconds;
+      processCycles = cycles;
+    }
+  }
+
+  double batchEnergy = 0;
+  for (unsigned long n = 0; n < frames; n++) batchEnergy += energy[n];
+
+  printf("Frames:           %lu (%zu valid)\n", frames, good);
+  printf("Per frame:        %.1f cycles in _process, %.1f ns/frame via handle(), %.0f frames/s\n",
+         (double)processCycles / frames, frameSeconds * 1e9 / frames, frames / frameSeconds);
+  printf("Batch:            %.1f cycles/frame, %.1f ns/frame, %.0f frames/s\n",
+         (double)batchCycles / frames, batchSeconds * 1e9 / frames, frames / batchSeconds);
+  printf("Speedup:          %.2fx over _process cycles, %.2fx over handle()\n",
+         batchCycles ? (double)processCycles / batchCycles : 0.0,
+         batchSeconds > 0 ? frameSeconds / batchSeconds : 0.0);
+  printf("Error codes:      %lu frames classified differently\n", mismatches);
+  printf("Values:           worst relative difference %.2e (float vs double)\n", worst);
+  printf("Energy:           per frame %.6f Wh, batch %.6f Wh\n", frameEnergy, batchEnergy);
+  return mismatches ? 1 : 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * CSE7766 decode benchmark: fixed-point vs double
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Decodes the same randomized, valid frames once per decode mode, reports
+ * the cycles spent in _process() for each and checks the fixed-point results
+ * against the error bound documented in CSE7766.h. Exits non-zero if any
+ * value falls outside the bound.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -std=c++17 -Ibench/host -Isonoff_s31_main \
+ *       bench/cse7766_decode.cpp sonoff_s31_main/CSE7766.cpp -o cse7766_decode
+ *
+ * Usage:
+ *   cse7766_decode [--frames N] [--seed N]
+ *
+ * On an x86 host with a hardware FPU both paths cost about the same; the
+ * gap is soft-float on the ESP8266, where getDecodeCycles() reads CCOUNT.
+ * Build the sketch with CSE7766_FIXED_POINT 0 and 1 to compare on device.
+ */
+
+#include <Arduino.h>
+#include <algorithm>
+#include <vector>
+#include "CSE7766.h"
+#include "bench_frames.h"
+
+struct ErrorCheck {
+  double worst = 0;     // largest error as a fraction of the bound
+  unsigned long violations = 0;
+
+  void check(double fixed, double reference, double ratio) {
+    double bound = 1.0 / 65536 + fabs(reference) / 131072 / ratio;
+    double err = fabs(fixed - reference);
+    worst = std::max(worst, err / bound);
+    if (err > bound) violations++;
+  }
+};
+
+int main(int argc, char** argv) {
+  unsigned long frames = 200000;
+  unsigned int seed = 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--frames") && i + 1 < argc) frames = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (unsigned int)atoi(argv[++i]);
+    else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+  srand(seed);
+
+  const double ratios[] = {1.0, 0.9731, 1.0417};
+  const char* labels[] = {"V", "I", "P"};
+
+  std::vector<uint8_t> capture(frames * 24);
+  unsigned int cf = 1;
+  for (unsigned long n = 0; n < frames; n++) {
+    cf += rand() % 64;
+    makeFrame(&capture[n * 24], cf & 0xFFFF);
+  }
+
+  // One pass per mode over the same frames
+  std::vector<double> values[2];
+  uint64_t cycles[2] = {0, 0};
+  double energy[2] = {0, 0};
+  for (int m = 0; m < 2; m++) {
+    BufferStream stream;
+    CSE7766 sensor;
+    sensor.setSerial(&stream);
+    sensor.setFixedPoint(m == 1);
+    sensor.setVoltageRatio(ratios[0]);
+    sensor.setCurrentRatio(ratios[1]);
+    sensor.setPowerRatio(ratios[2]);
+    sensor.begin();
+    values[m].resize(frames * 3);
+
+    double energyStart = 0;
+    for (unsigned long n = 0; n < frames; n++) {
+      stream.write(&capture[n * 24], 24);
+      sensor.handle();
+      cycles[m] += sensor.getDecodeCycles();
+      values[m][n * 3 + 0] = sensor.getVoltage();
+      values[m][n * 3 + 1] = sensor.getCurrent();
+      values[m][n * 3 + 2] = sensor.getActivePower();
+      // The first frame only seeds the CF pulse counter
+      if (0 == n) energyStart = sensor.getEnergy();
+    }
+    energy[m] = sensor.getEnergy() - energyStart;
+  }
+
+  ErrorCheck errors[3];
+  unsigned long gateMismatches = 0;
+  for (unsigned long n = 0; n < frames; n++) {
+    const double* reference = &values[0][n * 3];
+    const double* fixed = &values[1][n * 3];
+    if ((reference[1] == 0) != (fixed[1] == 0)) {
+      gateMismatches++;
+      continue;
+    }
+    for (int c = 0; c < 3; c++) errors[c].check(fixed[c], reference[c], ratios[c]);
+  }
+
+  printf("Frames:           %lu\n", frames);
+  printf("Cycles/frame:     double %.1f, fixed %.1f (%.2fx)\n",
+         (double)cycles[0] / frames, (double)cycles[1] / frames,
+         cycles[1] ? (double)cycles[0] / cycles[1] : 0.0);
+  for (int c = 0; c < 3; c++) {
+    printf("Error %s:          worst %.3f of bound, %lu over\n", labels[c], errors[c].worst, errors[c].violations);
+  }
+  printf("Current gate:     %lu frames decided differently\n", gateMismatches);
+  printf("Energy:           double %.6f Wh, fixed %.6f Wh\n", energy[0], energy[1]);
+
+  unsigned long violations = errors[0].violations + errors[1].violations + errors[2].violations;
+  return violations ? 1 : 0;
+}
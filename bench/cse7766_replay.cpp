@@ -0,0 +1,284 @@
+/*
+ * CSE7766 frame-replay benchmark
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Runs a captured (or synthesized) CSE7766 byte stream through the real
+ * CSE7766::_read/_process/_checksum code on the host and reports parser
+ * throughput, CRC error rate and the cost of resynchronising after noise.
+ * Bytes land in an emulated UART RX ring at their wire time and handle() is
+ * polled like loop() does, so frames lost to ring overflow show up too.
+ * With --instances N the capture is replayed into N independent CSE7766
+ * instances at once, each on its own time offset, as a gateway decoding many
+ * bridged sensors would; every instance must decode the same frames.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -std=c++17 -Ibench/host -Isonoff_s31_main \
+ *       bench/cse7766_replay.cpp sonoff_s31_main/CSE7766.cpp -o cse7766_replay
+ *
+ * Usage:
+ *   cse7766_replay [capture] [--frames N] [--noise PCT] [--corrupt PCT]
+ *                  [--gap-ms MS] [--poll-ms MS] [--fifo BYTES]
+ *                  [--instances N] [--repeat N] [--seed N]
+ *
+ * A capture is either raw bytes or hex text ("55 5A 02 E9 ..."). Without a
+ * capture, N frames are synthesized from the sample frames in _process(),
+ * with PCT% of frames preceded by junk bytes (--noise) and PCT% having one
+ * byte flipped (--corrupt). --poll-ms is the handle() call interval and
+ * --fifo the RX ring size (default CSE7766_RX_BUFFER_SIZE).
+ */
+
+#include <Arduino.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include "CSE7766.h"
+
+static const uint8_t SAMPLE_FRAMES[2][24] = {
+  {0x55, 0x5A, 0x02, 0xE9, 0x50, 0x00, 0x03, 0x31, 0x00, 0x3E, 0x9E, 0x00,
+   0x0D, 0x30, 0x4F, 0x44, 0xF8, 0x00, 0x12, 0x65, 0xF1, 0x81, 0x76, 0x72},  // w/ load
+  {0xF2, 0x5A, 0x02, 0xE9, 0x50, 0x00, 0x03, 0x2B, 0x00, 0x3E, 0x9E, 0x02,
+   0xD7, 0x7C, 0x4F, 0x44, 0xF8, 0xCF, 0xA5, 0x5D, 0xE1, 0xB3, 0x2A, 0xB4}   // w/o load
+};
+
+// Captured bytes plus the virtual time each one arrived at the UART
+struct Capture {
+  std::vector<uint8_t> bytes;
+  std::vector<uint64_t> arrival;
+  unsigned long frames = 0;        // frames synthesized (0 for captures)
+  unsigned long noiseEvents = 0;   // junk bursts injected
+  unsigned long corruptEvents = 0; // frames with a flipped byte
+};
+
+// Stream standing in for the UART: bytes enter a bounded RX ring at their
+// arrival time and are dropped when it is full, as the ESP8266 driver does.
+class ReplayStream : public Stream {
+public:
+  ReplayStream(const Capture& capture, size_t capacity, uint64_t offset = 0)
+    : _capture(capture), _capacity(capacity), _offset(offset) {}
+  void rewind() {
+    _next = 0;
+    _dropped = 0;
+    _ring.clear();
+  }
+  bool done() const { return _next >= _capture.bytes.size() && _ring.empty(); }
+  unsigned long dropped() const { return _dropped; }
+  int available() override {
+    while (_next < _capture.bytes.size() && _capture.arrival[_next] + _offset <= hostMicros) {
+      if (_ring.size() < _capacity) _ring.push_back(_capture.bytes[_next]);
+      else _dropped++;
+      _next++;
+    }
+    return (int)_ring.size();
+  }
+  int read() override {
+    if (_ring.empty()) return -1;
+    int byte = _ring.front();
+    _ring.pop_front();
+    return byte;
+  }
+
+private:
+  const Capture& _capture;
+  size_t _capacity;
+  uint64_t _offset;
+  size_t _next = 0;
+  unsigned long _dropped = 0;
+  std::deque<uint8_t> _ring;
+};
+
+static CSE7766* sensors = nullptr;
+static std::vector<unsigned long> decoded;
+
+static void countFrame(CSE7766& sensor) {
+  decoded[&sensor - sensors]++;
+}
+
+static void appendByte(Capture& capture, uint8_t byte, uint64_t& now) {
+  now += CSE7766_BYTE_TIME_US;
+  capture.bytes.push_back(byte);
+  capture.arrival.push_back(now);
+}
+
+static Capture synthesize(unsigned long frames, int noisePct, int corruptPct, unsigned long gapMs) {
+  Capture capture;
+  uint64_t now = 0;
+  for (unsigned long i = 0; i < frames; i++) {
+    if (rand() % 100 < noisePct) {
+      int junk = 1 + rand() % 8;
+      for (int j = 0; j < junk; j++) appendByte(capture, rand() & 0xFF, now);
+      capture.noiseEvents++;
+    }
+    uint8_t frame[24];
+    memcpy(frame, SAMPLE_FRAMES[i & 1], sizeof(frame));
+    if (rand() % 100 < corruptPct) {
+      frame[2 + rand() % 22] ^= 1 << (rand() % 8);
+      capture.corruptEvents++;
+    }
+    for (int j = 0; j < 24; j++) appendByte(capture, frame[j], now);
+    now += gapMs * 1000;
+    capture.frames++;
+  }
+  return capture;
+}
+
+static bool loadCapture(const char* path, Capture& capture) {
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    fprintf(stderr, "Cannot open %s\n", path);
+    return false;
+  }
+  std::vector<uint8_t> raw;
+  int c;
+  while ((c = fgetc(file)) != EOF) raw.push_back((uint8_t)c);
+  fclose(file);
+
+  bool isHex = !raw.empty();
+  for (uint8_t b : raw) {
+    if (!isxdigit(b) && !isspace(b)) {
+      isHex = false;
+      break;
+    }
+  }
+
+  uint64_t now = 0;
+  if (isHex) {
+    char digits[3] = {0, 0, 0};
+    int n = 0;
+    for (uint8_t b : raw) {
+      if (isspace(b)) continue;
+      digits[n++] = (char)b;
+      if (n == 2) {
+        appendByte(capture, (uint8_t)strtoul(digits, nullptr, 16), now);
+        n = 0;
+      }
+    }
+  } else {
+    for (uint8_t b : raw) appendByte(capture, b, now);
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  const char* path = nullptr;
+  unsigned long frames = 100000;
+  int noisePct = 1;
+  int corruptPct = 1;
+  unsigned long gapMs = 50;
+  unsigned long pollMs = 100;
+  size_t fifo = CSE7766_RX_BUFFER_SIZE;
+  int repeat = 5;
+  int instances = 1;
+  unsigned int seed = 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--frames") && i + 1 < argc) frames = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--noise") && i + 1 < argc) noisePct = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--corrupt") && i + 1 < argc) corruptPct = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--gap-ms") && i + 1 < argc) gapMs = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--poll-ms") && i + 1 < argc) pollMs = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--fifo") && i + 1 < argc) fifo = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--instances") && i + 1 < argc) instances = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--repeat") && i + 1 < argc) repeat = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (unsigned int)atoi(argv[++i]);
+    else if (argv[i][0] != '-') path = argv[i];
+    else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  srand(seed);
+  Capture capture;
+  if (path) {
+    if (!loadCapture(path, capture)) return 1;
+  } else {
+    capture = synthesize(frames, noisePct, corruptPct, gapMs);
+  }
+
+  if (instances < 1) instances = 1;
+  std::vector<ReplayStream> streams;
+  for (int i = 0; i < instances; i++) {
+    // Stagger instances across a frame time so their polls split frames differently
+    streams.emplace_back(capture, fifo, (uint64_t)i * 24 * CSE7766_BYTE_TIME_US / instances);
+  }
+  std::vector<unsigned long> received(instances);
+  decoded.assign(instances, 0);
+  CSE7766Stats health;
+  double bestSeconds = 0;
+
+  for (int r = 0; r < repeat; r++) {
+    // Fresh parsers each pass so every run sees identical state
+    std::vector<CSE7766> pool(instances);
+    sensors = pool.data();
+    for (int i = 0; i < instances; i++) {
+      pool[i].setSerial(&streams[i]);
+      pool[i].onFrame(countFrame);
+      pool[i].begin();
+      streams[i].rewind();
+      received[i] = decoded[i] = 0;
+    }
+    hostMicros = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    bool done = false;
+    while (!done) {
+      hostAdvanceMicros(pollMs * 1000);
+      done = true;
+      for (int i = 0; i < instances; i++) {
+        received[i] += pool[i].handle();
+        done = done && streams[i].done();
+      }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (r == 0 || seconds < bestSeconds) bestSeconds = seconds;
+    health = pool[0].getStats();
+  }
+
+  // Figures below are for the first instance; the others must match it
+  bool agree = true;
+  unsigned long totalReceived = 0;
+  for (int i = 0; i < instances; i++) {
+    agree = agree && received[i] == received[0] && decoded[i] == decoded[0]
+                  && streams[i].dropped() == streams[0].dropped();
+    totalReceived += received[i];
+  }
+  const ReplayStream& stream = streams[0];
+  unsigned long processed = received[0];
+  unsigned long rejected = processed - decoded[0];
+  unsigned long discarded = capture.bytes.size() - stream.dropped() - processed * 24;
+  unsigned long resyncs = capture.noiseEvents + capture.corruptEvents;
+
+  printf("Input:            %s\n", path ? path : "synthesized");
+  printf("Bytes:            %zu (%.1f s of UART time)\n",
+         capture.bytes.size(), capture.arrival.empty() ? 0.0 : capture.arrival.back() / 1e6);
+  if (capture.frames) {
+    printf("Frames sent:      %lu (noise bursts %lu, corrupted %lu)\n",
+           capture.frames, capture.noiseEvents, capture.corruptEvents);
+  }
+  printf("Frames received:  %lu (%lu decoded)\n", processed, decoded[0]);
+  if (capture.frames) {
+    printf("Frames lost:      %lu\n", capture.frames > processed ? capture.frames - processed : 0);
+  }
+  printf("CRC/other errors: %lu (%.3f%% of received)\n", rejected,
+         processed ? 100.0 * rejected / processed : 0.0);
+  printf("RX ring overflow: %lu bytes (poll %lu ms, ring %zu bytes)\n", stream.dropped(), pollMs, fifo);
+  printf("Bytes discarded:  %lu (%.3f%% of stream)\n", discarded,
+         capture.bytes.empty() ? 0.0 : 100.0 * discarded / capture.bytes.size());
+  if (resyncs) {
+    printf("Resync cost:      %.2f bytes, %.2f frames lost per injected fault\n",
+           (double)discarded / resyncs,
+           capture.frames > processed ? (double)(capture.frames - processed) / resyncs : 0.0);
+  }
+  printf("Sensor counters:  %u good, %u CRC, %u calibration, %u other, %u sync losses, %u bytes discarded\n",
+         health.good, health.crcErrors, health.calibrationErrors, health.otherErrors,
+         health.syncLosses, health.bytesDiscarded);
+  if (instances > 1) {
+    printf("Instances:        %d, %s\n", instances, agree ? "all decoded identically" : "RESULTS DIFFER");
+  }
+  printf("Throughput:       %.0f frames/s, %.1f ns/byte (best of %d)\n",
+         bestSeconds > 0 ? totalReceived / bestSeconds : 0.0,
+         capture.bytes.empty() ? 0.0 : bestSeconds * 1e9 / capture.bytes.size() / instances, repeat);
+  return agree ? 0 : 1;
+}
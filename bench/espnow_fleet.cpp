@@ -0,0 +1,521 @@
+/*
+ * ESP-NOW fleet simulation: the sketch's ESP-NOW code on 10-500 plugs
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Every plug runs its own copy of espnow_handler.cpp and the modules under
+ * it (loaded from fleet_plug.so, see fleet_plug.h) on the virtual radio in
+ * virtual_radio.h: the same pairing, beacons, peer table, group alerts,
+ * acknowledged alerts and mesh forwarding as on the devices, with loop()
+ * and its idle slices run at their real period.
+ *
+ * Families of one parent and --children children stand on a square grid
+ * --spacing metres apart, each family's plugs within 2 m. After boot,
+ * the families pair over the air one after another: parent, then children
+ * press the button, and each family's pairing mode is ended after
+ * --pair-window seconds. Then for --seconds each parent's load goes HIGH
+ * and LOW every --alert-every seconds on average.
+ *
+ * For each fleet size it reports the children paired to the right parent,
+ * frames per second and per plug per minute, channel use, the longest wait
+ * for the channel, the share of broadcast copies heard within --range and
+ * of unicasts acknowledged, the time from the parent's alert to each
+ * child's relay switching (LOW less the CHILD_TURN_OFF_DELAY), level
+ * changes children missed, and frames dropped by full receive rings. With
+ * --plugs it also breaks the frames down by message type, and checks the
+ * children's own timing of each switch (clock_sync.h): every plug boots at
+ * a random point of its 32-bit micros() and its crystal is up to --drift
+ * ppm off, and the time a child measured is compared with the simulation's.
+ *
+ * With --toggle-every, parents send each child a relay toggle command (the
+ * web UI's Toggle button) that often on average instead of switching their
+ * loads, and the driver counts toggles each child applied against those
+ * sent: one applied twice, from a resend whose first copy got through, is
+ * what the receivers' sequence windows are there to stop. From 50 plugs on
+ * every peer table is full (MAX_ESPNOW_PEERS), so most children have no
+ * entry for their parent.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -std=c++17 -fPIC -shared -DHOST_PLUG_CLOCK -Ibench/host -Isonoff_s31_main \
+ *       bench/fleet_plug.cpp sonoff_s31_main/espnow_handler.cpp \
+ *       sonoff_s31_main/espnow_wire.cpp sonoff_s31_main/espnow_reliable.cpp \
+ *       sonoff_s31_main/beacon.cpp sonoff_s31_main/mesh.cpp \
+ *       sonoff_s31_main/clock_sync.cpp sonoff_s31_main/current_automation.cpp \
+ *       -o fleet_plug.so
+ *   g++ -O2 -std=c++17 -rdynamic -Ibench/host -Isonoff_s31_main \
+ *       bench/espnow_fleet.cpp bench/virtual_radio.cpp -ldl -o espnow_fleet
+ *
+ * Usage:
+ *   espnow_fleet [--lib PATH] [--plugs N] [--children N] [--seconds S]
+ *                [--alert-every S] [--toggle-every S] [--pair-window S] [--spacing M] [--range M]
+ *                [--loss PCT] [--latency-us N] [--rate MBPS] [--drift PPM] [--seed N]
+ *                [--trace PLUG]
+ */
+
+#include <Arduino.h>
+#include <algorithm>
+#include <dlfcn.h>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "virtual_radio.h"
+#include "fleet_plug.h"
+#include "espnow_wire.h"
+
+struct Options {
+  const char* lib = "./fleet_plug.so";
+  int children = 4;
+  double seconds = 300;
+  double alertEvery = 30;
+  double toggleEvery = 0;                  // 0: loads switch instead
+  double pairWindow = 10;
+  double spacing = 8;
+  double drift = 20;
+  uint32_t seed = 1;
+  int trace = -1;
+  RadioConfig radio;
+};
+
+struct Plug {
+  int fd = -1;
+  void* handle = nullptr;
+  const FleetPlugApi* api = nullptr;
+  int family = -1;
+  bool started = false;
+  bool relay = false;
+  uint32_t ticks = 0;
+  uint32_t followSeen = 0;                 // followCount already compared
+  uint32_t togglesBefore = 0;              // relayToggles at the start of operation
+};
+
+struct Family {
+  int parent;
+  std::vector<int> children;
+  std::vector<bool> paired;                // to this parent
+  std::vector<bool> reached;               // switched to the current target
+  std::vector<uint32_t> toggles;           // toggle commands sent to each child
+  bool target = false;
+  uint64_t issued = 0;
+};
+
+struct Result {
+  int plugs = 0;
+  int families = 0;
+  int children = 0;
+  int paired = 0;
+  double seconds = 0;
+  RadioStats radio;
+  unsigned long changes = 0;
+  unsigned long missed = 0;
+  std::vector<uint64_t> onUs;
+  std::vector<uint64_t> offUs;
+  std::vector<uint64_t> followErrUs;       // |child's measure - simulation's|, per switch timed
+  unsigned long switches = 0;              // by paired children, timed or not
+  int synced = 0;                          // children with a parent clock at the end
+  uint64_t followReports = 0;              // received by parents
+  uint64_t rxDropped = 0;
+  uint64_t outboxOverflows = 0;
+  uint64_t alertAvgUs = 0;
+  uint32_t alertMaxUs = 0;
+  double peersAvg = 0;
+  unsigned long togglesSent = 0;           // to paired children
+  unsigned long togglesApplied = 0;
+  unsigned long togglesTwice = 0;          // applied beyond those sent
+  unsigned long togglesLost = 0;
+  uint64_t rxUntracked = 0;
+};
+
+static std::vector<char> libImage;
+static int tracePlug = -1;
+
+extern "C" void fleetLog(const char* text) {
+  VirtualRadio* radio = VirtualRadio::active();
+  if (tracePlug < 0 || !radio || radio->current() != tracePlug) return;
+  printf("[%10.3f] plug %d: %s", hostMicros / 1e6, tracePlug, text);
+  if (!*text || text[strlen(text) - 1] != '\n') printf("\n");
+}
+
+// A private copy of the plug library, through a memory file: dlopen() of a
+// path already loaded would share its globals. The file stays open while
+// the copy is loaded, or the next one could get the same /proc path.
+static bool loadPlug(Plug& plug) {
+  plug.fd = memfd_create("fleet_plug", 0);
+  if (plug.fd < 0 || write(plug.fd, libImage.data(), libImage.size()) != (ssize_t)libImage.size()) {
+    perror("memfd");
+    return false;
+  }
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/self/fd/%d", plug.fd);
+  plug.handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (!plug.handle) {
+    fprintf(stderr, "%s\n", dlerror());
+    return false;
+  }
+  plug.api = (const FleetPlugApi*)dlsym(plug.handle, "fleetPlug");
+  return plug.api != nullptr;
+}
+
+static RadioStats since(const RadioStats& now, const RadioStats& then) {
+  RadioStats d = now;
+  d.frames -= then.frames;
+  d.bytes -= then.bytes;
+  d.busyUs -= then.busyUs;
+  d.broadcastCopies -= then.broadcastCopies;
+  d.broadcastHeard -= then.broadcastHeard;
+  d.unicasts -= then.unicasts;
+  d.unicastFailed -= then.unicastFailed;
+  d.macRetries -= then.macRetries;
+  d.rejected -= then.rejected;
+  d.peerRefused -= then.peerRefused;
+  for (int t = 0; t < RADIO_TYPES; t++) {
+    d.typeFrames[t] -= then.typeFrames[t];
+    d.typeBytes[t] -= then.typeBytes[t];
+  }
+  return d;
+}
+
+// Timed actions of the scenario, in time then insertion order
+struct Action {
+  uint64_t at;
+  uint64_t order;
+  std::function<void()> run;
+  bool operator>(const Action& o) const { return at != o.at ? at > o.at : order > o.order; }
+};
+
+static bool run(int count, const Options& opt, Result& r) {
+  std::mt19937 rng(opt.seed);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  hostMicros = 0;
+
+  VirtualRadio radio(opt.radio, opt.seed);
+  std::vector<Plug> plugs(count);
+  std::vector<Family> families;
+  const int familySize = opt.children + 1;
+  const int familyCount = count / familySize;
+  const int cells = familyCount + (count % familySize ? 1 : 0);
+  const int cols = (int)ceil(sqrt((double)cells));
+
+  // Each family around its own grid point: the parent in the middle, the
+  // children 2 m away. Plugs left over share the last point.
+  for (int i = 0; i < count; i++) {
+    uint8_t mac[6] = {0x5C, 0xCF, 0x7F, 0, (uint8_t)(i >> 8), (uint8_t)i};
+    int cell = i / familySize;
+    int k = i % familySize;
+    double angle = 2 * M_PI * k / familySize;
+    double x = (cell % cols) * opt.spacing + (k ? 2 * cos(angle) : 0);
+    double y = (cell / cols) * opt.spacing + (k ? 2 * sin(angle) : 0);
+    radio.add(mac, x, y);
+    if (!loadPlug(plugs[i])) return false;
+  }
+  for (int f = 0; f < familyCount; f++) {
+    Family fam;
+    fam.parent = f * familySize;
+    for (int c = 1; c < familySize; c++) fam.children.push_back(fam.parent + c);
+    fam.paired.assign(opt.children, false);
+    fam.reached.assign(opt.children, true);
+    fam.toggles.assign(opt.children, 0);
+    for (int p = fam.parent; p < fam.parent + familySize; p++) plugs[p].family = f;
+    families.push_back(fam);
+  }
+
+  std::priority_queue<Action, std::vector<Action>, std::greater<Action>> actions;
+  uint64_t order = 0;
+  auto at = [&](uint64_t t, std::function<void()> fn) { actions.push(Action{t, order++, fn}); };
+  typedef std::pair<uint64_t, int> Tick;
+  std::priority_queue<Tick, std::vector<Tick>, std::greater<Tick>> ticks;
+  const uint64_t slice = SENSOR_POLL_SLICE * 1000ULL;
+  const uint32_t slicesPerLoop = 100 / SENSOR_POLL_SLICE;
+  auto us = [](double s) { return (uint64_t)(s * 1e6); };
+
+  // Boot within the first second, each with its own crystal
+  for (int i = 0; i < count; i++) {
+    uint64_t offset = rng();
+    double ppm = opt.drift * (2 * unit(rng) - 1);
+    at((uint64_t)(unit(rng) * 1e6), [&, i, offset, ppm] {
+      char id[32];
+      snprintf(id, sizeof(id), "SONOFF_S31_%06X", 0x7F0000 + i);
+      plugs[i].api->setClock(offset, ppm);
+      radio.as(i, [&] { plugs[i].api->setup(id); });
+      plugs[i].started = true;
+      ticks.push(Tick(hostMicros + slice, i));
+    });
+  }
+
+  // Pairing, one family at a time
+  uint64_t pairStart = us(2);
+  for (Family& fam : families) {
+    // The parent hears no one during its listen and becomes the parent; the
+    // children's listens take in its first broadcasts
+    at(pairStart, [&, p = fam.parent] { radio.as(p, [&] { plugs[p].api->startPairing(); }); });
+    for (int c : fam.children) {
+      uint64_t press = pairStart + us(PAIRING_LISTEN_MS / 1000.0 - 1 + unit(rng));
+      at(press, [&, c] { radio.as(c, [&] { plugs[c].api->startPairing(); }); });
+    }
+    at(pairStart + us(opt.pairWindow), [&, &fam = fam] {
+      radio.as(fam.parent, [&] { plugs[fam.parent].api->stopPairing(); });
+      for (int c : fam.children) radio.as(c, [&] { plugs[c].api->stopPairing(); });
+    });
+    pairStart += us(opt.pairWindow);
+  }
+
+  // Then the loads
+  const uint64_t opStart = pairStart + us(2);
+  const uint64_t opEnd = opStart + us(opt.seconds);
+  const uint64_t minGap = (CHILD_TURN_OFF_DELAY + 1000) * 1000ULL;
+  RadioStats startStats;
+  at(opStart, [&] {
+    startStats = radio.stats();
+    for (Family& fam : families) {
+      FleetPlugStatus parent;
+      radio.as(fam.parent, [&] { plugs[fam.parent].api->status(&parent); });
+      for (size_t c = 0; c < fam.children.size(); c++) {
+        FleetPlugStatus child;
+        radio.as(fam.children[c], [&] { plugs[fam.children[c]].api->status(&child); });
+        fam.paired[c] = child.hasParent && memcmp(child.parentMac, radio.mac(fam.parent), 6) == 0;
+        r.paired += fam.paired[c];
+        plugs[fam.children[c]].togglesBefore = child.relayToggles;
+      }
+    }
+  });
+  std::function<void(Family&)> alert = [&](Family& fam) {
+    if (hostMicros >= opEnd) return;
+    for (size_t c = 0; c < fam.children.size(); c++) {
+      if (!fam.paired[c]) continue;
+      r.changes++;
+      if (!fam.reached[c]) r.missed++;
+      fam.reached[c] = false;
+    }
+    fam.target = !fam.target;
+    fam.issued = hostMicros;
+    radio.as(fam.parent, [&] { plugs[fam.parent].api->setLoad(fam.target); });
+    uint64_t gap = std::max(minGap, us(opt.alertEvery * (0.5 + unit(rng))));
+    at(hostMicros + gap, [&] { alert(fam); });
+  };
+  // Or toggles, the last ones early enough for every resend to be over
+  std::function<void(Family&)> toggle = [&](Family& fam) {
+    if (hostMicros >= opEnd - minGap) return;
+    for (size_t c = 0; c < fam.children.size(); c++) fam.toggles[c] += fam.paired[c];
+    radio.as(fam.parent, [&] { plugs[fam.parent].api->commandChildren("relay", "toggle"); });
+    at(hostMicros + us(opt.toggleEvery * (0.5 + unit(rng))), [&] { toggle(fam); });
+  };
+  for (Family& fam : families) {
+    if (opt.toggleEvery > 0) {
+      at(opStart + us(unit(rng) * opt.toggleEvery), [&] { toggle(fam); });
+    } else {
+      at(opStart + us(unit(rng) * opt.alertEvery), [&] { alert(fam); });
+    }
+  }
+
+  // A child's relay changes only in its own loop()
+  auto checkRelay = [&](int p) {
+    Plug& plug = plugs[p];
+    FleetPlugStatus s;
+    plug.api->status(&s);
+    if (s.relay == plug.relay) return;
+    plug.relay = s.relay;
+    if (plug.family < 0 || hostMicros < opStart) return;
+    Family& fam = families[plug.family];
+    size_t c = p - fam.parent - 1;
+    if (p == fam.parent || !fam.paired[c] || fam.reached[c] || s.relay != fam.target) return;
+    fam.reached[c] = true;
+    uint64_t latency = hostMicros - fam.issued;
+    if (!fam.target) latency = latency > CHILD_TURN_OFF_DELAY * 1000ULL ? latency - CHILD_TURN_OFF_DELAY * 1000ULL : 0;
+    (fam.target ? r.onUs : r.offUs).push_back(latency);
+
+    // The child's own measure of the same switch, against its parent's clock
+    r.switches++;
+    if (s.followCount != plug.followSeen) {
+      plug.followSeen = s.followCount;
+      r.followErrUs.push_back((uint64_t)std::llabs((int64_t)s.followLastUs - (int64_t)latency));
+    }
+  };
+
+  while (true) {
+    uint64_t next = radio.nextEvent();
+    if (!actions.empty()) next = std::min(next, actions.top().at);
+    if (!ticks.empty()) next = std::min(next, ticks.top().first);
+    if (next >= opEnd) break;
+    hostMicros = next;
+
+    radio.dispatch();
+    while (!actions.empty() && actions.top().at <= hostMicros) {
+      Action a = actions.top();
+      actions.pop();
+      a.run();
+    }
+    while (!ticks.empty() && ticks.top().first <= hostMicros) {
+      int p = ticks.top().second;
+      ticks.pop();
+      Plug& plug = plugs[p];
+      radio.as(p, [&] {
+        if (plug.ticks++ % slicesPerLoop == 0) plug.api->loop();
+        plug.api->slice();
+        checkRelay(p);
+      });
+      ticks.push(Tick(hostMicros + slice, p));
+    }
+  }
+  hostMicros = opEnd;
+
+  // Changes still in flight at the end are not counted
+  for (Family& fam : families) {
+    for (size_t c = 0; c < fam.children.size(); c++) {
+      if (!fam.paired[c] || opEnd - fam.issued < minGap) continue;
+      r.changes++;
+      if (!fam.reached[c]) r.missed++;
+    }
+  }
+
+  r.plugs = count;
+  r.families = (int)families.size();
+  r.children = (int)families.size() * opt.children;
+  r.seconds = opt.seconds;
+  r.radio = since(radio.stats(), startStats);
+  uint32_t parents = 0;
+  for (int i = 0; i < count; i++) {
+    FleetPlugStatus s;
+    radio.as(i, [&] { plugs[i].api->status(&s); });
+    r.rxDropped += s.rxDropped;
+    r.rxUntracked += s.rxUntracked;
+    r.outboxOverflows += s.outboxOverflows;
+    r.peersAvg += s.peers / (double)count;
+    r.synced += s.hasParent && s.clockSynced;
+    r.followReports += s.childFollowReports;
+    if (s.isParent && s.alertsTimed) {
+      r.alertAvgUs += s.alertAvgUs;
+      parents++;
+      r.alertMaxUs = std::max(r.alertMaxUs, s.alertMaxUs);
+    }
+  }
+  if (parents) r.alertAvgUs /= parents;
+
+  for (Family& fam : families) {
+    for (size_t c = 0; c < fam.children.size(); c++) {
+      if (!fam.paired[c]) continue;
+      FleetPlugStatus s;
+      int p = fam.children[c];
+      radio.as(p, [&] { plugs[p].api->status(&s); });
+      uint32_t applied = s.relayToggles - plugs[p].togglesBefore;
+      r.togglesSent += fam.toggles[c];
+      r.togglesApplied += applied;
+      if (applied > fam.toggles[c]) r.togglesTwice += applied - fam.toggles[c];
+      else r.togglesLost += fam.toggles[c] - applied;
+    }
+  }
+
+  for (Plug& plug : plugs) {
+    dlclose(plug.handle);
+    close(plug.fd);
+  }
+  return true;
+}
+
+static double percentile(std::vector<uint64_t>& v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(p * (v.size() - 1))] / 1000.0;
+}
+
+static void printTypes(const Result& r) {
+  static const char* names[RADIO_TYPES] = {
+    "?", "DEVICE_STATE", "COMMAND", "DISCOVERY", "HEARTBEAT", "PAIRING", "PAIRING_RESPONSE",
+    "CURRENT_HIGH", "CURRENT_LOW", "ACK", "STATE_DELTA", "MESH", "GROUP_ALERT", "TIME_SYNC",
+  };
+  printf("\n%-18s %10s %10s %10s\n", "Type", "frames", "per min", "bytes");
+  for (int t = 0; t < RADIO_TYPES; t++) {
+    if (!r.radio.typeFrames[t]) continue;
+    printf("%-18s %10llu %10.1f %10llu\n", names[t] ? names[t] : "?",
+           (unsigned long long)r.radio.typeFrames[t], r.radio.typeFrames[t] * 60.0 / r.seconds,
+           (unsigned long long)r.radio.typeBytes[t]);
+  }
+}
+
+int main(int argc, char** argv) {
+  Options opt;
+  int plugs = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--lib") && i + 1 < argc) opt.lib = argv[++i];
+    else if (!strcmp(argv[i], "--plugs") && i + 1 < argc) plugs = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--children") && i + 1 < argc) opt.children = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) opt.seconds = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--alert-every") && i + 1 < argc) opt.alertEvery = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--toggle-every") && i + 1 < argc) opt.toggleEvery = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--pair-window") && i + 1 < argc) opt.pairWindow = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--spacing") && i + 1 < argc) opt.spacing = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--range") && i + 1 < argc) opt.radio.range = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--loss") && i + 1 < argc) opt.radio.lossPct = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--latency-us") && i + 1 < argc) opt.radio.latencyUs = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--rate") && i + 1 < argc) opt.radio.rateMbps = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--drift") && i + 1 < argc) opt.drift = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) opt.seed = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--trace") && i + 1 < argc) opt.trace = atoi(argv[++i]);
+    else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (opt.children < 1 || opt.children > MAX_CHILDREN) {
+    fprintf(stderr, "Need 1 to %d children per parent\n", MAX_CHILDREN);
+    return 1;
+  }
+  tracePlug = opt.trace;
+
+  std::ifstream in(opt.lib, std::ios::binary);
+  libImage.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  if (libImage.empty()) {
+    fprintf(stderr, "Cannot read %s\n", opt.lib);
+    return 1;
+  }
+
+  printf("%d children per parent, %.0f s, %s every %.0f s, %.0f m between families, "
+         "%.0f%% loss + 50%% at %.0f m, %.0f Mbps\n",
+         opt.children, opt.seconds, opt.toggleEvery > 0 ? "toggles" : "alerts",
+         opt.toggleEvery > 0 ? opt.toggleEvery : opt.alertEvery, opt.spacing, opt.radio.lossPct,
+         opt.radio.range, opt.radio.rateMbps);
+  printf("%5s %7s %8s %8s %6s %8s %7s %8s %8s %8s %8s %8s %8s %7s\n", "Plugs", "paired",
+         "frames/s", "/plug/m", "air %", "wait ms", "heard %", "ucast %", "on p50", "on p99",
+         "off p50", "off p99", "missed", "drops");
+
+  std::vector<int> sizes = {10, 50, 100, 250, 500};
+  if (plugs > 0) sizes = {plugs};
+  for (int n : sizes) {
+    Result r;
+    if (!run(n, opt, r)) return 1;
+    double frames = r.radio.frames / r.seconds;
+    char unicast[16] = "-";
+    if (r.radio.unicasts) {
+      snprintf(unicast, sizeof(unicast), "%.2f",
+               100.0 * (r.radio.unicasts - r.radio.unicastFailed) / r.radio.unicasts);
+    }
+    printf("%5d %3d/%-3d %8.1f %8.2f %6.2f %8.2f %7.2f %8s %8.1f %8.1f %8.1f %8.1f %7.3f%% %7llu\n",
+           n, r.paired, r.children, frames, frames * 60 / n, 100.0 * r.radio.busyUs / (r.seconds * 1e6),
+           r.radio.maxWaitUs / 1000.0,
+           r.radio.broadcastCopies ? 100.0 * r.radio.broadcastHeard / r.radio.broadcastCopies : 0,
+           unicast,
+           percentile(r.onUs, 0.5), percentile(r.onUs, 0.99), percentile(r.offUs, 0.5),
+           percentile(r.offUs, 0.99), r.changes ? 100.0 * r.missed / r.changes : 0,
+           (unsigned long long)r.rxDropped);
+    if (opt.toggleEvery > 0) {
+      printf("      toggles %lu sent, %lu applied, %lu applied twice, %lu lost; "
+             "%llu acknowledged but not applied (sender untracked)\n",
+             r.togglesSent, r.togglesApplied, r.togglesTwice, r.togglesLost,
+             (unsigned long long)r.rxUntracked);
+    }
+    if (plugs > 0) {
+      printf("\nAlerts on air %.2f ms avg, %.2f ms max (parents' alertLatency)\n",
+             r.alertAvgUs / 1000.0, r.alertMaxUs / 1000.0);
+      printf("Peer table %.1f entries avg, %llu esp_now_add_peer refused, %llu sends refused, "
+             "%llu outbox overflows\n", r.peersAvg, (unsigned long long)r.radio.peerRefused,
+             (unsigned long long)r.radio.rejected, (unsigned long long)r.outboxOverflows);
+      printf("Children timed %zu of %lu switches against the parent's clock (%d of %d synced), "
+             "error %.3f ms p50, %.3f ms p99, %.3f ms max; %llu reported to parents\n",
+             r.followErrUs.size(), r.switches, r.synced, r.paired, percentile(r.followErrUs, 0.5),
+             percentile(r.followErrUs, 0.99), percentile(r.followErrUs, 1.0),
+             (unsigned long long)r.followReports);
+      printTypes(r);
+    }
+  }
+  return 0;
+}
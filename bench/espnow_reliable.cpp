@@ -0,0 +1,215 @@
+/*
+ * Acknowledged delivery benchmark: current alerts over lossy links
+ * For SONOFF S31 ESP8266 Project
+ *
+ * A parent alternates HIGH/LOW current alerts to its children over links
+ * that lose --loss percent of frames in each direction. Each frame takes
+ * its airtime plus up to one SENSOR_POLL_SLICE before the receiver's loop()
+ * drains it. The alerts are sent two ways:
+ *   - once, as before: a lost frame leaves the child at the old level
+ *   - through ReliableOutbox/SeqWindow (espnow_reliable.h), with ACKs,
+ *     resends with backoff, and duplicate suppression on the child
+ * For each it reports how many level changes never reached a child before
+ * the next one, the time from alert to child switching (p50/p99/max),
+ * the delivery ratio and RTT the parent measured, and the resends and
+ * duplicates. The run covers more than 2^32 us, so the micros() wrap is
+ * crossed.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -std=c++17 -Ibench/host -Isonoff_s31_main \
+ *       bench/espnow_reliable.cpp sonoff_s31_main/espnow_reliable.cpp \
+ *       sonoff_s31_main/espnow_wire.cpp -o espnow_reliable
+ *
+ * Usage:
+ *   espnow_reliable [--alerts N] [--children N] [--loss PCT] [--seed N]
+ */
+
+#include <Arduino.h>
+#include <algorithm>
+#include <queue>
+#include <random>
+#include <vector>
+#include "espnow_reliable.h"
+
+static const uint64_t AIRTIME_US = 600;
+
+struct Frame {
+  uint64_t at;
+  int child;
+  bool toChild;
+  WireMessage msg;
+  bool operator>(const Frame& o) const { return at > o.at; }
+};
+
+struct Child {
+  SeqWindow window;
+  bool high = false;
+};
+
+struct Result {
+  unsigned long changes = 0;     // level changes x children
+  unsigned long missed = 0;      // child never reached the level before the next change
+  std::vector<uint64_t> latencies;
+  unsigned long resends = 0;
+  unsigned long duplicates = 0;
+  unsigned long failed = 0;
+  DeliveryStats total;
+};
+
+static Result run(bool reliable, unsigned long alerts, int children, int lossPct, unsigned int seed) {
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int> percent(0, 99);
+  std::uniform_int_distribution<uint64_t> drain(0, SENSOR_POLL_SLICE * 1000);
+  std::uniform_int_distribution<uint64_t> gap(500000, 5000000);
+
+  std::priority_queue<Frame, std::vector<Frame>, std::greater<Frame>> air;
+  std::vector<Child> kids(children);
+  std::vector<DeliveryStats> stats(children);
+  ReliableOutbox outbox;
+  outbox.seed(40000);
+  Result r;
+
+  uint64_t now = 0;
+  bool target = false;
+  uint64_t issued = 0;
+  std::vector<bool> reached(children, true);
+
+  auto transmit = [&](int child, bool toChild, const WireMessage& msg) {
+    if (percent(rng) < lossPct) return;
+    air.push(Frame{now + AIRTIME_US + drain(rng), child, toChild, msg});
+  };
+  auto macOf = [](int child, uint8_t* mac) {
+    const uint8_t base[6] = {0x5C, 0xCF, 0x7F, 0, 0, 0};
+    memcpy(mac, base, 6);
+    mac[5] = child;
+  };
+  auto poll = [&] {
+    outbox.poll((uint32_t)now,
+                [&](uint8_t* mac, const OutboxEntry& e) {
+                  WireMessage msg;
+                  wireDecode(e.frame, e.len, msg);
+                  transmit(mac[5], true, msg);
+                },
+                [&](uint8_t*, const OutboxEntry&) { r.failed++; },
+                [&](const uint8_t* mac) { return &stats[mac[5]]; });
+  };
+
+  uint64_t nextAlert = gap(rng);
+  unsigned long sent = 0;
+  while (sent < alerts || !air.empty() || outbox.pending()) {
+    // Next thing to happen: a frame landing, the next alert, or a 1 ms poll tick
+    uint64_t next = now + 1000;
+    if (!air.empty()) next = std::min(next, air.top().at);
+    if (sent < alerts) next = std::min(next, nextAlert);
+    now = next;
+
+    if (sent < alerts && now >= nextAlert) {
+      for (int c = 0; c < children; c++) {
+        if (!reached[c]) r.missed++;
+        reached[c] = false;
+      }
+      target = !target;
+      issued = now;
+      r.changes += children;
+      sent++;
+      nextAlert = now + gap(rng);
+
+      for (int c = 0; c < children; c++) {
+        WireMessage msg;
+        msg.type = target ? MSG_CURRENT_HIGH : MSG_CURRENT_LOW;
+        uint8_t mac[6];
+        macOf(c, mac);
+        if (reliable) outbox.queue(mac, msg, (uint32_t)now, &stats[c]);
+        else transmit(c, true, msg);
+      }
+    }
+
+    while (!air.empty() && air.top().at <= now) {
+      Frame f = air.top();
+      air.pop();
+      if (!f.toChild) {
+        uint8_t mac[6];
+        macOf(f.child, mac);
+        outbox.ack(mac, f.msg.seq, (uint32_t)now, &stats[f.child]);
+        continue;
+      }
+
+      Child& kid = kids[f.child];
+      bool high = f.msg.type == MSG_CURRENT_HIGH;
+      if (f.msg.seq) {
+        WireMessage ack;
+        ack.type = MSG_ACK;
+        ack.seq = f.msg.seq;
+        transmit(f.child, false, ack);
+        SeqResult seq = kid.window.accept(f.msg.seq);
+        if (seq != SEQ_NEW) {
+          r.duplicates++;
+          continue;
+        }
+      }
+      kid.high = high;
+      if (high == target && !reached[f.child]) {
+        reached[f.child] = true;
+        r.latencies.push_back(now - issued);
+      }
+    }
+
+    if (reliable) poll();
+  }
+  for (int c = 0; c < children; c++) {
+    if (!reached[c]) r.missed++;
+    r.total.sent += stats[c].sent;
+    r.total.delivered += stats[c].delivered;
+    r.total.superseded += stats[c].superseded;
+    r.resends += stats[c].retries;
+    r.total.rttMaxUs = std::max(r.total.rttMaxUs, stats[c].rttMaxUs);
+    r.total.rttAvgUs += stats[c].rttAvgUs / children;
+  }
+  return r;
+}
+
+static double percentile(std::vector<uint64_t>& v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(p * (v.size() - 1))] / 1000.0;
+}
+
+static void report(const char* name, Result& r) {
+  double p50 = percentile(r.latencies, 0.5);
+  double p99 = percentile(r.latencies, 0.99);
+  double max = r.latencies.empty() ? 0.0 : r.latencies.back() / 1000.0;
+  printf("%-9s %lu of %lu level changes missed (%.3f%%), alert to switch p50 %.1f ms, "
+         "p99 %.1f ms, max %.1f ms\n",
+         name, r.missed, r.changes, 100.0 * r.missed / r.changes, p50, p99, max);
+}
+
+int main(int argc, char** argv) {
+  unsigned long alerts = 2000;
+  int children = 5;
+  int lossPct = 10;
+  unsigned int seed = 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--alerts") && i + 1 < argc) alerts = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--children") && i + 1 < argc) children = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--loss") && i + 1 < argc) lossPct = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (unsigned int)atoi(argv[++i]);
+    else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  printf("%lu alerts to %d children, %d%% loss each way\n", alerts, children, lossPct);
+  Result once = run(false, alerts, children, lossPct, seed);
+  report("Once:", once);
+  Result acked = run(true, alerts, children, lossPct, seed);
+  report("Acked:", acked);
+  printf("          delivered %u of %u (%.3f%%), %u superseded, %lu given up, %lu resends, "
+         "%lu duplicates dropped, RTT avg %.1f ms max %.1f ms\n",
+         acked.total.delivered, acked.total.sent,
+         100.0 * acked.total.delivered / (acked.total.sent ? acked.total.sent : 1),
+         acked.total.superseded, acked.failed, acked.resends, acked.duplicates,
+         acked.total.rttAvgUs / 1000.0, acked.total.rttMaxUs / 1000.0);
+  return 0;
+}
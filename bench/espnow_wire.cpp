@@ -0,0 +1,287 @@
+/*
+ * ESP-NOW wire format benchmark: v2 compact vs v1 (legacy JSON) sizes
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Builds a typical message of each type, encodes it with wireEncode() and
+ * reports its length against the fixed sizeof(ESPNOWMessage) every v1
+ * message takes, the airtime at the 1 Mbps ESP-NOW rate, and the host cost
+ * of encode and decode. Then round-trips randomized messages and fails on
+ * any field that does not come back (within the fixed-point units for the
+ * readings), and checks that truncated messages are rejected.
+ *
+ * The v1 JSON cost needs ArduinoJson and is not measured here; on the
+ * device both formats are counted in the "wire" object of /api/peers.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -std=c++17 -Ibench/host -Isonoff_s31_main \
+ *       bench/espnow_wire.cpp sonoff_s31_main/espnow_wire.cpp -o espnow_wire
+ *
+ * Usage:
+ *   espnow_wire [--messages N] [--seed N]
+ */
+
+#include <Arduino.h>
+#include <chrono>
+#include <random>
+#include "espnow_wire.h"
+#include "beacon.h"
+
+// 802.11 frame overhead around an ESP-NOW payload (MAC header, vendor
+// action header and element, FCS), sent at 1 Mbps after a long preamble
+static const double FRAME_OVERHEAD_BYTES = 24 + 15 + 4;
+static const double PREAMBLE_US = 192;
+
+static double airtimeUs(size_t payload) {
+  return PREAMBLE_US + (payload + FRAME_OVERHEAD_BYTES) * 8;
+}
+
+static void fill(WireMessage& msg, uint8_t type, std::mt19937& rng) {
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  msg = WireMessage();
+  msg.type = type;
+  if (type == MSG_ACK || type == MSG_ALERT_NACK) {
+    msg.seq = rng() % 0xFFFF + 1;
+    return;
+  }
+  if (type == MSG_GROUP_ALERT) {
+    msg.groupId = rng() % 0xFFFF + 1;
+    msg.seq = rng();
+    msg.high = rng() & 1;
+    msg.stamp = (rng() & 1) ? rng() | 1 : 0;
+    return;
+  }
+  if (type == MSG_TIME_SYNC) {
+    msg.syncOrigin = rng();
+    msg.syncReceive = rng();
+    msg.syncTransmit = rng();
+    return;
+  }
+  if (type == MSG_MESH) {
+    for (int i = 0; i < 6; i++) msg.meshOrigin[i] = rng();
+    for (int i = 0; i < 6; i++) msg.meshDest[i] = rng();
+    msg.meshId = rng();
+    msg.meshTtl = rng() % (MESH_TTL + 1);
+    msg.meshHops = rng() % (MESH_TTL + 1);
+    msg.meshInner = (rng() & 1) ? MSG_CURRENT_HIGH : MSG_ACK;
+    msg.seq = rng();
+    msg.meshStamp = rng();
+    msg.meshArg = rng() % (MESH_TTL + 1);
+    return;
+  }
+  if (type == MSG_COMMAND || type == MSG_CURRENT_HIGH || type == MSG_CURRENT_LOW) {
+    msg.seq = (rng() & 1) ? rng() % 0xFFFF + 1 : 0;  // sequenced or not
+  }
+  if (type == MSG_CURRENT_HIGH || type == MSG_CURRENT_LOW || type == MSG_HEARTBEAT) {
+    msg.stamp = (rng() & 1) ? rng() | 1 : 0;        // timed or not
+  }
+  if (type == MSG_DEVICE_STATE || type == MSG_STATE_DELTA) {
+    msg.followUs = (rng() & 1) ? rng() % 100000 + 1 : 0;
+  }
+  if (type == MSG_DEVICE_STATE || type == MSG_STATE_DELTA || type == MSG_HEARTBEAT) {
+    msg.alertSeq = (rng() & 1) ? rng() % 0xFFFF + 1 : 0;  // from a parent or not
+  }
+  if (type == MSG_DISCOVERY || type == MSG_CURRENT_HIGH || type == MSG_CURRENT_LOW) {
+    return;  // no fields besides the sequence number
+  }
+  snprintf(msg.deviceId, sizeof(msg.deviceId), "sonoff-s31-%06x", (unsigned)(rng() & 0xFFFFFF));
+  switch (type) {
+    case MSG_DEVICE_STATE:
+      msg.relay = rng() & 1;
+      msg.wifi = rng() & 1;
+      msg.voltage = 200 + unit(rng) * 50;
+      msg.current = unit(rng) * 15;
+      msg.power = unit(rng) * 3500;
+      msg.energy = unit(rng) * 100000;
+      msg.uptime = rng();
+      break;
+    case MSG_STATE_DELTA:
+      msg.fields = rng() % BEACON_ALL + 1;
+      if (msg.fields & BEACON_RELAY) msg.relay = rng() & 1;
+      if (msg.fields & BEACON_WIFI) msg.wifi = rng() & 1;
+      if (msg.fields & BEACON_VOLTAGE) msg.voltage = 200 + unit(rng) * 50;
+      if (msg.fields & BEACON_CURRENT) msg.current = unit(rng) * 15;
+      if (msg.fields & BEACON_POWER) msg.power = unit(rng) * 3500;
+      if (msg.fields & BEACON_ENERGY) msg.energy = unit(rng) * 100000;
+      if (msg.fields & BEACON_UPTIME) msg.uptime = rng();
+      break;
+    case MSG_COMMAND:
+      wireSetString(msg.command, "relay");
+      wireSetString(msg.value, (rng() & 1) ? "toggle" : "on");
+      break;
+    case MSG_PAIRING:
+      msg.isParent = rng() & 1;
+      msg.hasParent = !msg.isParent;
+      msg.childCount = rng() % (MAX_CHILDREN + 1);
+      for (int i = 0; msg.hasParent && i < 6; i++) msg.parentMac[i] = rng();
+      msg.groupId = msg.isParent ? rng() : 0;
+      break;
+    case MSG_PAIRING_RESPONSE:
+      msg.accepted = rng() & 1;
+      break;
+  }
+}
+
+static bool near(float a, float b, float unit) {
+  return fabs(a - b) <= unit / 2 + 1e-3f;
+}
+
+static bool sameMessage(const WireMessage& a, const WireMessage& b) {
+  if (a.type != b.type || a.seq != b.seq || strcmp(a.deviceId, b.deviceId)) return false;
+  switch (a.type) {
+    case MSG_DEVICE_STATE:
+      return a.relay == b.relay && a.wifi == b.wifi && near(a.voltage, b.voltage, 0.1f) &&
+             near(a.current, b.current, 0.001f) && near(a.power, b.power, 0.1f) &&
+             a.energy == b.energy && a.uptime == b.uptime && a.followUs == b.followUs &&
+             a.alertSeq == b.alertSeq;
+    case MSG_STATE_DELTA:
+      return a.fields == b.fields && a.relay == b.relay && a.wifi == b.wifi &&
+             near(a.voltage, b.voltage, 0.1f) && near(a.current, b.current, 0.001f) &&
+             near(a.power, b.power, 0.1f) && a.energy == b.energy && a.uptime == b.uptime &&
+             a.followUs == b.followUs && a.alertSeq == b.alertSeq;
+    case MSG_COMMAND:
+      return !strcmp(a.command, b.command) && !strcmp(a.value, b.value);
+    case MSG_PAIRING:
+      return a.isParent == b.isParent && a.hasParent == b.hasParent &&
+             a.childCount == b.childCount && a.groupId == b.groupId &&
+             (!a.hasParent || !memcmp(a.parentMac, b.parentMac, 6));
+    case MSG_PAIRING_RESPONSE:
+      return a.accepted == b.accepted;
+    case MSG_HEARTBEAT:
+      return a.stamp == b.stamp && a.alertSeq == b.alertSeq;
+    case MSG_CURRENT_HIGH:
+    case MSG_CURRENT_LOW:
+      return a.stamp == b.stamp;
+    case MSG_GROUP_ALERT:
+      return a.groupId == b.groupId && a.high == b.high && a.stamp == b.stamp;
+    case MSG_TIME_SYNC:
+      return a.syncOrigin == b.syncOrigin && a.syncReceive == b.syncReceive &&
+             a.syncTransmit == b.syncTransmit;
+    case MSG_MESH:
+      return !memcmp(a.meshOrigin, b.meshOrigin, 6) && !memcmp(a.meshDest, b.meshDest, 6) &&
+             a.meshId == b.meshId && a.meshTtl == b.meshTtl && a.meshHops == b.meshHops &&
+             a.meshInner == b.meshInner && a.meshStamp == b.meshStamp && a.meshArg == b.meshArg;
+  }
+  return true;
+}
+
+// Drop the last optional trailer present, false if there is none
+static bool dropTrailer(WireMessage& msg) {
+  switch (msg.type) {
+    case MSG_PAIRING:
+      if (!msg.groupId) return false;
+      msg.groupId = 0;
+      return true;
+    case MSG_COMMAND:
+      if (!msg.seq) return false;
+      msg.seq = 0;
+      return true;
+    case MSG_CURRENT_HIGH:
+    case MSG_CURRENT_LOW:
+      if (msg.stamp) msg.stamp = 0;
+      else if (msg.seq) msg.seq = 0;
+      else return false;
+      return true;
+    case MSG_HEARTBEAT:
+      if (msg.alertSeq) msg.alertSeq = 0;
+      else if (msg.stamp) msg.stamp = 0;
+      else return false;
+      return true;
+    case MSG_GROUP_ALERT:
+      if (!msg.stamp) return false;
+      msg.stamp = 0;
+      return true;
+    case MSG_DEVICE_STATE:
+    case MSG_STATE_DELTA:
+      if (msg.alertSeq) msg.alertSeq = 0;
+      else if (msg.followUs) msg.followUs = 0;
+      else return false;
+      return true;
+  }
+  return false;
+}
+
+int main(int argc, char** argv) {
+  unsigned long messages = 1000000;
+  unsigned int seed = 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--messages") && i + 1 < argc) messages = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (unsigned int)atoi(argv[++i]);
+    else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  static const struct { uint8_t type; const char* name; } types[] = {
+    {MSG_DEVICE_STATE, "DEVICE_STATE"}, {MSG_COMMAND, "COMMAND"},
+    {MSG_DISCOVERY, "DISCOVERY"}, {MSG_HEARTBEAT, "HEARTBEAT"},
+    {MSG_PAIRING, "PAIRING"}, {MSG_PAIRING_RESPONSE, "PAIRING_RESPONSE"},
+    {MSG_CURRENT_HIGH, "CURRENT_HIGH"}, {MSG_CURRENT_LOW, "CURRENT_LOW"},
+    {MSG_ACK, "ACK"}, {MSG_STATE_DELTA, "STATE_DELTA"},
+    {MSG_MESH, "MESH"}, {MSG_GROUP_ALERT, "GROUP_ALERT"},
+    {MSG_TIME_SYNC, "TIME_SYNC"}, {MSG_ALERT_NACK, "ALERT_NACK"},
+  };
+  const size_t legacy = sizeof(ESPNOWMessage);
+
+  std::mt19937 rng(seed);
+  uint8_t buf[ESPNOW_MAX_PAYLOAD];
+  unsigned long failures = 0;
+
+  printf("%-18s %6s %6s %10s %10s %9s %9s\n", "Type", "v1 B", "v2 B", "v1 air us", "v2 air us",
+         "enc ns", "dec ns");
+  for (const auto& t : types) {
+    WireMessage msg, out;
+    fill(msg, t.type, rng);
+    size_t len = wireEncode(msg, buf, sizeof(buf));
+
+    const unsigned long reps = messages / 8 + 1;
+    volatile size_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long n = 0; n < reps; n++) {
+      msg.uptime = n;
+      sink = sink + wireEncode(msg, buf, sizeof(buf));
+    }
+    double encNs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e9 / reps;
+
+    start = std::chrono::steady_clock::now();
+    for (unsigned long n = 0; n < reps; n++) {
+      sink = sink + wireDecode(buf, len, out);
+    }
+    double decNs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e9 / reps;
+
+    printf("%-18s %6zu %6zu %10.0f %10.0f %9.1f %9.1f\n", t.name, legacy, len,
+           airtimeUs(legacy), airtimeUs(len), encNs, decNs);
+  }
+
+  // Round trip and truncation
+  for (unsigned long n = 0; n < messages; n++) {
+    WireMessage msg, out;
+    fill(msg, types[rng() % (sizeof(types) / sizeof(types[0]))].type, rng);
+    size_t len = wireEncode(msg, buf, sizeof(buf));
+    if (len == 0 || !wireDecode(buf, len, out) || !sameMessage(msg, out)) {
+      if (failures++ < 5) printf("Round trip failed: type %d, %zu bytes\n", msg.type, len);
+      continue;
+    }
+    // A cut message must be rejected, unless only optional trailers (a
+    // sequence number, a stamp, a pairing group ID...) went missing and it
+    // reads as the message without them
+    size_t cut = 2 + rng() % (len - 1);
+    if (cut < len && wireDecode(buf, cut, out)) {
+      WireMessage trimmed = msg;
+      bool same = false;
+      while (!same && dropTrailer(trimmed)) {
+        same = sameMessage(trimmed, out);
+      }
+      if (!same) {
+        if (failures++ < 5) printf("Truncated message accepted: type %d, %zu of %zu bytes\n", msg.type, cut, len);
+      }
+    }
+    if (wireIsLegacy(buf, len)) {
+      if (failures++ < 5) printf("v2 message taken for v1: type %d\n", msg.type);
+    }
+  }
+
+  printf("Round trip:         %lu messages, %lu failures\n", messages, failures);
+  return failures ? 1 : 0;
+}
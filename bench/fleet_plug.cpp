@@ -0,0 +1,193 @@
+/*
+ * One simulated plug for bench/espnow_fleet.cpp
+ * For SONOFF S31 ESP8266 Project
+ *
+ * What sonoff_s31_main.ino does around the ESP-NOW handler, without the
+ * sensor, web server, WiFi and MQTT: the globals the handler links against,
+ * the relay functions, Logger, and loop(). Readings follow the relay and,
+ * for a parent, the load the driver sets.
+ */
+
+#include "config.h"
+#include <LittleFS.h>
+#include <stdarg.h>
+#include "espnow_handler.h"
+#include "current_automation.h"
+#include "Logger.h"
+#include "fleet_plug.h"
+
+DeviceState deviceState;
+CurrentAutomation currentAutomation;
+FS LittleFS;
+uint64_t hostClockOffsetUs = 0;
+double hostClockPpm = 0;
+
+static bool loadHigh = false;
+static unsigned long lastReading = 0;
+static uint32_t relayToggles = 0;
+
+// ===== LOGGER =====
+
+Adafruit_MQTT_Publish* Logger::mqttLogger = nullptr;
+bool Logger::serialEnabled = true;
+char Logger::buffer[512];
+Logger logger;
+
+void Logger::disableSerial() {}
+void Logger::enableSerial() {}
+void Logger::withoutSerial(void (*f_ptr)()) { f_ptr(); }
+void Logger::setMQTTLogger(Adafruit_MQTT_Publish* mp) { mqttLogger = mp; }
+void Logger::println(const String& message) { sendMessage(message, true); }
+void Logger::println(const char* message) { sendMessage(String(message), true); }
+void Logger::print(const String& message) { sendMessage(message, false); }
+void Logger::print(const char* message) { sendMessage(String(message), false); }
+
+void Logger::printf(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  sendMessage(String(buffer), false);
+}
+
+void Logger::sendMessage(const String& message, bool addNewline) {
+  fleetLog((message + (addNewline ? "\n" : "")).c_str());
+}
+
+// ===== RELAY =====
+
+static void saveRelayState() {
+  File file = LittleFS.open(RELAY_STATE_FILE, "w");
+  if (file) {
+    file.write(deviceState.relayState ? 1 : 0);
+    file.close();
+  }
+}
+
+void toggleRelay() {
+  relayToggles++;
+  deviceState.relayState = !deviceState.relayState;
+  logger.printf("Relay %s\n", deviceState.relayState ? "ON" : "OFF");
+  saveRelayState();
+  handleBeacon();
+}
+
+void turnOnRelay() {
+  if (!deviceState.relayState) {
+    deviceState.relayState = true;
+    logger.println("Relay ON");
+    saveRelayState();
+    handleBeacon();
+  }
+}
+
+void turnOffRelay() {
+  if (deviceState.relayState) {
+    deviceState.relayState = false;
+    logger.println("Relay OFF");
+    saveRelayState();
+    handleBeacon();
+  }
+}
+
+// ===== LOOP =====
+
+// Once a second, as updateSensorReadings(): mains wander a little, the
+// current is the load's while the relay is closed
+static void updateReadings() {
+  if (millis() - lastReading < 1000) {
+    return;
+  }
+  float current = 0.0f;
+  if (deviceState.relayState) {
+    current = deviceState.isParent ? (loadHigh ? 6.0f : 0.08f) : 0.6f;
+  }
+  deviceState.voltage = 229.0f + (ESP.random() % 40) / 10.0f;
+  deviceState.current = current;
+  deviceState.power = deviceState.voltage * current;
+  deviceState.energy += deviceState.power * (millis() - lastReading) / 3600000.0f;
+  deviceState.lastUpdate = millis();
+  lastReading = millis();
+}
+
+static void plugSetClock(uint64_t offsetUs, double ppm) {
+  hostClockOffsetUs = offsetUs;
+  hostClockPpm = ppm;
+}
+
+static void plugSetup(const char* deviceId) {
+  deviceState.deviceId = deviceId;
+  loadPairingData();
+  initESPNOW();
+  currentAutomation.state = CURRENT_STATE_LOW;
+  currentAutomation.stateSince = millis();
+  currentAutomation.childTurnOffTimer = 0;
+  lastReading = millis();
+}
+
+static void plugLoop() {
+  updateReadings();
+  handleESPNOWMessages();
+  handleChildTurnOff();
+  handlePairingMode();
+}
+
+static void plugSlice() {
+  drainESPNOWQueue();
+}
+
+static void plugStartPairing() {
+  enterPairingMode();
+}
+
+static void plugStopPairing() {
+  exitPairingMode();
+}
+
+// The parent's relay carries the load; a crossing is what the automation
+// state machine reports after its debounce
+static void plugSetLoad(bool high) {
+  loadHigh = high;
+  turnOnRelay();
+  sendCurrentAlert(high, micros());
+}
+
+// What the web UI's relay buttons do, for every child
+static void plugCommandChildren(const char* command, const char* value) {
+  for (int i = 0; i < deviceState.childCount; i++) {
+    sendCommand(deviceState.childMacs[i], command, value);
+  }
+}
+
+static void plugStatus(FleetPlugStatus* status) {
+  status->relay = deviceState.relayState;
+  status->isParent = deviceState.isParent;
+  status->hasParent = deviceState.hasParent;
+  status->pairingMode = deviceState.pairingMode;
+  memcpy(status->parentMac, deviceState.parentMac, 6);
+  status->childCount = deviceState.childCount;
+  status->groupId = deviceState.groupId;
+  status->peers = espnowPeers.size();
+  status->txMessages = wireStats.txMessages;
+  status->rxMessages = wireStats.rxMessages;
+  status->rxDuplicates = wireStats.rxDuplicates;
+  status->rxUntracked = wireStats.rxUntracked;
+  status->rxDropped = espnowRxQueue.stats().dropped;
+  status->outboxOverflows = reliableOutbox.overflows();
+  status->alertsTimed = alertLatency.count();
+  status->alertAvgUs = alertLatency.averageUs();
+  status->alertMaxUs = alertLatency.maxUs();
+  status->clockSynced = parentClock.synced();
+  status->followCount = followLatency.count();
+  status->followLastUs = followLatency.lastUs();
+  status->childFollowReports = 0;
+  for (int i = 0; i < deviceState.childCount; i++) {
+    status->childFollowReports += childFollow[i].count();
+  }
+  status->relayToggles = relayToggles;
+}
+
+extern "C" const FleetPlugApi fleetPlug = {
+  plugSetClock, plugSetup, plugLoop, plugSlice, plugStartPairing, plugStopPairing, plugSetLoad,
+  plugCommandChildren, plugStatus,
+};
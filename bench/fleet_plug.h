@@ -0,0 +1,58 @@
+/*
+ * One simulated plug for bench/espnow_fleet.cpp
+ * For SONOFF S31 ESP8266 Project
+ *
+ * fleet_plug.cpp and the sketch's ESP-NOW sources build into a shared
+ * library; the fleet driver loads a private copy per plug, so each has its
+ * own globals (deviceState, the peer table, the outbox...) exactly as on a
+ * device, and reaches it through the fleetPlug table below. The radio and
+ * virtual time are the driver's, shared by every copy; each plug reads the
+ * time through its own crystal (setClock, host/Arduino.h).
+ */
+
+#ifndef FLEET_PLUG_H
+#define FLEET_PLUG_H
+
+#include <stdint.h>
+
+struct FleetPlugStatus {
+  bool relay;
+  bool isParent;
+  bool hasParent;
+  bool pairingMode;
+  uint8_t parentMac[6];
+  uint8_t childCount;
+  uint16_t groupId;
+  uint16_t peers;                          // peer table entries
+  uint32_t txMessages;
+  uint32_t rxMessages;
+  uint32_t rxDuplicates;
+  uint32_t rxUntracked;                    // sequenced but not applied, sender untracked
+  uint32_t rxDropped;                      // receive ring full
+  uint32_t outboxOverflows;
+  uint32_t alertsTimed;                    // alertLatency samples, parent side
+  uint32_t alertAvgUs;
+  uint32_t alertMaxUs;
+  bool clockSynced;                        // child: has a parent clock estimate
+  uint32_t followCount;                    // child: followLatency samples
+  uint32_t followLastUs;
+  uint32_t childFollowReports;             // parent: childFollow samples, all children
+  uint32_t relayToggles;                   // toggleRelay() calls
+};
+
+struct FleetPlugApi {
+  void (*setClock)(uint64_t offsetUs, double ppm);  // before setup: this plug's micros()
+  void (*setup)(const char* deviceId);     // setup(), ESP-NOW part
+  void (*loop)();                          // loop() body, once per 100 ms
+  void (*slice)();                         // loop() idle slice, every SENSOR_POLL_SLICE
+  void (*startPairing)();                  // button held: enterPairingMode()
+  void (*stopPairing)();
+  void (*setLoad)(bool high);              // parent: the load crossed the current threshold
+  void (*commandChildren)(const char* command, const char* value);  // parent: sendCommand() to each
+  void (*status)(FleetPlugStatus* status);
+};
+
+// Logger output of the traced plug, implemented by the driver
+extern "C" void fleetLog(const char* text);
+
+#endif // FLEET_PLUG_H
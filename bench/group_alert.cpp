@@ -0,0 +1,269 @@
+/*
+ * Group alert benchmark: one broadcast vs. a unicast per child
+ * For SONOFF S31 ESP8266 Project
+ *
+ * A parent alternates HIGH/LOW current alerts to 1..16 children over one
+ * shared channel: frames go out one after another, each taking its v2
+ * airtime, and each child loses --loss percent of them. A frame reaches a
+ * child's loop() up to one SENSOR_POLL_SLICE after it ends. Two ways:
+ *   - per child: an acknowledged unicast through ReliableOutbox, the child
+ *     answering each with an ACK, as a sketch built with GROUP_ALERTS 0
+ *     (which gives the outbox a slot for each child)
+ *   - group: one MSG_GROUP_ALERT broadcast and GROUP_ALERT_REPEATS repeats
+ *     GROUP_REPEAT_MS apart (doubling), children dropping copies with a
+ *     SeqWindow. The parent's next state beacon, up to BEACON_READING_MS
+ *     after the alert as its readings changed, then its heartbeats every
+ *     ESPNOW_BROADCAST_INTERVAL, name the alert; a child that missed every
+ *     copy answers with MSG_ALERT_NACK and gets it unicast. The beacons go
+ *     out either way and are not counted; the mesh is not modelled
+ * For each child count it reports frames and channel time per alert, the
+ * time until the last child switched (p50/p99) and level changes missed.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -std=c++17 -DGROUP_ALERTS=0 -Ibench/host -Isonoff_s31_main \
+ *       bench/group_alert.cpp sonoff_s31_main/espnow_reliable.cpp \
+ *       sonoff_s31_main/espnow_wire.cpp -o group_alert
+ *
+ * Usage:
+ *   group_alert [--alerts N] [--loss PCT] [--seed N]
+ */
+
+#include <Arduino.h>
+#include <algorithm>
+#include <queue>
+#include <random>
+#include <vector>
+#include "espnow_reliable.h"
+
+static const double FRAME_OVERHEAD_BYTES = 24 + 15 + 4;
+static const double PREAMBLE_US = 192;
+
+static uint64_t airtimeUs(const WireMessage& msg) {
+  uint8_t buf[ESPNOW_MAX_PAYLOAD];
+  size_t len = wireEncode(msg, buf, sizeof(buf));
+  return (uint64_t)(PREAMBLE_US + (len + FRAME_OVERHEAD_BYTES) * 8);
+}
+
+struct Frame {
+  uint64_t at;
+  int to;                        // child index, or -1 for the parent
+  int from;
+  WireMessage msg;
+  bool operator>(const Frame& o) const { return at > o.at; }
+};
+
+struct Result {
+  unsigned long frames = 0;
+  uint64_t busyUs = 0;
+  unsigned long changes = 0;
+  unsigned long missed = 0;
+  std::vector<uint64_t> lastSwitch;    // per alert, time until every child switched
+};
+
+static Result run(bool group, int children, unsigned long alerts, int lossPct, unsigned int seed) {
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int> percent(0, 99);
+  std::uniform_int_distribution<uint64_t> drain(0, SENSOR_POLL_SLICE * 1000);
+  std::uniform_int_distribution<uint64_t> gap(500000, 5000000);
+
+  std::priority_queue<Frame, std::vector<Frame>, std::greater<Frame>> air;
+  std::vector<SeqWindow> windows(children);
+  std::vector<DeliveryStats> stats(children);
+  std::vector<bool> reached(children, true);
+  ReliableOutbox outbox;
+  outbox.seed(40000);
+  Result r;
+
+  uint64_t now = 0;
+  uint64_t channelFree = 0;
+  bool target = false;
+  uint64_t issued = 0;
+  int pendingChildren = 0;
+
+  // Queue on the channel; to < 0 from the parent broadcasts to every child
+  auto transmit = [&](int from, int to, const WireMessage& msg, bool counted = true) {
+    uint64_t start = std::max(now, channelFree);
+    uint64_t air_us = airtimeUs(msg);
+    channelFree = start + air_us;
+    if (counted) {
+      r.frames++;
+      r.busyUs += air_us;
+    }
+    if (from >= 0) {
+      if (percent(rng) >= lossPct) air.push(Frame{channelFree + drain(rng), -1, from, msg});
+      return;
+    }
+    for (int c = 0; c < children; c++) {
+      if (to >= 0 && c != to) continue;
+      if (percent(rng) >= lossPct) air.push(Frame{channelFree + drain(rng), c, -1, msg});
+    }
+  };
+  auto macOf = [](int child, uint8_t* mac) {
+    const uint8_t base[6] = {0x5C, 0xCF, 0x7F, 0, 0, 0};
+    memcpy(mac, base, 6);
+    mac[5] = child;
+  };
+
+  WireMessage repeat;
+  int repeatsLeft = 0;
+  uint64_t repeatAt = 0, repeatGap = 0;
+  uint16_t groupSeq = 7;
+  uint64_t beaconAt = ~0ULL;
+  std::uniform_int_distribution<uint64_t> beaconDelay(0, BEACON_READING_MS * 1000ULL);
+
+  uint64_t nextAlert = gap(rng);
+  unsigned long sent = 0;
+  // The last alert gets as long as the others before it is counted
+  while (sent < alerts || now < nextAlert || !air.empty() || outbox.pending() || repeatsLeft) {
+    uint64_t next = now + 1000;
+    if (!air.empty()) next = std::min(next, air.top().at);
+    next = std::min(next, nextAlert);
+    if (repeatsLeft) next = std::min(next, repeatAt);
+    if (group) next = std::min(next, beaconAt);
+    now = std::max(now + 1, next);
+
+    if (sent < alerts && now >= nextAlert) {
+      for (int c = 0; c < children; c++) {
+        if (!reached[c]) r.missed++;
+        reached[c] = false;
+      }
+      target = !target;
+      issued = now;
+      pendingChildren = children;
+      r.changes += children;
+      sent++;
+      nextAlert = now + gap(rng);
+
+      if (group) {
+        repeat = WireMessage();
+        repeat.type = MSG_GROUP_ALERT;
+        repeat.groupId = 0x4A21;
+        repeat.seq = groupSeq++;
+        repeat.high = target;
+        transmit(-1, -1, repeat);
+        repeatsLeft = GROUP_ALERT_REPEATS;
+        repeatGap = GROUP_REPEAT_MS * 1000;
+        repeatAt = now + repeatGap;
+        beaconAt = now + beaconDelay(rng);
+      } else {
+        for (int c = 0; c < children; c++) {
+          WireMessage msg;
+          msg.type = target ? MSG_CURRENT_HIGH : MSG_CURRENT_LOW;
+          uint8_t mac[6];
+          macOf(c, mac);
+          if (!outbox.queue(mac, msg, (uint32_t)now, &stats[c])) transmit(-1, c, msg);
+        }
+      }
+    }
+
+    if (repeatsLeft && now >= repeatAt) {
+      transmit(-1, -1, repeat);
+      repeatsLeft--;
+      repeatGap *= 2;
+      repeatAt = now + repeatGap;
+    }
+    // As announcedAlertSeq(): named once the repeats are over
+    if (group && now >= beaconAt) {
+      WireMessage beacon;
+      beacon.type = MSG_HEARTBEAT;
+      wireSetString(beacon.deviceId, "sonoff-s31-4a21c0");
+      beacon.alertSeq = repeatsLeft ? 0 : repeat.seq;
+      transmit(-1, -1, beacon, false);
+      beaconAt = now + ESPNOW_BROADCAST_INTERVAL * 1000ULL;
+    }
+
+    while (!air.empty() && air.top().at <= now) {
+      Frame f = air.top();
+      air.pop();
+      if (f.to < 0) {
+        uint8_t mac[6];
+        macOf(f.from, mac);
+        if (f.msg.type == MSG_ALERT_NACK) {
+          if (f.msg.seq == repeat.seq) transmit(-1, f.from, repeat);
+          continue;
+        }
+        outbox.ack(mac, f.msg.seq, (uint32_t)now, &stats[f.from]);
+        continue;
+      }
+
+      if (f.msg.type == MSG_HEARTBEAT) {
+        // As checkGroupAlert()
+        if (f.msg.alertSeq && windows[f.to].check(f.msg.alertSeq) == SEQ_NEW) {
+          WireMessage nack;
+          nack.type = MSG_ALERT_NACK;
+          nack.seq = f.msg.alertSeq;
+          transmit(f.to, -1, nack);
+        }
+        continue;
+      }
+      if (f.msg.type == MSG_GROUP_ALERT) {
+        if (windows[f.to].accept(f.msg.seq) != SEQ_NEW) continue;
+      } else if (f.msg.seq) {
+        // Every sequenced copy is acknowledged
+        WireMessage ack;
+        ack.type = MSG_ACK;
+        ack.seq = f.msg.seq;
+        transmit(f.to, -1, ack);
+        if (windows[f.to].accept(f.msg.seq) != SEQ_NEW) continue;
+      }
+      bool high = f.msg.type == MSG_GROUP_ALERT ? f.msg.high : f.msg.type == MSG_CURRENT_HIGH;
+      if (high == target && !reached[f.to]) {
+        reached[f.to] = true;
+        if (--pendingChildren == 0) r.lastSwitch.push_back(now - issued);
+      }
+    }
+
+    if (!group) {
+      outbox.poll((uint32_t)now,
+                  [&](uint8_t* mac, const OutboxEntry& e) {
+                    WireMessage msg;
+                    wireDecode(e.frame, e.len, msg);
+                    transmit(-1, mac[5], msg);
+                  },
+                  [&](uint8_t*, const OutboxEntry&) {},
+                  [&](const uint8_t* mac) { return &stats[mac[5]]; });
+    }
+  }
+  for (int c = 0; c < children; c++) {
+    if (!reached[c]) r.missed++;
+  }
+  return r;
+}
+
+static double percentile(std::vector<uint64_t>& v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(p * (v.size() - 1))] / 1000.0;
+}
+
+int main(int argc, char** argv) {
+  unsigned long alerts = 1000;
+  int lossPct = 5;
+  unsigned int seed = 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--alerts") && i + 1 < argc) alerts = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--loss") && i + 1 < argc) lossPct = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (unsigned int)atoi(argv[++i]);
+    else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  printf("%lu alerts, %d%% loss, %d repeats\n", alerts, lossPct, GROUP_ALERT_REPEATS);
+  printf("%-10s %8s %7s %9s %9s %9s %8s\n", "Children", "Scheme", "frames", "air ms",
+         "all p50", "all p99", "missed");
+  const int counts[] = {1, 5, 10, 16};
+  for (int n : counts) {
+    if (n > MAX_CHILDREN) break;
+    for (int group = 0; group < 2; group++) {
+      Result r = run(group, n, alerts, lossPct, seed);
+      printf("%-10d %8s %7.1f %9.2f %9.1f %9.1f %7.3f%%\n", n, group ? "group" : "unicast",
+             (double)r.frames / alerts, r.busyUs / 1000.0 / alerts,
+             percentile(r.lastSwitch, 0.5), percentile(r.lastSwitch, 0.99),
+             100.0 * r.missed / r.changes);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,10 @@
+/*
+ * Host stand-in for Adafruit_MQTT.h (included by Logger.h only)
+ */
+
+#ifndef HOST_ADAFRUIT_MQTT_H
+#define HOST_ADAFRUIT_MQTT_H
+
+class Adafruit_MQTT_Publish;
+
+#endif // HOST_ADAFRUIT_MQTT_H
@@ -0,0 +1,143 @@
+/*
+ * Minimal Arduino core shim for host (Linux) builds of the sketch sources
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Only what the benchmarked modules actually touch is provided. Time is
+ * virtual: millis()/micros() return a clock the benchmark advances with
+ * hostAdvanceMicros(), so replays are deterministic and run at full speed.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <string>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define HEX 16
+#define IRAM_ATTR                        // interrupt code, in IRAM on the device
+
+// ---------------------------------------------------------------------
+// Virtual clock
+// ---------------------------------------------------------------------
+
+inline uint64_t hostMicros = 0;
+
+inline void hostAdvanceMicros(uint64_t us) { hostMicros += us; }
+
+#ifdef HOST_PLUG_CLOCK
+// bench/fleet_plug.cpp gives each simulated plug its own crystal: booted at
+// another time, a few ppm fast or slow, micros() wrapping at 32 bits as on
+// the device. Static, so the copies of the plug library cannot share them.
+extern uint64_t hostClockOffsetUs;
+extern double hostClockPpm;
+static inline uint64_t hostLocalMicros() {
+  return hostMicros + hostClockOffsetUs + (int64_t)(hostMicros * hostClockPpm / 1e6);
+}
+static inline unsigned long micros() { return (uint32_t)hostLocalMicros(); }
+static inline unsigned long millis() { return (unsigned long)(hostLocalMicros() / 1000); }
+#else
+inline unsigned long micros() { return (unsigned long)hostMicros; }
+inline unsigned long millis() { return (unsigned long)(hostMicros / 1000); }
+#endif
+inline void delay(unsigned long ms) { hostAdvanceMicros((uint64_t)ms * 1000); }
+inline void yield() {}
+
+// ---------------------------------------------------------------------
+// String
+// ---------------------------------------------------------------------
+
+class String : public std::string {
+public:
+  String() {}
+  String(const char* s) : std::string(s ? s : "") {}
+  String(const std::string& s) : std::string(s) {}
+  String(int value) : std::string(std::to_string(value)) {}
+  String(unsigned int value, int base = 10) : std::string(format(value, base)) {}
+  String(unsigned long value, int base = 10) : std::string(format(value, base)) {}
+  unsigned int length() const { return (unsigned int)size(); }
+
+private:
+  static std::string format(unsigned long value, int base) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), base == HEX ? "%lx" : "%lu", value);
+    return buf;
+  }
+};
+
+// ---------------------------------------------------------------------
+// Serial
+// ---------------------------------------------------------------------
+
+class Stream {
+public:
+  virtual ~Stream() {}
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual void flush() {}
+};
+
+enum SerialConfig { SERIAL_8N1, SERIAL_8E1 };
+
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long, SerialConfig = SERIAL_8N1) {}
+  int available() override { return 0; }
+  int read() override { return -1; }
+  size_t setRxBufferSize(size_t size) { return size; }
+  explicit operator bool() const { return false; }
+  void print(const char*) {}
+  void println(const char* = "") {}
+  void printf(const char*, ...) {}
+};
+
+inline HardwareSerial Serial;
+
+// ---------------------------------------------------------------------
+// ESP
+// ---------------------------------------------------------------------
+
+class EspClass {
+public:
+  void wdtFeed() {}
+  uint32_t getFreeHeap() { return 0; }
+  uint32_t getChipId() { return 0; }
+  // Hardware RNG stand-in: xorshift32, one sequence for the whole process
+  // so simulations are repeatable
+  uint32_t random() {
+    _random ^= _random << 13;
+    _random ^= _random >> 17;
+    _random ^= _random << 5;
+    return _random;
+  }
+
+  // Host stand-in for the Xtensa CCOUNT register: the TSC on x86, otherwise
+  // nanoseconds of real time. Either way deltas compare code paths fairly.
+  uint32_t getCycleCount() {
+#if defined(__x86_64__) || defined(__i386__)
+    return (uint32_t)__rdtsc();
+#else
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+  }
+
+private:
+  uint32_t _random = 0x2545F491;
+};
+
+inline EspClass ESP;
+
+#endif // HOST_ARDUINO_H
@@ -0,0 +1,36 @@
+/*
+ * Host stand-in for ArduinoJson.h, enough for espnow_handler.cpp to build
+ *
+ * Documents hold nothing: every value reads back as its default and nothing
+ * is serialized, so the v1 (legacy JSON) ESP-NOW format is not simulated.
+ * Simulations run the v2 format (ESPNOW_WIRE_FORMAT 2).
+ */
+
+#ifndef HOST_ARDUINOJSON_H
+#define HOST_ARDUINOJSON_H
+
+#include <Arduino.h>
+
+class JsonVariant {
+public:
+  template <typename T> JsonVariant& operator=(const T&) { return *this; }
+  template <typename T> operator T() const { return T(); }
+  template <typename T> T as() const { return T(); }
+  template <typename T> T operator|(T fallback) const { return fallback; }
+};
+
+class DynamicJsonDocument {
+public:
+  explicit DynamicJsonDocument(size_t) {}
+  JsonVariant operator[](const char*) { return JsonVariant(); }
+  bool containsKey(const char*) const { return false; }
+};
+
+inline size_t serializeJson(const DynamicJsonDocument&, char* out, size_t size) {
+  if (size) out[0] = '\0';
+  return 0;
+}
+
+inline int deserializeJson(DynamicJsonDocument&, const char*) { return 0; }
+
+#endif // HOST_ARDUINOJSON_H
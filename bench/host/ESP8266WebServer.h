@@ -0,0 +1,3 @@
+/*
+ * Host stand-in for ESP8266WebServer.h (included by Logger.h only)
+ */
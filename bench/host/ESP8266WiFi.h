@@ -0,0 +1,38 @@
+/*
+ * Host stand-in for ESP8266WiFi.h (the MAC address and mode, for ESP-NOW)
+ *
+ * hostMacAddress() is implemented by bench/virtual_radio.cpp and answers
+ * for the plug the simulation is running.
+ */
+
+#ifndef HOST_ESP8266WIFI_H
+#define HOST_ESP8266WIFI_H
+
+#include <Arduino.h>
+
+enum WiFiMode_t { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 };
+
+void hostMacAddress(uint8_t* mac);
+
+class ESP8266WiFiClass {
+public:
+  bool mode(WiFiMode_t) { return true; }
+
+  uint8_t* macAddress(uint8_t* mac) {
+    hostMacAddress(mac);
+    return mac;
+  }
+
+  String macAddress() {
+    uint8_t mac[6];
+    char buf[18];
+    hostMacAddress(mac);
+    snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    return String(buf);
+  }
+};
+
+inline ESP8266WiFiClass WiFi;
+
+#endif // HOST_ESP8266WIFI_H
@@ -0,0 +1,80 @@
+/*
+ * Host stand-in for LittleFS.h: files kept in memory
+ *
+ * LittleFS is declared, not defined: each simulated plug (bench/fleet_plug.cpp)
+ * defines its own, so every plug has its own flash.
+ */
+
+#ifndef HOST_LITTLEFS_H
+#define HOST_LITTLEFS_H
+
+#include <Arduino.h>
+#include <map>
+#include <memory>
+
+class File {
+public:
+  File() {}
+  File(std::shared_ptr<std::string> data, size_t pos) : _data(data), _pos(pos) {}
+
+  explicit operator bool() const { return (bool)_data; }
+
+  size_t write(uint8_t b) { return write(&b, 1); }
+  size_t write(const uint8_t* buf, size_t len) {
+    if (!_data) return 0;
+    if (_data->size() < _pos + len) _data->resize(_pos + len);
+    memcpy(&(*_data)[_pos], buf, len);
+    _pos += len;
+    return len;
+  }
+
+  int read() {
+    if (!_data || _pos >= _data->size()) return -1;
+    return (uint8_t)(*_data)[_pos++];
+  }
+  size_t read(uint8_t* buf, size_t len) {
+    if (!_data || _pos >= _data->size()) return 0;
+    if (len > _data->size() - _pos) len = _data->size() - _pos;
+    memcpy(buf, &(*_data)[_pos], len);
+    _pos += len;
+    return len;
+  }
+
+  size_t size() const { return _data ? _data->size() : 0; }
+  void close() { _data.reset(); }
+
+private:
+  std::shared_ptr<std::string> _data;
+  size_t _pos = 0;
+};
+
+class FS {
+public:
+  bool begin() { return true; }
+
+  bool exists(const char* path) const { return _files.count(path) != 0; }
+  bool exists(const String& path) const { return exists(path.c_str()); }
+
+  // "r", "w" (truncate) or "a"
+  File open(const char* path, const char* mode) {
+    auto it = _files.find(path);
+    if (mode[0] == 'r') {
+      return it == _files.end() ? File() : File(it->second, 0);
+    }
+    if (it == _files.end() || mode[0] == 'w') {
+      it = _files.insert_or_assign(path, std::make_shared<std::string>()).first;
+    }
+    return File(it->second, it->second->size());
+  }
+  File open(const String& path, const char* mode) { return open(path.c_str(), mode); }
+
+  bool remove(const char* path) { return _files.erase(path) != 0; }
+  bool remove(const String& path) { return remove(path.c_str()); }
+
+private:
+  std::map<std::string, std::shared_ptr<std::string>> _files;
+};
+
+extern FS LittleFS;
+
+#endif // HOST_LITTLEFS_H
@@ -0,0 +1,3 @@
+/*
+ * Host stand-in for the ESP8266 core debug.h
+ */
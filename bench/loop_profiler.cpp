@@ -0,0 +1,103 @@
+/*
+ * Loop profiler benchmark: cost of a PERF_SCOPE and bucket checks
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Times an empty loop, the same loop with a PERF_SCOPE around its body,
+ * and a direct LoopProfiler::record() with ESP.getCycleCount() (the TSC
+ * on x86 hosts), and reports the cycles a scope adds. Also checks
+ * bucketOf() against a plain loop over the bucket edges for every power
+ * of two and its neighbours, and that counts and totals add up.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -std=c++17 -Ibench/host -Isonoff_s31_main \
+ *       bench/loop_profiler.cpp sonoff_s31_main/loop_profiler.cpp -o loop_profiler
+ *
+ * Usage:
+ *   loop_profiler [--runs N]
+ */
+
+#include <Arduino.h>
+#include <algorithm>
+#include "loop_profiler.h"
+
+static volatile uint32_t sink = 0;
+
+static uint8_t referenceBucket(uint32_t cycles) {
+  for (uint8_t i = 0; i + 1 < PERF_BUCKETS; i++) {
+    if (cycles < LoopProfiler::bucketLimit(i)) return i;
+  }
+  return PERF_BUCKETS - 1;
+}
+
+static bool checkBuckets() {
+  bool ok = true;
+  for (int bit = 0; bit < 32; bit++) {
+    uint32_t p = 1UL << bit;
+    for (uint32_t c : {p - 1, p, p + 1}) {
+      if (LoopProfiler::bucketOf(c) != referenceBucket(c)) {
+        printf("FAIL: %u cycles in bucket %u, expected %u\n", c, LoopProfiler::bucketOf(c),
+               referenceBucket(c));
+        ok = false;
+      }
+    }
+  }
+  if (LoopProfiler::bucketOf(0xFFFFFFFFUL) != PERF_BUCKETS - 1) {
+    printf("FAIL: largest count not in the last bucket\n");
+    ok = false;
+  }
+  return ok;
+}
+
+// Cycles per pass of f over runs passes, best of a few tries
+template <typename F>
+static double cyclesPerRun(uint32_t runs, F f) {
+  double best = 1e30;
+  for (int attempt = 0; attempt < 5; attempt++) {
+    uint32_t start = ESP.getCycleCount();
+    for (uint32_t i = 0; i < runs; i++) f(i);
+    best = std::min(best, (double)(uint32_t)(ESP.getCycleCount() - start) / runs);
+  }
+  return best;
+}
+
+int main(int argc, char** argv) {
+  uint32_t runs = 2000000;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--runs") && i + 1 < argc) runs = (uint32_t)atol(argv[++i]);
+    else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  bool ok = checkBuckets();
+
+  double bare = cyclesPerRun(runs, [](uint32_t i) { sink += i; });
+  double scoped = cyclesPerRun(runs, [](uint32_t i) {
+    PERF_SCOPE(PERF_SENSOR);
+    sink += i;
+  });
+  double recorded = cyclesPerRun(runs, [](uint32_t i) { loopProfiler.record(PERF_WEB, i & 0xFFFFF); });
+
+  printf("%u runs, host cycle counter\n", runs);
+  printf("  empty body          %6.1f cycles\n", bare);
+  printf("  with PERF_SCOPE     %6.1f cycles (+%.1f)\n", scoped, scoped - bare);
+  printf("  record() alone      %6.1f cycles\n", recorded);
+
+  const PerfStageStats& s = loopProfiler.stage(PERF_SENSOR);
+  uint64_t inBuckets = 0;
+  for (uint8_t b = 0; b < PERF_BUCKETS; b++) inBuckets += s.buckets[b];
+  if (s.count != runs * 5 || inBuckets != s.count) {
+    printf("FAIL: %u scopes counted, %llu in buckets, expected %u\n", s.count,
+           (unsigned long long)inBuckets, runs * 5);
+    ok = false;
+  }
+  loopProfiler.reset();
+  if (loopProfiler.stage(PERF_SENSOR).count != 0 || loopProfiler.stage(PERF_WEB).totalCycles != 0) {
+    printf("FAIL: reset left counts\n");
+    ok = false;
+  }
+
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
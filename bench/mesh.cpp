@@ -0,0 +1,285 @@
+/*
+ * Mesh forwarding benchmark: parent alerts to children across rooms
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Plugs stand in a row --spacing metres apart, the parent at one end and
+ * the last --children plugs its children; the others are unpaired S31s
+ * that may forward. A frame between two plugs is lost with a probability
+ * rising with distance (about 50% at --range metres, walls included), each
+ * direction and copy independently. Each frame takes its airtime plus up to
+ * one SENSOR_POLL_SLICE before the receiver's loop() drains it.
+ *
+ * The parent alternates HIGH/LOW alerts and runs the sketch's logic:
+ * ReliableOutbox to each child directly, and with mesh forwarding, a child
+ * whose alert went unacknowledged gets it, and each send and resend of the
+ * next ones, as a MSG_MESH flood through MeshRouter (mesh.h) on every plug.
+ * For direct only and with the mesh it reports, per child, how many level
+ * changes were missed and the alert-to-switch latency, then the frames sent
+ * per alert, the hops mesh alerts took, and the round trip and per-hop
+ * latency the parent measured.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -std=c++17 -Ibench/host -Isonoff_s31_main \
+ *       bench/mesh.cpp sonoff_s31_main/mesh.cpp sonoff_s31_main/espnow_reliable.cpp \
+ *       sonoff_s31_main/espnow_wire.cpp -o mesh
+ *
+ * Usage:
+ *   mesh [--alerts N] [--plugs N] [--children N] [--spacing M] [--range M] [--seed N]
+ */
+
+#include <Arduino.h>
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <random>
+#include <vector>
+#include "espnow_reliable.h"
+#include "mesh.h"
+
+static const uint64_t AIRTIME_US = 600;
+
+struct Frame {
+  uint64_t at;
+  int from;
+  int to;
+  WireMessage msg;
+  bool operator>(const Frame& o) const { return at > o.at; }
+};
+
+struct Plug {
+  MeshRouter router;
+  SeqWindow fromParent;
+  bool high = false;
+};
+
+struct ChildResult {
+  unsigned long missed = 0;
+  std::vector<uint64_t> latencies;
+};
+
+struct Result {
+  std::vector<ChildResult> children;
+  unsigned long frames = 0;
+  MeshStats parentMesh;
+  uint32_t hops[MESH_MAX_HOPS + 1] = {0};
+};
+
+static void macOf(int plug, uint8_t* mac) {
+  const uint8_t base[6] = {0x5C, 0xCF, 0x7F, 0, 0, 0};
+  memcpy(mac, base, 6);
+  mac[5] = plug;
+}
+
+static Result run(bool mesh, unsigned long alerts, int plugs, int children, double spacing,
+                  double range, unsigned int seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  std::uniform_int_distribution<uint64_t> drain(0, SENSOR_POLL_SLICE * 1000);
+  std::uniform_int_distribution<uint64_t> gap(500000, 5000000);
+
+  std::priority_queue<Frame, std::vector<Frame>, std::greater<Frame>> air;
+  std::vector<Plug> nodes(plugs);
+  for (int i = 0; i < plugs; i++) {
+    uint8_t mac[6];
+    macOf(i, mac);
+    nodes[i].router.begin(mac, 1000 + i);
+  }
+  const int firstChild = plugs - children;
+  std::vector<bool> viaMesh(plugs, false);
+  std::vector<DeliveryStats> stats(plugs);
+  ReliableOutbox outbox;
+  outbox.seed(40000);
+
+  Result r;
+  r.children.resize(children);
+  uint64_t now = 0;
+  bool target = false;
+  uint64_t issued = 0;
+  std::vector<bool> reached(plugs, true);
+
+  auto lossBetween = [&](int a, int b) {
+    double d = std::abs(a - b) * spacing;
+    return 1.0 / (1.0 + std::exp(-(d - range) / 2.0));
+  };
+  // to < 0 broadcasts
+  auto transmit = [&](int from, int to, const WireMessage& msg) {
+    r.frames++;
+    for (int n = 0; n < plugs; n++) {
+      if (n == from || (to >= 0 && n != to)) continue;
+      if (unit(rng) < lossBetween(from, n)) continue;
+      air.push(Frame{now + AIRTIME_US + drain(rng), from, n, msg});
+    }
+  };
+  auto floodFrom = [&](int plug, const uint8_t* dest, uint8_t type, uint16_t seq) {
+    WireMessage env;
+    nodes[plug].router.originate(env, dest, type, seq, (uint32_t)now);
+    transmit(plug, -1, env);
+  };
+  auto applyAlert = [&](int child, bool high) {
+    nodes[child].high = high;
+    if (high == target && !reached[child]) {
+      reached[child] = true;
+      r.children[child - firstChild].latencies.push_back(now - issued);
+    }
+  };
+  auto poll = [&] {
+    outbox.poll((uint32_t)now,
+                [&](uint8_t* mac, const OutboxEntry& e) {
+                  WireMessage msg;
+                  wireDecode(e.frame, e.len, msg);
+                  transmit(0, mac[5], msg);
+                  if (viaMesh[mac[5]]) floodFrom(0, mac, e.type, e.seq);
+                },
+                [&](uint8_t* mac, const OutboxEntry& e) {
+                  if (!mesh) return;
+                  viaMesh[mac[5]] = true;
+                  floodFrom(0, mac, e.type, e.seq);
+                },
+                [&](const uint8_t* mac) { return &stats[mac[5]]; });
+  };
+
+  uint64_t nextAlert = gap(rng);
+  unsigned long sent = 0;
+  while (sent < alerts || !air.empty() || outbox.pending()) {
+    uint64_t next = now + 1000;
+    if (!air.empty()) next = std::min(next, air.top().at);
+    if (sent < alerts) next = std::min(next, nextAlert);
+    now = next;
+
+    if (sent < alerts && now >= nextAlert) {
+      for (int c = firstChild; c < plugs; c++) {
+        if (!reached[c]) r.children[c - firstChild].missed++;
+        reached[c] = false;
+      }
+      target = !target;
+      issued = now;
+      sent++;
+      nextAlert = now + gap(rng);
+
+      WireMessage msg;
+      msg.type = target ? MSG_CURRENT_HIGH : MSG_CURRENT_LOW;
+      for (int c = firstChild; c < plugs; c++) {
+        uint8_t mac[6];
+        macOf(c, mac);
+        outbox.queue(mac, msg, (uint32_t)now, &stats[c]);
+      }
+    }
+
+    while (!air.empty() && air.top().at <= now) {
+      Frame f = air.top();
+      air.pop();
+      Plug& node = nodes[f.to];
+      WireMessage& msg = f.msg;
+
+      if (msg.type == MSG_MESH) {
+        MeshAction action = node.router.receive(msg);
+        if (action == MESH_FORWARD) {
+          transmit(f.to, -1, msg);
+        } else if (action == MESH_FOR_US && msg.meshInner == MSG_ACK) {
+          node.router.recordRoundTrip(msg, (uint32_t)now);
+          outbox.ack(msg.meshOrigin, msg.seq, (uint32_t)now, &stats[msg.meshOrigin[5]]);
+        } else if (action == MESH_FOR_US) {
+          WireMessage ack;
+          node.router.reply(ack, msg, MSG_ACK);
+          transmit(f.to, -1, ack);
+          if (node.fromParent.accept(msg.seq) == SEQ_NEW) {
+            applyAlert(f.to, msg.meshInner == MSG_CURRENT_HIGH);
+          }
+        }
+        continue;
+      }
+
+      if (msg.type == MSG_ACK && f.to == 0) {
+        uint8_t mac[6];
+        macOf(f.from, mac);
+        if (outbox.ack(mac, msg.seq, (uint32_t)now, &stats[f.from])) viaMesh[f.from] = false;
+        continue;
+      }
+
+      if (f.from == 0 && f.to >= firstChild &&
+          (msg.type == MSG_CURRENT_HIGH || msg.type == MSG_CURRENT_LOW)) {
+        WireMessage ack;
+        ack.type = MSG_ACK;
+        ack.seq = msg.seq;
+        transmit(f.to, 0, ack);
+        if (node.fromParent.accept(msg.seq) == SEQ_NEW) {
+          applyAlert(f.to, msg.type == MSG_CURRENT_HIGH);
+        }
+      }
+    }
+
+    poll();
+  }
+
+  for (int c = firstChild; c < plugs; c++) {
+    if (!reached[c]) r.children[c - firstChild].missed++;
+    const MeshStats& s = nodes[c].router.stats();
+    for (int h = 0; h <= MESH_MAX_HOPS; h++) r.hops[h] += s.hops[h];
+  }
+  r.parentMesh = nodes[0].router.stats();
+  return r;
+}
+
+static double percentile(std::vector<uint64_t>& v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(p * (v.size() - 1))] / 1000.0;
+}
+
+static void report(const char* name, Result& r, unsigned long alerts, int firstChild, double spacing) {
+  printf("%s\n", name);
+  for (size_t c = 0; c < r.children.size(); c++) {
+    ChildResult& cr = r.children[c];
+    double p50 = percentile(cr.latencies, 0.5);
+    double p99 = percentile(cr.latencies, 0.99);
+    printf("  child at %4.0f m: %5lu of %lu changes missed (%6.2f%%), switch p50 %7.1f ms, p99 %7.1f ms\n",
+           (firstChild + c) * spacing, cr.missed, alerts, 100.0 * cr.missed / alerts, p50, p99);
+  }
+  printf("  %.1f frames per alert", (double)r.frames / alerts);
+  uint32_t meshDelivered = 0;
+  for (int h = 1; h <= MESH_MAX_HOPS; h++) meshDelivered += r.hops[h];
+  if (meshDelivered) {
+    printf(", mesh alerts by hops:");
+    for (int h = 1; h <= MESH_MAX_HOPS; h++) {
+      if (r.hops[h]) printf(" %d:%u", h, r.hops[h]);
+    }
+    printf("\n  mesh round trip avg %.1f ms, %.1f ms per hop",
+           r.parentMesh.rttAvgUs / 1000.0, r.parentMesh.hopUsAvg / 1000.0);
+  }
+  printf("\n");
+}
+
+int main(int argc, char** argv) {
+  unsigned long alerts = 2000;
+  int plugs = 6;
+  int children = 3;
+  double spacing = 7;
+  double range = 15;
+  unsigned int seed = 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--alerts") && i + 1 < argc) alerts = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--plugs") && i + 1 < argc) plugs = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--children") && i + 1 < argc) children = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--spacing") && i + 1 < argc) spacing = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--range") && i + 1 < argc) range = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (unsigned int)atoi(argv[++i]);
+    else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (children < 1 || children > RELIABLE_OUTBOX_SLOTS || children >= plugs) {
+    fprintf(stderr, "Need 1 to %d children and fewer than --plugs\n", RELIABLE_OUTBOX_SLOTS);
+    return 1;
+  }
+
+  printf("%lu alerts, %d plugs %.0f m apart, %d children, 50%% loss at %.0f m, TTL %d\n",
+         alerts, plugs, spacing, children, range, MESH_TTL);
+  int firstChild = plugs - children;
+  Result direct = run(false, alerts, plugs, children, spacing, range, seed);
+  report("Direct only:", direct, alerts, firstChild, spacing);
+  Result meshed = run(true, alerts, plugs, children, spacing, range, seed);
+  report("With mesh:", meshed, alerts, firstChild, spacing);
+  return 0;
+}
@@ -0,0 +1,219 @@
+/*
+ * Peer table benchmark: hash index + timer heap vs linear scans
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Replays the same ESP-NOW traffic through PeerTable (peer_table.h) and
+ * through the previous array code (a memcmp scan in addPeer, another in the
+ * receive branch, and updatePeerList scanning every peer on every loop pass
+ * and shifting the array on removal), at 10, 100 and 1000 peers. Every peer
+ * is heard about every 10 seconds, and with --churn a peer goes silent and
+ * a new one appears, so peers go offline and expire as on a real mesh.
+ *
+ * First both are run side by side and compared after every step (same
+ * peers, online state and lastSeen); then each is timed alone, reporting ns
+ * per received message and per loop pass (handleESPNOWMessages()).
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -std=c++17 -Ibench/host -Isonoff_s31_main \
+ *       bench/peer_table.cpp -o peer_table
+ *
+ * Usage:
+ *   peer_table [--messages N] [--passes N] [--churn PCT] [--seed N]
+ */
+
+#include <Arduino.h>
+#include <array>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "peer_table.h"
+
+// The code PeerTable replaced, from espnow_handler.cpp
+template <uint16_t N>
+struct LinearPeers {
+  ESPNOWPeer peers[N];
+  int count = 0;
+
+  ESPNOWPeer* add(const uint8_t* mac, unsigned long now) {
+    for (int i = 0; i < count; i++) {
+      if (memcmp(peers[i].mac, mac, 6) == 0) {
+        peers[i].lastSeen = now;
+        peers[i].isOnline = true;
+        return &peers[i];
+      }
+    }
+    if (count < N) {
+      memcpy(peers[count].mac, mac, 6);
+      peers[count].deviceId = "";
+      peers[count].lastSeen = now;
+      peers[count].isOnline = true;
+      return &peers[count++];
+    }
+    return nullptr;
+  }
+
+  // Second scan, as the MSG_DEVICE_STATE/MSG_HEARTBEAT branches did
+  void seen(const uint8_t* mac, unsigned long now) {
+    for (int i = 0; i < count; i++) {
+      if (memcmp(peers[i].mac, mac, 6) == 0) {
+        peers[i].lastSeen = now;
+        peers[i].isOnline = true;
+        break;
+      }
+    }
+  }
+
+  void remove(const uint8_t* mac) {
+    for (int i = 0; i < count; i++) {
+      if (memcmp(peers[i].mac, mac, 6) == 0) {
+        for (int j = i; j < count - 1; j++) peers[j] = peers[j + 1];
+        count--;
+        break;
+      }
+    }
+  }
+
+  void update(unsigned long now) {
+    for (int i = 0; i < count; i++) {
+      if (now - peers[i].lastSeen > PEER_OFFLINE_MS) {
+        peers[i].isOnline = false;
+        if (now - peers[i].lastSeen > PEER_EXPIRE_MS) {
+          remove(peers[i].mac);
+          i--;
+        }
+      }
+    }
+  }
+};
+
+struct Event {
+  uint8_t mac[6];
+  unsigned long time;
+};
+
+// Traffic from about 3/4 of capacity active peers, each heard every ~10s
+static std::vector<Event> traffic(uint16_t capacity, unsigned long messages, int churnPct,
+                                  std::mt19937& rng) {
+  uint16_t activeCount = capacity * 3 / 4 + 1;
+  unsigned long interval = 10000 / activeCount ? 10000 / activeCount : 1;
+  uint32_t next = 0;
+  auto fresh = [&](uint8_t* mac) {
+    // Espressif vendor prefix, NIC part sequential as on a batch of plugs
+    const uint8_t oui[3] = {0x5C, 0xCF, 0x7F};
+    memcpy(mac, oui, 3);
+    mac[3] = next >> 16;
+    mac[4] = next >> 8;
+    mac[5] = next;
+    next++;
+  };
+
+  std::vector<std::array<uint8_t, 6>> active(activeCount);
+  for (auto& mac : active) fresh(mac.data());
+  std::uniform_int_distribution<int> percent(0, 99);
+
+  std::vector<Event> events(messages);
+  unsigned long now = 0;
+  for (unsigned long n = 0; n < messages; n++) {
+    uint16_t who = rng() % activeCount;
+    if (percent(rng) < churnPct) fresh(active[who].data());
+    memcpy(events[n].mac, active[who].data(), 6);
+    now += interval;
+    events[n].time = now;
+  }
+  return events;
+}
+
+template <uint16_t N>
+static bool sameState(PeerTable<N>& table, LinearPeers<N>& linear) {
+  if (table.size() != linear.count) return false;
+  for (int i = 0; i < linear.count; i++) {
+    ESPNOWPeer* peer = table.find(linear.peers[i].mac);
+    if (!peer || peer->isOnline != linear.peers[i].isOnline ||
+        peer->lastSeen != linear.peers[i].lastSeen) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <uint16_t N>
+static int run(unsigned long messages, int passes, int churnPct, unsigned int seed) {
+  std::mt19937 rng(seed);
+  std::vector<Event> events = traffic(N, messages, churnPct, rng);
+  static PeerTable<N> table;
+  static LinearPeers<N> linear;
+
+  // Side by side
+  unsigned long mismatches = 0, expired = 0;
+  for (const Event& e : events) {
+    table.touch(e.mac, e.time);
+    linear.add(e.mac, e.time);
+    for (int p = 0; p < passes; p++) {
+      expired += table.expire(e.time + p);
+      linear.update(e.time + p);
+    }
+    if (!sameState(table, linear) && mismatches++ < 3) {
+      printf("  state differs at %lu ms\n", e.time);
+    }
+  }
+
+  // Timed alone: messages only, then messages with the loop passes between
+  // them (expiry needs the traffic), the difference is the passes
+  auto timeMessages = [&](auto&& receive, auto&& pass, bool passes_) {
+    auto start = std::chrono::steady_clock::now();
+    for (const Event& e : events) {
+      ESPNOWPeer* peer = receive(e);
+      if (peer) peer->deviceId = "";
+      for (int p = 0; passes_ && p < passes; p++) pass(e.time + p);
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  };
+  auto tableReceive = [&](const Event& e) { return table.touch(e.mac, e.time); };
+  auto tablePassFn = [&](unsigned long now) { table.expire(now); };
+  auto linearReceive = [&](const Event& e) {
+    ESPNOWPeer* peer = linear.add(e.mac, e.time);
+    linear.seen(e.mac, e.time);
+    return peer;
+  };
+  auto linearPassFn = [&](unsigned long now) { linear.update(now); };
+
+  table.clear();
+  double tableMsg = timeMessages(tableReceive, tablePassFn, false);
+  table.clear();
+  double tablePass = timeMessages(tableReceive, tablePassFn, true) - tableMsg;
+  linear.count = 0;
+  double linearMsg = timeMessages(linearReceive, linearPassFn, false);
+  linear.count = 0;
+  double linearPass = timeMessages(linearReceive, linearPassFn, true) - linearMsg;
+
+  double totalPasses = (double)messages * passes;
+  printf("%5u peers: message %7.1f ns (linear %8.1f)   loop pass %6.1f ns (linear %8.1f)   "
+         "%lu expired, %lu mismatches\n",
+         N, tableMsg * 1e9 / messages, linearMsg * 1e9 / messages,
+         tablePass * 1e9 / totalPasses, linearPass * 1e9 / totalPasses, expired, mismatches);
+  return mismatches ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+  unsigned long messages = 200000;
+  int passes = 10;
+  int churnPct = 1;
+  unsigned int seed = 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--messages") && i + 1 < argc) messages = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--passes") && i + 1 < argc) passes = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--churn") && i + 1 < argc) churnPct = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (unsigned int)atoi(argv[++i]);
+    else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  int failed = 0;
+  failed |= run<10>(messages, passes, churnPct, seed);
+  failed |= run<100>(messages, passes, churnPct, seed);
+  failed |= run<1000>(messages, passes, churnPct, seed);
+  return failed;
+}
@@ -0,0 +1,256 @@
+/*
+ * Power history check: rollups and range queries across the millis() wrap
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Feeds PowerHistory a known per-frame trace (power, voltage and current in
+ * whole storage units, so quantizing is exact) with the odd silent gap, the
+ * clock starting shortly before millis() wraps. Every simulated second it
+ * checks:
+ *   - each raw sample and each second/minute rollup in the rings against a
+ *     reference computed from the trace: min/max exact, averages rounded
+ *     as documented (a minute is the frame-weighted average of its seconds)
+ *   - that no rollup is empty and the rings are in time order
+ *   - lowerBound() plus the handler's "not after to" stop against a linear
+ *     scan of the ring by unwrapped time, for random from/to around and
+ *     inside each tier's span, and the handler's default range (all)
+ * and at the end that every closed interval made it into the rings. Fails
+ * on any mismatch. Also reports the cost of add().
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -std=c++17 -Ibench/host -Isonoff_s31_main \
+ *       bench/power_history.cpp sonoff_s31_main/power_history.cpp -o power_history
+ *
+ * Usage:
+ *   power_history [--minutes N] [--frame-ms MS] [--seed N]
+ */
+
+#include <Arduino.h>
+#include <chrono>
+#include <map>
+#include <random>
+#include <vector>
+#include "power_history.h"
+
+static const uint64_t WRAP_MS = 0x100000000ULL;
+static const uint64_t START_MS = WRAP_MS - 30 * 60000;
+
+// Expected rollup, unwrapped time
+struct Expected {
+  uint64_t time;
+  uint32_t powerSum = 0;
+  uint32_t voltageSum = 0;
+  uint32_t currentSum = 0;
+  uint16_t powerMin = 0xFFFF;
+  uint16_t powerMax = 0;
+  uint16_t samples = 0;
+
+  void add(uint16_t powerAvg, uint16_t powerLo, uint16_t powerHi, uint16_t voltage, uint16_t current,
+           uint16_t n) {
+    powerSum += (uint32_t)powerAvg * n;
+    voltageSum += (uint32_t)voltage * n;
+    currentSum += (uint32_t)current * n;
+    powerMin = std::min(powerMin, powerLo);
+    powerMax = std::max(powerMax, powerHi);
+    samples += n;
+  }
+  uint16_t avg(uint32_t sum) const { return (sum + samples / 2) / samples; }
+};
+
+static std::map<uint64_t, HistorySample> rawByTime;
+static std::map<uint64_t, Expected> secondByTime;
+static std::map<uint64_t, Expected> minuteByTime;
+static unsigned long failures = 0;
+
+static void fail(const char* what, uint64_t now) {
+  if (failures++ < 10) {
+    printf("FAIL: %s at %.3f s\n", what, (now - START_MS) / 1000.0);
+  }
+}
+
+// Unwrapped time of a ring entry, given it is no later than now
+static uint64_t unwrap(uint32_t time, uint64_t now) {
+  return now - (uint32_t)((uint32_t)now - time);
+}
+
+// Interval start in the device's own (wrapping) arithmetic, unwrapped
+static uint64_t intervalStart(uint64_t time, uint32_t ms) {
+  uint32_t t = (uint32_t)time;
+  return unwrap(t - t % ms, time);
+}
+
+static bool sameRollup(const HistoryRollup& r, const Expected& e) {
+  return r.samples == e.samples && r.powerMin == e.powerMin && r.powerMax == e.powerMax &&
+         r.powerAvg == e.avg(e.powerSum) && r.voltage == e.avg(e.voltageSum) &&
+         r.current == e.avg(e.currentSum);
+}
+
+template <typename Ring>
+static void checkOrder(const Ring& ring, uint64_t now, const char* tier) {
+  for (uint16_t i = 1; i < ring.size(); i++) {
+    if (unwrap(ring.at(i).time, now) <= unwrap(ring.at(i - 1).time, now)) {
+      fail(tier, now);
+      return;
+    }
+  }
+}
+
+template <typename Ring>
+static void checkRollups(const Ring& ring, const std::map<uint64_t, Expected>& expected, uint64_t now,
+                         const char* tier) {
+  for (uint16_t i = 0; i < ring.size(); i++) {
+    const HistoryRollup& r = ring.at(i);
+    auto it = expected.find(unwrap(r.time, now));
+    if (r.samples == 0 || it == expected.end() || !sameRollup(r, it->second)) {
+      fail(tier, now);
+      return;
+    }
+  }
+  checkOrder(ring, now, tier);
+}
+
+// The handler's loop: lowerBound(from), then while not after to
+template <typename Ring>
+static bool queryMatches(const Ring& ring, uint32_t from, uint32_t to, uint64_t from64, uint64_t to64,
+                         uint64_t now) {
+  std::vector<uint16_t> got;
+  for (uint16_t i = ring.lowerBound(from); i < ring.size() && !historyBefore(to, ring.at(i).time); i++) {
+    got.push_back(i);
+  }
+  std::vector<uint16_t> want;
+  for (uint16_t i = 0; i < ring.size(); i++) {
+    uint64_t t = unwrap(ring.at(i).time, now);
+    if (t >= from64 && t <= to64) want.push_back(i);
+  }
+  return got == want;
+}
+
+template <typename Ring>
+static void checkQueries(const Ring& ring, uint64_t now, std::mt19937& rng, const char* tier) {
+  if (ring.size() == 0) return;
+  uint64_t oldest = unwrap(ring.at(0).time, now);
+  uint64_t span = now - oldest + 1;
+  std::uniform_int_distribution<uint64_t> pick(0, span + span / 5);
+  for (int q = 0; q < 8; q++) {
+    uint64_t a = now - std::min<uint64_t>(pick(rng), now);
+    uint64_t b = now - std::min<uint64_t>(pick(rng), now);
+    uint64_t from64 = std::min(a, b);
+    uint64_t to64 = std::max(a, b);
+    if (!queryMatches(ring, (uint32_t)from64, (uint32_t)to64, from64, to64, now)) {
+      fail(tier, now);
+      return;
+    }
+  }
+  // No from/to: the handler asks for the 24 days up to now
+  uint32_t from = (uint32_t)now - 0x7FFFFFFFUL;
+  std::vector<uint16_t> all;
+  uint16_t i = ring.lowerBound(from);
+  for (; i < ring.size() && !historyBefore((uint32_t)now, ring.at(i).time); i++) all.push_back(i);
+  if (all.size() != ring.size()) fail(tier, now);
+}
+
+static void checkAll(const PowerHistory& history, uint64_t now, std::mt19937& rng) {
+  const auto& raw = history.raw();
+  for (uint16_t i = 0; i < raw.size(); i++) {
+    const HistorySample& s = raw.at(i);
+    auto it = rawByTime.find(unwrap(s.time, now));
+    if (it == rawByTime.end() || it->second.power != s.power || it->second.voltage != s.voltage ||
+        it->second.current != s.current) {
+      fail("raw sample", now);
+      break;
+    }
+  }
+  checkOrder(raw, now, "raw order");
+  checkRollups(history.seconds(), secondByTime, now, "second rollup");
+  checkRollups(history.minutes(), minuteByTime, now, "minute rollup");
+  checkQueries(raw, now, rng, "raw query");
+  checkQueries(history.seconds(), now, rng, "second query");
+  checkQueries(history.minutes(), now, rng, "minute query");
+}
+
+int main(int argc, char** argv) {
+  double minutes = 90;
+  uint32_t frameMs = 100;
+  unsigned int seed = 1;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--minutes") && i + 1 < argc) minutes = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--frame-ms") && i + 1 < argc) frameMs = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (unsigned int)atoi(argv[++i]);
+    else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  std::mt19937 rng(seed);
+  std::mt19937 queryRng(seed + 1);
+  std::uniform_int_distribution<int> jitter(-(int)frameMs / 4, (int)frameMs / 4);
+  std::uniform_real_distribution<double> u(0, 1);
+  static PowerHistory history;
+
+  uint64_t end = START_MS + (uint64_t)(minutes * 60000);
+  uint64_t now = START_MS;
+  uint64_t nextFrame = now;
+  uint64_t nextCheck = now + 1000;
+  uint64_t gapUntil = 0;
+  uint16_t power = 500;
+  unsigned long frames = 0;
+  double addNs = 0;
+
+  for (; now < end; now++) {
+    if (now >= nextFrame && now >= gapUntil) {
+      // A load wandering in 0.1 W steps, now and then switching
+      if (u(rng) < 0.002) power = u(rng) < 0.5 ? 0 : (uint16_t)(u(rng) * 20000);
+      power = (uint16_t)std::max(0, std::min(30000, (int)power + (int)(u(rng) * 41) - 20));
+      uint16_t voltage = (uint16_t)(2250 + u(rng) * 100);
+      uint16_t current = (uint16_t)((uint32_t)power * 1000 / voltage);
+
+      auto t0 = std::chrono::steady_clock::now();
+      history.add((uint32_t)now, voltage / 10.0f, current / 1000.0f, power / 10.0f);
+      addNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+      frames++;
+
+      rawByTime[now] = {(uint32_t)now, power, voltage, current};
+      uint64_t second = intervalStart(now, 1000);
+      secondByTime.emplace(second, Expected{second}).first->second.add(power, power, power, voltage,
+                                                                       current, 1);
+      // A minute is its seconds, frame-weighted; rebuild it from them
+      uint64_t minute = intervalStart(second, 60000);
+      Expected m{minute};
+      for (auto it = secondByTime.lower_bound(minute); it != secondByTime.end(); ++it) {
+        if (intervalStart(it->first, 60000) != minute) break;
+        const Expected& e = it->second;
+        m.add(e.avg(e.powerSum), e.powerMin, e.powerMax, e.avg(e.voltageSum), e.avg(e.currentSum),
+              e.samples);
+      }
+      minuteByTime[minute] = m;
+
+      nextFrame = now + frameMs + jitter(rng);
+      if (u(rng) < 0.0003) gapUntil = now + 2000 + (uint64_t)(u(rng) * 120000);  // sensor quiet
+    }
+    if (now % 100 == 0) {
+      history.update((uint32_t)now);                       // the readings task
+    }
+    if (now >= nextCheck) {
+      checkAll(history, now, queryRng);
+      nextCheck += 1000;
+    }
+  }
+
+  // Close the last intervals, then every closed one must be there
+  now += 61000;
+  history.update((uint32_t)now);
+  checkAll(history, now, queryRng);
+  size_t seconds = std::min<size_t>(secondByTime.size(), HISTORY_SECOND_SAMPLES);
+  size_t minutesKept = std::min<size_t>(minuteByTime.size(), HISTORY_MINUTE_SAMPLES);
+  if (history.seconds().size() != seconds || history.minutes().size() != minutesKept) {
+    fail("rollup count", now);
+  }
+
+  printf("%lu frames over %.0f min, millis() wrapping at %.0f min\n", frames, minutes,
+         (WRAP_MS - START_MS) / 60000.0);
+  printf("  rollups: %zu seconds, %zu minutes (rings hold %u, %u)\n", secondByTime.size(),
+         minuteByTime.size(), HISTORY_SECOND_SAMPLES, HISTORY_MINUTE_SAMPLES);
+  printf("  add(): %.1f ns per frame\n", addNs / frames);
+  printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,257 @@
+/*
+ * Main loop benchmark: fixed 100 ms passes vs. the task scheduler
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Models the sketch's main loop work with fixed run costs on the virtual
+ * clock, fed with web requests, button presses and received ESP-NOW frames
+ * at random times, two ways:
+ *   - as before: every subsystem once per pass, then ten SENSOR_POLL_SLICE
+ *     slices of sensor poll and ESP-NOW drain with delay() between
+ *   - through TaskScheduler (scheduler.h) with the periods and deadlines
+ *     initTasks() registers, loop() sleeping until the next task is due
+ * and reports, for each input, the wait from its arrival to the start of
+ * the task that handles it (p50/p99/max), and the scheduler's misses. With
+ * --mqtt-down the broker is unreachable: the old loop blocks for three
+ * failed connects every 10 s, the scheduled one makes single attempts
+ * bounded by MQTT_CONNECT_TIMEOUT_MS, backing off (connection.h).
+ *
+ * The clock starts just before micros() wraps. Fails if a task's runs and
+ * skipped runs stray from the elapsed time over its period.
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -std=c++17 -Ibench/host -Isonoff_s31_main \
+ *       bench/scheduler.cpp sonoff_s31_main/scheduler.cpp \
+ *       sonoff_s31_main/connection.cpp -o scheduler
+ *
+ * Usage:
+ *   scheduler [--seconds N] [--web-per-s N] [--frames-per-s N] [--mqtt-down] [--seed N]
+ */
+
+#include <Arduino.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "scheduler.h"
+#include "connection.h"
+
+// Run costs, microseconds
+static const uint32_t COST_SENSOR = 150;         // UART drain, decode, automation
+static const uint32_t COST_DRAIN = 60;           // empty ESP-NOW queue, resend checks
+static const uint32_t COST_FRAME = 500;          // one received frame processed
+static const uint32_t COST_BUTTON = 10;
+static const uint32_t COST_WEB = 40;             // no client waiting
+static const uint32_t COST_REQUEST = 6000;       // one API request served
+static const uint32_t COST_NETWORK = 250;        // OTA and mDNS polls
+static const uint32_t COST_PEERS = 300;          // peer expiry, beacon check
+static const uint32_t COST_SMALL = 20;           // pairing, LED, readings
+static const uint32_t COST_POWER_LOG = 2000;
+static const uint32_t COST_MQTT = 30;
+static const uint32_t COST_MQTT_FAIL = 300000;   // three connect attempts, 100 ms apart
+static const uint32_t LOOP_OVERHEAD_US = 5;      // loop() return and call by the core
+static const uint64_t START_US = 0xFFFFFFFFULL - 2000000;
+
+enum Input { INPUT_WEB, INPUT_BUTTON, INPUT_FRAME, INPUTS };
+static const char* const INPUT_NAMES[INPUTS] = {"web request", "button press", "espnow frame"};
+
+struct Arrivals {
+  std::vector<uint64_t> at;
+  size_t next = 0;
+  std::vector<uint64_t> wait;
+};
+
+static Arrivals inputs[INPUTS];
+static bool mqttDown = false;
+static uint64_t lastMqttFail = 0;
+
+// Handle every input of kind that arrived by now
+static void serve(Input kind, uint32_t costEach) {
+  Arrivals& a = inputs[kind];
+  uint64_t start = hostMicros;
+  while (a.next < a.at.size() && a.at[a.next] <= start) {
+    a.wait.push_back(start - a.at[a.next]);
+    a.next++;
+    hostAdvanceMicros(costEach);
+  }
+}
+
+static void sensorTask() { hostAdvanceMicros(COST_SENSOR); }
+static void espnowTask() { serve(INPUT_FRAME, COST_FRAME); hostAdvanceMicros(COST_DRAIN); }
+static void buttonTask() { serve(INPUT_BUTTON, COST_BUTTON); hostAdvanceMicros(COST_BUTTON); }
+static void webTask() { serve(INPUT_WEB, COST_REQUEST); hostAdvanceMicros(COST_WEB); }
+static void networkTask() { hostAdvanceMicros(COST_NETWORK); }
+static void peersTask() { espnowTask(); hostAdvanceMicros(COST_PEERS); }
+static void smallTask() { hostAdvanceMicros(COST_SMALL); }
+static void powerLogTask() { hostAdvanceMicros(COST_POWER_LOG); }
+
+static void mqttTask() {
+  if (mqttDown && (lastMqttFail == 0 || hostMicros - lastMqttFail >= 10000000)) {
+    lastMqttFail = hostMicros;
+    hostAdvanceMicros(COST_MQTT_FAIL);
+  } else {
+    hostAdvanceMicros(COST_MQTT);
+  }
+}
+
+// The scheduled loop's WiFi/MQTT check, WiFi up
+static ConnectionManager mqttLink(0, MQTT_RETRY_MIN_MS, MQTT_RETRY_MAX_MS);
+
+static void connectTask() {
+  mqttLink.start(millis());
+  if (mqttLink.update(!mqttDown, millis())) {
+    hostAdvanceMicros(MQTT_CONNECT_TIMEOUT_MS * 1000UL);
+    mqttLink.failed(millis());
+  }
+  hostAdvanceMicros(COST_MQTT);
+}
+
+static void resetInputs() {
+  for (Arrivals& a : inputs) {
+    a.next = 0;
+    a.wait.clear();
+  }
+  lastMqttFail = 0;
+}
+
+// The loop() this replaced
+static void runFixed(uint64_t end) {
+  uint64_t lastReadings = 0;
+  uint64_t lastLog = 0;
+  while (hostMicros < end) {
+    networkTask();
+    webTask();
+    mqttTask();
+    buttonTask();
+    sensorTask();
+    if (hostMicros - lastReadings > 1000000) {
+      smallTask();
+      lastReadings = hostMicros;
+      if (hostMicros - lastLog > 10000000) {
+        powerLogTask();
+        lastLog = hostMicros;
+      }
+    }
+    peersTask();
+    smallTask();                                 // child turn-off
+    smallTask();                                 // pairing
+    smallTask();                                 // LED
+    uint64_t idleStart = hostMicros;
+    while (hostMicros - idleStart < 100000) {
+      sensorTask();
+      espnowTask();
+      delay(SENSOR_POLL_SLICE);
+    }
+  }
+}
+
+static unsigned long clockUs() { return micros(); }
+
+static bool runScheduled(uint64_t end) {
+  TaskScheduler scheduler(clockUs);
+  scheduler.add("sensor", sensorTask, SENSOR_POLL_SLICE, SENSOR_POLL_SLICE);
+  scheduler.add("espnow", espnowTask, TASK_ESPNOW_MS, TASK_ESPNOW_MS);
+  scheduler.add("button", buttonTask, TASK_INPUT_MS, 2 * TASK_INPUT_MS);
+  scheduler.add("web", webTask, TASK_INPUT_MS, 5 * TASK_INPUT_MS);
+  scheduler.add("network", networkTask, TASK_NETWORK_MS, 2 * TASK_NETWORK_MS);
+  scheduler.add("peers", peersTask, TASK_PEERS_MS, TASK_PEERS_MS);
+  scheduler.add("pairing", smallTask, TASK_PEERS_MS, TASK_PEERS_MS);
+  scheduler.add("led", smallTask, PAIRING_LED_FAST_BLINK, PAIRING_LED_FAST_BLINK / 2);
+  scheduler.add("readings", smallTask, TASK_READINGS_MS, TASK_READINGS_MS / 2);
+  scheduler.add("powerLog", powerLogTask, TASK_POWER_LOG_MS, TASK_POWER_LOG_MS / 2);
+  scheduler.add("connect", connectTask, TASK_CONNECT_MS, TASK_CONNECT_MS);
+
+  uint64_t start = hostMicros;
+  while (hostMicros < end) {
+    uint32_t wait = scheduler.runNext();
+    if (wait >= 1000) {
+      delay(wait / 1000);
+    }
+    hostAdvanceMicros(LOOP_OVERHEAD_US);
+  }
+  double elapsed = (double)(hostMicros - start);
+
+  bool ok = true;
+  printf("  %-9s %6s %6s %7s %6s %8s %8s %8s %8s\n", "task", "period", "runs", "skipped", "misses",
+         "lateAvg", "lateMax", "runAvg", "runMax");
+  for (uint8_t i = 0; i < scheduler.size(); i++) {
+    const SchedulerTask& t = scheduler.task(i);
+    const TaskStats& s = t.stats;
+    printf("  %-9s %6u %6u %7u %6u %8.2f %8.2f %8.2f %8.2f\n", t.name, t.periodUs / 1000, s.runs,
+           s.skipped, s.misses, s.runs ? s.lateTotalUs / 1000.0 / s.runs : 0, s.lateMaxUs / 1000.0,
+           s.runs ? s.runTotalUs / 1000.0 / s.runs : 0, s.runMaxUs / 1000.0);
+    double expected = elapsed / t.periodUs;
+    if (fabs(s.runs + s.skipped - expected) > 2) {
+      printf("  FAIL: %s ran %u + %u skipped times, expected %.0f\n", t.name, s.runs, s.skipped, expected);
+      ok = false;
+    }
+  }
+  printf("  MQTT attempts %u\n", mqttLink.stats().attempts);
+  printf("  busy %.1f%% of %.0f s\n", 100.0 * scheduler.busyUs() / scheduler.elapsedUs(),
+         scheduler.elapsedUs() / 1e6);
+  return ok;
+}
+
+static double percentile(std::vector<uint64_t> v, double p) {
+  if (v.empty()) return 0;
+  size_t k = std::min(v.size() - 1, (size_t)(p / 100 * v.size()));
+  std::nth_element(v.begin(), v.begin() + k, v.end());
+  return v[k] / 1000.0;
+}
+
+static void printWaits(const char* scheme) {
+  for (int i = 0; i < INPUTS; i++) {
+    const std::vector<uint64_t>& w = inputs[i].wait;
+    uint64_t worst = w.empty() ? 0 : *std::max_element(w.begin(), w.end());
+    printf("%-10s %-13s %7zu %8.2f %8.2f %8.2f\n", scheme, INPUT_NAMES[i], w.size(),
+           percentile(w, 50), percentile(w, 99), worst / 1000.0);
+  }
+}
+
+int main(int argc, char** argv) {
+  double seconds = 600;
+  double webPerSecond = 1;
+  double framesPerSecond = 5;
+  double pressesPerSecond = 0.2;
+  unsigned int seed = 1;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--seconds") && i + 1 < argc) seconds = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--web-per-s") && i + 1 < argc) webPerSecond = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--frames-per-s") && i + 1 < argc) framesPerSecond = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--mqtt-down")) mqttDown = true;
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (unsigned int)atoi(argv[++i]);
+    else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  std::mt19937 rng(seed);
+  const double rates[INPUTS] = {webPerSecond, pressesPerSecond, framesPerSecond};
+  uint64_t end = START_US + (uint64_t)(seconds * 1e6);
+  for (int i = 0; i < INPUTS; i++) {
+    if (rates[i] <= 0) continue;
+    std::exponential_distribution<double> gap(rates[i] / 1e6);
+    for (double t = START_US + gap(rng); t < end; t += gap(rng)) {
+      inputs[i].at.push_back((uint64_t)t);
+    }
+  }
+
+  printf("%.0f s, MQTT %s\n", seconds, mqttDown ? "down" : "up");
+  hostMicros = START_US;
+  runFixed(end);
+  std::vector<Arrivals> fixed(inputs, inputs + INPUTS);
+
+  resetInputs();
+  hostMicros = START_US;
+  printf("scheduled tasks (ms):\n");
+  bool ok = runScheduled(end);
+
+  printf("\n%-10s %-13s %7s %8s %8s %8s\n", "Loop", "Input", "count", "p50 ms", "p99 ms", "max ms");
+  std::vector<Arrivals> scheduled(inputs, inputs + INPUTS);
+  std::copy(fixed.begin(), fixed.end(), inputs);
+  printWaits("fixed");
+  std::copy(scheduled.begin(), scheduled.end(), inputs);
+  printWaits("scheduled");
+
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
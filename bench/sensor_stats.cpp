@@ -0,0 +1,152 @@
+/*
+ * Sensor statistics benchmark: threshold toggles, raw vs smoothed current
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Synthesizes a per-frame current trace for a small load switching on and
+ * off around CURRENT_THRESHOLD: gaussian noise plus frames the CSE7766
+ * current gate zeroes (P/V <= 0.05). Counts how often the raw reading and
+ * the EWMA from sensor_stats.h cross the threshold, and how often the EWMA
+ * through the hysteresis/debounce state machine in current_automation.h
+ * would alert the children: how many of those were false (not at a real
+ * on/off step), the frames it took to follow each real step, and the cost
+ * per frame of SensorStats::add().
+ *
+ * Build (from the repository root):
+ *   g++ -O2 -std=c++17 -Ibench/host -Isonoff_s31_main \
+ *       bench/sensor_stats.cpp sonoff_s31_main/sensor_stats.cpp \
+ *       sonoff_s31_main/current_automation.cpp -o sensor_stats
+ *
+ * Usage:
+ *   sensor_stats [--frames N] [--on AMPS] [--noise AMPS] [--dropout PCT]
+ *                [--period FRAMES] [--frame-ms MS] [--seed N]
+ */
+
+#include <Arduino.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "sensor_stats.h"
+#include "current_automation.h"
+
+// Crossing counter for one signal
+struct Toggles {
+  bool high = false;
+  bool pending = false;          // a real step has not been followed yet
+  unsigned long stepFrame = 0;
+  unsigned long total = 0;
+  unsigned long falseToggles = 0;
+  unsigned long followed = 0;
+  unsigned long lagFrames = 0;
+
+  void step(unsigned long frame) {
+    pending = true;
+    stepFrame = frame;
+  }
+
+  void update(float current, bool truth, unsigned long frame) {
+    level(current >= CURRENT_THRESHOLD, truth, frame);
+  }
+
+  void level(bool now, bool truth, unsigned long frame) {
+    if (now == high) return;
+    high = now;
+    total++;
+    if (pending && now == truth) {
+      pending = false;
+      followed++;
+      lagFrames += frame - stepFrame;
+    } else {
+      falseToggles++;
+    }
+  }
+};
+
+int main(int argc, char** argv) {
+  unsigned long frames = 200000;
+  float onCurrent = 0.11f;     // LED lamp, per the CURRENT_THRESHOLD note
+  float noise = 0.02f;
+  int dropoutPct = 3;
+  unsigned long period = 600;  // frames between on/off steps (~1 minute)
+  unsigned long frameMs = 105; // 24 bytes at 4800 8E1 plus the gap between frames
+  unsigned int seed = 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--frames") && i + 1 < argc) frames = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--on") && i + 1 < argc) onCurrent = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--noise") && i + 1 < argc) noise = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--dropout") && i + 1 < argc) dropoutPct = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--period") && i + 1 < argc) period = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--frame-ms") && i + 1 < argc) frameMs = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = (unsigned int)atoi(argv[++i]);
+    else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> gauss(0.0f, noise);
+  std::uniform_int_distribution<int> percent(0, 99);
+
+  std::vector<float> trace(frames);
+  std::vector<uint8_t> truth(frames);
+  for (unsigned long n = 0; n < frames; n++) {
+    bool on = (n / period) & 1;
+    float current = 0;
+    if (on && percent(rng) >= dropoutPct) {
+      current = onCurrent + gauss(rng);
+      if (current < 0) current = 0;
+    }
+    trace[n] = current;
+    truth[n] = on;
+  }
+
+  SensorStats stats;
+  Toggles raw, smoothed, debounced;
+  CurrentAutomation automation;
+  unsigned long steps = 0;
+  double p95Error = 0;
+  unsigned long p95Checks = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned long n = 0; n < frames; n++) {
+    if (n > 0 && truth[n] != truth[n - 1]) {
+      raw.step(n);
+      smoothed.step(n);
+      debounced.step(n);
+      steps++;
+    }
+    float voltage = 230.0f;
+    stats.add(voltage, trace[n], trace[n] * voltage * 0.6f);
+    raw.update(trace[n], truth[n], n);
+    smoothed.update(stats.current.ewma(), truth[n], n);
+    unsigned long now = n * frameMs;
+    updateCurrentAutomation(automation, stats.current.ewma(), now * 1000, now);
+    debounced.level(currentAutomationHigh(automation), truth[n], n);
+
+    // Mid-"on" periods, p95 should sit near on + 1.645 sigma
+    if (truth[n] && n % period == period - 1 && n >= 2 * STATS_QUANTILE_FRAMES) {
+      p95Error += fabs(stats.current.p95() - (onCurrent + 1.645f * noise));
+      p95Checks++;
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("Frames:           %lu (%lu on/off steps, threshold %.3fA, on %.3fA +- %.3fA, %d%% gated)\n",
+         frames, steps, (double)CURRENT_THRESHOLD, onCurrent, noise, dropoutPct);
+  printf("Raw current:      %lu toggles, %lu false, %.2f frames to follow a step\n",
+         raw.total, raw.falseToggles, raw.followed ? (double)raw.lagFrames / raw.followed : 0.0);
+  printf("EWMA (a=%.2f):    %lu toggles, %lu false, %.2f frames to follow a step\n",
+         (double)STATS_EWMA_ALPHA, smoothed.total, smoothed.falseToggles,
+         smoothed.followed ? (double)smoothed.lagFrames / smoothed.followed : 0.0);
+  printf("EWMA + band:      %lu alerts, %lu false, %.2f frames to follow a step "
+         "(band %.3f-%.3fA, debounce %dms, dwell %dms)\n",
+         debounced.total, debounced.falseToggles,
+         debounced.followed ? (double)debounced.lagFrames / debounced.followed : 0.0,
+         (double)(CURRENT_THRESHOLD - CURRENT_HYSTERESIS), (double)CURRENT_THRESHOLD,
+         CURRENT_DEBOUNCE_MS, CURRENT_MIN_DWELL_MS);
+  if (p95Checks) {
+    printf("P2 p95:           mean error %.4fA vs the gaussian p95\n", p95Error / p95Checks);
+  }
+  printf("Cost:             %.1f ns per SensorStats::add()\n", seconds * 1e9 / frames);
+  return 0;
+}
@@ -0,0 +1,230 @@
+/*
+ * Virtual ESP-NOW radio for host simulations
+ * For SONOFF S31 ESP8266 Project
+ */
+
+#include "virtual_radio.h"
+#include <ESP8266WiFi.h>
+#include <cmath>
+#include "espnow_wire.h"
+
+// 802.11 framing around the payload and the MAC ACK, as in espnow_wire.cpp
+static const double FRAME_OVERHEAD_BYTES = 24 + 15 + 4;
+static const double PREAMBLE_US = 192;
+static const uint64_t MAC_ACK_US = 10 + 192 + 14 * 8;   // SIFS, preamble, ACK frame
+
+static const uint8_t BROADCAST[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+static VirtualRadio* activeRadio = nullptr;
+
+VirtualRadio::VirtualRadio(const RadioConfig& config, uint32_t seed)
+    : _config(config), _rng(seed), _unit(0.0, 1.0) {
+  activeRadio = this;
+}
+
+VirtualRadio::~VirtualRadio() {
+  if (activeRadio == this) activeRadio = nullptr;
+}
+
+VirtualRadio* VirtualRadio::active() {
+  return activeRadio;
+}
+
+int VirtualRadio::add(const uint8_t* mac, double x, double y) {
+  Node node;
+  memcpy(node.mac, mac, 6);
+  node.x = x;
+  node.y = y;
+  _nodes.push_back(node);
+  return (int)_nodes.size() - 1;
+}
+
+double VirtualRadio::distance(int a, int b) const {
+  return std::hypot(_nodes[a].x - _nodes[b].x, _nodes[a].y - _nodes[b].y);
+}
+
+bool VirtualRadio::lost(int from, int to) {
+  double d = distance(from, to);
+  double p = _config.lossPct / 100.0 + 1.0 / (1.0 + std::exp(-(d - _config.range) / 2.0));
+  return _unit(_rng) < p;
+}
+
+uint64_t VirtualRadio::airtimeUs(size_t len) const {
+  return (uint64_t)((PREAMBLE_US + (len + FRAME_OVERHEAD_BYTES) * 8) / _config.rateMbps);
+}
+
+int VirtualRadio::find(const uint8_t* mac) const {
+  for (size_t i = 0; i < _nodes.size(); i++) {
+    if (memcmp(_nodes[i].mac, mac, 6) == 0) return (int)i;
+  }
+  return -1;
+}
+
+void VirtualRadio::schedule(uint64_t at, int node, bool sendDone, uint8_t status,
+                            const std::shared_ptr<Frame>& frame) {
+  _events.push(Event{at, _order++, node, sendDone, status, frame});
+}
+
+void VirtualRadio::dispatch() {
+  while (!_events.empty() && _events.top().at <= hostMicros) {
+    Event e = _events.top();
+    _events.pop();
+    Node& node = _nodes[e.node];
+    if (!node.started) continue;
+
+    as(e.node, [&] {
+      if (e.sendDone) {
+        if (node.sent) node.sent(e.frame->to, e.status);
+      } else if (node.recv) {
+        node.recv(e.frame->from, e.frame->data, e.frame->len);
+      }
+    });
+  }
+}
+
+int VirtualRadio::init() {
+  _nodes[_current].started = true;
+  return 0;
+}
+
+int VirtualRadio::deinit() {
+  Node& node = _nodes[_current];
+  node.started = false;
+  node.recv = nullptr;
+  node.sent = nullptr;
+  node.peers.clear();
+  return 0;
+}
+
+int VirtualRadio::setRecv(esp_now_recv_cb_t cb) {
+  _nodes[_current].recv = cb;
+  return 0;
+}
+
+int VirtualRadio::setSent(esp_now_send_cb_t cb) {
+  _nodes[_current].sent = cb;
+  return 0;
+}
+
+int VirtualRadio::addPeer(const uint8_t* mac) {
+  Node& node = _nodes[_current];
+  if (hasPeer(mac)) return 0;
+  if (node.peers.size() >= RADIO_MAX_PEERS) {
+    _stats.peerRefused++;
+    return -1;
+  }
+  std::array<uint8_t, 6> peer;
+  memcpy(peer.data(), mac, 6);
+  node.peers.push_back(peer);
+  return 0;
+}
+
+int VirtualRadio::delPeer(const uint8_t* mac) {
+  std::vector<std::array<uint8_t, 6>>& peers = _nodes[_current].peers;
+  for (size_t i = 0; i < peers.size(); i++) {
+    if (memcmp(peers[i].data(), mac, 6) == 0) {
+      peers.erase(peers.begin() + i);
+      return 0;
+    }
+  }
+  return -1;
+}
+
+bool VirtualRadio::hasPeer(const uint8_t* mac) const {
+  for (const auto& peer : _nodes[_current].peers) {
+    if (memcmp(peer.data(), mac, 6) == 0) return true;
+  }
+  return false;
+}
+
+void VirtualRadio::selfMac(uint8_t* mac) const {
+  memcpy(mac, _nodes[_current].mac, 6);
+}
+
+int VirtualRadio::send(const uint8_t* da, const uint8_t* data, int len) {
+  const int self = _current;
+  if (!_nodes[self].started || len <= 0 || len > RADIO_MAX_PAYLOAD || !hasPeer(da)) {
+    _stats.rejected++;
+    return -1;
+  }
+
+  auto frame = std::make_shared<Frame>();
+  memcpy(frame->from, _nodes[self].mac, 6);
+  memcpy(frame->to, da, 6);
+  frame->len = (uint8_t)len;
+  memcpy(frame->data, data, len);
+
+  uint8_t type = wireIsV2(data, len) ? data[1] : data[0];
+  _stats.frames++;
+  _stats.bytes += len;
+  _stats.typeFrames[type % RADIO_TYPES]++;
+  _stats.typeBytes[type % RADIO_TYPES] += len;
+
+  uint64_t start = std::max(hostMicros, _channelFree);
+  if (start - hostMicros > _stats.maxWaitUs) _stats.maxWaitUs = start - hostMicros;
+  uint64_t air = airtimeUs(len);
+
+  if (memcmp(da, BROADCAST, 6) == 0) {
+    uint64_t end = start + air;
+    for (int n = 0; n < (int)_nodes.size(); n++) {
+      if (n == self || !_nodes[n].started) continue;
+      bool inRange = distance(self, n) <= _config.range;
+      _stats.broadcastCopies += inRange;
+      if (lost(self, n)) continue;
+      _stats.broadcastHeard += inRange;
+      schedule(end + _config.latencyUs, n, false, 0, frame);
+    }
+    _channelFree = end;
+    _stats.busyUs += air;
+    schedule(end, self, true, 0, frame);
+    return 0;
+  }
+
+  // Unicast: resent until the receiver's MAC ACK gets back
+  _stats.unicasts++;
+  int to = find(da);
+  bool heard = false;
+  uint8_t status = 1;
+  uint64_t t = start;
+  for (uint8_t attempt = 0; attempt <= _config.macRetries; attempt++) {
+    if (attempt) _stats.macRetries++;
+    t += air;
+    bool arrived = to >= 0 && _nodes[to].started && !lost(self, to);
+    if (arrived && !heard) {
+      heard = true;                        // later copies are MAC duplicates
+      schedule(t + _config.latencyUs, to, false, 0, frame);
+    }
+    t += MAC_ACK_US;
+    if (arrived && !lost(to, self)) {
+      status = 0;
+      break;
+    }
+  }
+  if (status) _stats.unicastFailed++;
+  _stats.busyUs += t - start;
+  _channelFree = t;
+  schedule(t, self, true, status, frame);
+  return 0;
+}
+
+// ===== SDK AND WIFI ENTRY POINTS =====
+
+void hostMacAddress(uint8_t* mac) {
+  VirtualRadio::active()->selfMac(mac);
+}
+
+extern "C" {
+
+int esp_now_init(void) { return VirtualRadio::active()->init(); }
+int esp_now_deinit(void) { return VirtualRadio::active()->deinit(); }
+int esp_now_register_recv_cb(esp_now_recv_cb_t cb) { return VirtualRadio::active()->setRecv(cb); }
+int esp_now_unregister_recv_cb(void) { return VirtualRadio::active()->setRecv(nullptr); }
+int esp_now_register_send_cb(esp_now_send_cb_t cb) { return VirtualRadio::active()->setSent(cb); }
+int esp_now_unregister_send_cb(void) { return VirtualRadio::active()->setSent(nullptr); }
+int esp_now_send(u8* da, u8* data, int len) { return VirtualRadio::active()->send(da, data, len); }
+int esp_now_add_peer(u8* mac_addr, u8, u8, u8*, u8) { return VirtualRadio::active()->addPeer(mac_addr); }
+int esp_now_del_peer(u8* mac_addr) { return VirtualRadio::active()->delPeer(mac_addr); }
+int esp_now_set_self_role(u8) { return 0; }
+int esp_now_is_peer_exist(u8* mac_addr) { return VirtualRadio::active()->hasPeer(mac_addr) ? 1 : 0; }
+
+}
@@ -0,0 +1,147 @@
+/*
+ * Virtual ESP-NOW radio for host simulations
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Implements the SDK's esp_now_* functions (host/espnow.h) and WiFi's MAC
+ * address (host/ESP8266WiFi.h) over one simulated channel shared by every
+ * plug:
+ *   - a frame waits for the channel to be free, then takes its airtime at
+ *     rateMbps after a long preamble
+ *   - each copy is lost with lossPct, plus a loss rising with distance
+ *     (half the frames at range metres, walls included)
+ *   - a broadcast reaches every plug that does not lose it; a unicast is
+ *     acknowledged by the receiver and retried up to macRetries times, the
+ *     send callback getting 0 only if an acknowledgement came back
+ *   - the receive callback runs latencyUs after the frame ends, the send
+ *     callback when the channel is released
+ * As on the ESP8266, sends go only to registered peers (broadcast
+ * included), and at most RADIO_MAX_PEERS of them.
+ *
+ * The esp_now_* functions act for the current plug: the simulation runs
+ * each plug's code inside as(plug, ...). Time is the host virtual clock.
+ */
+
+#ifndef VIRTUAL_RADIO_H
+#define VIRTUAL_RADIO_H
+
+#include <Arduino.h>
+#include <espnow.h>
+#include <array>
+#include <memory>
+#include <queue>
+#include <random>
+#include <vector>
+
+#define RADIO_MAX_PEERS 20                 // the SDK's limit for unencrypted peers
+#define RADIO_MAX_PAYLOAD 250
+#define RADIO_TYPES 16                     // counted by message type byte
+
+struct RadioConfig {
+  double lossPct = 1;                      // copies lost at any distance
+  double range = 30;                       // metres at which half the copies are lost
+  double rateMbps = 1;
+  uint32_t latencyUs = 100;                // end of frame to receive callback
+  uint8_t macRetries = 3;                  // unicast resends after a missing MAC ACK
+};
+
+struct RadioStats {
+  uint64_t frames = 0;                     // sends put on the air
+  uint64_t bytes = 0;
+  uint64_t busyUs = 0;                     // channel time, retries and MAC ACKs included
+  uint64_t maxWaitUs = 0;                  // longest wait for the channel
+  uint64_t broadcastCopies = 0;            // broadcast frames times plugs within range
+  uint64_t broadcastHeard = 0;             // of those, received
+  uint64_t unicasts = 0;
+  uint64_t unicastFailed = 0;              // no MAC ACK after the retries
+  uint64_t macRetries = 0;
+  uint64_t rejected = 0;                   // esp_now_send refused: no such peer, not started
+  uint64_t peerRefused = 0;                // esp_now_add_peer over RADIO_MAX_PEERS
+  uint64_t typeFrames[RADIO_TYPES] = {0};
+  uint64_t typeBytes[RADIO_TYPES] = {0};
+};
+
+class VirtualRadio {
+public:
+  explicit VirtualRadio(const RadioConfig& config, uint32_t seed = 1);
+  ~VirtualRadio();
+
+  // A plug at (x, y) metres; returns its index
+  int add(const uint8_t* mac, double x, double y);
+  size_t size() const { return _nodes.size(); }
+  const uint8_t* mac(int node) const { return _nodes[node].mac; }
+  double distance(int a, int b) const;
+
+  // Run f as node: its esp_now_* calls and callbacks are that plug's
+  template <typename F>
+  void as(int node, F f) {
+    int previous = _current;
+    _current = node;
+    f();
+    _current = previous;
+  }
+  int current() const { return _current; }
+
+  // Time of the next callback due, UINT64_MAX if none
+  uint64_t nextEvent() const { return _events.empty() ? UINT64_MAX : _events.top().at; }
+
+  // Run every callback due by the virtual clock
+  void dispatch();
+
+  const RadioStats& stats() const { return _stats; }
+
+  // For the esp_now_* functions
+  static VirtualRadio* active();
+  int init();
+  int deinit();
+  int setRecv(esp_now_recv_cb_t cb);
+  int setSent(esp_now_send_cb_t cb);
+  int addPeer(const uint8_t* mac);
+  int delPeer(const uint8_t* mac);
+  bool hasPeer(const uint8_t* mac) const;
+  int send(const uint8_t* da, const uint8_t* data, int len);
+  void selfMac(uint8_t* mac) const;
+
+private:
+  struct Node {
+    uint8_t mac[6];
+    double x, y;
+    bool started = false;
+    esp_now_recv_cb_t recv = nullptr;
+    esp_now_send_cb_t sent = nullptr;
+    std::vector<std::array<uint8_t, 6>> peers;
+  };
+
+  struct Frame {
+    uint8_t from[6];
+    uint8_t to[6];
+    uint8_t len;
+    uint8_t data[RADIO_MAX_PAYLOAD];
+  };
+
+  struct Event {
+    uint64_t at;
+    uint64_t order;                        // keeps same-time events in send order
+    int node;
+    bool sendDone;                         // send callback, else receive callback
+    uint8_t status;
+    std::shared_ptr<Frame> frame;
+    bool operator>(const Event& o) const { return at != o.at ? at > o.at : order > o.order; }
+  };
+
+  bool lost(int from, int to);
+  uint64_t airtimeUs(size_t len) const;
+  int find(const uint8_t* mac) const;
+  void schedule(uint64_t at, int node, bool sendDone, uint8_t status, const std::shared_ptr<Frame>& frame);
+
+  RadioConfig _config;
+  std::mt19937 _rng;
+  std::uniform_real_distribution<double> _unit;
+  std::vector<Node> _nodes;
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event>> _events;
+  uint64_t _order = 0;
+  uint64_t _channelFree = 0;
+  int _current = -1;
+  RadioStats _stats;
+};
+
+#endif // VIRTUAL_RADIO_H
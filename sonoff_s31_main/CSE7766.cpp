@@ -6,7 +6,7 @@
 // -----------------------------------------------------------------------------
 
 #include "CSE7766.h"
-#include "logger.h"
+#include "Logger.h"
 #include "config.h"
 
 // Constructor
@@ -17,33 +17,42 @@ CSE7766::~CSE7766() {
 }
 
 void CSE7766::expectedCurrent(double expected) {
+    _sync();
     if ((expected > 0) && (_current > 0)) {
         _ratioC = _ratioC * (expected / _current);
+        _updateScales();
     }
 }
 
 void CSE7766::expectedVoltage(unsigned int expected) {
+    _sync();
     if ((expected > 0) && (_voltage > 0)) {
         _ratioV = _ratioV * (expected / _voltage);
+        _updateScales();
     }
 }
 
 void CSE7766::expectedPower(unsigned int expected) {
+    _sync();
     if ((expected > 0) && (_active > 0)) {
         _ratioP = _ratioP * (expected / _active);
+        _updateScales();
     }
 }
 
 void CSE7766::setCurrentRatio(double value) {
     _ratioC = value;
+    _updateScales();
 };
 
 void CSE7766::setVoltageRatio(double value) {
     _ratioV = value;
+    _updateScales();
 };
 
 void CSE7766::setPowerRatio(double value) {
     _ratioP = value;
+    _updateScales();
 };
 
 double CSE7766::getCurrentRatio() {
@@ -60,25 +69,31 @@ double CSE7766::getPowerRatio() {
 
 void CSE7766::resetRatios() {
     _ratioC = _ratioV = _ratioP = 1.0;
+    _updateScales();
 }
 
 void CSE7766::resetEnergy(double value) {
+    _sync();
     _energy = value;
 }
 
 double CSE7766::getCurrent() {
+    _sync();
     return _current;
 }
 
 double CSE7766::getVoltage() {
+    _sync();
     return _voltage;
 }
 
 double CSE7766::getActivePower() {
+    _sync();
     return _active;
 }
 
 double CSE7766::getApparentPower() {
+    _sync();
     return _voltage * _current;
 }
 
@@ -93,28 +108,85 @@ double CSE7766::getReactivePower() {
 }
 
 double CSE7766::getPowerFactor() {
+      _sync();
       return ((_voltage > 0) && (_current > 0)) ? 100 * _active / _voltage / _current : 100;
   }
 
 double CSE7766::getEnergy() {
+    _sync();
     return _energy;
 }
 
+int CSE7766::getError() {
+    return _error;
+}
+
+void CSE7766::setFixedPoint(bool fixedPoint) {
+    _sync();
+    _fixedPoint = fixedPoint;
+}
+
+bool CSE7766::getFixedPoint() {
+    return _fixedPoint;
+}
+
+unsigned long CSE7766::getDecodeCycles() {
+    return _decodeCycles;
+}
+
+void CSE7766::setSerial(Stream* serial) {
+    _serial = serial;
+}
+
+void CSE7766::onFrame(CSE7766FrameCallback callback) {
+    _frameCallback = callback;
+}
+
+unsigned long CSE7766::getFrameTime() {
+    return _frameTime;
+}
+
+const CSE7766Stats& CSE7766::getStats() {
+    return _stats;
+}
+
+void CSE7766::resetStats() {
+    _stats = CSE7766Stats();
+    _rateGood = 0;
+    _rateStart = millis();
+    _frameRate = 0;
+}
+
+float CSE7766::getFrameRate() {
+    return _frameRate;
+}
+
+unsigned long CSE7766::getLastGoodFrameAge() {
+    return _hasGood ? millis() - _lastGood : 0xFFFFFFFFUL;
+}
+
 void CSE7766::begin() {
 
     if (!_dirty) return;
 
-    Serial.begin(CSE7766_BAUDRATE, SerialConfig::SERIAL_8E1);
+    // Only the hardware UART needs configuring, other streams arrive ready.
+    // The UART ISR fills the RX ring, size it to hold frames between handle() calls.
+    if (_serial == &Serial) {
+        Serial.setRxBufferSize(CSE7766_RX_BUFFER_SIZE);
+        Serial.begin(CSE7766_BAUDRATE, SerialConfig::SERIAL_8E1);
+    }
 
+    _last = micros();
+    _rateStart = millis();
     _ready = true;
     _dirty = false;
 
 }
 
-void CSE7766::handle() {
+int CSE7766::handle() {
 
-    if (!_ready) return;
-    _read();
+    if (!_ready) return 0;
+    return _read();
 
 }
 
@@ -141,6 +213,8 @@ bool CSE7766::_checksum() {
 
 void CSE7766::_process() {
 
+    uint32_t start = ESP.getCycleCount();
+
     // Sample data:
     // 55 5A 02 E9 50 00 03 31 00 3E 9E 00 0D 30 4F 44 F8 00 12 65 F1 81 76 72 (w/ load)
     // F2 5A 02 E9 50 00 03 2B 00 3E 9E 02 D7 7C 4F 44 F8 CF A5 5D E1 B3 2A B4 (w/o load)
@@ -157,8 +231,11 @@ void CSE7766::_process() {
     #endif
 
     // Checksum
+    _stats.frames++;
+
     if (!_checksum()) {
         _error = SENSOR_ERROR_CRC;
+        _stats.crcErrors++;
         #if DEBUG_SENSOR
             logger.println("[SENSOR] CSE7766: Checksum error\n");
         #endif
@@ -168,6 +245,7 @@ void CSE7766::_process() {
     // Calibration
     if (0xAA == _data[0]) {
         _error = SENSOR_ERROR_CALIBRATION;
+        _stats.calibrationErrors++;
         #if DEBUG_SENSOR
             logger.println("[SENSOR] CSE7766: Chip not calibrated\n");
         #endif
@@ -176,6 +254,7 @@ void CSE7766::_process() {
 
     if ((_data[0] & 0xFC) > 0xF0) {
         _error = SENSOR_ERROR_OTHER;
+        _stats.otherErrors++;
         #if DEBUG_SENSOR
             if (0xF1 == _data[0] & 0xF1) logger.println("[SENSOR] CSE7766: Abnormal coefficient storage area\n");
             if (0xF2 == _data[0] & 0xF2) logger.println("[SENSOR] CSE7766: Power cycle exceeded range\n");
@@ -193,6 +272,40 @@ void CSE7766::_process() {
     // Adj: this looks like a sampling report
     uint8_t adj = _data[20];                                                            // F1 11110001
 
+    if (_fixedPoint) {
+        _decodeFixed(adj, _coefV, _coefC, _coefP);
+    } else {
+        _decodeDouble(adj, _coefV, _coefC, _coefP);
+    }
+
+    // Calculate energy
+    unsigned int difference;
+    unsigned int cf_pulses = _data[21] << 8 | _data[22];
+    if (0 == _cfPulsesLast) _cfPulsesLast = cf_pulses;
+    if (cf_pulses < _cfPulsesLast) {
+        difference = cf_pulses + (0xFFFF - _cfPulsesLast) + 1;
+    } else {
+        difference = cf_pulses - _cfPulsesLast;
+    }
+    if (_fixedPoint) {
+        _energyPulses += (uint64_t) difference * _coefP;
+    } else {
+        _energy += difference * (float) _coefP / 1000000.0 / 3600.0;
+    }
+    _cfPulsesLast = cf_pulses;
+
+    _stats.good++;
+    _hasGood = true;
+    _lastGood = millis();
+
+    _decodeCycles = (uint32_t) (ESP.getCycleCount() - start);
+
+    if (_frameCallback) _frameCallback(*this);
+
+}
+
+void CSE7766::_decodeDouble(uint8_t adj, unsigned long _coefV, unsigned long _coefC, unsigned long _coefP) {
+
     // Calculate voltage
     _voltage = 0;
     if ((adj & 0x40) == 0x40) {
@@ -222,64 +335,137 @@ void CSE7766::_process() {
         }
     }
 
-    // Calculate energy
-    unsigned int difference;
-    static unsigned int cf_pulses_last = 0;
-    unsigned int cf_pulses = _data[21] << 8 | _data[22];
-    if (0 == cf_pulses_last) cf_pulses_last = cf_pulses;
-    if (cf_pulses < cf_pulses_last) {
-        difference = cf_pulses + (0xFFFF - cf_pulses_last) + 1;
-    } else {
-        difference = cf_pulses - cf_pulses_last;
+}
+
+// scale (Q16) * coef / cycle, saturated to 32 bits
+static uint32_t fixedDivide(uint32_t scale, unsigned long coef, unsigned long cycle) {
+    if (0 == cycle) return 0;
+    uint64_t value = (uint64_t) scale * coef / cycle;
+    return value > 0xFFFFFFFFUL ? 0xFFFFFFFFUL : (uint32_t) value;
+}
+
+void CSE7766::_decodeFixed(uint8_t adj, unsigned long _coefV, unsigned long _coefC, unsigned long _coefP) {
+
+    // Same rules as _decodeDouble(), in Q16 with the ratios pre-scaled
+    _voltageQ16 = 0;
+    if ((adj & 0x40) == 0x40) {
+        unsigned long voltage_cycle = _data[5] << 16 | _data[6] << 8 | _data[7];
+        _voltageQ16 = fixedDivide(_scaleV, _coefV, voltage_cycle);
     }
-    _energy += difference * (float) _coefP / 1000000.0 / 3600.0;
-    cf_pulses_last = cf_pulses;
 
+    _activeQ16 = 0;
+    if ((adj & 0x10) == 0x10) {
+        if ((_data[0] & 0xF2) != 0xF2) {
+            unsigned long power_cycle = _data[17] << 16 | _data[18] << 8 | _data[19];
+            _activeQ16 = fixedDivide(_scaleP, _coefP, power_cycle);
+        }
+    }
+
+    // P / V > 0.05 is 20 * P > V
+    _currentQ16 = 0;
+    if ((adj & 0x20) == 0x20) {
+        if (_activeQ16 && (_voltageQ16 > (1UL << 16)) && ((uint64_t) _activeQ16 * 20 > _voltageQ16)) {
+            unsigned long current_cycle = _data[11] << 16 | _data[12] << 8 | _data[13];
+            _currentQ16 = fixedDivide(_scaleC, _coefC, current_cycle);
+        }
+    }
+
+    _stale = true;
+
+}
+
+void CSE7766::_updateScales() {
+    _scaleV = (uint32_t) (_ratioV / CSE7766_V2R * 65536.0 + 0.5);
+    _scaleC = (uint32_t) (_ratioC / CSE7766_V1R * 65536.0 + 0.5);
+    _scaleP = (uint32_t) (_ratioP / CSE7766_V1R / CSE7766_V2R * 65536.0 + 0.5);
+}
+
+// Bring the double fields up to date with the fixed-point decode
+void CSE7766::_sync() {
+    if (!_stale) return;
+    _voltage = _voltageQ16 / 65536.0;
+    _current = _currentQ16 / 65536.0;
+    _active = _activeQ16 / 65536.0;
+    _energy += _energyPulses / 1000000.0 / 3600.0;
+    _energyPulses = 0;
+    _stale = false;
 }
 
-void CSE7766::_read() {
+int CSE7766::_read() {
 
     _error = SENSOR_ERROR_OK;
 
-    static unsigned char index = 0;
-    static unsigned long last = millis();
+    int frames = 0;
+
+    // Bytes waiting in the RX ring arrived back to back, so the n-th newest
+    // landed about n byte times before now. Those arrival stamps drive the
+    // resync below rather than the time we got round to reading them.
+    unsigned long now = micros();
+    int pending = _serial->available();
+
+    while (pending > 0) {
 
-    while (Serial.available()) {
+        unsigned long stamp = now - (unsigned long) --pending * CSE7766_BYTE_TIME_US;
+        if ((long) (stamp - _last) < 0) stamp = _last;
 
         // A 24 bytes message takes ~55ms to go through at 4800 bps
-        // Reset counter if more than 1000ms have passed since last byte.
-        if (millis() - last > CSE7766_SYNC_INTERVAL) index = 0;
-        last = millis();
+        // Reset counter if more than CSE7766_SYNC_INTERVAL passed since last byte.
+        if (stamp - _last > CSE7766_SYNC_INTERVAL * 1000UL) _dropPartial();
+        _last = stamp;
 
-        uint8_t byte = Serial.read();
+        uint8_t byte = _serial->read();
+
+        // Pick up bytes that landed while we were draining
+        if (0 == pending) {
+            pending = _serial->available();
+            now = micros();
+        }
 
         // first byte must be 0x55 or 0xF?
-        if (0 == index) {
+        if (0 == _index) {
             if ((0x55 != byte) && (byte < 0xF0)) {
+                _stats.bytesDiscarded++;
                 continue;
             }
 
         // second byte must be 0x5A
-        } else if (1 == index) {
+        } else if (1 == _index) {
             if (0x5A != byte) {
-                index = 0;
+                _dropPartial();
+                _stats.bytesDiscarded++;
                 continue;
             }
         }
 
-        _data[index++] = byte;
-        if (index > 23) {
+        _data[_index++] = byte;
+
+        // Process every complete packet, not just the first one buffered
+        if (_index > 23) {
+            _frameTime = stamp;
+            _process();
+            _index = 0;
+            frames++;
             ESP.wdtFeed();
-            Serial.flush();
-            break;
         }
 
     }
 
-    // Process packet
-    if (24 == index) {
-        _process();
-        index = 0;
+    // Good frames per second, refreshed once per window
+    unsigned long nowMs = millis();
+    if (nowMs - _rateStart >= CSE7766_RATE_INTERVAL) {
+        _frameRate = (_stats.good - _rateGood) * 1000.0f / (nowMs - _rateStart);
+        _rateGood = _stats.good;
+        _rateStart = nowMs;
     }
 
+    return frames;
+
+}
+
+// Give up on a partially received frame
+void CSE7766::_dropPartial() {
+    if (0 == _index) return;
+    _stats.syncLosses++;
+    _stats.bytesDiscarded += _index;
+    _index = 0;
 }
@@ -9,12 +9,16 @@
 // Usage example:
 //   CSE7766 cse7766;
 //   cse7766.begin();
-//   cse7766.handle();
+//   cse7766.onFrame(callback); // optional, called for every decoded frame
+//   cse7766.handle(); // call often, decodes every frame buffered since last call
 //   double voltage = cse7766.getVoltage();
 //   double current = cse7766.getCurrent();
 //   double power = cse7766.getActivePower();
 //   double energy = cse7766.getEnergy(); // in Wh (cumulative)
 //   cse7766.resetEnergy(); // reset energy counter
+//
+// The sensor is read through any Arduino Stream (default: Serial), so the
+// parser can be fed captured byte streams on the host, see bench/.
 // -----------------------------------------------------------------------------
 #ifndef CSE7766_h
 #define CSE7766_h
@@ -24,10 +28,22 @@
 
 #define CSE7766_SYNC_INTERVAL           300     // Safe time between transmissions (ms)
 #define CSE7766_BAUDRATE                4800    // UART baudrate
+#define CSE7766_BYTE_TIME_US            (11 * 1000000UL / CSE7766_BAUDRATE) // 8E1 = 11 bits per byte
+#define CSE7766_RX_BUFFER_SIZE          512     // UART RX ring (bytes), ~1s of frames
 
 #define CSE7766_V1R                     1.0     // 1mR current resistor
 #define CSE7766_V2R                     1.0     // 1M voltage resistor
 
+// Fixed-point decode (the ESP8266 has no FPU): the ratios are folded into Q16
+// scales whenever they change, and each frame costs one 64/32-bit integer
+// division per channel instead of several soft-float divisions. Values are
+// converted to double only when read. Compared to the double path, results
+// differ by at most 2^-16 + value * 2^-17 / ratio (0.000015 + 7.6ppm at ratio 1);
+// frames right at the current gate (V = 1.0, P/V = 0.05) may land either side.
+// Off by default: on the host (hardware FPU) it is no faster than double, and
+// it stays off until getDecodeCycles() on an ESP8266 shows the gain.
+#define CSE7766_FIXED_POINT             0       // Default decode mode, see setFixedPoint()
+
 #define SENSOR_ERROR_OK             0       // No error
 #define SENSOR_ERROR_OUT_OF_RANGE   1       // Result out of sensor range
 #define SENSOR_ERROR_WARM_UP        2       // Sensor is warming-up
@@ -39,6 +55,22 @@
 #define SENSOR_ERROR_CALIBRATION    8       // Calibration error or Not calibrated
 #define SENSOR_ERROR_OTHER          99      // Any other error
 
+#define CSE7766_RATE_INTERVAL           1000    // Window for getFrameRate() (ms)
+
+// Health counters, cumulative since begin() or resetStats()
+struct CSE7766Stats {
+  uint32_t frames = 0;              // complete frames processed
+  uint32_t good = 0;                // frames decoded without error
+  uint32_t crcErrors = 0;           // SENSOR_ERROR_CRC
+  uint32_t calibrationErrors = 0;   // SENSOR_ERROR_CALIBRATION
+  uint32_t otherErrors = 0;         // SENSOR_ERROR_OTHER (chip reported out of range)
+  uint32_t syncLosses = 0;          // partial frames dropped (silence or bad second header byte)
+  uint32_t bytesDiscarded = 0;      // bytes skipped looking for 0x55/0xF? 0x5A, incl. dropped partials
+};
+
+class CSE7766;
+typedef void (*CSE7766FrameCallback)(CSE7766& sensor);
+
 class CSE7766 {
 
 public:
@@ -69,9 +101,20 @@ public:
   double getReactivePower();
   double getPowerFactor(); //((_voltage > 0) && (_current > 0)) ? 100 * _active / _voltage / _current : 100;
   double getEnergy(); //_energy
+  int getError(); //_error of the last handle()
+  void setFixedPoint(bool fixedPoint);
+  bool getFixedPoint();
+  unsigned long getDecodeCycles(); // CPU cycles spent in the last _process()
+  void setSerial(Stream* serial); // defaults to Serial
+  void onFrame(CSE7766FrameCallback callback);
+  unsigned long getFrameTime(); // micros() when the last decoded frame finished arriving
+  const CSE7766Stats& getStats();
+  void resetStats();
+  float getFrameRate(); // good frames per second over the last CSE7766_RATE_INTERVAL
+  unsigned long getLastGoodFrameAge(); // ms since the last good frame, 0xFFFFFFFF if none yet
 
   void begin();
-  void handle();
+  int handle(); // number of full frames received and processed
 
 private:
 
@@ -92,11 +135,45 @@ private:
   double _ratioC = 1.0;
   double _ratioP = 1.0;
 
+  // Fixed-point decode state, values and scales in Q16
+  bool _fixedPoint = CSE7766_FIXED_POINT;
+  bool _stale = false;
+  uint32_t _scaleV = 1UL << 16;
+  uint32_t _scaleC = 1UL << 16;
+  uint32_t _scaleP = 1UL << 16;
+  uint32_t _voltageQ16 = 0;
+  uint32_t _currentQ16 = 0;
+  uint32_t _activeQ16 = 0;
+  uint64_t _energyPulses = 0;   // sum of CF pulses * coefP, in 1/3.6e9 Wh
+  unsigned long _decodeCycles = 0;
+
+  Stream* _serial = &Serial;
+  CSE7766FrameCallback _frameCallback = nullptr;
+  unsigned long _frameTime = 0;
+
+  // Parser state, per instance so several sensors can be decoded at once
   unsigned char _data[24];
+  unsigned char _index = 0;             // next byte of _data to fill
+  unsigned long _last = 0;              // arrival stamp (micros) of the previous byte
+  unsigned int _cfPulsesLast = 0;       // CF pulse counter of the previous frame
+
+  // Health
+  CSE7766Stats _stats;
+  bool _hasGood = false;
+  unsigned long _lastGood = 0;          // millis() of the last good frame
+  unsigned long _rateStart = 0;         // millis() the frame rate window opened
+  uint32_t _rateGood = 0;               // _stats.good when it opened
+  float _frameRate = 0;
+
+void _dropPartial();
   
 bool _checksum();
 void _process();
-void _read();
+void _decodeDouble(uint8_t adj, unsigned long coefV, unsigned long coefC, unsigned long coefP);
+void _decodeFixed(uint8_t adj, unsigned long coefV, unsigned long coefC, unsigned long coefP);
+void _updateScales();
+void _sync();
+int _read();
 
 };
 #endif
\ No newline at end of file
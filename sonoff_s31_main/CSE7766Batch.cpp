@@ -0,0 +1,130 @@
+// -----------------------------------------------------------------------------
+// CSE7766 batch frame decoder
+// For SONOFF S31 ESP8266 Project
+// -----------------------------------------------------------------------------
+
+#include "CSE7766Batch.h"
+
+void CSE7766Batch::setCurrentRatio(double value) {
+    _ratioC = value;
+}
+
+void CSE7766Batch::setVoltageRatio(double value) {
+    _ratioV = value;
+}
+
+void CSE7766Batch::setPowerRatio(double value) {
+    _ratioP = value;
+}
+
+void CSE7766Batch::resetEnergy() {
+    _cfPulsesLast = 0;
+}
+
+size_t CSE7766Batch::decode(const uint8_t* frames, size_t count, CSE7766Columns& out) {
+
+    for (size_t base = 0; base < count; base += CSE7766_BATCH_BLOCK) {
+        size_t n = count - base < CSE7766_BATCH_BLOCK ? count - base : CSE7766_BATCH_BLOCK;
+        _decodeBlock(frames + base * CSE7766_FRAME_SIZE, n, out, base);
+    }
+
+    // Energy needs the previous *valid* frame, the only sequential step
+    size_t good = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (out.error[i] != SENSOR_ERROR_OK) {
+            out.energy[i] = 0;
+            continue;
+        }
+        good++;
+        const uint8_t* f = frames + i * CSE7766_FRAME_SIZE;
+        unsigned int cf_pulses = out.cfPulses[i];
+        if (0 == _cfPulsesLast) _cfPulsesLast = cf_pulses;
+        unsigned int difference = (cf_pulses - _cfPulsesLast) & 0xFFFF;
+        unsigned long coefP = f[14] << 16 | f[15] << 8 | f[16];
+        out.energy[i] = difference * (float) coefP / 1000000.0f / 3600.0f;
+        _cfPulsesLast = cf_pulses;
+    }
+    return good;
+
+}
+
+// Sum of the 8 bytes of a 64-bit word, modulo 256
+static inline uint8_t byteSum(uint64_t x) {
+    x = (x & 0x00FF00FF00FF00FFULL) + ((x >> 8) & 0x00FF00FF00FF00FFULL);
+    return (uint8_t) ((x * 0x0001000100010001ULL) >> 48);
+}
+
+// Zero cycles would turn a masked-out value into 0 * inf = NaN
+static inline float cycle24(const uint8_t* p) {
+    uint32_t cycle = (uint32_t) p[0] << 16 | (uint32_t) p[1] << 8 | p[2];
+    return cycle ? cycle : 1;
+}
+
+static inline uint32_t be24(const uint8_t* p) {
+    return (uint32_t) p[0] << 16 | (uint32_t) p[1] << 8 | p[2];
+}
+
+void CSE7766Batch::_decodeBlock(const uint8_t* frames, size_t n, CSE7766Columns& out, size_t offset) {
+
+    uint8_t head[CSE7766_BATCH_BLOCK];
+    uint8_t adj[CSE7766_BATCH_BLOCK];
+    uint8_t crcOk[CSE7766_BATCH_BLOCK];
+    float coefV[CSE7766_BATCH_BLOCK], cycleV[CSE7766_BATCH_BLOCK];
+    float coefC[CSE7766_BATCH_BLOCK], cycleC[CSE7766_BATCH_BLOCK];
+    float coefP[CSE7766_BATCH_BLOCK], cycleP[CSE7766_BATCH_BLOCK];
+
+    // Pass 1: checksum (SWAR, 8 bytes per add) and transpose fields to columns.
+    // Words are read little-endian, as on both the ESP8266 and x86.
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t* f = frames + i * CSE7766_FRAME_SIZE;
+        uint64_t w[3];
+        memcpy(w, f, sizeof(w));
+        // bytes 2..22: drop header bytes 0-1 and the checksum byte 23
+        uint8_t sum = byteSum(w[0] & 0xFFFFFFFFFFFF0000ULL) + byteSum(w[1])
+                    + byteSum(w[2] & 0x00FFFFFFFFFFFFFFULL);
+        crcOk[i] = sum == f[23];
+        head[i] = f[0];
+        adj[i] = f[20];
+        coefV[i] = be24(f + 2);
+        cycleV[i] = cycle24(f + 5);
+        coefC[i] = be24(f + 8);
+        cycleC[i] = cycle24(f + 11);
+        coefP[i] = be24(f + 14);
+        cycleP[i] = cycle24(f + 17);
+        out.cfPulses[offset + i] = f[21] << 8 | f[22];
+    }
+
+    float* voltage = out.voltage + offset;
+    float* current = out.current + offset;
+    float* power = out.power + offset;
+    uint8_t* error = out.error + offset;
+
+    // Pass 2: error classification, same order of checks as _process
+    for (size_t i = 0; i < n; i++) {
+        uint8_t e = SENSOR_ERROR_OK;
+        e = ((head[i] & 0xFC) > 0xF0) ? SENSOR_ERROR_OTHER : e;
+        e = (0xAA == head[i]) ? SENSOR_ERROR_CALIBRATION : e;
+        e = crcOk[i] ? e : SENSOR_ERROR_CRC;
+        error[i] = e;
+    }
+
+    // Pass 3: values. Conditions become 0/1 multipliers rather than branches
+    // or selects, which keeps the loop vectorizable under strict FP rules.
+    const float ratioV = _ratioV / CSE7766_V2R;
+    const float ratioP = _ratioP / CSE7766_V1R / CSE7766_V2R;
+    const float ratioC = _ratioC / CSE7766_V1R;
+    for (size_t i = 0; i < n; i++) {
+        int ok = error[i] == SENSOR_ERROR_OK;
+        float v = ratioV * coefV[i] / cycleV[i];
+        v *= (float) (ok & (adj[i] >> 6));
+        float p = ratioP * coefP[i] / cycleP[i];
+        p *= (float) (ok & (adj[i] >> 4) & ((head[i] & 0xF2) != 0xF2));
+        // P / V > 0.05 gate from _process, as 20 * P > V once V > 1
+        float c = ratioC * coefC[i] / cycleC[i];
+        c *= (float) (ok & (adj[i] >> 5) & (p != 0.0f) & (v > 1.0f) & (p > 0.05f * v));
+        voltage[i] = v;
+        power[i] = p;
+        current[i] = c;
+    }
+
+}
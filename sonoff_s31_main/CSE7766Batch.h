@@ -0,0 +1,66 @@
+// -----------------------------------------------------------------------------
+// CSE7766 batch frame decoder
+// For SONOFF S31 ESP8266 Project
+// -----------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+// Decodes many frame-aligned 24-byte CSE7766 frames at once, for
+// post-processing captures off the device. Same rules as CSE7766::_process,
+// but the output is structure-of-arrays and the work is split into passes
+// with no data-dependent branches, so the compiler can vectorize them
+// (build with -O3, plus -march=native on the host).
+//
+// Usage example:
+//   CSE7766Batch batch;
+//   batch.setVoltageRatio(1.0);
+//   CSE7766Columns out = {error, voltage, current, power, cfPulses, energy};
+//   size_t good = batch.decode(frames, count, out); // frames: count * 24 bytes
+//
+// Differences from CSE7766:
+//   - values are float (coefficients and cycles are 24-bit, so exact inputs)
+//   - frames with an error get zeros instead of keeping the previous values
+//   - energy is reported per frame (Wh since the previous valid frame)
+//   - a zero cycle count decodes as 1 instead of dividing by zero
+// -----------------------------------------------------------------------------
+#ifndef CSE7766Batch_h
+#define CSE7766Batch_h
+
+#include "CSE7766.h"
+
+#define CSE7766_FRAME_SIZE              24
+#define CSE7766_BATCH_BLOCK             64      // Frames per pass, bounds stack use
+
+// Structure-of-arrays output, one entry per frame. The caller owns the
+// arrays, each at least as long as the number of frames decoded.
+struct CSE7766Columns {
+  uint8_t* error;       // SENSOR_ERROR_* per frame
+  float* voltage;       // V
+  float* current;       // A
+  float* power;         // W
+  uint16_t* cfPulses;   // raw CF pulse counter
+  float* energy;        // Wh since the previous valid frame
+};
+
+class CSE7766Batch {
+
+public:
+
+  void setCurrentRatio(double value);
+  void setVoltageRatio(double value);
+  void setPowerRatio(double value);
+  void resetEnergy(); // next frame restarts CF pulse differencing
+
+  // Decodes count frames, returns how many had no error
+  size_t decode(const uint8_t* frames, size_t count, CSE7766Columns& out);
+
+private:
+
+  float _ratioV = 1.0;
+  float _ratioC = 1.0;
+  float _ratioP = 1.0;
+  unsigned int _cfPulsesLast = 0;
+
+  void _decodeBlock(const uint8_t* frames, size_t count, CSE7766Columns& out, size_t offset);
+
+};
+#endif
@@ -0,0 +1,82 @@
+/*
+ * ESP-NOW Beacon Scheduler Implementation
+ * For SONOFF S31 ESP8266 Project
+ */
+
+#include "beacon.h"
+#include <math.h>
+
+static bool movedBy(float now, float sent, float delta) {
+  return fabs(now - sent) >= delta;
+}
+
+uint8_t BeaconScheduler::changedFields(const BeaconSnapshot& state) const {
+  uint8_t fields = 0;
+  if (state.relay != _sent.relay) fields |= BEACON_RELAY;
+  if (state.wifi != _sent.wifi) fields |= BEACON_WIFI;
+  if (movedBy(state.voltage, _sent.voltage, BEACON_DELTA_VOLTAGE)) fields |= BEACON_VOLTAGE;
+  if (movedBy(state.current, _sent.current, BEACON_DELTA_CURRENT)) fields |= BEACON_CURRENT;
+  if (movedBy(state.power, _sent.power, BEACON_DELTA_POWER)) fields |= BEACON_POWER;
+  if (movedBy(state.energy, _sent.energy, BEACON_DELTA_ENERGY)) fields |= BEACON_ENERGY;
+  return fields;
+}
+
+uint8_t BeaconScheduler::poll(uint32_t now, const BeaconSnapshot& state) {
+  if (!_started) {
+    _started = true;
+    _tokenTime = now;
+    _lastFull = now;
+  }
+
+  // Refill the burst allowance
+  while (_tokens < BEACON_BURST && now - _tokenTime >= BEACON_RATE_MS) {
+    _tokens++;
+    _tokenTime += BEACON_RATE_MS;
+  }
+  if (_tokens == BEACON_BURST) _tokenTime = now;
+
+  uint8_t fields = changedFields(state);
+  const uint8_t readings = BEACON_VOLTAGE | BEACON_CURRENT | BEACON_POWER | BEACON_ENERGY;
+  if (now - _lastReadings < BEACON_READING_MS) {
+    fields &= ~readings;  // readings wait, switch state does not
+  }
+  if (_fullRequested || now - _lastFull >= BEACON_FULL_MS) {
+    fields = BEACON_ALL;
+  }
+
+  if (fields) {
+    if (_tokens == 0) {
+      _stats.deferred++;
+      return 0;
+    }
+    _tokens--;
+
+    if (fields & BEACON_RELAY) _sent.relay = state.relay;
+    if (fields & BEACON_WIFI) _sent.wifi = state.wifi;
+    if (fields & BEACON_VOLTAGE) _sent.voltage = state.voltage;
+    if (fields & BEACON_CURRENT) _sent.current = state.current;
+    if (fields & BEACON_POWER) _sent.power = state.power;
+    if (fields & BEACON_ENERGY) _sent.energy = state.energy;
+    if (fields & readings) _lastReadings = now;
+    if (fields == BEACON_ALL) {
+      _fullRequested = false;
+      _lastFull = now;
+      _stats.full++;
+    }
+
+    _lastBeacon = now;
+    _idle = ESPNOW_BROADCAST_INTERVAL;
+    _stats.deltas++;
+    for (uint8_t f = fields; f; f &= f - 1) _stats.fieldsSent++;
+    return fields;
+  }
+
+  if (now - _lastBeacon >= _idle) {
+    // Quiet: keep peers' lastSeen fresh, and back off
+    _lastBeacon = now;
+    _idle = _idle * 2 < BEACON_IDLE_MAX_MS ? _idle * 2 : BEACON_IDLE_MAX_MS;
+    _stats.heartbeats++;
+    return BEACON_HEARTBEAT;
+  }
+  return 0;
+}
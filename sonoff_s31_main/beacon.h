@@ -0,0 +1,81 @@
+/*
+ * ESP-NOW Beacon Scheduler
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Decides when this plug broadcasts its state and which fields go in it,
+ * replacing the fixed 10 s full dump, the 30 s heartbeat and the broadcast
+ * on every relay change:
+ *   - relay/WiFi changes go out at once, limited to BEACON_BURST in a row
+ *     and then one per BEACON_RATE_MS; changes while limited are coalesced
+ *     into the next beacon, which carries the latest state
+ *   - readings go out when they moved more than their BEACON_DELTA_* since
+ *     last sent, at most every BEACON_READING_MS
+ *   - only changed fields are sent (MSG_STATE_DELTA)
+ *   - with nothing to report a heartbeat is sent after ESPNOW_BROADCAST_INTERVAL,
+ *     the gap doubling on each quiet beacon up to BEACON_IDLE_MAX_MS
+ *   - every BEACON_FULL_MS the beacon carries every field, for late joiners
+ *
+ * Host-compilable; the caller encodes and sends what poll() returns.
+ */
+
+#ifndef BEACON_H
+#define BEACON_H
+
+#include "config.h"
+
+// Fields of a state beacon (WireMessage::fields)
+#define BEACON_RELAY    0x01
+#define BEACON_WIFI     0x02
+#define BEACON_VOLTAGE  0x04
+#define BEACON_CURRENT  0x08
+#define BEACON_POWER    0x10
+#define BEACON_ENERGY   0x20
+#define BEACON_UPTIME   0x40
+#define BEACON_ALL      0x7F
+#define BEACON_HEARTBEAT 0x80                // poll(): nothing changed, send a heartbeat
+
+struct BeaconSnapshot {
+  bool relay = false;
+  bool wifi = false;
+  float voltage = 0;
+  float current = 0;
+  float power = 0;
+  float energy = 0;
+};
+
+struct BeaconStats {
+  uint32_t deltas = 0;                     // beacons with some fields
+  uint32_t full = 0;                       // of those, with every field
+  uint32_t heartbeats = 0;
+  uint32_t deferred = 0;                   // polls that had changes but were rate limited
+  uint32_t fieldsSent = 0;
+};
+
+class BeaconScheduler {
+public:
+  // What to send now: a BEACON_* field mask, BEACON_HEARTBEAT, or 0 for
+  // nothing. Whatever is returned counts as sent.
+  uint8_t poll(uint32_t now, const BeaconSnapshot& state);
+
+  // Send every field with the next beacon (e.g. a new peer appeared)
+  void requestFull() { _fullRequested = true; }
+
+  uint32_t idleInterval() const { return _idle; }
+  const BeaconStats& stats() const { return _stats; }
+
+private:
+  uint8_t changedFields(const BeaconSnapshot& state) const;
+
+  BeaconSnapshot _sent;                    // values as last broadcast
+  bool _started = false;
+  bool _fullRequested = true;
+  uint32_t _lastBeacon = 0;
+  uint32_t _lastReadings = 0;
+  uint32_t _lastFull = 0;
+  uint32_t _idle = ESPNOW_BROADCAST_INTERVAL;
+  uint32_t _tokenTime = 0;                 // when the bucket was last refilled
+  uint8_t _tokens = BEACON_BURST;
+  BeaconStats _stats;
+};
+
+#endif // BEACON_H
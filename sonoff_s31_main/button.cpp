@@ -0,0 +1,100 @@
+/*
+ * Button Edges and Gestures Implementation
+ * For SONOFF S31 ESP8266 Project
+ */
+
+#include "button.h"
+
+static const uint32_t DEBOUNCE_US = BUTTON_DEBOUNCE_MS * 1000UL;
+static const uint32_t MIN_PRESS_US = BUTTON_MIN_PRESS_MS * 1000UL;
+static const uint32_t LONG_PRESS_US = BUTTON_LONG_PRESS_MS * 1000UL;
+static const uint32_t DOUBLE_PRESS_US = BUTTON_DOUBLE_PRESS_MS * 1000UL;
+static const uint32_t HOLD_US = PAIRING_BUTTON_HOLD_TIME * 1000UL;
+
+// Runs in the GPIO interrupt, so in IRAM and without blocking
+bool IRAM_ATTR ButtonEdgeQueue::push(bool pressed, uint32_t time) {
+  if (_started && time - _lastEdge.load(std::memory_order_relaxed) < DEBOUNCE_US) {
+    _bounces++;
+    return false;
+  }
+  _started = true;
+  _lastEdge.store(time, std::memory_order_release);
+
+  uint32_t head = _head.load(std::memory_order_relaxed);
+  if (head - _tail.load(std::memory_order_acquire) >= BUTTON_EDGE_SLOTS) {
+    _dropped++;
+    return false;
+  }
+  ButtonEdge& edge = _ring[head & (BUTTON_EDGE_SLOTS - 1)];
+  edge.time = time;
+  edge.pressed = pressed;
+  _head.store(head + 1, std::memory_order_release);
+  _edges++;
+  return true;
+}
+
+bool ButtonEdgeQueue::pop(ButtonEdge& edge) {
+  uint32_t tail = _tail.load(std::memory_order_relaxed);
+  if (_head.load(std::memory_order_acquire) == tail) return false;
+  edge = _ring[tail & (BUTTON_EDGE_SLOTS - 1)];
+  _tail.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+ButtonGesture ButtonDecoder::edge(bool pressed, uint32_t time) {
+  // Bounce can queue two edges to the same level; only changes count
+  if (pressed == _pressed) return BUTTON_NONE;
+  _pressed = pressed;
+  _lastEdgeAt = time;
+
+  if (pressed) {
+    _second = _afterShort && time - _releaseAt <= DOUBLE_PRESS_US;
+    _afterShort = false;
+    _pressAt = time;
+    _held = false;
+    return BUTTON_NONE;
+  }
+
+  uint32_t held = time - _pressAt;
+  if (_held) return BUTTON_NONE;           // reported while held
+  if (held < MIN_PRESS_US) {
+    _stats.noise++;
+    return BUTTON_NONE;
+  }
+  if (held >= HOLD_US) return report(BUTTON_HOLD, _pressAt + HOLD_US); // no poll() while held
+  if (held >= LONG_PRESS_US) return report(BUTTON_LONG_PRESS, time);
+  if (_second) return report(BUTTON_DOUBLE_PRESS, time);
+  _afterShort = true;
+  _releaseAt = time;
+  return report(BUTTON_PRESS, time);
+}
+
+ButtonGesture ButtonDecoder::poll(bool pressed, uint32_t now, uint32_t lastEdge) {
+  // An edge hidden by the debounce: the pin settled elsewhere
+  if (pressed != _pressed && now - lastEdge >= DEBOUNCE_US && now - _lastEdgeAt >= DEBOUNCE_US) {
+    _stats.resyncs++;
+    return edge(pressed, now);
+  }
+  if (_pressed && !_held && now - _pressAt >= HOLD_US) {
+    _held = true;
+    return report(BUTTON_HOLD, _pressAt + HOLD_US);
+  }
+  return BUTTON_NONE;
+}
+
+ButtonGesture ButtonDecoder::report(ButtonGesture gesture, uint32_t time) {
+  _gestureTime = time;
+  _stats.gestures[gesture]++;
+  return gesture;
+}
+
+const char* buttonGestureName(ButtonGesture gesture) {
+  switch (gesture) {
+    case BUTTON_NONE: return "none";
+    case BUTTON_PRESS: return "press";
+    case BUTTON_DOUBLE_PRESS: return "double";
+    case BUTTON_LONG_PRESS: return "long";
+    case BUTTON_HOLD: return "hold";
+  }
+  return "unknown";
+}
@@ -0,0 +1,112 @@
+/*
+ * Button Edges and Gestures
+ * For SONOFF S31 ESP8266 Project
+ *
+ * The button interrupt stamps every edge with micros() and queues it; loop()
+ * decodes the queued edges into gestures, so a press is seen however short
+ * it is and timed to the edge, not to when loop() got to it:
+ *   - ButtonEdgeQueue: single-producer/single-consumer ring between the
+ *     GPIO interrupt (producer) and loop() (consumer), as espnow_queue.h.
+ *     An edge within BUTTON_DEBOUNCE_MS of the last accepted one is
+ *     contact bounce and dropped in the interrupt.
+ *   - ButtonDecoder: press/release edges to gestures. A press shorter than
+ *     BUTTON_MIN_PRESS_MS is noise; a short press is BUTTON_PRESS at its
+ *     release, at once (no wait for a possible second press); a short press
+ *     starting within BUTTON_DOUBLE_PRESS_MS of the previous one's release
+ *     is BUTTON_DOUBLE_PRESS instead; a press released after
+ *     BUTTON_LONG_PRESS_MS is BUTTON_LONG_PRESS, and one still held at
+ *     PAIRING_BUTTON_HOLD_TIME is BUTTON_HOLD, reported while held.
+ * Bounce dropped in the interrupt can hide a real edge (a tap shorter than
+ * the debounce); poll() then catches up with the pin once it has been
+ * steady for the debounce time.
+ *
+ * Times are micros(), compared wrap-safe. Host-compilable.
+ */
+
+#ifndef BUTTON_H
+#define BUTTON_H
+
+#include <atomic>
+#include "config.h"
+
+// One accepted edge
+struct ButtonEdge {
+  uint32_t time;                           // micros() in the interrupt
+  bool pressed;
+};
+
+// Decoder counts; the queue counts edges, bounces and drops itself
+struct ButtonStats {
+  uint32_t resyncs = 0;                    // edges taken from the pin, none queued
+  uint32_t noise = 0;                      // presses shorter than BUTTON_MIN_PRESS_MS
+  uint32_t gestures[BUTTON_HOLD + 1] = {}; // by ButtonGesture
+};
+
+class ButtonEdgeQueue {
+public:
+  static_assert(BUTTON_EDGE_SLOTS >= 2 && (BUTTON_EDGE_SLOTS & (BUTTON_EDGE_SLOTS - 1)) == 0,
+                "BUTTON_EDGE_SLOTS must be a power of two");
+
+  // Interrupt: an edge to level pressed at time; false if bounce or full
+  bool push(bool pressed, uint32_t time);
+
+  // loop(): oldest edge, false if none
+  bool pop(ButtonEdge& edge);
+
+  // loop(): an edge is waiting
+  bool pending() const {
+    return _head.load(std::memory_order_acquire) != _tail.load(std::memory_order_relaxed);
+  }
+
+  // micros() of the last edge the interrupt accepted
+  uint32_t lastEdge() const { return _lastEdge.load(std::memory_order_acquire); }
+
+  uint32_t edges() const { return _edges; }       // queued
+  uint32_t bounces() const { return _bounces; }   // dropped as contact bounce
+  uint32_t dropped() const { return _dropped; }   // lost to a full ring
+
+private:
+  ButtonEdge _ring[BUTTON_EDGE_SLOTS];
+  std::atomic<uint32_t> _head{0};
+  std::atomic<uint32_t> _tail{0};
+  std::atomic<uint32_t> _lastEdge{0};
+  bool _started = false;                   // an edge has been accepted
+  uint32_t _edges = 0;
+  uint32_t _bounces = 0;
+  uint32_t _dropped = 0;
+};
+
+class ButtonDecoder {
+public:
+  // A queued edge; returns the gesture it completes, if any
+  ButtonGesture edge(bool pressed, uint32_t time);
+
+  // With the queue drained: pressed is the pin now, lastEdge the queue's.
+  // Returns BUTTON_HOLD once a press reaches PAIRING_BUTTON_HOLD_TIME, or
+  // the gesture of an edge bounce filtering hid.
+  ButtonGesture poll(bool pressed, uint32_t now, uint32_t lastEdge);
+
+  bool pressed() const { return _pressed; }
+
+  // Edge time of the last gesture, what its action's latency is measured from
+  uint32_t gestureTime() const { return _gestureTime; }
+
+  ButtonStats& stats() { return _stats; }
+
+private:
+  ButtonGesture report(ButtonGesture gesture, uint32_t time);
+
+  bool _pressed = false;
+  uint32_t _pressAt = 0;
+  uint32_t _lastEdgeAt = 0;
+  uint32_t _releaseAt = 0;                 // of the last short press
+  bool _afterShort = false;                // a short press ended at _releaseAt
+  bool _second = false;                    // this press started a double press
+  bool _held = false;                      // BUTTON_HOLD reported for this press
+  uint32_t _gestureTime = 0;
+  ButtonStats _stats;
+};
+
+const char* buttonGestureName(ButtonGesture gesture);
+
+#endif // BUTTON_H
@@ -0,0 +1,71 @@
+/*
+ * Parent Clock Estimate Implementation
+ * For SONOFF S31 ESP8266 Project
+ */
+
+#include "clock_sync.h"
+#include <math.h>
+
+static const uint32_t BEST_DELAY_WINDOW_US = 300000000UL;  // best round trip forgotten after 5 min
+static const uint32_t DRIFT_SPAN_US = 25000000UL;          // samples at least this far apart for a rate
+static const float MAX_DRIFT_PPM = 200;                    // beyond any crystal: a bad sample
+static const uint8_t MAX_SPIKES = 4;                       // slow replies in a row before taking one anyway
+
+bool ClockSync::addSample(uint32_t t1, uint32_t t2, uint32_t t3, uint32_t t4) {
+  int32_t delay = (int32_t)((t4 - t1) - (t3 - t2));
+  if (delay < 0 || delay > CLOCK_SYNC_MAX_DELAY_US) {
+    _stats.rejected++;
+    return false;
+  }
+
+  // A reply that queued much longer than the best recent one has an uneven
+  // split between the legs; a lasting change in the path is accepted after
+  // a few
+  if (!_synced || (uint32_t)delay < _minDelay || t4 - _minDelayAt > BEST_DELAY_WINDOW_US) {
+    _minDelay = delay;
+    _minDelayAt = t4;
+  }
+  if ((uint32_t)delay > _minDelay + CLOCK_SYNC_SPIKE_US && _spikes < MAX_SPIKES) {
+    _spikes++;
+    _stats.rejected++;
+    return false;
+  }
+  _spikes = 0;
+
+  // ((t2 - t1) + (t3 - t4)) / 2, kept modulo 2^32
+  uint32_t offset = (t3 - t4) + (uint32_t)(delay / 2);
+
+  if (!_synced) {
+    _anchorOffset = offset;
+    _anchorAt = t4;
+  } else if (t4 - _anchorAt >= DRIFT_SPAN_US) {
+    float ppm = (int32_t)(offset - _anchorOffset) * 1e6f / (float)(t4 - _anchorAt);
+    if (fabsf(ppm) <= MAX_DRIFT_PPM) {
+      _drift = _driftKnown ? _drift + (ppm - _drift) / 4 : ppm;
+      _driftKnown = true;
+    }
+    _anchorOffset = offset;
+    _anchorAt = t4;
+  }
+
+  _offset = offset;
+  _at = t4;
+  _synced = true;
+  _stats.samples++;
+  _stats.lastDelayUs = delay;
+  _stats.bestDelayUs = _minDelay;
+  return true;
+}
+
+void ClockSync::reset() {
+  *this = ClockSync();
+}
+
+uint32_t ClockSync::offsetUs(uint32_t now) const {
+  int32_t since = (int32_t)(now - _at);
+  return _offset + (int32_t)(_drift * since / 1e6f);
+}
+
+uint32_t ClockSync::toLocal(uint32_t remote, uint32_t now) const {
+  return remote - offsetUs(now);
+}
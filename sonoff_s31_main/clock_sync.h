@@ -0,0 +1,77 @@
+/*
+ * Parent Clock Estimate
+ * For SONOFF S31 ESP8266 Project
+ *
+ * A child's view of its parent's micros(), kept NTP-style over the heartbeat
+ * exchange so alerts stamped with the parent's sensing time can be timed:
+ *
+ *   child  t1 ---- HEARTBEAT(stamp t1) ----> t2  parent
+ *          t4 <--- TIME_SYNC(t1, t2, t3) --- t3
+ *
+ *   round trip  delay  = (t4 - t1) - (t3 - t2)
+ *   offset      parent - child = ((t2 - t1) + (t3 - t4)) / 2
+ *
+ * The offset is exact when both legs take as long; an ESP-NOW frame takes
+ * well under a millisecond each way, so the error is that of the slower
+ * leg's queueing. Samples whose round trip is over CLOCK_SYNC_MAX_DELAY_US,
+ * or CLOCK_SYNC_SPIKE_US slower than the best recent one, are not used.
+ * The two crystals drift apart by up to some tens of ppm, so the rate of
+ * the offset is tracked as well and the estimate extrapolated between
+ * samples.
+ *
+ * Arithmetic is modulo 2^32 like micros(): clocks need not be close, only
+ * each leg shorter than half the wrap (35 minutes).
+ *
+ * Host-compilable; the caller exchanges the messages.
+ */
+
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include "config.h"
+
+struct ClockSyncStats {
+  uint32_t samples = 0;                    // replies used
+  uint32_t rejected = 0;                   // replies with too slow a round trip
+  uint32_t lastDelayUs = 0;                // round trip of the last sample used
+  uint32_t bestDelayUs = 0;                // fastest recent round trip
+};
+
+class ClockSync {
+public:
+  // A reply to our heartbeat stamped t1, received at t4 (our micros());
+  // t2 and t3 are the parent's. False if the sample was not used.
+  bool addSample(uint32_t t1, uint32_t t2, uint32_t t3, uint32_t t4);
+
+  // Forget the parent's clock (e.g. a new parent)
+  void reset();
+
+  bool synced() const { return _synced; }
+
+  // The parent's micros() time remote on our clock, now being our micros()
+  uint32_t toLocal(uint32_t remote, uint32_t now) const;
+
+  // Parent minus child at now, and the parent's rate relative to ours
+  uint32_t offsetUs(uint32_t now) const;
+  float driftPpm() const { return _drift; }
+
+  // Our micros() of the last sample used
+  uint32_t lastSample() const { return _at; }
+
+  const ClockSyncStats& stats() const { return _stats; }
+
+private:
+  bool _synced = false;
+  uint32_t _offset = 0;                    // at _at, modulo 2^32
+  uint32_t _at = 0;
+  float _drift = 0;                        // ppm, parent fast if positive
+  bool _driftKnown = false;
+  uint32_t _anchorOffset = 0;              // older sample the drift is measured from
+  uint32_t _anchorAt = 0;
+  uint32_t _minDelay = 0;
+  uint32_t _minDelayAt = 0;
+  uint8_t _spikes = 0;                     // slow replies in a row
+  ClockSyncStats _stats;
+};
+
+#endif // CLOCK_SYNC_H
@@ -9,7 +9,14 @@
 #include <Arduino.h>
 
 // ESP-NOW Pairing Configuration Constants
-#define MAX_CHILDREN 5                      // Maximum number of child devices
+#define MAX_CHILDREN 16                     // Maximum number of child devices, each an ESP-NOW SDK peer (ESPNOW_SDK_PEERS)
+
+// Pairing mode phases, driven from handlePairingMode()
+enum PairingPhase : uint8_t {
+  PAIRING_IDLE = 0,                      // Not pairing
+  PAIRING_LISTEN = 1,                    // Listening for a parent's pairing broadcast
+  PAIRING_OPEN = 2                       // Paired as child, or parent taking children
+};
 
 // Device state structure
 struct DeviceState {
@@ -24,12 +31,14 @@ struct DeviceState {
   
   // Pairing state
   bool pairingMode = false;
+  PairingPhase pairingPhase = PAIRING_IDLE;
   bool isParent = false;
   bool hasParent = false;
   unsigned long pairingStartTime = 0;
   uint8_t parentMac[6];
   uint8_t childCount = 0;
   uint8_t childMacs[MAX_CHILDREN][6];
+  uint16_t groupId = 0;                  // Parent's group, chosen by the parent at pairing; 0 if none
 };
 
 // Hardware pins for SONOFF S31
@@ -37,6 +46,15 @@ struct DeviceState {
 #define LED_PIN 13
 #define BUTTON_PIN 0
 
+// Button gestures, decoded from timestamped edges in button.h
+enum ButtonGesture : uint8_t {
+  BUTTON_NONE = 0,
+  BUTTON_PRESS = 1,                      // Short press: toggle relay
+  BUTTON_DOUBLE_PRESS = 2,               // Second short press soon after a first
+  BUTTON_LONG_PRESS = 3,                 // Released after BUTTON_LONG_PRESS_MS
+  BUTTON_HOLD = 4                        // Still held at PAIRING_BUTTON_HOLD_TIME: pairing
+};
+
 // WiFi Configuration Structure
 struct WiFiConfig {
   char ssid[32];
@@ -44,37 +62,163 @@ struct WiFiConfig {
   bool isConfigured = false;
 };
 
+// Current automation states (parent side), see current_automation.h
+enum CurrentAutomationState : uint8_t {
+  CURRENT_STATE_LOW = 0,                 // Below the band, children told LOW
+  CURRENT_STATE_RISING = 1,              // Above CURRENT_THRESHOLD, debouncing
+  CURRENT_STATE_HIGH = 2,                // Above the band, children told HIGH
+  CURRENT_STATE_FALLING = 3              // Below the turn-off level, debouncing
+};
+
 // Current Automation Structure
 struct CurrentAutomation {
-  bool lastCurrentState = false;         // Last current threshold state (above/below 1A)
+  CurrentAutomationState state = CURRENT_STATE_LOW;
+  unsigned long stateSince = 0;          // millis() of the last committed change
+  unsigned long pendingSince = 0;        // millis() the current crossed towards the other state
+  unsigned long pendingFrameTime = 0;    // micros() arrival of the frame that crossed
   unsigned long childTurnOffTimer = 0;   // Timer for child turn-off delay
 };
 
+// WiFi and MQTT connection states, see connection.h
+enum ConnectionState : uint8_t {
+  CONNECTION_IDLE = 0,                   // Not started
+  CONNECTION_CONNECTING = 1,             // Attempt under way
+  CONNECTION_UP = 2,                     // Connected
+  CONNECTION_BACKOFF = 3                 // Attempt failed or link lost, waiting to retry
+};
+
 // Access Point Configuration (for initial setup)
 #define AP_SSID "SONOFF-S31-Setup"
 #define AP_PASSWORD "sonoff123"
 
 // ESP-NOW Configuration
 #define ESPNOW_CHANNEL 1
-#define ESPNOW_BROADCAST_INTERVAL 10000    // Broadcast interval in milliseconds
-#define MAX_ESPNOW_PEERS 10
+#define ESPNOW_BROADCAST_INTERVAL 10000    // Heartbeat after this long with no change, then backs off
+#define BEACON_IDLE_MAX_MS 40000           // Longest heartbeat gap (keep below PEER_OFFLINE_MS)
+#define BEACON_FULL_MS 300000              // Every field re-sent at least this often
+#define BEACON_BURST 3                     // State beacons allowed back to back
+#define BEACON_RATE_MS 1000                // then one per this long
+#define BEACON_READING_MS 5000             // Readings re-sent at most this often
+#define BEACON_DELTA_VOLTAGE 2.0           // Re-send a reading once it moved by this much
+#define BEACON_DELTA_CURRENT 0.05
+#define BEACON_DELTA_POWER 10.0
+#define BEACON_DELTA_ENERGY 10.0           // Wh
+#define MAX_ESPNOW_PEERS 10                // Peer table capacity
+#define ESPNOW_SDK_PEERS 20                // Peers the SDK registers: broadcast, our parent or children,
+                                           // then table peers while there is room
+#define PEER_OFFLINE_MS 60000              // Peer shown offline after this long unheard
+#define PEER_EXPIRE_MS 300000              // Peer removed after this long unheard
+#define ESPNOW_RX_QUEUE_SLOTS 16           // Received frames buffered for loop(), power of two (~264 B each)
+#define ESPNOW_RX_BATCH 8                  // Most frames processed per drain
+#define RELIABLE_ACK_TIMEOUT_MS 50         // First resend after this, then doubling
+#define RELIABLE_MAX_ATTEMPTS 6            // Sends before giving up (~3 s with the backoff)
+#ifndef GROUP_ALERTS
+#define GROUP_ALERTS 1                     // Parent alerts all children with one broadcast, children that
+                                           // missed it ask again; 0 = one acknowledged unicast each
+#endif
+#define GROUP_ALERT_REPEATS 2              // Unacknowledged re-broadcasts of each group alert,
+#define GROUP_REPEAT_MS 20                 // after this long, then doubling
+#if GROUP_ALERTS
+#define RELIABLE_OUTBOX_SLOTS 12           // Alerts/commands awaiting an ACK (68 B each)
+#else
+#define RELIABLE_OUTBOX_SLOTS (MAX_CHILDREN + 4)  // an alert for each child, and room for commands
+#endif
+#define MESH_TTL 3                         // Hops a mesh-forwarded alert may take, 0 = direct only
+#define MESH_RELAY 1                       // Re-send other plugs' mesh messages
+#define MESH_CACHE_SLOTS 32                // Recent mesh messages remembered to drop copies
+#define CLOCK_SYNC 1                       // Children sync to the parent's clock to time alerts (v2 only)
+#define CLOCK_SYNC_INTERVAL_MS 30000       // Child heartbeats at least this often for a sample
+#define CLOCK_SYNC_RETRY_MS 5000           // until the first sample is in
+#define CLOCK_SYNC_MAX_DELAY_US 20000      // Replies with a longer round trip are not used,
+#define CLOCK_SYNC_SPIKE_US 2000           // nor ones this much slower than the best recent one
+#define ESPNOW_WIRE_FORMAT 2               // Highest format sent: 2 = compact binary, 1 = legacy JSON.
+                                           // Older firmware drops v2, so it gets v1, as do
+                                           // broadcasts while it is heard (both are received)
 
 // ESP-NOW Pairing Configuration
 #define PAIRING_MODE_TIMEOUT 60000         // Pairing mode timeout in milliseconds
+#define PAIRING_LISTEN_MS 5000             // Listen this long for a parent before becoming one
 #define PAIRING_BUTTON_HOLD_TIME 10000     // Button hold time to enter pairing mode
 #define PAIRING_LED_FAST_BLINK 100         // Fast blink interval for pairing mode
 #define PAIRING_LED_SLOW_BLINK 500         // Slow blink interval for parent mode
 
+// Button Configuration (see button.h), held PAIRING_BUTTON_HOLD_TIME enters pairing
+#define BUTTON_DEBOUNCE_MS 20              // Edges this soon after the last accepted one are bounce
+#define BUTTON_MIN_PRESS_MS 50             // Shorter presses are noise
+#define BUTTON_LONG_PRESS_MS 3000          // Press held this long is a long press (WiFi reset request)
+#define BUTTON_DOUBLE_PRESS_MS 400         // Second press starting this soon after a release: double press
+#define BUTTON_EDGE_SLOTS 16               // Edges buffered from the interrupt for loop(), power of two
+
 // Current Automation Configuration
 #define CURRENT_THRESHOLD 0.075            // Current threshold in amps for parent automation (lamp with LED light is between .1 and .15), lowest possible is .05
+#define CURRENT_HYSTERESIS 0.015           // Turn-off level is CURRENT_THRESHOLD minus this (keep it above .05)
+#define CURRENT_DEBOUNCE_MS 200            // A crossing must hold this long before children are told
+#define CURRENT_MIN_DWELL_MS 1000          // Minimum time between two alerts
 #define CHILD_TURN_OFF_DELAY 3000          // Delay in milliseconds before child turns off
 
+// Sensor Statistics Configuration (see sensor_stats.h)
+#define STATS_EWMA_ALPHA 0.15              // Weight of each new frame, follows a step in ~4 frames (~0.4s)
+#define STATS_WINDOW 16                    // Frames in the RMS/min/max window
+#define STATS_QUANTILE_FRAMES 600          // Frames per median/p95 period (~1 minute)
+
+// Overcurrent Protection Configuration
+// Checked on every decoded sensor frame; the relay opens before anything is
+// logged or written to flash. The S31 is rated 16A / 3500W.
+#define OVERCURRENT_LIMIT 15.0             // Trip above this current in amps
+#define OVERPOWER_LIMIT 3500.0             // Trip above this active power in watts
+#define SENSOR_POLL_SLICE 10               // ms between sensor polls (the sensor task's period)
+
+// Last overcurrent trip, reported by /api/status
+struct OvercurrentTrip {
+  uint32_t count = 0;                    // Trips since boot
+  unsigned long lastTrip = 0;            // millis() of the last trip
+  uint32_t lastLatencyUs = 0;            // Frame arrival to relay open, last trip
+  uint32_t maxLatencyUs = 0;             // Frame arrival to relay open, worst trip
+  float current = 0.0;                   // Reading that tripped
+  float power = 0.0;
+  bool pending = false;                  // Logging, flash save and broadcast still to do
+};
+
+// Main Loop Scheduler (see scheduler.h): loop() runs each task when due and
+// sleeps until the next one. A run starting later than its deadline after it
+// was due counts as a miss in /api/tasks.
+#define SCHED_MAX_TASKS 16                 // Tasks loop() can register
+#define TASK_ESPNOW_MS 10                  // Received ESP-NOW frames, resends, child turn-off
+#define TASK_INPUT_MS 20                   // Button and web requests
+#define TASK_NETWORK_MS 50                 // OTA and mDNS
+#define TASK_PEERS_MS 100                  // Peer expiry, beacons, pairing
+#define TASK_READINGS_MS 1000              // Readings shown in /api/status
+#define TASK_POWER_LOG_MS 10000            // Power logged this often
+#define TASK_CONNECT_MS 250                // WiFi and MQTT connection checks
+
+// Relay state restored at boot, reported by /api/status
+enum RelayRestoreSource : uint8_t {
+  RELAY_RESTORE_DEFAULT = 0,             // Nothing saved, relay left off
+  RELAY_RESTORE_RTC = 1,                 // RTC user memory, kept across resets but not power loss
+  RELAY_RESTORE_FLASH = 2                // RELAY_STATE_FILE
+};
+
+struct RelayRestore {
+  RelayRestoreSource source = RELAY_RESTORE_DEFAULT;
+  uint32_t relayUs = 0;                  // micros() since reset when RELAY_PIN was driven
+  uint32_t setupUs = 0;                  // micros() since reset when setup() returned
+};
+
+// Relay state kept in RTC user memory, written on every change
+struct RelayRtcRecord {
+  uint32_t magic;                        // RELAY_RTC_MAGIC
+  uint32_t relayState;                   // 0 or 1
+  uint32_t check;                        // ~(magic ^ relayState)
+};
+
 // Flash Storage Configuration (LittleFS)
 #define PAIRING_FILE "/pairing.dat"        // File name for pairing data
 #define WIFI_CONFIG_FILE "/wifi.dat"       // File name for WiFi configuration
 #define RELAY_STATE_FILE "/relay.dat"      // File name for relay state storage
 #define FLASH_MAGIC 0xA5B4                 // Magic number to verify valid data
-#define FLASH_VERSION 1
+#define RELAY_RTC_OFFSET 64                // RTC user memory block of the relay state (OTA uses blocks 0-31)
+#define RELAY_RTC_MAGIC 0x52454C59         // Marks a valid RTC relay record
+#define FLASH_VERSION 2                    // 2: group ID, 16 children
 
 // Pairing data structure for flash storage
 struct PairingData {
@@ -85,9 +229,38 @@ struct PairingData {
   uint8_t parentMac[6];                 // Parent device MAC address
   uint8_t childCount;                   // Number of child devices
   uint8_t childMacs[MAX_CHILDREN][6];   // Child device MAC addresses
+  uint16_t groupId;                     // Group ID of the parent (ours if parent)
   uint32_t checksum;                    // Data integrity checksum
 };
 
+// Version 1 layout, read once to migrate
+struct PairingDataV1 {
+  uint16_t magic;
+  uint8_t version;
+  bool isParent;
+  bool hasParent;
+  uint8_t parentMac[6];
+  uint8_t childCount;
+  uint8_t childMacs[5][6];
+  uint32_t checksum;
+};
+
+// Power History Configuration (RAM only, lost on reboot)
+#define HISTORY_RAW_SAMPLES 256            // Per-frame samples (~25s of sensor frames)
+#define HISTORY_SECOND_SAMPLES 180         // 1-second min/max/avg rollups (3 minutes)
+#define HISTORY_MINUTE_SAMPLES 120         // 1-minute min/max/avg rollups (2 hours)
+#define HISTORY_BUDGET_BYTES 8192          // Hard cap on the whole store, checked at compile time
+
+// Network Connection Configuration (see connection.h): setup() does not
+// wait for the network, loop() connects in the background and retries
+// after a failure with exponential backoff (each wait randomized +-25%)
+#define WIFI_CONNECT_TIMEOUT_MS 15000      // A WiFi attempt fails after this long without an IP
+#define WIFI_RETRY_MIN_MS 5000             // First wait after a failure, then doubling
+#define WIFI_RETRY_MAX_MS 300000           // up to this
+#define MQTT_CONNECT_TIMEOUT_MS 500        // TCP connect to the broker; bounds how long loop() stalls
+#define MQTT_RETRY_MIN_MS 2000             // First wait after a failure, then doubling
+#define MQTT_RETRY_MAX_MS 300000           // up to this
+
 // Web Server Configuration
 #define WEB_SERVER_PORT 80
 
@@ -104,6 +277,7 @@ struct PairingData {
 #define DEBUG_ESPNOW 1                     // Enable/Disable ESP-NOW debug output
 #define DEBUG_SENSOR 0                     // Enable/Disable sensor debug output
 #define DEBUG_MEMORY 0                     // Enable/Disable memory usage debug output
+#define LOOP_PROFILER 1                    // Time each loop() stage for /api/perf (cost not yet measured on-device)
 
 // MQTT Logging
 #define MQTT_LOGGING_ENABLED 1
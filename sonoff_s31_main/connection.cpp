@@ -0,0 +1,88 @@
+/*
+ * Connection Retry State Machine Implementation
+ * For SONOFF S31 ESP8266 Project
+ */
+
+#include "connection.h"
+
+ConnectionManager::ConnectionManager(uint32_t timeoutMs, uint32_t backoffMinMs, uint32_t backoffMaxMs)
+    : _timeout(timeoutMs), _backoffMin(backoffMinMs), _backoffMax(backoffMaxMs), _backoff(backoffMinMs) {}
+
+void ConnectionManager::start(unsigned long now) {
+  if (_state != CONNECTION_IDLE) return;
+  _state = CONNECTION_BACKOFF;
+  _since = now;
+  _backoff = _backoffMin;
+}
+
+void ConnectionManager::stop() {
+  _state = CONNECTION_IDLE;
+}
+
+bool ConnectionManager::update(bool up, unsigned long now) {
+  switch (_state) {
+    case CONNECTION_IDLE:
+      return false;
+
+    case CONNECTION_UP:
+      if (up) return false;
+      _stats.drops++;
+      backOff(now);
+      return false;
+
+    case CONNECTION_CONNECTING:
+      if (up) {
+        _state = CONNECTION_UP;
+        _stats.upSince = now;
+        _backoff = _backoffMin;
+      } else if (_timeout && now - _since >= _timeout) {
+        failed(now);
+      }
+      return false;
+
+    case CONNECTION_BACKOFF:
+      if (up) {
+        // Came up by itself (e.g. the SDK's own reconnect)
+        _state = CONNECTION_UP;
+        _stats.upSince = now;
+        _backoff = _backoffMin;
+        return false;
+      }
+      if ((long)(now - _since) < 0) return false;
+      _state = CONNECTION_CONNECTING;
+      _since = now;
+      _stats.attempts++;
+      return true;
+  }
+  return false;
+}
+
+void ConnectionManager::failed(unsigned long now) {
+  if (_state != CONNECTION_CONNECTING) return;
+  _stats.failures++;
+  backOff(now);
+}
+
+// Wait the current backoff +-25%, then double it
+void ConnectionManager::backOff(unsigned long now) {
+  uint32_t spread = _backoff / 2;
+  uint32_t wait = _backoff - spread / 2 + (spread ? ESP.random() % (spread + 1) : 0);
+  _state = CONNECTION_BACKOFF;
+  _since = now + wait;
+  _backoff = _backoff < _backoffMax / 2 ? _backoff * 2 : _backoffMax;
+}
+
+unsigned long ConnectionManager::retryInMs(unsigned long now) const {
+  if (_state != CONNECTION_BACKOFF || (long)(now - _since) >= 0) return 0;
+  return _since - now;
+}
+
+const char* connectionStateName(ConnectionState state) {
+  switch (state) {
+    case CONNECTION_IDLE: return "idle";
+    case CONNECTION_CONNECTING: return "connecting";
+    case CONNECTION_UP: return "up";
+    case CONNECTION_BACKOFF: return "backoff";
+  }
+  return "unknown";
+}
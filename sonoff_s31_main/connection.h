@@ -0,0 +1,75 @@
+/*
+ * Connection Retry State Machine
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Decides when to (re)connect a link that comes up in the background, so
+ * nothing waits for the network in setup() or loop():
+ *
+ *   IDLE --start()--> CONNECTING --up--> UP --lost--> BACKOFF
+ *                        |   ^                          |
+ *                timeout |   +----- wait elapsed -------+
+ *             or failed()+----------> BACKOFF
+ *
+ * The owner calls update() from a task with whether the link is up now; a
+ * true return means start an attempt (WiFi.begin(), mqtt.connect()). An
+ * attempt that completes in the background is failed by its timeout; one
+ * whose result is known at once reports failure with failed(). Each wait
+ * doubles from the minimum to the maximum and is randomized by +-25%, so
+ * plugs that lost the network together do not retry in step; it resets
+ * once the link has come up.
+ *
+ * Times are millis(), compared wrap-safe. Host-compilable.
+ */
+
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include "config.h"
+
+struct ConnectionStats {
+  uint32_t attempts = 0;
+  uint32_t failures = 0;                   // attempts failed or timed out
+  uint32_t drops = 0;                      // link lost after coming up
+  unsigned long upSince = 0;               // millis() the link last came up
+};
+
+class ConnectionManager {
+public:
+  // timeoutMs 0: attempts report their own failure with failed()
+  ConnectionManager(uint32_t timeoutMs, uint32_t backoffMinMs, uint32_t backoffMaxMs);
+
+  // Allow attempts, the first at once
+  void start(unsigned long now);
+
+  // Back to IDLE, no more attempts until start()
+  void stop();
+
+  // Whether the link is up at now; true when an attempt should start
+  bool update(bool up, unsigned long now);
+
+  // The attempt just started failed
+  void failed(unsigned long now);
+
+  ConnectionState state() const { return _state; }
+  bool isUp() const { return _state == CONNECTION_UP; }
+
+  // Time until the next attempt while in BACKOFF
+  unsigned long retryInMs(unsigned long now) const;
+
+  const ConnectionStats& stats() const { return _stats; }
+
+private:
+  void backOff(unsigned long now);
+
+  uint32_t _timeout;
+  uint32_t _backoffMin;
+  uint32_t _backoffMax;
+  uint32_t _backoff;                       // next wait before randomizing
+  ConnectionState _state = CONNECTION_IDLE;
+  unsigned long _since = 0;                // attempt start, or BACKOFF end
+  ConnectionStats _stats;
+};
+
+const char* connectionStateName(ConnectionState state);
+
+#endif // CONNECTION_H
@@ -0,0 +1,101 @@
+/*
+ * Current Automation State Machine Implementation
+ * For SONOFF S31 ESP8266 Project
+ */
+
+#include "current_automation.h"
+
+LatencyHistogram alertLatency;
+
+// ===== LATENCY HISTOGRAM =====
+
+void LatencyHistogram::record(uint32_t us) {
+  uint32_t ms = us / 1000;
+  uint8_t i = 0;
+  while (ms && i < LATENCY_BUCKETS - 1) {
+    ms >>= 1;
+    i++;
+  }
+  _buckets[i]++;
+  _count++;
+  _last = us;
+  _sum += us;
+  if (us > _max) _max = us;
+}
+
+void LatencyHistogram::reset() {
+  for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) _buckets[i] = 0;
+  _count = 0;
+  _max = 0;
+  _last = 0;
+  _sum = 0;
+}
+
+uint32_t LatencyHistogram::bucketLimitMs(uint8_t i) {
+  return i < LATENCY_BUCKETS - 1 ? 1UL << i : 0;
+}
+
+// ===== STATE MACHINE =====
+
+static void enterState(CurrentAutomation& automation, CurrentAutomationState state, unsigned long now) {
+  automation.state = state;
+  automation.stateSince = now;
+}
+
+static void startPending(CurrentAutomation& automation, CurrentAutomationState state,
+                         unsigned long frameTime, unsigned long now) {
+  automation.state = state;
+  automation.pendingSince = now;
+  automation.pendingFrameTime = frameTime;
+}
+
+// Debounced long enough, and far enough from the previous alert
+static bool pendingDone(const CurrentAutomation& automation, unsigned long now) {
+  return now - automation.pendingSince >= CURRENT_DEBOUNCE_MS &&
+         now - automation.stateSince >= CURRENT_MIN_DWELL_MS;
+}
+
+bool updateCurrentAutomation(CurrentAutomation& automation, float current,
+                             unsigned long frameTime, unsigned long now) {
+  const float onLevel = CURRENT_THRESHOLD;
+  const float offLevel = CURRENT_THRESHOLD - CURRENT_HYSTERESIS;
+
+  switch (automation.state) {
+    case CURRENT_STATE_LOW:
+      if (current >= onLevel) startPending(automation, CURRENT_STATE_RISING, frameTime, now);
+      break;
+
+    case CURRENT_STATE_RISING:
+      if (current < onLevel) {
+        automation.state = CURRENT_STATE_LOW;  // blip, children were never told
+      } else if (pendingDone(automation, now)) {
+        enterState(automation, CURRENT_STATE_HIGH, now);
+        return true;
+      }
+      break;
+
+    case CURRENT_STATE_HIGH:
+      if (current < offLevel) startPending(automation, CURRENT_STATE_FALLING, frameTime, now);
+      break;
+
+    case CURRENT_STATE_FALLING:
+      if (current >= offLevel) {
+        automation.state = CURRENT_STATE_HIGH;
+      } else if (pendingDone(automation, now)) {
+        enterState(automation, CURRENT_STATE_LOW, now);
+        return true;
+      }
+      break;
+  }
+  return false;
+}
+
+const char* currentAutomationStateName(CurrentAutomationState state) {
+  switch (state) {
+    case CURRENT_STATE_LOW: return "low";
+    case CURRENT_STATE_RISING: return "rising";
+    case CURRENT_STATE_HIGH: return "high";
+    case CURRENT_STATE_FALLING: return "falling";
+  }
+  return "unknown";
+}
@@ -0,0 +1,67 @@
+/*
+ * Current Automation State Machine
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Decides when a parent tells its children the load went HIGH or LOW.
+ * The current must rise to CURRENT_THRESHOLD to go HIGH and fall below
+ * CURRENT_THRESHOLD - CURRENT_HYSTERESIS to go LOW (the band), stay past
+ * that level for CURRENT_DEBOUNCE_MS, and no two alerts are sent less than
+ * CURRENT_MIN_DWELL_MS apart. A load hovering at the threshold therefore
+ * sends one alert instead of chattering:
+ *
+ *        >= on level               held DEBOUNCE_MS + dwell
+ *   LOW ------------> RISING ------------------------------> HIGH
+ *    ^                  | < on level                           |
+ *    |                  v                                      | < off level
+ *    |                 LOW                                     v
+ *    +-------------------------------------------------- FALLING
+ *        held DEBOUNCE_MS + dwell       (>= off level: back to HIGH)
+ *
+ * The time from the arrival of the frame that started a change to the
+ * radio finishing each alert send is kept in alertLatency, for tuning.
+ */
+
+#ifndef CURRENT_AUTOMATION_H
+#define CURRENT_AUTOMATION_H
+
+#include "config.h"
+
+#define LATENCY_BUCKETS 16                 // <1ms, then powers of two up to 16s+
+
+// Log2 histogram of latencies in microseconds
+class LatencyHistogram {
+public:
+  void record(uint32_t us);
+  void reset();
+  uint32_t count() const { return _count; }
+  uint32_t maxUs() const { return _max; }
+  uint32_t lastUs() const { return _last; }
+  uint32_t averageUs() const { return _count ? _sum / _count : 0; }
+  uint32_t bucket(uint8_t i) const { return _buckets[i]; }
+  static uint32_t bucketLimitMs(uint8_t i);  // exclusive upper edge, 0 for the last
+
+private:
+  uint32_t _buckets[LATENCY_BUCKETS] = {};
+  uint32_t _count = 0;
+  uint32_t _max = 0;
+  uint32_t _last = 0;
+  uint64_t _sum = 0;
+};
+
+// Advance the state machine with the latest (smoothed) current. frameTime is
+// the micros() arrival of the frame it came from. Returns true when the
+// committed level changed and the children should be told.
+bool updateCurrentAutomation(CurrentAutomation& automation, float current,
+                             unsigned long frameTime, unsigned long now);
+
+// Level the children were last told
+inline bool currentAutomationHigh(const CurrentAutomation& automation) {
+  return automation.state == CURRENT_STATE_HIGH || automation.state == CURRENT_STATE_FALLING;
+}
+
+const char* currentAutomationStateName(CurrentAutomationState state);
+
+// Frame arrival to alert sent, recorded from the ESP-NOW send callback
+extern LatencyHistogram alertLatency;
+
+#endif // CURRENT_AUTOMATION_H
@@ -5,14 +5,93 @@
 
 #include "config.h"
 #include "espnow_handler.h"
+#include "current_automation.h"
 #include <LittleFS.h>
 #include "Logger.h"
 
 // Global variables
-ESPNOWPeer espnowPeers[MAX_ESPNOW_PEERS];
-int espnowPeerCount = 0;
+PeerTable<MAX_ESPNOW_PEERS> espnowPeers;
+ESPNOWWireStats wireStats;
+ESPNOWRxQueue<ESPNOW_RX_QUEUE_SLOTS> espnowRxQueue;
+ReliableOutbox reliableOutbox;
+BeaconScheduler stateBeacon;
+MeshRouter meshRouter;
+ClockSync parentClock;
+LatencyHistogram alertDelay;
+LatencyHistogram followLatency;
+LatencyHistogram childFollow[MAX_CHILDREN];
 extern DeviceState deviceState;
 
+// The SDK registers the broadcast address, our parent or children, and
+// table peers in the slots left over (TABLE_SDK_PEERS)
+static_assert(MAX_CHILDREN + 2 <= ESPNOW_SDK_PEERS, "MAX_CHILDREN leaves no ESP-NOW peer for anyone else");
+#define TABLE_SDK_PEERS (ESPNOW_SDK_PEERS - 1 - MAX_CHILDREN)
+static uint8_t tablePeersRegistered = 0;
+
+// Current alert in flight, for alertLatency
+static unsigned long alertFrameTime = 0;  // micros() arrival of the frame behind the alert
+static uint8_t alertSendsPending = 0;     // child sends not yet confirmed by the radio
+
+// Group alert being repeated. Broadcasts are not acknowledged: our beacons
+// carry its seq, and children that missed it ask for it (MSG_ALERT_NACK)
+static WireMessage groupAlert;
+static uint8_t groupRepeatsLeft = 0;
+static uint32_t groupRepeatAt = 0;        // micros() of the next repeat
+static uint32_t groupRepeatGap = 0;
+static uint16_t groupNacked[MAX_CHILDREN] = {0};  // seq each child last asked for
+static bool alertToGroup = false;         // alertSendsPending counts the group broadcast
+static SeqWindow groupWindow;             // Child side, group alerts seen from our parent
+
+// Children that missed a direct alert get the next ones through the mesh too,
+// until one of our unicasts reaches them directly again
+static bool childViaMesh[MAX_CHILDREN] = {false};
+
+// Sequence numbers seen from our parent and children, kept here rather than
+// in the peer table, which may be full and then holds no entry for them
+static SeqWindow parentRxSeq;
+static SeqWindow childRxSeq[MAX_CHILDREN];
+
+// Last v1 message from firmware that reads only v1 (see sendFormat)
+static bool legacyHeard = false;
+static unsigned long legacyHeardAt = 0;
+
+// Child side alert timing against the parent's clock
+static uint32_t syncStamp = 0;            // stamp of our last heartbeat, echoed by the parent's reply
+static unsigned long syncSentAt = 0;      // millis() of that heartbeat
+static uint32_t pendingFollowUs = 0;      // reported to the parent with the next state beacon
+static uint32_t offSensed = 0;            // LOW alert's sensing time on our clock, for the turn-off
+static bool offTimed = false;
+
+// Register with the SDK for unicasts (or broadcasts); false if it is full
+static bool registerPeer(uint8_t* mac) {
+  if (esp_now_is_peer_exist(mac) > 0) {
+    return true;
+  }
+  if (esp_now_add_peer(mac, ESP_NOW_ROLE_COMBO, ESPNOW_CHANNEL, NULL, 0) != 0) {
+    logger.printf("ESP-NOW: Could not register peer %s, sends to it will fail\n", macToString(mac).c_str());
+    return false;
+  }
+  return true;
+}
+
+// Our parent or a child: it has a slot kept for it
+static bool registerLink(uint8_t* mac) {
+  ESPNOWPeer* peer = espnowPeers.find(mac);
+  if (peer && peer->registered) {
+    // Already in as a table peer, the slot is its own now
+    peer->registered = false;
+    tablePeersRegistered--;
+  }
+  return registerPeer(mac);
+}
+
+static void unregisterTablePeer(const ESPNOWPeer& peer) {
+  if (peer.registered) {
+    esp_now_del_peer((uint8_t*)peer.mac);
+    tablePeersRegistered--;
+  }
+}
+
 void initESPNOW() {
   // Set device in AP+STA mode for ESP-NOW
   WiFi.mode(WIFI_AP_STA);
@@ -26,13 +105,26 @@ void initESPNOW() {
   // Set ESP-NOW role
   esp_now_set_self_role(ESP_NOW_ROLE_COMBO);
   
+  // Acknowledged messages are numbered from a random start each boot
+  reliableOutbox.seed(ESP.random());
+  
+  uint8_t selfMac[6];
+  WiFi.macAddress(selfMac);
+  meshRouter.begin(selfMac, ESP.random());
+  
   // Register callbacks
   esp_now_register_recv_cb(onESPNOWDataReceived);
   esp_now_register_send_cb(onESPNOWDataSent);
   
-  // Add broadcast peer for discovery
+  // Add broadcast peer for discovery, and the devices we are paired with
   uint8_t broadcastMac[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
-  esp_now_add_peer(broadcastMac, ESP_NOW_ROLE_COMBO, ESPNOW_CHANNEL, NULL, 0);
+  registerPeer(broadcastMac);
+  if (deviceState.hasParent) {
+    registerLink(deviceState.parentMac);
+  }
+  for (int i = 0; i < deviceState.childCount; i++) {
+    registerLink(deviceState.childMacs[i]);
+  }
   
   logger.println("ESP-NOW initialized successfully");
   
@@ -42,43 +134,345 @@ void initESPNOW() {
 }
 
 void handleESPNOWMessages() {
+  // Process received messages
+  drainESPNOWQueue();
+  
   // Update peer list (remove offline peers)
   updatePeerList();
   
-  // Send periodic heartbeat
-  static unsigned long lastHeartbeat = 0;
-  if (millis() - lastHeartbeat > 30000) { // Every 30 seconds
-    broadcastHeartbeat();
-    lastHeartbeat = millis();
-  }
+  // State changes and heartbeats
+  handleBeacon();
 }
 
-void broadcastDeviceState() {
-  ESPNOWMessage msg;
-  msg.messageType = MSG_DEVICE_STATE;
+// Fill a v1 (legacy JSON) message from a WireMessage
+static void encodeLegacyMessage(const WireMessage& wm, ESPNOWMessage& msg) {
+  msg.messageType = wm.type;
   msg.timestamp = millis();
+  memset(msg.payload, 0, sizeof(msg.payload));
+  
+  // Past the terminator: tells receivers on this firmware we read v2 too
+  msg.payload[sizeof(msg.payload) - 1] = ESPNOW_WIRE_V2;
   
-  // Copy device MAC to message
   uint8_t mac[6];
   WiFi.macAddress(mac);
   memcpy(msg.deviceId, mac, 6);
   
-  // Create JSON payload
   DynamicJsonDocument doc(200);
-  doc["deviceId"] = deviceState.deviceId;
-  doc["relay"] = deviceState.relayState;
-  doc["voltage"] = deviceState.voltage;
-  doc["current"] = deviceState.current;
-  doc["power"] = deviceState.power;
-  doc["energy"] = deviceState.energy;
-  doc["wifi"] = deviceState.wifiConnected;
-  doc["uptime"] = millis();
+  switch (wm.type) {
+    case MSG_DEVICE_STATE:
+      doc["deviceId"] = wm.deviceId;
+      doc["relay"] = wm.relay;
+      doc["voltage"] = wm.voltage;
+      doc["current"] = wm.current;
+      doc["power"] = wm.power;
+      doc["energy"] = wm.energy;
+      doc["wifi"] = wm.wifi;
+      doc["uptime"] = wm.uptime;
+      break;
+    case MSG_COMMAND:
+      doc["command"] = wm.command;
+      doc["value"] = wm.value;
+      doc["sender"] = wm.deviceId;
+      break;
+    case MSG_HEARTBEAT:
+      strncpy(msg.payload, wm.deviceId, sizeof(msg.payload) - 2);
+      return;
+    case MSG_PAIRING:
+      doc["deviceId"] = wm.deviceId;
+      doc["isParent"] = wm.isParent;
+      doc["hasParent"] = wm.hasParent;
+      doc["childCount"] = wm.childCount;
+      if (wm.hasParent) {
+        doc["parentMac"] = macToString((uint8_t*)wm.parentMac);
+      }
+      if (wm.groupId) {
+        doc["group"] = wm.groupId;
+      }
+      break;
+    case MSG_PAIRING_RESPONSE:
+      doc["deviceId"] = wm.deviceId;
+      doc["accepted"] = wm.accepted;
+      break;
+    case MSG_CURRENT_HIGH:
+    case MSG_CURRENT_LOW:
+      msg.payload[0] = wm.type == MSG_CURRENT_HIGH ? 1 : 0;
+      return;
+    case MSG_ACK:
+      doc["seq"] = wm.seq;
+      break;
+    default:
+      return;
+  }
+  serializeJson(doc, msg.payload, sizeof(msg.payload) - 1);
+}
+
+// Read a v1 (legacy JSON) message into a WireMessage
+static void decodeLegacyMessage(const ESPNOWMessage* msg, WireMessage& wm) {
+  wm = WireMessage();
+  wm.type = msg->messageType;
+  
+  // Payload may not be terminated if the sender filled it
+  char payload[sizeof(msg->payload) + 1];
+  memcpy(payload, msg->payload, sizeof(msg->payload));
+  payload[sizeof(msg->payload)] = '\0';
+  
+  if (wm.type == MSG_HEARTBEAT) {
+    wireSetString(wm.deviceId, payload);
+    return;
+  }
+  if (wm.type != MSG_DEVICE_STATE && wm.type != MSG_COMMAND &&
+      wm.type != MSG_PAIRING && wm.type != MSG_PAIRING_RESPONSE && wm.type != MSG_ACK) {
+    return;
+  }
+  
+  DynamicJsonDocument doc(200);
+  deserializeJson(doc, payload);
+  switch (wm.type) {
+    case MSG_DEVICE_STATE:
+      wireSetString(wm.deviceId, doc["deviceId"] | "");
+      wm.relay = doc["relay"];
+      wm.voltage = doc["voltage"];
+      wm.current = doc["current"];
+      wm.power = doc["power"];
+      wm.energy = doc["energy"];
+      wm.wifi = doc["wifi"];
+      wm.uptime = doc["uptime"];
+      break;
+    case MSG_COMMAND:
+      wireSetString(wm.command, doc["command"] | "");
+      wireSetString(wm.value, doc["value"] | "");
+      wireSetString(wm.deviceId, doc["sender"] | "");
+      break;
+    case MSG_PAIRING:
+      wireSetString(wm.deviceId, doc["deviceId"] | "");
+      wm.isParent = doc["isParent"];
+      wm.hasParent = doc["hasParent"];
+      wm.childCount = doc["childCount"];
+      if (doc.containsKey("parentMac")) {
+        stringToMac(doc["parentMac"].as<String>(), wm.parentMac);
+      }
+      wm.groupId = doc["group"] | 0;
+      break;
+    case MSG_PAIRING_RESPONSE:
+      wireSetString(wm.deviceId, doc["deviceId"] | "");
+      wm.accepted = doc["accepted"];
+      break;
+    case MSG_ACK:
+      wm.seq = doc["seq"];
+      break;
+  }
+}
+
+bool legacyPeersNearby() {
+  return legacyHeard && millis() - legacyHeardAt < PEER_OFFLINE_MS;
+}
+
+static bool isBroadcast(const uint8_t* mac) {
+  return (mac[0] & mac[1] & mac[2] & mac[3] & mac[4] & mac[5]) == 0xFF;
+}
+
+// Format to send wm in, at most ESPNOW_WIRE_FORMAT: v1 to a peer heard
+// reading only v1, and to broadcasts and unheard peers while such a peer is
+// around (older firmware drops v2). v2-only types go out in v2 regardless.
+static uint8_t sendFormat(const uint8_t* targetMac, const WireMessage& wm) {
+#if ESPNOW_WIRE_FORMAT == 1
+  return 1;
+#else
+  if (!wireHasLegacy(wm.type)) {
+    return 2;
+  }
+  if (!isBroadcast(targetMac)) {
+    ESPNOWPeer* peer = espnowPeers.find(targetMac);
+    if (peer && peer->wireFormat) {
+      return peer->wireFormat;
+    }
+  }
+  return legacyPeersNearby() ? 1 : 2;
+#endif
+}
+
+static void sendFrame(uint8_t* targetMac, uint8_t* data, size_t len, uint32_t start) {
+  wireStats.encodeCycles += (uint32_t)(ESP.getCycleCount() - start);
+  wireStats.txMessages++;
+  wireStats.txBytes += len;
+  
+  esp_now_send(targetMac, data, len);
+}
+
+// Encode in the format the receiver reads and send
+static void sendMessage(uint8_t* targetMac, const WireMessage& wm) {
+  uint32_t start = ESP.getCycleCount();
+  if (sendFormat(targetMac, wm) == 1) {
+    ESPNOWMessage msg;
+    encodeLegacyMessage(wm, msg);
+    sendFrame(targetMac, (uint8_t*)&msg, sizeof(msg), start);
+    
+    // Plugs on this firmware hear a broadcast too, and need what v1 cannot
+    // carry (clock sync stamp, follow time, last group alert) in a v2 copy
+    if (ESPNOW_WIRE_FORMAT == 1 || !isBroadcast(targetMac) ||
+        (wm.stamp == 0 && wm.followUs == 0 && wm.alertSeq == 0)) {
+      return;
+    }
+    start = ESP.getCycleCount();
+  }
   
-  serializeJson(doc, msg.payload, sizeof(msg.payload));
+  uint8_t data[ESPNOW_MAX_PAYLOAD];
+  size_t len = wireEncode(wm, data, sizeof(data));
+  if (len == 0) {
+    logger.printf("ESP-NOW: Message type %d does not fit a frame\n", wm.type);
+    return;
+  }
+  sendFrame(targetMac, data, len, start);
+}
+
+static DeliveryStats* peerDelivery(const uint8_t* mac) {
+  ESPNOWPeer* peer = espnowPeers.find(mac);
+  return peer ? &peer->delivery : nullptr;
+}
+
+static int childIndex(const uint8_t* mac) {
+  for (int i = 0; i < deviceState.childCount; i++) {
+    if (memcmp(mac, deviceState.childMacs[i], 6) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static bool isLink(const uint8_t* mac) {
+  return (deviceState.hasParent && memcmp(mac, deviceState.parentMac, 6) == 0) || childIndex(mac) >= 0;
+}
+
+// Where we track a sender's sequence numbers, nullptr if nowhere
+static SeqWindow* rxSeqFor(const uint8_t* mac, ESPNOWPeer* peer) {
+  if (deviceState.hasParent && memcmp(mac, deviceState.parentMac, 6) == 0) {
+    return &parentRxSeq;
+  }
+  int child = childIndex(mac);
+  if (child >= 0) {
+    return &childRxSeq[child];
+  }
+  return peer ? &peer->rxSeq : nullptr;
+}
+
+// Flood a header-only message (an alert or its ACK) towards dest
+static void sendViaMesh(const uint8_t* dest, uint8_t type, uint16_t seq) {
+#if ESPNOW_WIRE_FORMAT == 2 && MESH_TTL > 0
+  WireMessage env;
+  meshRouter.originate(env, dest, type, seq, micros());
+  uint8_t broadcastMac[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+  sendMessage(broadcastMac, env);
+#endif
+}
+
+static bool isAlert(uint8_t type) {
+  return type == MSG_CURRENT_HIGH || type == MSG_CURRENT_LOW;
+}
+
+// Send what the outbox has due: first sends, resends, and give-ups
+static void pollReliable() {
+  reliableOutbox.poll(micros(),
+    [](uint8_t* mac, const OutboxEntry& e) {
+      // Queued encoded, for a v2 receiver; the SDK takes a writable buffer
+      uint8_t frame[RELIABLE_FRAME_BYTES];
+      memcpy(frame, e.frame, e.len);
+      sendFrame(mac, frame, e.len, ESP.getCycleCount());
+      
+      // Children behind other plugs get each (re)send through the mesh as well
+      int child = childIndex(mac);
+      if (child >= 0 && childViaMesh[child] && isAlert(e.type)) {
+        sendViaMesh(mac, e.type, e.seq);
+      }
+    },
+    [](uint8_t* mac, const OutboxEntry& e) {
+      logger.printf("ESP-NOW: No ACK from %s for message type %d after %d attempts\n",
+                    macToString(mac).c_str(), e.type, RELIABLE_MAX_ATTEMPTS);
+      
+      // Out of direct range: try other plugs
+      int child = childIndex(mac);
+      if (child >= 0 && isAlert(e.type)) {
+        childViaMesh[child] = true;
+        sendViaMesh(mac, e.type, e.seq);
+      }
+    },
+    peerDelivery);
+}
+
+// Our last group alert, named in our beacons for children that missed it;
+// 0 while it is still being repeated, or if there is none
+static uint16_t announcedAlertSeq() {
+#if GROUP_ALERTS && ESPNOW_WIRE_FORMAT == 2
+  return deviceState.isParent && groupRepeatsLeft == 0 ? groupAlert.seq : 0;
+#else
+  return 0;
+#endif
+}
+
+// A child missed our last group alert and asks for it: send it that one
+// directly, and through the mesh as well if it has to ask again
+static void resendGroupAlert(uint8_t* mac, uint16_t seq) {
+  int child = childIndex(mac);
+  if (child < 0 || seq == 0 || seq != groupAlert.seq) {
+    return;  // not ours, or a newer alert already went out
+  }
+  wireStats.alertNacks++;
+  sendMessage(mac, groupAlert);
+  if (groupNacked[child] == seq) {
+    childViaMesh[child] = true;
+    sendViaMesh(mac, groupAlert.high ? MSG_CURRENT_HIGH : MSG_CURRENT_LOW, seq);
+  }
+  groupNacked[child] = seq;
+}
+
+// Our parent's beacon names its last group alert: ask for it if we missed
+// it. Asked again on each beacon until it arrives.
+static void checkGroupAlert(uint8_t* mac, uint16_t alertSeq) {
+  if (!alertSeq || !deviceState.hasParent || memcmp(mac, deviceState.parentMac, 6) != 0 ||
+      groupWindow.check(alertSeq) != SEQ_NEW) {
+    return;
+  }
+  wireStats.alertNacks++;
+  WireMessage nack;
+  nack.type = MSG_ALERT_NACK;
+  nack.seq = alertSeq;
+  sendMessage(mac, nack);
+}
+
+// Send a message the receiver should acknowledge
+static void sendReliable(uint8_t* targetMac, WireMessage& msg) {
+#if ESPNOW_WIRE_FORMAT == 2
+  if (sendFormat(targetMac, msg) == 2) {
+    if (!reliableOutbox.queue(targetMac, msg, micros(), peerDelivery(targetMac))) {
+      logger.println("ESP-NOW: Outbox full or message too long, sending without ACK");
+      sendMessage(targetMac, msg);
+      return;
+    }
+    pollReliable();
+    return;
+  }
+#endif
+  // v1 receivers cannot acknowledge, a resend could repeat a toggle
+  sendMessage(targetMac, msg);
+}
+
+void broadcastDeviceState() {
+  WireMessage msg;
+  msg.type = MSG_DEVICE_STATE;
+  wireSetString(msg.deviceId, deviceState.deviceId.c_str());
+  msg.relay = deviceState.relayState;
+  msg.voltage = deviceState.voltage;
+  msg.current = deviceState.current;
+  msg.power = deviceState.power;
+  msg.energy = deviceState.energy;
+  msg.wifi = deviceState.wifiConnected;
+  msg.uptime = millis();
+  msg.followUs = pendingFollowUs;
+  pendingFollowUs = 0;
+  msg.alertSeq = announcedAlertSeq();
   
   // Broadcast to all peers
   uint8_t broadcastMac[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
-  esp_now_send(broadcastMac, (uint8_t*)&msg, sizeof(msg));
+  sendMessage(broadcastMac, msg);
   
   #if DEBUG_ESPNOW
   static unsigned long lastDebug = 0;
@@ -90,37 +484,95 @@ void broadcastDeviceState() {
 }
 
 void broadcastHeartbeat() {
-  ESPNOWMessage msg;
-  msg.messageType = MSG_HEARTBEAT;
-  msg.timestamp = millis();
-  
-  uint8_t mac[6];
-  WiFi.macAddress(mac);
-  memcpy(msg.deviceId, mac, 6);
+  WireMessage msg;
+  msg.type = MSG_HEARTBEAT;
+  wireSetString(msg.deviceId, deviceState.deviceId.c_str());
   
-  strcpy(msg.payload, deviceState.deviceId.c_str());
+#if CLOCK_SYNC
+  // Our parent answers with its clock (MSG_TIME_SYNC)
+  if (deviceState.hasParent) {
+    syncStamp = micros() | 1;
+    syncSentAt = millis();
+    msg.stamp = syncStamp;
+  }
+#endif
+  msg.alertSeq = announcedAlertSeq();
   
   uint8_t broadcastMac[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
-  esp_now_send(broadcastMac, (uint8_t*)&msg, sizeof(msg));
+  sendMessage(broadcastMac, msg);
 }
 
-void sendCommand(uint8_t* targetMac, const String& command, const String& value) {
-  ESPNOWMessage msg;
-  msg.messageType = MSG_COMMAND;
-  msg.timestamp = millis();
+// A child whose last clock sample is getting old heartbeats even while its
+// beacons carry changes
+static bool clockSyncDue() {
+#if CLOCK_SYNC && ESPNOW_WIRE_FORMAT == 2
+  if (!deviceState.hasParent) {
+    return false;
+  }
+  unsigned long interval = parentClock.synced() ? CLOCK_SYNC_INTERVAL_MS : CLOCK_SYNC_RETRY_MS;
+  return millis() - syncSentAt >= interval;
+#else
+  return false;
+#endif
+}
+
+void handleBeacon() {
+  BeaconSnapshot state;
+  state.relay = deviceState.relayState;
+  state.wifi = deviceState.wifiConnected;
+  state.voltage = deviceState.voltage;
+  state.current = deviceState.current;
+  state.power = deviceState.power;
+  state.energy = deviceState.energy;
+  
+  uint8_t fields = stateBeacon.poll(millis(), state);
+  if (fields == 0) {
+    if (clockSyncDue()) {
+      broadcastHeartbeat();
+    }
+    return;
+  }
+  if (fields == BEACON_HEARTBEAT) {
+    broadcastHeartbeat();
+    return;
+  }
   
-  uint8_t mac[6];
-  WiFi.macAddress(mac);
-  memcpy(msg.deviceId, mac, 6);
+#if ESPNOW_WIRE_FORMAT == 1
+  // v1 has no partial state
+  broadcastDeviceState();
+#else
+  if (fields == BEACON_ALL || legacyPeersNearby()) {
+    broadcastDeviceState();
+    return;
+  }
   
-  DynamicJsonDocument doc(200);
-  doc["command"] = command;
-  doc["value"] = value;
-  doc["sender"] = deviceState.deviceId;
+  WireMessage msg;
+  msg.type = MSG_STATE_DELTA;
+  msg.fields = fields;
+  wireSetString(msg.deviceId, deviceState.deviceId.c_str());
+  msg.relay = state.relay;
+  msg.wifi = state.wifi;
+  msg.voltage = state.voltage;
+  msg.current = state.current;
+  msg.power = state.power;
+  msg.energy = state.energy;
+  msg.followUs = pendingFollowUs;
+  pendingFollowUs = 0;
+  msg.alertSeq = announcedAlertSeq();
   
-  serializeJson(doc, msg.payload, sizeof(msg.payload));
+  uint8_t broadcastMac[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+  sendMessage(broadcastMac, msg);
+#endif
+}
+
+void sendCommand(uint8_t* targetMac, const String& command, const String& value) {
+  WireMessage msg;
+  msg.type = MSG_COMMAND;
+  wireSetString(msg.command, command.c_str());
+  wireSetString(msg.value, value.c_str());
+  wireSetString(msg.deviceId, deviceState.deviceId.c_str());
   
-  esp_now_send(targetMac, (uint8_t*)&msg, sizeof(msg));
+  sendReliable(targetMac, msg);
   
   #if DEBUG_ESPNOW
   logger.printf("ESP-NOW: Command sent to %s: %s=%s\n", 
@@ -129,45 +581,180 @@ void sendCommand(uint8_t* targetMac, const String& command, const String& value)
 }
 
 void onESPNOWDataReceived(uint8_t *mac, uint8_t *data, uint8_t len) {
-  if (len != sizeof(ESPNOWMessage)) {
+  // Runs in the WiFi stack: queue the frame, loop() processes it
+  uint32_t start = ESP.getCycleCount();
+  espnowRxQueue.push(mac, data, len, micros());
+  espnowRxQueue.recordCallbackCycles(ESP.getCycleCount() - start);
+}
+
+// A mesh envelope from a neighbour: pass it on, or open it if it is ours
+static void handleMeshMessage(WireMessage& env) {
+  MeshAction action = meshRouter.receive(env);
+  
+  if (action == MESH_FORWARD) {
+    uint8_t broadcastMac[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    sendMessage(broadcastMac, env);
+    return;
+  }
+  if (action != MESH_FOR_US) {
+    return;
+  }
+  
+  #if DEBUG_ESPNOW
+  logger.printf("ESP-NOW: Mesh message type %d from %s after %d hops\n",
+                env.meshInner, macToString(env.meshOrigin).c_str(), env.meshHops);
+  #endif
+  
+  // The origin is out of radio range: its entry, if heard directly before,
+  // is only for delivery stats and sequence numbers; it is not added
+  ESPNOWPeer* origin = espnowPeers.find(env.meshOrigin);
+  
+  if (env.meshInner == MSG_ACK) {
+    meshRouter.recordRoundTrip(env, micros());
+    reliableOutbox.ack(env.meshOrigin, env.seq, micros(), origin ? &origin->delivery : nullptr);
     return;
   }
   
-  ESPNOWMessage* msg = (ESPNOWMessage*)data;
+  if (env.meshInner == MSG_CURRENT_HIGH || env.meshInner == MSG_CURRENT_LOW) {
+    WireMessage ack;
+    meshRouter.reply(ack, env, MSG_ACK);
+    uint8_t broadcastMac[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    sendMessage(broadcastMac, ack);
+    
+    // Same ordering as direct copies of the alert
+    SeqWindow* window = rxSeqFor(env.meshOrigin, origin);
+    if (env.seq && !window) {
+      wireStats.rxUntracked++;
+      return;
+    }
+    SeqResult seq = env.seq ? window->accept(env.seq) : SEQ_NEW;
+    if (seq == SEQ_NEW && env.seq && window == &parentRxSeq &&
+        groupWindow.accept(env.seq) == SEQ_DUPLICATE) {
+      seq = SEQ_DUPLICATE;  // a group alert that reached us directly after all
+    }
+    if (seq != SEQ_NEW) {
+      wireStats.rxDuplicates++;
+      return;
+    }
+    handleCurrentAlert(env.meshOrigin, env.meshInner == MSG_CURRENT_HIGH, 0, 0);
+  }
+}
+
+// A group alert: every plug in range hears it, only our parent's group acts
+static void handleGroupAlert(uint8_t* senderMac, const WireMessage& msg, uint32_t rxTime) {
+  if (!deviceState.hasParent || memcmp(senderMac, deviceState.parentMac, 6) != 0) {
+    return;
+  }
+  if (msg.groupId != deviceState.groupId) {
+    if (deviceState.groupId != 0) {
+      return;
+    }
+    // Paired before groups existed: take the group our parent uses
+    deviceState.groupId = msg.groupId;
+    savePairingData();
+    logger.printf("ESP-NOW: Joined parent's group %04X\n", msg.groupId);
+  }
+  
+  // Repeats, and anything older than the level we already follow
+  if (groupWindow.accept(msg.seq) != SEQ_NEW) {
+    wireStats.rxDuplicates++;
+    return;
+  }
+  handleCurrentAlert(senderMac, msg.high, msg.stamp, rxTime);
+}
+
+static void processESPNOWMessage(uint8_t* mac, const uint8_t* data, uint8_t len, uint32_t rxTime) {
+  // Accept both formats while devices are being updated
+  WireMessage msg;
+  uint8_t format = 2;
+  uint32_t start = ESP.getCycleCount();
+  if (wireIsV2(data, len)) {
+    if (!wireDecode(data, len, msg)) {
+      wireStats.rxMalformed++;
+      return;
+    }
+  } else if (wireIsLegacy(data, len)) {
+    decodeLegacyMessage((const ESPNOWMessage*)data, msg);
+    wireStats.rxLegacy++;
+    if (!wireLegacyReadsV2((const ESPNOWMessage*)data)) {
+      // Older firmware: it gets v1 from now on
+      format = 1;
+      legacyHeard = true;
+      legacyHeardAt = millis();
+    }
+  } else {
+    wireStats.rxMalformed++;
+    return;
+  }
+  wireStats.decodeCycles += (uint32_t)(ESP.getCycleCount() - start);
+  wireStats.rxMessages++;
+  wireStats.rxBytes += len;
   
   #if DEBUG_ESPNOW
   logger.printf("ESP-NOW: Received message type %d from %s\n", 
-                msg->messageType, macToString(mac).c_str());
+                msg.type, macToString(mac).c_str());
   #endif
   
   // Add or update peer
-  addPeer(mac);
+  ESPNOWPeer* peer = addPeer(mac);
+  if (peer) {
+    peer->wireFormat = format;
+  }
   
-  switch (msg->messageType) {
-    case MSG_DEVICE_STATE: {
-      // Process device state update
-      DynamicJsonDocument doc(200);
-      deserializeJson(doc, msg->payload);
-      
+  if (msg.type == MSG_ACK) {
+    if (reliableOutbox.ack(mac, msg.seq, micros(), peer ? &peer->delivery : nullptr)) {
+      int child = childIndex(mac);
+      if (child >= 0) {
+        childViaMesh[child] = false;  // reachable directly again
+      }
+    }
+    return;
+  }
+  
+  if (msg.seq && wireIsReliable(msg.type)) {
+    // Acknowledge every copy, the sender resends until one ACK gets through
+    WireMessage ack;
+    ack.type = MSG_ACK;
+    ack.seq = msg.seq;
+    sendMessage(mac, ack);
+    
+    SeqWindow* window = rxSeqFor(mac, peer);
+    if (!window) {
+      // A sender we cannot track might be resending: applying it could
+      // repeat a toggle, so it only gets the ACK
+      wireStats.rxUntracked++;
+      return;
+    }
+    SeqResult seq = window->accept(msg.seq);
+    bool alert = msg.type == MSG_CURRENT_HIGH || msg.type == MSG_CURRENT_LOW;
+    if (seq == SEQ_DUPLICATE || (seq == SEQ_LATE && alert)) {
+      // Already applied, or an alert older than the level we already follow
+      wireStats.rxDuplicates++;
+      return;
+    }
+  }
+  
+  switch (msg.type) {
+    case MSG_DEVICE_STATE:
+    case MSG_STATE_DELTA: {
       // Update peer information
-      for (int i = 0; i < espnowPeerCount; i++) {
-        if (memcmp(espnowPeers[i].mac, mac, 6) == 0) {
-          espnowPeers[i].deviceId = doc["deviceId"].as<String>();
-          espnowPeers[i].lastSeen = millis();
-          espnowPeers[i].isOnline = true;
-          break;
-        }
+      if (peer) {
+        peer->deviceId = msg.deviceId;
+      }
+      
+      // A child reporting how long it took to follow our last alert
+      int child = msg.followUs ? childIndex(mac) : -1;
+      if (child >= 0) {
+        childFollow[child].record(msg.followUs);
       }
+      checkGroupAlert(mac, msg.alertSeq);
       break;
     }
     
     case MSG_COMMAND: {
       // Process incoming command
-      DynamicJsonDocument doc(200);
-      deserializeJson(doc, msg->payload);
-      
-      String command = doc["command"];
-      String value = doc["value"];
+      String command = msg.command;
+      String value = msg.value;
       
       if (command == "relay") {
         if (value == "on" || value == "1") {
@@ -190,13 +777,28 @@ void onESPNOWDataReceived(uint8_t *mac, uint8_t *data, uint8_t len) {
     }
     
     case MSG_HEARTBEAT: {
-      // Update peer last seen time
-      for (int i = 0; i < espnowPeerCount; i++) {
-        if (memcmp(espnowPeers[i].mac, mac, 6) == 0) {
-          espnowPeers[i].lastSeen = millis();
-          espnowPeers[i].isOnline = true;
-          break;
-        }
+      // Last seen time was updated by addPeer
+      checkGroupAlert(mac, msg.alertSeq);
+#if CLOCK_SYNC
+      // A child asking for our clock
+      if (msg.stamp && childIndex(mac) >= 0) {
+        WireMessage reply;
+        reply.type = MSG_TIME_SYNC;
+        reply.syncOrigin = msg.stamp;
+        reply.syncReceive = rxTime;
+        reply.syncTransmit = micros();
+        sendMessage(mac, reply);
+      }
+#endif
+      break;
+    }
+    
+    case MSG_TIME_SYNC: {
+      // Our parent's answer to our last heartbeat; older ones are not used
+      if (deviceState.hasParent && memcmp(mac, deviceState.parentMac, 6) == 0 &&
+          msg.syncOrigin == syncStamp) {
+        parentClock.addSample(msg.syncOrigin, msg.syncReceive, msg.syncTransmit, rxTime);
+        syncStamp = 0;
       }
       break;
     }
@@ -204,21 +806,81 @@ void onESPNOWDataReceived(uint8_t *mac, uint8_t *data, uint8_t len) {
     case MSG_PAIRING:
     case MSG_PAIRING_RESPONSE: {
       // Process pairing message
-      processPairingMessage(mac, msg->payload);
+      processPairingMessage(mac, msg);
       break;
     }
     
     case MSG_CURRENT_HIGH:
     case MSG_CURRENT_LOW: {
       // Process current alert message
-      bool isHigh = (msg->messageType == MSG_CURRENT_HIGH);
-      handleCurrentAlert(mac, isHigh);
+      bool isHigh = (msg.type == MSG_CURRENT_HIGH);
+      handleCurrentAlert(mac, isHigh, msg.stamp, rxTime);
+      break;
+    }
+    
+    case MSG_MESH: {
+      handleMeshMessage(msg);
+      break;
+    }
+    
+    case MSG_GROUP_ALERT: {
+      handleGroupAlert(mac, msg, rxTime);
+      break;
+    }
+    
+    case MSG_ALERT_NACK: {
+      resendGroupAlert(mac, msg.seq);
       break;
     }
   }
 }
 
+void drainESPNOWQueue() {
+  espnowRxQueue.drain(ESPNOW_RX_BATCH, [](const ESPNOWRxFrame& frame) {
+    processESPNOWMessage((uint8_t*)frame.mac, frame.data, frame.len, frame.time);
+  });
+  
+  // Resend unacknowledged alerts and commands
+  if (reliableOutbox.pending()) {
+    pollReliable();
+  }
+  
+  // Repeat the last group alert
+  if (groupRepeatsLeft > 0 && (int32_t)(micros() - groupRepeatAt) >= 0) {
+    uint8_t broadcastMac[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    sendMessage(broadcastMac, groupAlert);
+    groupRepeatsLeft--;
+    groupRepeatGap *= 2;
+    groupRepeatAt = micros() + groupRepeatGap;
+  }
+}
+
 void onESPNOWDataSent(uint8_t *mac, uint8_t status) {
+  // Sends complete in order; the first child sends after an alert are its own
+  if (alertSendsPending > 0 && alertToGroup) {
+    static const uint8_t broadcastMac[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    if (memcmp(mac, broadcastMac, 6) == 0) {
+      alertLatency.record(micros() - alertFrameTime);
+      alertSendsPending = 0;
+    }
+  } else if (alertSendsPending > 0) {
+    for (int i = 0; i < deviceState.childCount; i++) {
+      if (memcmp(mac, deviceState.childMacs[i], 6) == 0) {
+        alertLatency.record(micros() - alertFrameTime);
+        alertSendsPending--;
+        break;
+      }
+    }
+  }
+  
+  // A child's radio acknowledged a unicast: it is in direct range again
+  if (status == 0) {
+    int child = childIndex(mac);
+    if (child >= 0) {
+      childViaMesh[child] = false;
+    }
+  }
+  
   #if DEBUG_ESPNOW
   if (status != 0) {
     logger.printf("ESP-NOW: Send failed to %s, status: %d\n", 
@@ -227,66 +889,50 @@ void onESPNOWDataSent(uint8_t *mac, uint8_t status) {
   #endif
 }
 
-void addPeer(uint8_t* mac) {
-  // Check if peer already exists
-  for (int i = 0; i < espnowPeerCount; i++) {
-    if (memcmp(espnowPeers[i].mac, mac, 6) == 0) {
-      espnowPeers[i].lastSeen = millis();
-      espnowPeers[i].isOnline = true;
-      return;
+ESPNOWPeer* addPeer(uint8_t* mac) {
+  bool added;
+  ESPNOWPeer* peer = espnowPeers.touch(mac, millis(), &added);
+  
+  if (added) {
+    // Add to ESP-NOW peer list, past the slots kept for our parent or
+    // children (already registered if it is one)
+    if (!isLink(mac) && tablePeersRegistered < TABLE_SDK_PEERS && registerPeer(mac)) {
+      peer->registered = true;
+      tablePeersRegistered++;
     }
-  }
-  
-  // Add new peer if there's space
-  if (espnowPeerCount < MAX_ESPNOW_PEERS) {
-    memcpy(espnowPeers[espnowPeerCount].mac, mac, 6);
-    espnowPeers[espnowPeerCount].lastSeen = millis();
-    espnowPeers[espnowPeerCount].isOnline = true;
-    espnowPeerCount++;
     
-    // Add to ESP-NOW peer list
-    esp_now_add_peer(mac, ESP_NOW_ROLE_COMBO, ESPNOW_CHANNEL, NULL, 0);
+    // Let it learn our whole state with the next beacon
+    stateBeacon.requestFull();
     
     #if DEBUG_ESPNOW
     logger.printf("ESP-NOW: New peer added: %s\n", macToString(mac).c_str());
     #endif
   }
+  return peer;
 }
 
 void removePeer(uint8_t* mac) {
-  for (int i = 0; i < espnowPeerCount; i++) {
-    if (memcmp(espnowPeers[i].mac, mac, 6) == 0) {
-      // Remove from ESP-NOW peer list
-      esp_now_del_peer(mac);
-      
-      // Shift array elements
-      for (int j = i; j < espnowPeerCount - 1; j++) {
-        espnowPeers[j] = espnowPeers[j + 1];
-      }
-      espnowPeerCount--;
-      
-      #if DEBUG_ESPNOW
-      logger.printf("ESP-NOW: Peer removed: %s\n", macToString(mac).c_str());
-      #endif
-      break;
-    }
+  ESPNOWPeer* peer = espnowPeers.find(mac);
+  if (peer) {
+    // Remove from ESP-NOW peer list
+    unregisterTablePeer(*peer);
+    espnowPeers.remove(mac);
+    
+    #if DEBUG_ESPNOW
+    logger.printf("ESP-NOW: Peer removed: %s\n", macToString(mac).c_str());
+    #endif
   }
 }
 
 void updatePeerList() {
-  unsigned long currentTime = millis();
-  
-  for (int i = 0; i < espnowPeerCount; i++) {
-    if (currentTime - espnowPeers[i].lastSeen > 60000) { // 1 minute timeout
-      espnowPeers[i].isOnline = false;
-      
-      // Remove completely offline peers after 5 minutes
-      if (currentTime - espnowPeers[i].lastSeen > 300000) {
-        removePeer(espnowPeers[i].mac);
-        i--; // Adjust index after removal
-      }
-    }
-  }
+  // Only peers whose timer is due are visited
+  espnowPeers.expire(millis(), [](const ESPNOWPeer& peer) {
+    unregisterTablePeer(peer);
+    
+    #if DEBUG_ESPNOW
+    logger.printf("ESP-NOW: Peer removed: %s\n", macToString((uint8_t*)peer.mac).c_str());
+    #endif
+  });
 }
 
 String macToString(uint8_t* mac) {
@@ -303,32 +949,36 @@ void stringToMac(const String& macStr, uint8_t* mac) {
 
 // ===== PAIRING SYSTEM IMPLEMENTATION =====
 
+// Random, non-zero: 0 means no group
+static uint16_t newGroupId() {
+  return (uint16_t)(ESP.random() % 0xFFFF) + 1;
+}
+
+// Returns at once: the listen window runs in handlePairingMode(), while
+// loop() keeps receiving (a parent's broadcast is taken by
+// processPairingMessage()) and serving everything else
 void enterPairingMode() {
   if (deviceState.pairingMode) {
     return; // Already in pairing mode
   }
   
   deviceState.pairingMode = true;
+  deviceState.pairingPhase = PAIRING_LISTEN;
   deviceState.pairingStartTime = millis();
   
   logger.println("\n=== ENTERING PAIRING MODE ===");
-  logger.println("Listening for parent devices for 5 seconds...");
-  
-  // Wait 5 seconds to listen for existing parent devices
-  unsigned long listenStart = millis();
-  bool parentFound = false;
-  
-  while (millis() - listenStart < 5000) {
-    // Process any incoming ESP-NOW messages
-    delay(100);
-    
-    // Check if we received a pairing message with parent flag
-    // This would be handled in processPairingMessage function
-  }
+  logger.printf("Listening for parent devices for %d seconds...\n", PAIRING_LISTEN_MS / 1000);
+}
+
+// End of the listen window: a parent was heard, or become one
+static void finishPairingListen() {
+  deviceState.pairingPhase = PAIRING_OPEN;
   
-  // If no parent found after 5 seconds, become parent
   if (!deviceState.hasParent) {
     deviceState.isParent = true;
+    if (deviceState.groupId == 0) {
+      deviceState.groupId = newGroupId();
+    }
     logger.println("No parent found - becoming PARENT device");
     logger.println("LED will blink slowly, sending pairing messages...");
   } else {
@@ -339,12 +989,22 @@ void enterPairingMode() {
   printPairingStatus();
 }
 
+const char* pairingPhaseName(PairingPhase phase) {
+  switch (phase) {
+    case PAIRING_IDLE: return "idle";
+    case PAIRING_LISTEN: return "listening";
+    case PAIRING_OPEN: return "open";
+  }
+  return "unknown";
+}
+
 void exitPairingMode() {
   if (!deviceState.pairingMode) {
     return; // Not in pairing mode
   }
   
   deviceState.pairingMode = false;
+  deviceState.pairingPhase = PAIRING_IDLE;
   
   logger.println("\n=== EXITING PAIRING MODE ===");
   
@@ -362,6 +1022,14 @@ void handlePairingMode() {
   
   unsigned long currentTime = millis();
   
+  // Listening: done once a parent took us, or the window is over
+  if (deviceState.pairingPhase == PAIRING_LISTEN) {
+    if (!deviceState.hasParent && currentTime - deviceState.pairingStartTime < PAIRING_LISTEN_MS) {
+      return;
+    }
+    finishPairingListen();
+  }
+  
   // Check for pairing timeout
   if (currentTime - deviceState.pairingStartTime > PAIRING_MODE_TIMEOUT) {
     logger.println("Pairing mode timeout - exiting");
@@ -387,41 +1055,32 @@ void handlePairingMode() {
 }
 
 void sendPairingMessage(bool isParent) {
-  ESPNOWMessage msg;
-  msg.messageType = MSG_PAIRING;
-  msg.timestamp = millis();
-  
-  uint8_t mac[6];
-  WiFi.macAddress(mac);
-  memcpy(msg.deviceId, mac, 6);
-  
-  DynamicJsonDocument doc(200);
-  doc["deviceId"] = deviceState.deviceId;
-  doc["isParent"] = isParent;
-  doc["hasParent"] = deviceState.hasParent;
-  doc["childCount"] = deviceState.childCount;
+  WireMessage msg;
+  msg.type = MSG_PAIRING;
+  wireSetString(msg.deviceId, deviceState.deviceId.c_str());
+  msg.isParent = isParent;
+  msg.hasParent = deviceState.hasParent;
+  msg.childCount = deviceState.childCount;
   
   if (deviceState.hasParent) {
-    doc["parentMac"] = macToString(deviceState.parentMac);
+    memcpy(msg.parentMac, deviceState.parentMac, 6);
+  }
+  if (isParent) {
+    msg.groupId = deviceState.groupId;
   }
-  
-  serializeJson(doc, msg.payload, sizeof(msg.payload));
   
   uint8_t broadcastMac[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
-  esp_now_send(broadcastMac, (uint8_t*)&msg, sizeof(msg));
+  sendMessage(broadcastMac, msg);
   
   #if DEBUG_ESPNOW
   logger.printf("Pairing message sent - isParent: %s\n", isParent ? "true" : "false");
   #endif
 }
 
-void processPairingMessage(uint8_t* senderMac, const char* payload) {
-  DynamicJsonDocument doc(200);
-  deserializeJson(doc, payload);
-  
-  String senderDeviceId = doc["deviceId"];
-  bool senderIsParent = doc["isParent"];
-  bool senderHasParent = doc["hasParent"];
+void processPairingMessage(uint8_t* senderMac, const WireMessage& msg) {
+  String senderDeviceId = msg.deviceId;
+  bool senderIsParent = msg.isParent;
+  bool senderHasParent = msg.hasParent;
   
   #if DEBUG_ESPNOW
   logger.printf("Pairing message from %s: isParent=%s, hasParent=%s\n", 
@@ -433,24 +1092,17 @@ void processPairingMessage(uint8_t* senderMac, const char* payload) {
   // If we're in pairing mode and sender is a parent, set them as our parent
   if (deviceState.pairingMode && !deviceState.hasParent && senderIsParent) {
     if (setParent(senderMac)) {
-      logger.printf("Set parent device: %s (%s)\n", 
-                   macToString(senderMac).c_str(), senderDeviceId.c_str());
+      deviceState.groupId = msg.groupId;
+      logger.printf("Set parent device: %s (%s), group %04X\n", 
+                   macToString(senderMac).c_str(), senderDeviceId.c_str(), msg.groupId);
       
       // Send pairing response
-      ESPNOWMessage response;
-      response.messageType = MSG_PAIRING_RESPONSE;
-      response.timestamp = millis();
-      
-      uint8_t mac[6];
-      WiFi.macAddress(mac);
-      memcpy(response.deviceId, mac, 6);
+      WireMessage response;
+      response.type = MSG_PAIRING_RESPONSE;
+      wireSetString(response.deviceId, deviceState.deviceId.c_str());
+      response.accepted = true;
       
-      DynamicJsonDocument responseDoc(200);
-      responseDoc["deviceId"] = deviceState.deviceId;
-      responseDoc["accepted"] = true;
-      serializeJson(responseDoc, response.payload, sizeof(response.payload));
-      
-      esp_now_send(senderMac, (uint8_t*)&response, sizeof(response));
+      sendMessage(senderMac, response);
     }
   }
   
@@ -472,9 +1124,11 @@ bool setParent(uint8_t* parentMac) {
   memcpy(deviceState.parentMac, parentMac, 6);
   deviceState.hasParent = true;
   deviceState.isParent = false;
+  parentClock.reset();
+  parentRxSeq = SeqWindow();
   
   // Add parent to ESP-NOW peer list
-  esp_now_add_peer(parentMac, ESP_NOW_ROLE_COMBO, ESPNOW_CHANNEL, NULL, 0);
+  registerLink(parentMac);
   
   return true;
 }
@@ -494,10 +1148,14 @@ bool addChild(uint8_t* childMac) {
   }
   
   memcpy(deviceState.childMacs[deviceState.childCount], childMac, 6);
+  childFollow[deviceState.childCount].reset();
+  childRxSeq[deviceState.childCount] = SeqWindow();
+  groupNacked[deviceState.childCount] = 0;
   deviceState.childCount++;
   
-  // Add child to ESP-NOW peer list
-  esp_now_add_peer(childMac, ESP_NOW_ROLE_COMBO, ESPNOW_CHANNEL, NULL, 0);
+  // Add child to ESP-NOW peer list, for commands and per-child alerts
+  // (group alerts are broadcast and need none)
+  registerLink(childMac);
   
   return true;
 }
@@ -513,6 +1171,7 @@ void savePairingData() {
   data.isParent = deviceState.isParent;
   data.hasParent = deviceState.hasParent;
   data.childCount = deviceState.childCount;
+  data.groupId = deviceState.groupId;
   
   if (deviceState.hasParent) {
     memcpy(data.parentMac, deviceState.parentMac, 6);
@@ -535,6 +1194,56 @@ void savePairingData() {
   }
 }
 
+static uint32_t checksumBytes(const void* data, size_t size) {
+  uint32_t checksum = 0;
+  const uint8_t* bytes = (const uint8_t*)data;
+  
+  for (size_t i = 0; i < size; i++) {
+    checksum += bytes[i];
+  }
+  
+  return checksum;
+}
+
+// Load valid data
+static void applyPairingData(const PairingData& data) {
+  deviceState.isParent = data.isParent;
+  deviceState.hasParent = data.hasParent;
+  deviceState.childCount = data.childCount < MAX_CHILDREN ? data.childCount : MAX_CHILDREN;
+  deviceState.groupId = data.groupId;
+  
+  // Registered with the SDK by initESPNOW()
+  if (deviceState.hasParent) {
+    memcpy(deviceState.parentMac, data.parentMac, 6);
+  }
+  
+  for (int i = 0; i < deviceState.childCount; i++) {
+    memcpy(deviceState.childMacs[i], data.childMacs[i], 6);
+  }
+}
+
+// Read a version 1 pairing file into the current layout. A parent gets a
+// group ID now; its children learn it from the first group alert.
+static bool migratePairingDataV1(File& file, PairingData& data) {
+  PairingDataV1 old;
+  file.read((uint8_t*)&old, sizeof(old));
+  if (old.magic != FLASH_MAGIC || old.version != 1 ||
+      old.checksum != checksumBytes(&old, sizeof(old) - sizeof(uint32_t))) {
+    return false;
+  }
+  
+  memset(&data, 0, sizeof(data));
+  data.magic = FLASH_MAGIC;
+  data.version = FLASH_VERSION;
+  data.isParent = old.isParent;
+  data.hasParent = old.hasParent;
+  memcpy(data.parentMac, old.parentMac, 6);
+  data.childCount = old.childCount < 5 ? old.childCount : 5;
+  memcpy(data.childMacs, old.childMacs, sizeof(old.childMacs));
+  data.groupId = old.isParent ? newGroupId() : 0;
+  return true;
+}
+
 void loadPairingData() {
   PairingData data;
   
@@ -553,6 +1262,21 @@ void loadPairingData() {
     return;
   }
   
+  if (file.size() == sizeof(PairingDataV1)) {
+    bool migrated = migratePairingDataV1(file, data);
+    file.close();
+    if (!migrated) {
+      logger.println("No valid pairing data found in flash - using defaults");
+      clearPairingData();
+      return;
+    }
+    applyPairingData(data);
+    savePairingData();
+    logger.println("Pairing data migrated to version 2");
+    printPairingStatus();
+    return;
+  }
+  
   if (file.size() != sizeof(PairingData)) {
     logger.println("Pairing file size mismatch - using defaults");
     file.close();
@@ -581,45 +1305,40 @@ void loadPairingData() {
     return;
   }
   
-  // Load valid data
-  deviceState.isParent = data.isParent;
-  deviceState.hasParent = data.hasParent;
-  deviceState.childCount = data.childCount;
-  
-  if (deviceState.hasParent) {
-    memcpy(deviceState.parentMac, data.parentMac, 6);
-    // Add parent to ESP-NOW peer list
-    esp_now_add_peer(deviceState.parentMac, ESP_NOW_ROLE_COMBO, ESPNOW_CHANNEL, NULL, 0);
-  }
-  
-  for (int i = 0; i < deviceState.childCount && i < MAX_CHILDREN; i++) {
-    memcpy(deviceState.childMacs[i], data.childMacs[i], 6);
-    // Add child to ESP-NOW peer list
-    esp_now_add_peer(deviceState.childMacs[i], ESP_NOW_ROLE_COMBO, ESPNOW_CHANNEL, NULL, 0);
-  }
+  applyPairingData(data);
   
   logger.println("Pairing data loaded from flash storage");
   printPairingStatus();
 }
 
 uint32_t calculateChecksum(const PairingData* data) {
-  uint32_t checksum = 0;
-  const uint8_t* bytes = (const uint8_t*)data;
-  size_t size = sizeof(PairingData) - sizeof(uint32_t); // Exclude checksum field
-  
-  for (size_t i = 0; i < size; i++) {
-    checksum += bytes[i];
-  }
-  
-  return checksum;
+  return checksumBytes(data, sizeof(PairingData) - sizeof(uint32_t)); // Exclude checksum field
 }
 
 void clearPairingData() {
+  // Free their SDK slots
+  if (deviceState.hasParent) {
+    esp_now_del_peer(deviceState.parentMac);
+  }
+  for (int i = 0; i < deviceState.childCount; i++) {
+    esp_now_del_peer(deviceState.childMacs[i]);
+  }
+  
   deviceState.isParent = false;
   deviceState.hasParent = false;
   deviceState.childCount = 0;
+  deviceState.groupId = 0;
   memset(deviceState.parentMac, 0, 6);
   memset(deviceState.childMacs, 0, sizeof(deviceState.childMacs));
+  memset(childViaMesh, 0, sizeof(childViaMesh));
+  memset(groupNacked, 0, sizeof(groupNacked));
+  groupWindow = SeqWindow();
+  parentRxSeq = SeqWindow();
+  parentClock.reset();
+  for (int i = 0; i < MAX_CHILDREN; i++) {
+    childFollow[i].reset();
+    childRxSeq[i] = SeqWindow();
+  }
   
   // Remove pairing file from flash storage
   if (LittleFS.exists(PAIRING_FILE)) {
@@ -649,18 +1368,73 @@ void printPairingStatus() {
   logger.println("=====================\n");
 }
 
-void sendCurrentAlert(bool isHigh) {
+#if GROUP_ALERTS && ESPNOW_WIRE_FORMAT == 2
+// One broadcast for every child, repeated from drainESPNOWQueue(). Its
+// sequence number is the outbox's, so a copy through the mesh stays in
+// order with the alerts and commands a child gets from us directly.
+static void sendGroupAlert(bool isHigh) {
+  groupAlert = WireMessage();
+  groupAlert.type = MSG_GROUP_ALERT;
+  groupAlert.groupId = deviceState.groupId;
+  groupAlert.seq = reliableOutbox.takeSeq();
+  groupAlert.high = isHigh;
+#if CLOCK_SYNC
+  groupAlert.stamp = alertFrameTime;
+#endif
+  
+  uint8_t broadcastMac[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+  sendMessage(broadcastMac, groupAlert);
+  
+  // A newer alert replaces the repeats of the last one
+  groupRepeatsLeft = GROUP_ALERT_REPEATS;
+  groupRepeatGap = GROUP_REPEAT_MS * 1000UL;
+  groupRepeatAt = micros() + groupRepeatGap;
+  
+  // Children behind other plugs get it through the mesh as well. Children
+  // on older firmware drop the group broadcast and get their own v1 alert.
+  WireMessage direct;
+  direct.type = isHigh ? MSG_CURRENT_HIGH : MSG_CURRENT_LOW;
+  for (int i = 0; i < deviceState.childCount; i++) {
+    if (sendFormat(deviceState.childMacs[i], direct) == 1) {
+      sendMessage(deviceState.childMacs[i], direct);
+    } else if (childViaMesh[i]) {
+      sendViaMesh(deviceState.childMacs[i], direct.type, groupAlert.seq);
+    }
+  }
+}
+#endif
+
+void sendCurrentAlert(bool isHigh, unsigned long frameTime) {
   if (!deviceState.isParent || deviceState.childCount == 0) {
     return; // Only parents with children should send alerts
   }
   
-  ESPNOWMessage msg;
-  msg.messageType = isHigh ? MSG_CURRENT_HIGH : MSG_CURRENT_LOW;
-  msg.payload[0] = isHigh ? 1 : 0;  // Simple payload indicating high/lowq
+  alertFrameTime = frameTime;
+  
+#if GROUP_ALERTS && ESPNOW_WIRE_FORMAT == 2
+  if (deviceState.groupId != 0) {
+    alertToGroup = true;
+    alertSendsPending = 1;
+    sendGroupAlert(isHigh);
+    #if DEBUG_ESPNOW
+    logger.printf("ESP-NOW: Sent current %s alert to group %04X\n",
+                  isHigh ? "HIGH" : "LOW", deviceState.groupId);
+    #endif
+    return;
+  }
+#endif
+  
+  WireMessage msg;
+  msg.type = isHigh ? MSG_CURRENT_HIGH : MSG_CURRENT_LOW;
+#if CLOCK_SYNC
+  msg.stamp = frameTime;
+#endif
 
   // Send alert to all children
+  alertToGroup = false;
+  alertSendsPending = deviceState.childCount;
   for (int i = 0; i < deviceState.childCount; i++) {
-    esp_now_send(deviceState.childMacs[i], (uint8_t*)&msg, sizeof(ESPNOWMessage));
+    sendReliable(deviceState.childMacs[i], msg);
     #if DEBUG_ESPNOW
     logger.printf("ESP-NOW: Sent current %s alert to child %s\n", 
                   isHigh ? "HIGH" : "LOW", 
@@ -669,7 +1443,18 @@ void sendCurrentAlert(bool isHigh) {
   }
 }
 
-void handleCurrentAlert(uint8_t* senderMac, bool isHigh) {
+// Our relay now follows an alert sensed at sensed (our clock), less the
+// delay the automation adds on purpose
+static void recordFollow(uint32_t sensed, uint32_t addedUs) {
+  int32_t us = (int32_t)(micros() - sensed - addedUs);
+  if (us < 0) {
+    us = 0;  // the clock estimate is off by more than the lag
+  }
+  followLatency.record(us);
+  pendingFollowUs = us ? us : 1;
+}
+
+void handleCurrentAlert(uint8_t* senderMac, bool isHigh, uint32_t sensed, uint32_t rxTime) {
   // Only children should respond to current alerts
   if (!deviceState.hasParent) {
     return;
@@ -696,14 +1481,40 @@ void handleCurrentAlert(uint8_t* senderMac, bool isHigh) {
   logger.printf("ESP-NOW: Received current %s alert from parent\n", isHigh ? "HIGH" : "LOW");
   #endif
   
+  // Parent's sensing time on our clock, once we know its clock
+  bool timed = sensed != 0 && parentClock.synced();
+  uint32_t sensedHere = timed ? parentClock.toLocal(sensed, micros()) : 0;
+  if (timed) {
+    int32_t delay = (int32_t)(rxTime - sensedHere);
+    alertDelay.record(delay > 0 ? delay : 0);
+  }
+  
   if (isHigh) {
     // Turn on immediately when parent current goes high
+    if (timed) {
+      recordFollow(sensedHere, 0);
+    }
+    offTimed = false;
     turnOnRelay();
     currentAutomation.childTurnOffTimer = 0; // Cancel any pending turn-off
     logger.println("Child: Turning ON due to parent high current");
   } else {
     // Turn off after 3 seconds when parent current goes low
     currentAutomation.childTurnOffTimer = millis() + CHILD_TURN_OFF_DELAY;
+    offTimed = timed;
+    offSensed = sensedHere;
     logger.println("Child: Scheduled turn OFF in 3 seconds due to parent low current");
   }
-}
\ No newline at end of file
+}
+
+void handleChildTurnOff() {
+  if (currentAutomation.childTurnOffTimer > 0 && millis() >= currentAutomation.childTurnOffTimer) {
+    if (offTimed) {
+      recordFollow(offSensed, CHILD_TURN_OFF_DELAY * 1000UL);
+      offTimed = false;
+    }
+    turnOffRelay();
+    currentAutomation.childTurnOffTimer = 0;
+    logger.println("Child: Turning OFF after 3-second delay");
+  }
+}
@@ -10,32 +10,28 @@
 #include <espnow.h>
 #include <ArduinoJson.h>
 
-// ESP-NOW message types
-enum ESPNOWMessageType {
-  MSG_DEVICE_STATE = 1,
-  MSG_COMMAND = 2,
-  MSG_DISCOVERY = 3,
-  MSG_HEARTBEAT = 4,
-  MSG_PAIRING = 5,
-  MSG_PAIRING_RESPONSE = 6,
-  MSG_CURRENT_HIGH = 7,
-  MSG_CURRENT_LOW = 8
-};
-
-// ESP-NOW message structure
-struct ESPNOWMessage {
-  uint8_t messageType;
-  uint8_t deviceId[6];
-  uint32_t timestamp;
-  char payload[200];
-};
+#include "espnow_wire.h"
+#include "peer_table.h"
+#include "espnow_queue.h"
+#include "espnow_reliable.h"
+#include "beacon.h"
+#include "mesh.h"
+#include "clock_sync.h"
+#include "current_automation.h"
 
-// Peer device structure
-struct ESPNOWPeer {
-  uint8_t mac[6];
-  String deviceId;
-  unsigned long lastSeen;
-  bool isOnline;
+// Wire format counters, see /api/peers
+struct ESPNOWWireStats {
+  uint32_t txMessages = 0;
+  uint32_t txBytes = 0;
+  uint32_t rxMessages = 0;
+  uint32_t rxBytes = 0;
+  uint32_t rxLegacy = 0;                 // received in the v1 (JSON) format
+  uint32_t rxMalformed = 0;              // dropped, neither format decoded
+  uint32_t rxDuplicates = 0;             // sequenced messages seen before, not processed again
+  uint32_t rxUntracked = 0;              // sequenced, from a sender with no peer table entry: acknowledged, not processed
+  uint32_t alertNacks = 0;               // group alerts missed: child, asked for; parent, resent
+  uint64_t encodeCycles = 0;             // CPU cycles building outgoing messages
+  uint64_t decodeCycles = 0;             // CPU cycles decoding incoming messages
 };
 
 // Function declarations
@@ -43,10 +39,13 @@ void initESPNOW();
 void handleESPNOWMessages();
 void broadcastDeviceState();
 void broadcastHeartbeat();
+void handleBeacon();
 void sendCommand(uint8_t* targetMac, const String& command, const String& value);
 void onESPNOWDataReceived(uint8_t *mac, uint8_t *data, uint8_t len);
+void drainESPNOWQueue();
 void onESPNOWDataSent(uint8_t *mac, uint8_t status);
-void addPeer(uint8_t* mac);
+ESPNOWPeer* addPeer(uint8_t* mac);
+bool legacyPeersNearby();
 void removePeer(uint8_t* mac);
 void updatePeerList();
 String macToString(uint8_t* mac);
@@ -56,8 +55,9 @@ void stringToMac(const String& macStr, uint8_t* mac);
 void enterPairingMode();
 void exitPairingMode();
 void handlePairingMode();
+const char* pairingPhaseName(PairingPhase phase);
 void sendPairingMessage(bool isParent);
-void processPairingMessage(uint8_t* senderMac, const char* payload);
+void processPairingMessage(uint8_t* senderMac, const WireMessage& msg);
 void savePairingData();
 void loadPairingData();
 bool addChild(uint8_t* childMac);
@@ -67,8 +67,10 @@ void clearPairingData();
 void printPairingStatus();
 
 // Current automation functions
-void sendCurrentAlert(bool isHigh);
-void handleCurrentAlert(uint8_t* senderMac, bool isHigh);
+void sendCurrentAlert(bool isHigh, unsigned long frameTime);
+// sensed is the parent's stamp (0 if none), rxTime the alert's micros() arrival
+void handleCurrentAlert(uint8_t* senderMac, bool isHigh, uint32_t sensed, uint32_t rxTime);
+void handleChildTurnOff();
 
 // Relay control functions (defined in main .ino file)
 void turnOnRelay();
@@ -76,8 +78,16 @@ void turnOffRelay();
 void toggleRelay();
 
 // Global variables
-extern ESPNOWPeer espnowPeers[MAX_ESPNOW_PEERS];
-extern int espnowPeerCount;
+extern PeerTable<MAX_ESPNOW_PEERS> espnowPeers;
+extern ESPNOWWireStats wireStats;
+extern ESPNOWRxQueue<ESPNOW_RX_QUEUE_SLOTS> espnowRxQueue;
+extern ReliableOutbox reliableOutbox;
+extern BeaconScheduler stateBeacon;
+extern MeshRouter meshRouter;
+extern ClockSync parentClock;                     // child: the parent's micros()
+extern LatencyHistogram alertDelay;               // child: parent's sensing to alert arrival
+extern LatencyHistogram followLatency;            // child: parent's sensing to our relay switching
+extern LatencyHistogram childFollow[MAX_CHILDREN]; // parent: the same, as each child reports it
 extern CurrentAutomation currentAutomation;
 
 #endif // ESPNOW_HANDLER_H
\ No newline at end of file
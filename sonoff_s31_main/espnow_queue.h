@@ -0,0 +1,118 @@
+/*
+ * ESP-NOW Receive Queue
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Single-producer/single-consumer ring between the ESP-NOW receive callback
+ * (producer, runs in the WiFi stack) and loop() (consumer). The callback
+ * only copies the frame into a free slot and returns, so its time is
+ * bounded by one memcpy; decoding, relay switching, LittleFS and MQTT all
+ * happen when loop() drains the ring. A frame that finds the ring full is
+ * dropped and counted.
+ *
+ * Each index is written by one side only: the producer advances _head, the
+ * consumer _tail, both free-running and wrapped by the power-of-two size.
+ * Release stores publish a slot's contents before its index, so no lock
+ * or interrupt masking is needed.
+ */
+
+#ifndef ESPNOW_QUEUE_H
+#define ESPNOW_QUEUE_H
+
+#include <atomic>
+#include "espnow_wire.h"
+
+// One received frame
+struct ESPNOWRxFrame {
+  uint8_t mac[6];
+  uint8_t len;
+  uint32_t time;                           // micros() when it arrived
+  uint8_t data[ESPNOW_MAX_PAYLOAD];
+};
+
+struct ESPNOWQueueStats {
+  uint32_t received = 0;                   // frames queued
+  uint32_t dropped = 0;                    // frames lost to a full ring
+  uint32_t processed = 0;                  // frames drained
+  uint32_t drains = 0;                     // drain calls that found frames
+  uint32_t highWater = 0;                  // deepest the ring has been
+  uint64_t depthSum = 0;                   // depth at each drain, for the average
+  uint32_t callbackCyclesMax = 0;          // longest receive callback
+};
+
+template <uint16_t N>
+class ESPNOWRxQueue {
+public:
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "ESPNOWRxQueue size must be a power of two");
+
+  // Producer: copy the frame in, false (and counted) if the ring is full
+  // or the frame is oversized
+  bool push(const uint8_t* mac, const uint8_t* data, uint8_t len, uint32_t time) {
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    uint32_t depth = head - _tail.load(std::memory_order_acquire);
+    if (depth >= N || len > ESPNOW_MAX_PAYLOAD) {
+      _stats.dropped++;
+      return false;
+    }
+    ESPNOWRxFrame& frame = _frames[head & (N - 1)];
+    memcpy(frame.mac, mac, 6);
+    memcpy(frame.data, data, len);
+    frame.len = len;
+    frame.time = time;
+    _head.store(head + 1, std::memory_order_release);
+
+    _stats.received++;
+    if (depth + 1 > _stats.highWater) _stats.highWater = depth + 1;
+    return true;
+  }
+
+  // Consumer: oldest frame, or nullptr if empty. Valid until pop().
+  const ESPNOWRxFrame* front() const {
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    if (_head.load(std::memory_order_acquire) == tail) return nullptr;
+    return &_frames[tail & (N - 1)];
+  }
+
+  void pop() {
+    _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    _stats.processed++;
+  }
+
+  // Consumer: hand up to max frames to process(frame), oldest first.
+  // Returns the number processed.
+  template <typename F>
+  uint16_t drain(uint16_t max, F process) {
+    uint32_t depth = size();
+    if (depth == 0) return 0;
+    _stats.drains++;
+    _stats.depthSum += depth;
+
+    uint16_t done = 0;
+    const ESPNOWRxFrame* frame;
+    while (done < max && (frame = front()) != nullptr) {
+      process(*frame);
+      pop();
+      done++;
+    }
+    return done;
+  }
+
+  uint32_t size() const {
+    return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_relaxed);
+  }
+  uint16_t capacity() const { return N; }
+
+  // Producer side
+  void recordCallbackCycles(uint32_t cycles) {
+    if (cycles > _stats.callbackCyclesMax) _stats.callbackCyclesMax = cycles;
+  }
+
+  const ESPNOWQueueStats& stats() const { return _stats; }
+
+private:
+  ESPNOWRxFrame _frames[N];
+  std::atomic<uint32_t> _head{0};
+  std::atomic<uint32_t> _tail{0};
+  ESPNOWQueueStats _stats;
+};
+
+#endif // ESPNOW_QUEUE_H
@@ -0,0 +1,121 @@
+/*
+ * ESP-NOW Acknowledged Delivery Implementation
+ * For SONOFF S31 ESP8266 Project
+ */
+
+#include "espnow_reliable.h"
+
+// ===== RECEIVER =====
+
+SeqResult SeqWindow::accept(uint16_t seq) {
+  if (!valid) {
+    valid = true;
+    last = seq;
+    seen = 1;
+    return SEQ_NEW;
+  }
+
+  int16_t ahead = (int16_t)(seq - last);
+  if (ahead > 0) {
+    seen = ahead >= SEQ_WINDOW_BITS ? 1 : (seen << ahead) | 1;
+    last = seq;
+    return SEQ_NEW;
+  }
+  if (ahead <= -SEQ_WINDOW_BITS) {
+    // Far behind: the sender restarted its sequence, start over
+    last = seq;
+    seen = 1;
+    return SEQ_NEW;
+  }
+
+  uint32_t bit = 1UL << -ahead;
+  if (seen & bit) return SEQ_DUPLICATE;
+  seen |= bit;
+  return SEQ_LATE;
+}
+
+SeqResult SeqWindow::check(uint16_t seq) const {
+  SeqWindow copy = *this;
+  return copy.accept(seq);
+}
+
+// ===== SENDER =====
+
+void DeliveryStats::recordAck(uint32_t rttUs) {
+  delivered++;
+  rttLastUs = rttUs;
+  rttAvgUs = delivered == 1 ? rttUs : rttAvgUs - rttAvgUs / 8 + rttUs / 8;
+  if (rttUs > rttMaxUs) rttMaxUs = rttUs;
+}
+
+ReliableOutbox::ReliableOutbox() : _nextSeq(1) {}
+
+void ReliableOutbox::seed(uint16_t start) {
+  _nextSeq = start ? start : 1;
+}
+
+uint16_t ReliableOutbox::takeSeq() {
+  uint16_t seq = _nextSeq++;
+  if (_nextSeq == 0) _nextSeq = 1;  // 0 means unsequenced
+  return seq;
+}
+
+bool ReliableOutbox::queue(const uint8_t* mac, WireMessage& msg, uint32_t nowUs, DeliveryStats* stats) {
+  bool alert = msg.type == MSG_CURRENT_HIGH || msg.type == MSG_CURRENT_LOW;
+  OutboxEntry* slot = nullptr;
+
+  for (uint8_t i = 0; i < RELIABLE_OUTBOX_SLOTS; i++) {
+    OutboxEntry& e = _entries[i];
+    if (!e.used) {
+      if (!slot) slot = &e;
+      continue;
+    }
+    if (alert && memcmp(e.mac, mac, 6) == 0 &&
+        (e.type == MSG_CURRENT_HIGH || e.type == MSG_CURRENT_LOW)) {
+      // Only the latest level matters, stop retrying the old one
+      if (stats) stats->superseded++;
+      e.used = false;
+      _pending--;
+      slot = &e;
+    }
+  }
+  if (!slot) {
+    _overflows++;
+    return false;
+  }
+
+  msg.seq = takeSeq();
+  size_t len = wireEncode(msg, slot->frame, sizeof(slot->frame));
+  if (len == 0) {
+    return false;
+  }
+
+  memcpy(slot->mac, mac, 6);
+  slot->type = msg.type;
+  slot->seq = msg.seq;
+  slot->len = (uint8_t)len;
+  slot->attempts = 0;
+  slot->nextUs = nowUs;
+  slot->used = true;
+  _pending++;
+  if (stats) stats->sent++;
+  return true;
+}
+
+bool ReliableOutbox::ack(const uint8_t* mac, uint16_t seq, uint32_t nowUs, DeliveryStats* stats) {
+  for (uint8_t i = 0; i < RELIABLE_OUTBOX_SLOTS; i++) {
+    OutboxEntry& e = _entries[i];
+    if (e.used && e.seq == seq && memcmp(e.mac, mac, 6) == 0) {
+      e.used = false;
+      _pending--;
+      if (stats) stats->recordAck(nowUs - e.firstSentUs);
+      return true;
+    }
+  }
+  return false;
+}
+
+void ReliableOutbox::clear() {
+  for (uint8_t i = 0; i < RELIABLE_OUTBOX_SLOTS; i++) _entries[i].used = false;
+  _pending = 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * ESP-NOW Acknowledged Delivery
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Current alerts and relay commands carry a sequence number (v2 wire
+ * format) and are acknowledged by the receiver with MSG_ACK:
+ *
+ *   sender                               receiver
+ *   outbox.queue() ── msg, seq ────────► SeqWindow::accept(seq)
+ *        │  no ACK in RELIABLE_ACK_TIMEOUT_MS        │ new: process it
+ *        │  resend, timeout doubles                  │ duplicate: skip it
+ *        ◄─────────────── MSG_ACK, seq ──────────────┘ ACK either way
+ *
+ * A message is given up after RELIABLE_MAX_ATTEMPTS sends. A newer alert to
+ * the same peer replaces a pending one, so only the level the child should
+ * be at is retried. The receiver remembers the last 32 sequence numbers per
+ * sender, so retransmissions whose ACK was lost are not applied twice.
+ *
+ * Queued messages are kept encoded (v2), a few dozen bytes a slot rather
+ * than a whole WireMessage; the outbox is only used for v2 receivers.
+ *
+ * Delivery counts and the time from first send to ACK are kept per peer.
+ * No ESP-NOW calls here, sending is passed in, so it also builds on the host.
+ */
+
+#ifndef ESPNOW_RELIABLE_H
+#define ESPNOW_RELIABLE_H
+
+#include "espnow_wire.h"
+
+#define SEQ_WINDOW_BITS 32
+#define RELIABLE_FRAME_BYTES 48            // Longest message queued: alerts take 8 bytes, relay commands ~35
+
+enum SeqResult {
+  SEQ_DUPLICATE = 0,                       // seen before, do not process again
+  SEQ_NEW = 1,                             // newest from this sender
+  SEQ_LATE = 2                             // not seen, but older than the newest
+};
+
+// Receiver side: which recent sequence numbers of one sender were seen
+struct SeqWindow {
+  uint16_t last = 0;                       // newest accepted
+  uint32_t seen = 0;                       // bit i: last - i was accepted
+  bool valid = false;
+
+  SeqResult accept(uint16_t seq);
+  SeqResult check(uint16_t seq) const;     // what accept() would return, recording nothing
+};
+
+// Per-peer delivery figures
+struct DeliveryStats {
+  uint32_t sent = 0;                       // messages queued for this peer
+  uint32_t delivered = 0;                  // acknowledged
+  uint32_t failed = 0;                     // given up after RELIABLE_MAX_ATTEMPTS
+  uint32_t superseded = 0;                 // replaced by a newer alert before its ACK
+  uint32_t retries = 0;                    // resends
+  uint32_t rttLastUs = 0;                  // first send to ACK, retries included
+  uint32_t rttAvgUs = 0;                   // moving average, 1/8 weight
+  uint32_t rttMaxUs = 0;
+
+  void recordAck(uint32_t rttUs);
+};
+
+struct OutboxEntry {
+  bool used = false;
+  uint8_t mac[6];
+  uint8_t type = 0;                        // of the message, for superseding alerts
+  uint16_t seq = 0;
+  uint8_t len = 0;
+  uint8_t frame[RELIABLE_FRAME_BYTES];     // the message, encoded
+  uint8_t attempts = 0;
+  uint32_t firstSentUs = 0;
+  uint32_t nextUs = 0;                     // next send due
+};
+
+class ReliableOutbox {
+public:
+  ReliableOutbox();
+
+  // Start of the sequence, random per boot so a restarted sender is not
+  // taken for a retransmission
+  void seed(uint16_t start);
+
+  // Queue msg for mac with the next sequence number (written to msg.seq),
+  // replacing a pending alert to the same peer. It is first sent by the
+  // next poll(). Returns false if the outbox is full or msg encodes to more
+  // than RELIABLE_FRAME_BYTES.
+  bool queue(const uint8_t* mac, WireMessage& msg, uint32_t nowUs, DeliveryStats* stats);
+
+  // The next sequence number, for a message sent outside the outbox (group
+  // alerts). One sequence keeps each receiver's window in order.
+  uint16_t takeSeq();
+
+  // An ACK arrived. Returns false if nothing was waiting for it.
+  bool ack(const uint8_t* mac, uint16_t seq, uint32_t nowUs, DeliveryStats* stats);
+
+  // Send what is due: send(mac, entry) for each (re)transmission of
+  // entry.frame, and gaveUp(mac, entry) once per message that ran out of
+  // attempts. stats(mac) returns the peer's DeliveryStats or nullptr.
+  template <typename Send, typename GaveUp, typename Stats>
+  void poll(uint32_t nowUs, Send send, GaveUp gaveUp, Stats stats) {
+    for (uint8_t i = 0; i < RELIABLE_OUTBOX_SLOTS; i++) {
+      OutboxEntry& e = _entries[i];
+      if (!e.used || (int32_t)(nowUs - e.nextUs) < 0) continue;
+
+      DeliveryStats* s = stats(e.mac);
+      if (e.attempts >= RELIABLE_MAX_ATTEMPTS) {
+        e.used = false;
+        _pending--;
+        if (s) s->failed++;
+        gaveUp(e.mac, e);
+        continue;
+      }
+      if (e.attempts == 0) {
+        e.firstSentUs = nowUs;
+      } else if (s) {
+        s->retries++;
+      }
+      send(e.mac, e);
+      e.nextUs = nowUs + ((uint32_t)RELIABLE_ACK_TIMEOUT_MS * 1000 << e.attempts);
+      e.attempts++;
+    }
+  }
+
+  uint8_t pending() const { return _pending; }
+  uint32_t overflows() const { return _overflows; }
+  void clear();
+
+private:
+  OutboxEntry _entries[RELIABLE_OUTBOX_SLOTS];
+  uint16_t _nextSeq;
+  uint8_t _pending = 0;
+  uint32_t _overflows = 0;
+};
+
+// Message types that are sequenced and acknowledged
+inline bool wireIsReliable(uint8_t type) {
+  return type == MSG_COMMAND || type == MSG_CURRENT_HIGH || type == MSG_CURRENT_LOW;
+}
+
+#endif // ESPNOW_RELIABLE_H
@@ -0,0 +1,331 @@
+/*
+ * ESP-NOW Wire Format Implementation
+ * For SONOFF S31 ESP8266 Project
+ */
+
+#include "espnow_wire.h"
+#include "beacon.h"
+
+// Appends fields to a buffer, remembers if anything did not fit
+struct WireWriter {
+  uint8_t* buf;
+  size_t size;
+  size_t len = 0;
+  bool overflow = false;
+
+  WireWriter(uint8_t* b, size_t s) : buf(b), size(s) {}
+
+  void u8(uint8_t v) {
+    if (len + 1 > size) {
+      overflow = true;
+      return;
+    }
+    buf[len++] = v;
+  }
+  void u16(uint16_t v) {
+    u8(v & 0xFF);
+    u8(v >> 8);
+  }
+  void u32(uint32_t v) {
+    u16(v & 0xFFFF);
+    u16(v >> 16);
+  }
+  void f32(float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    u32(bits);
+  }
+  void bytes(const uint8_t* p, size_t n) {
+    for (size_t i = 0; i < n; i++) u8(p[i]);
+  }
+  void str(const char* s) {
+    size_t n = strnlen(s, WIRE_STRING_MAX);
+    u8((uint8_t)n);
+    bytes((const uint8_t*)s, n);
+  }
+};
+
+// Reads fields back, any read past the end marks the message malformed
+struct WireReader {
+  const uint8_t* data;
+  size_t len;
+  size_t pos = 0;
+  bool error = false;
+
+  WireReader(const uint8_t* d, size_t l) : data(d), len(l) {}
+
+  size_t remaining() const { return pos < len ? len - pos : 0; }
+
+  uint8_t u8() {
+    if (pos + 1 > len) {
+      error = true;
+      return 0;
+    }
+    return data[pos++];
+  }
+  uint16_t u16() {
+    uint16_t lo = u8();
+    return lo | (uint16_t)u8() << 8;
+  }
+  uint32_t u32() {
+    uint32_t lo = u16();
+    return lo | (uint32_t)u16() << 16;
+  }
+  float f32() {
+    uint32_t bits = u32();
+    float v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+  }
+  void bytes(uint8_t* p, size_t n) {
+    for (size_t i = 0; i < n; i++) p[i] = u8();
+  }
+  void str(char* s) {
+    size_t n = u8();
+    if (n > WIRE_STRING_MAX || pos + n > len) {
+      error = true;
+      s[0] = '\0';
+      return;
+    }
+    memcpy(s, data + pos, n);
+    s[n] = '\0';
+    pos += n;
+  }
+};
+
+// Scale to a 16-bit fixed-point unit, clamped
+static uint16_t toFixed16(float value, float scale) {
+  float scaled = value * scale + 0.5f;
+  if (!(scaled > 0)) return 0;
+  if (scaled > 65535.0f) return 65535;
+  return (uint16_t)scaled;
+}
+
+void wireSetString(char* field, const char* value) {
+  strncpy(field, value, WIRE_STRING_MAX);
+  field[WIRE_STRING_MAX] = '\0';
+}
+
+size_t wireEncode(const WireMessage& msg, uint8_t* buf, size_t size) {
+  WireWriter w(buf, size);
+  w.u8(ESPNOW_WIRE_V2);
+  w.u8(msg.type);
+
+  switch (msg.type) {
+    case MSG_DEVICE_STATE:
+      w.u8((msg.relay ? 0x01 : 0) | (msg.wifi ? 0x02 : 0));
+      w.u16(toFixed16(msg.voltage, 10));
+      w.u16(toFixed16(msg.current, 1000));
+      w.u16(toFixed16(msg.power, 10));
+      w.f32(msg.energy);
+      w.u32(msg.uptime);
+      w.str(msg.deviceId);
+      if (msg.followUs || msg.alertSeq) w.u32(msg.followUs);
+      if (msg.alertSeq) w.u16(msg.alertSeq);
+      break;
+
+    case MSG_COMMAND:
+      w.str(msg.command);
+      w.str(msg.value);
+      w.str(msg.deviceId);
+      if (msg.seq) w.u16(msg.seq);
+      break;
+
+    case MSG_HEARTBEAT:
+      w.str(msg.deviceId);
+      if (msg.stamp || msg.alertSeq) w.u32(msg.stamp);
+      if (msg.alertSeq) w.u16(msg.alertSeq);
+      break;
+
+    case MSG_PAIRING:
+      w.u8((msg.isParent ? 0x01 : 0) | (msg.hasParent ? 0x02 : 0));
+      w.u8(msg.childCount);
+      if (msg.hasParent) w.bytes(msg.parentMac, 6);
+      w.str(msg.deviceId);
+      if (msg.groupId) w.u16(msg.groupId);
+      break;
+
+    case MSG_PAIRING_RESPONSE:
+      w.u8(msg.accepted ? 0x01 : 0);
+      w.str(msg.deviceId);
+      break;
+
+    case MSG_CURRENT_HIGH:
+    case MSG_CURRENT_LOW:
+      if (msg.seq || msg.stamp) w.u16(msg.seq);
+      if (msg.stamp) w.u32(msg.stamp);
+      break;
+
+    case MSG_ACK:
+    case MSG_ALERT_NACK:
+      w.u16(msg.seq);
+      break;
+
+    case MSG_STATE_DELTA:
+      w.u8(msg.fields);
+      if (msg.fields & (BEACON_RELAY | BEACON_WIFI)) {
+        w.u8((msg.relay ? 0x01 : 0) | (msg.wifi ? 0x02 : 0));
+      }
+      if (msg.fields & BEACON_VOLTAGE) w.u16(toFixed16(msg.voltage, 10));
+      if (msg.fields & BEACON_CURRENT) w.u16(toFixed16(msg.current, 1000));
+      if (msg.fields & BEACON_POWER) w.u16(toFixed16(msg.power, 10));
+      if (msg.fields & BEACON_ENERGY) w.f32(msg.energy);
+      if (msg.fields & BEACON_UPTIME) w.u32(msg.uptime);
+      w.str(msg.deviceId);
+      if (msg.followUs || msg.alertSeq) w.u32(msg.followUs);
+      if (msg.alertSeq) w.u16(msg.alertSeq);
+      break;
+
+    case MSG_MESH:
+      w.bytes(msg.meshOrigin, 6);
+      w.bytes(msg.meshDest, 6);
+      w.u16(msg.meshId);
+      w.u8(msg.meshTtl);
+      w.u8(msg.meshHops);
+      w.u8(msg.meshInner);
+      w.u16(msg.seq);
+      w.u32(msg.meshStamp);
+      w.u8(msg.meshArg);
+      break;
+
+    case MSG_GROUP_ALERT:
+      w.u16(msg.groupId);
+      w.u16(msg.seq);
+      w.u8(msg.high ? 0x01 : 0);
+      if (msg.stamp) w.u32(msg.stamp);
+      break;
+
+    case MSG_TIME_SYNC:
+      w.u32(msg.syncOrigin);
+      w.u32(msg.syncReceive);
+      w.u32(msg.syncTransmit);
+      break;
+
+    default:
+      break;  // header only
+  }
+
+  return w.overflow ? 0 : w.len;
+}
+
+bool wireDecode(const uint8_t* data, size_t len, WireMessage& msg) {
+  if (!wireIsV2(data, len)) return false;
+
+  WireReader r(data, len);
+  r.u8();  // version
+  msg = WireMessage();
+  msg.type = r.u8();
+
+  switch (msg.type) {
+    case MSG_DEVICE_STATE: {
+      uint8_t flags = r.u8();
+      msg.relay = flags & 0x01;
+      msg.wifi = flags & 0x02;
+      msg.voltage = r.u16() / 10.0f;
+      msg.current = r.u16() / 1000.0f;
+      msg.power = r.u16() / 10.0f;
+      msg.energy = r.f32();
+      msg.uptime = r.u32();
+      r.str(msg.deviceId);
+      if (r.remaining() >= 4) {
+        msg.followUs = r.u32();
+        if (r.remaining() >= 2) msg.alertSeq = r.u16();
+      }
+      break;
+    }
+
+    case MSG_COMMAND:
+      r.str(msg.command);
+      r.str(msg.value);
+      r.str(msg.deviceId);
+      if (r.remaining() >= 2) msg.seq = r.u16();
+      break;
+
+    case MSG_HEARTBEAT:
+      r.str(msg.deviceId);
+      if (r.remaining() >= 4) {
+        msg.stamp = r.u32();
+        if (r.remaining() >= 2) msg.alertSeq = r.u16();
+      }
+      break;
+
+    case MSG_PAIRING: {
+      uint8_t flags = r.u8();
+      msg.isParent = flags & 0x01;
+      msg.hasParent = flags & 0x02;
+      msg.childCount = r.u8();
+      if (msg.hasParent) r.bytes(msg.parentMac, 6);
+      r.str(msg.deviceId);
+      if (r.remaining() >= 2) msg.groupId = r.u16();
+      break;
+    }
+
+    case MSG_PAIRING_RESPONSE:
+      msg.accepted = r.u8() & 0x01;
+      r.str(msg.deviceId);
+      break;
+
+    case MSG_CURRENT_HIGH:
+    case MSG_CURRENT_LOW:
+      if (r.remaining() >= 2) msg.seq = r.u16();
+      if (r.remaining() >= 4) msg.stamp = r.u32();
+      break;
+
+    case MSG_ACK:
+    case MSG_ALERT_NACK:
+      msg.seq = r.u16();
+      break;
+
+    case MSG_STATE_DELTA:
+      msg.fields = r.u8() & BEACON_ALL;
+      if (msg.fields & (BEACON_RELAY | BEACON_WIFI)) {
+        uint8_t flags = r.u8();
+        msg.relay = flags & 0x01;
+        msg.wifi = flags & 0x02;
+      }
+      if (msg.fields & BEACON_VOLTAGE) msg.voltage = r.u16() / 10.0f;
+      if (msg.fields & BEACON_CURRENT) msg.current = r.u16() / 1000.0f;
+      if (msg.fields & BEACON_POWER) msg.power = r.u16() / 10.0f;
+      if (msg.fields & BEACON_ENERGY) msg.energy = r.f32();
+      if (msg.fields & BEACON_UPTIME) msg.uptime = r.u32();
+      r.str(msg.deviceId);
+      if (r.remaining() >= 4) {
+        msg.followUs = r.u32();
+        if (r.remaining() >= 2) msg.alertSeq = r.u16();
+      }
+      break;
+
+    case MSG_MESH:
+      r.bytes(msg.meshOrigin, 6);
+      r.bytes(msg.meshDest, 6);
+      msg.meshId = r.u16();
+      msg.meshTtl = r.u8();
+      msg.meshHops = r.u8();
+      msg.meshInner = r.u8();
+      msg.seq = r.u16();
+      msg.meshStamp = r.u32();
+      msg.meshArg = r.u8();
+      break;
+
+    case MSG_GROUP_ALERT:
+      msg.groupId = r.u16();
+      msg.seq = r.u16();
+      msg.high = r.u8() & 0x01;
+      if (r.remaining() >= 4) msg.stamp = r.u32();
+      break;
+
+    case MSG_TIME_SYNC:
+      msg.syncOrigin = r.u32();
+      msg.syncReceive = r.u32();
+      msg.syncTransmit = r.u32();
+      break;
+
+    case MSG_DISCOVERY:
+      break;
+
+    default:
+      return false;
+  }
+
+  return !r.error;
+}
@@ -0,0 +1,165 @@
+/*
+ * ESP-NOW Wire Format
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Two encodings of the same messages:
+ *   - v1 (legacy): the fixed 212-byte ESPNOWMessage struct with a JSON payload
+ *   - v2 (compact): [0xE2][type][packed fields], only the bytes in use
+ *
+ * Senders build a WireMessage and encode it in ESPNOW_WIRE_FORMAT; receivers
+ * accept both, telling them apart by length and first byte (a v1 message
+ * starts with its type, 1..9, and is always sizeof(ESPNOWMessage) long).
+ *
+ * Older firmware reads only v1. A v1 message from this firmware ends its
+ * payload with ESPNOW_WIRE_V2 (past the JSON's terminator, which older
+ * firmware stops at), so a receiver knows which senders also read v2 and
+ * sends v1 to the others (see sendMessage() in espnow_handler.cpp).
+ *
+ * v2 layout after the two header bytes, integers little-endian, strings as
+ * a length byte and the characters (no terminator):
+ *   DEVICE_STATE      flags(relay, wifi) voltage:u16 0.1V  current:u16 mA
+ *                     power:u16 0.1W  energy:f32 Wh  uptime:u32 ms  deviceId:str
+ *   COMMAND           command:str  value:str  sender:str
+ *   HEARTBEAT         deviceId:str  [stamp:u32]  [alertSeq:u16]
+ *   PAIRING           flags(isParent, hasParent) childCount:u8
+ *                     [parentMac:6 if hasParent]  deviceId:str  [groupId:u16]
+ *   PAIRING_RESPONSE  flags(accepted)  deviceId:str
+ *   ACK               seq:u16
+ *   STATE_DELTA       fields:u8 (BEACON_* bits), then only the fields set:
+ *                     [flags(relay, wifi)] [voltage:u16] [current:u16]
+ *                     [power:u16] [energy:f32] [uptime:u32], deviceId:str
+ *   MESH              origin:6  dest:6  id:u16  ttl:u8  hops:u8  inner:u8
+ *                     seq:u16  stamp:u32  arg:u8 (see mesh.h)
+ *   GROUP_ALERT       groupId:u16  seq:u16  flags(high)  [stamp:u32]
+ *   TIME_SYNC         origin:u32  receive:u32  transmit:u32 (see clock_sync.h)
+ *   ALERT_NACK        seq:u16
+ *   DISCOVERY, CURRENT_HIGH, CURRENT_LOW: header only
+ * COMMAND, CURRENT_HIGH and CURRENT_LOW may be followed by seq:u16, which
+ * asks the receiver to acknowledge them (see espnow_reliable.h); the alerts
+ * then by stamp:u32, the seq being 0 if unsequenced.
+ * DEVICE_STATE and STATE_DELTA may be followed by follow:u32. A parent's
+ * DEVICE_STATE, STATE_DELTA and HEARTBEAT then carry alertSeq:u16, its last
+ * group alert, with the follow time or stamp before it written as 0 if none.
+ * Decoders ignore trailing bytes, so later versions may append fields.
+ *
+ * The JSON (v1) side lives in espnow_handler.cpp, this file has no
+ * ESP-NOW or ArduinoJson dependencies and also builds on the host.
+ */
+
+#ifndef ESPNOW_WIRE_H
+#define ESPNOW_WIRE_H
+
+#include "config.h"
+
+// ESP-NOW message types
+enum ESPNOWMessageType {
+  MSG_DEVICE_STATE = 1,
+  MSG_COMMAND = 2,
+  MSG_DISCOVERY = 3,
+  MSG_HEARTBEAT = 4,
+  MSG_PAIRING = 5,
+  MSG_PAIRING_RESPONSE = 6,
+  MSG_CURRENT_HIGH = 7,
+  MSG_CURRENT_LOW = 8,
+  MSG_ACK = 9,
+  MSG_STATE_DELTA = 10,                    // v2 only, fields that changed (beacon.h)
+  MSG_MESH = 11,                           // v2 only, forwarded envelope (mesh.h)
+  MSG_GROUP_ALERT = 12,                    // v2 only, current alert broadcast to a parent's children
+  MSG_TIME_SYNC = 13,                      // v2 only, parent's answer to a child's heartbeat
+  MSG_ALERT_NACK = 14                      // v2 only, child missed its parent's last group alert
+};
+
+// ESP-NOW message structure (v1 wire format)
+struct ESPNOWMessage {
+  uint8_t messageType;
+  uint8_t deviceId[6];
+  uint32_t timestamp;
+  char payload[200];
+};
+
+#define ESPNOW_WIRE_V2 0xE2                // First byte of a v2 message
+#define ESPNOW_MAX_PAYLOAD 250             // ESP-NOW frame payload limit
+#define WIRE_STRING_MAX 32                 // Longest string field
+
+// Decoded message, whichever format it came in. Only the fields of its
+// type are meaningful.
+struct WireMessage {
+  uint8_t type = 0;                        // ESPNOWMessageType
+  uint16_t seq = 0;                        // ACK, or sequenced message; 0 if unsequenced
+  char deviceId[WIRE_STRING_MAX + 1] = ""; // DEVICE_STATE, HEARTBEAT, PAIRING*; sender for COMMAND
+
+  // MSG_DEVICE_STATE, MSG_STATE_DELTA
+  uint8_t fields = 0;                      // STATE_DELTA: BEACON_* bits present
+  bool relay = false;
+  bool wifi = false;
+  float voltage = 0;
+  float current = 0;
+  float power = 0;
+  float energy = 0;
+  uint32_t uptime = 0;
+  uint32_t followUs = 0;                   // child's last sensing-to-switch time; 0 if none
+
+  // MSG_HEARTBEAT: sender's micros() at send. Alerts: parent's micros() when
+  // the sensor frame behind them arrived. 0 if not stamped
+  uint32_t stamp = 0;
+
+  // MSG_TIME_SYNC, micros() of the parent but for origin
+  uint32_t syncOrigin = 0;                 // the heartbeat's stamp, echoed
+  uint32_t syncReceive = 0;                // heartbeat received
+  uint32_t syncTransmit = 0;               // this reply sent
+
+  // MSG_COMMAND
+  char command[WIRE_STRING_MAX + 1] = "";
+  char value[WIRE_STRING_MAX + 1] = "";
+
+  // MSG_PAIRING / MSG_PAIRING_RESPONSE
+  bool isParent = false;
+  bool hasParent = false;
+  bool accepted = false;
+  uint8_t childCount = 0;
+  uint8_t parentMac[6] = {0};
+  uint16_t groupId = 0;                    // PAIRING from a parent, GROUP_ALERT; 0 if none
+
+  // MSG_GROUP_ALERT
+  bool high = false;
+  uint16_t alertSeq = 0;                   // parent's beacons: seq of its last group alert; 0 if none
+
+  // MSG_MESH, seq is the inner message's
+  uint8_t meshOrigin[6] = {0};             // node that started it
+  uint8_t meshDest[6] = {0};
+  uint16_t meshId = 0;                     // per origin, with it names the envelope
+  uint8_t meshTtl = 0;                     // sends left, including the next
+  uint8_t meshHops = 0;                    // sends so far
+  uint8_t meshInner = 0;                   // wrapped message type, header only
+  uint32_t meshStamp = 0;                  // origin's micros() at send, echoed in replies
+  uint8_t meshArg = 0;                     // ACK: hops the answered envelope took
+};
+
+// Encode as v2 into buf, returns the length or 0 if it does not fit
+size_t wireEncode(const WireMessage& msg, uint8_t* buf, size_t size);
+
+// Decode a v2 message, false if malformed or not v2
+bool wireDecode(const uint8_t* data, size_t len, WireMessage& msg);
+
+inline bool wireIsV2(const uint8_t* data, size_t len) {
+  return len >= 2 && data[0] == ESPNOW_WIRE_V2;
+}
+
+// Types v1 has, the rest are v2 only
+inline bool wireHasLegacy(uint8_t type) {
+  return type >= MSG_DEVICE_STATE && type <= MSG_ACK;
+}
+
+inline bool wireIsLegacy(const uint8_t* data, size_t len) {
+  return len == sizeof(ESPNOWMessage) && wireHasLegacy(data[0]);
+}
+
+// A v1 message whose sender also reads v2
+inline bool wireLegacyReadsV2(const ESPNOWMessage* msg) {
+  return (uint8_t)msg->payload[sizeof(msg->payload) - 1] == ESPNOW_WIRE_V2;
+}
+
+// Bounded copy into a WireMessage string field
+void wireSetString(char* field, const char* value);
+
+#endif // ESPNOW_WIRE_H
@@ -0,0 +1,24 @@
+/*
+ * Main Loop Profiler Implementation
+ * For SONOFF S31 ESP8266 Project
+ */
+
+#include "loop_profiler.h"
+
+LoopProfiler loopProfiler;
+
+static const char* const STAGE_NAMES[PERF_STAGES] = {
+  "ota", "web", "mdns", "mqtt", "button", "sensor", "overcurrent",
+  "espnowDrain", "espnow", "childOff", "pairing", "led", "readings", "sleep"
+};
+
+void LoopProfiler::reset() {
+  for (uint8_t i = 0; i < PERF_STAGES; i++) {
+    _stages[i] = PerfStageStats();
+  }
+  _resetAt = millis();
+}
+
+const char* LoopProfiler::stageName(uint8_t i) {
+  return i < PERF_STAGES ? STAGE_NAMES[i] : "unknown";
+}
@@ -0,0 +1,108 @@
+/*
+ * Main Loop Profiler
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Where loop() time goes, per stage (OTA, web server, mDNS, MQTT, sensor,
+ * ESP-NOW, ...): count, total, max and a log2 histogram of the time each
+ * run took, in CPU cycles (the Xtensa CCOUNT register, ESP.getCycleCount()).
+ *
+ *   { PERF_SCOPE(PERF_WEB); server.handleClient(); }
+ *
+ * times the rest of the block. A scope is two register reads, a count
+ * leading zeros (a libgcc call if the core has no instruction for it), a
+ * 64-bit add and a few 32-bit ones. That has only been timed on the host
+ * (bench/loop_profiler), not on the ESP8266; LOOP_PROFILER 0 compiles the
+ * scopes out. Stages are recorded from loop() only, and one run must take
+ * less than a CCOUNT wrap (53 s at 80 MHz).
+ *
+ * Host-compilable.
+ */
+
+#ifndef LOOP_PROFILER_H
+#define LOOP_PROFILER_H
+
+#include "config.h"
+
+#define PERF_BUCKETS 18                    // <1024 cycles, then powers of two up to 2^26+
+#define PERF_FIRST_BUCKET_BITS 10
+
+// Stages of loop(), in /api/perf order
+enum PerfStage : uint8_t {
+  PERF_OTA = 0,
+  PERF_WEB,
+  PERF_MDNS,
+  PERF_MQTT,
+  PERF_BUTTON,
+  PERF_SENSOR,                             // updateSensorReadings()
+  PERF_OVERCURRENT,                        // deferred part of a trip
+  PERF_ESPNOW_DRAIN,                       // received frames, resends
+  PERF_ESPNOW,                             // handleESPNOWMessages(): peers, beacons
+  PERF_CHILD_OFF,
+  PERF_PAIRING,
+  PERF_LED,
+  PERF_READINGS,                           // readings and power log
+  PERF_SLEEP,                              // loop() waiting for the next task
+  PERF_STAGES
+};
+
+struct PerfStageStats {
+  uint32_t count = 0;
+  uint64_t totalCycles = 0;
+  uint32_t maxCycles = 0;
+  uint32_t buckets[PERF_BUCKETS] = {};
+};
+
+class LoopProfiler {
+public:
+  void record(uint8_t stage, uint32_t cycles) {
+    PerfStageStats& s = _stages[stage];
+    s.count++;
+    s.totalCycles += cycles;
+    if (cycles > s.maxCycles) s.maxCycles = cycles;
+    s.buckets[bucketOf(cycles)]++;
+  }
+
+  // Clear every stage; stats cover from here on
+  void reset();
+  unsigned long resetAt() const { return _resetAt; }   // millis()
+
+  const PerfStageStats& stage(uint8_t i) const { return _stages[i]; }
+  static const char* stageName(uint8_t i);
+
+  static uint8_t bucketOf(uint32_t cycles) {
+    uint8_t bits = cycles ? 32 - __builtin_clz(cycles) : 0;
+    if (bits <= PERF_FIRST_BUCKET_BITS) return 0;
+    bits -= PERF_FIRST_BUCKET_BITS;
+    return bits < PERF_BUCKETS ? bits : PERF_BUCKETS - 1;
+  }
+
+  // Exclusive upper edge of bucket i in cycles, 0 for the last
+  static uint32_t bucketLimit(uint8_t i) {
+    return i + 1 < PERF_BUCKETS ? 1UL << (PERF_FIRST_BUCKET_BITS + i) : 0;
+  }
+
+private:
+  PerfStageStats _stages[PERF_STAGES];
+  unsigned long _resetAt = 0;
+};
+
+extern LoopProfiler loopProfiler;
+
+// Records the cycles from construction to the end of the scope
+class PerfScope {
+public:
+  explicit PerfScope(uint8_t stage) : _stage(stage), _start(ESP.getCycleCount()) {}
+  ~PerfScope() { loopProfiler.record(_stage, ESP.getCycleCount() - _start); }
+
+private:
+  uint8_t _stage;
+  uint32_t _start;
+};
+
+#if LOOP_PROFILER
+#define PERF_SCOPE(stage) PerfScope perfScope_(stage)
+#else
+#define PERF_SCOPE(stage) do {} while (0)
+#endif
+
+#endif // LOOP_PROFILER_H
@@ -0,0 +1,93 @@
+/*
+ * ESP-NOW Mesh Forwarding Implementation
+ * For SONOFF S31 ESP8266 Project
+ */
+
+#include "mesh.h"
+
+MeshRouter::MeshRouter() : _nextId(1) {
+  memset(_self, 0, sizeof(_self));
+  memset(_seen, 0, sizeof(_seen));
+}
+
+void MeshRouter::begin(const uint8_t* self, uint16_t firstId) {
+  memcpy(_self, self, 6);
+  _nextId = firstId;
+}
+
+bool MeshRouter::remember(const uint8_t* origin, uint16_t id) {
+  for (uint8_t i = 0; i < MESH_CACHE_SLOTS; i++) {
+    const Seen& s = _seen[i];
+    if (s.used && s.id == id && memcmp(s.origin, origin, 6) == 0) return false;
+  }
+  // Oldest entry makes room
+  Seen& s = _seen[_seenNext];
+  _seenNext = (_seenNext + 1) % MESH_CACHE_SLOTS;
+  memcpy(s.origin, origin, 6);
+  s.id = id;
+  s.used = true;
+  return true;
+}
+
+void MeshRouter::originate(WireMessage& env, const uint8_t* dest, uint8_t inner, uint16_t seq,
+                           uint32_t nowUs, uint8_t arg) {
+  env = WireMessage();
+  env.type = MSG_MESH;
+  memcpy(env.meshOrigin, _self, 6);
+  memcpy(env.meshDest, dest, 6);
+  env.meshId = _nextId++;
+  env.meshTtl = MESH_TTL;
+  env.meshHops = 0;
+  env.meshInner = inner;
+  env.meshStamp = nowUs;
+  env.meshArg = arg;
+  env.seq = seq;
+
+  // Our own flood comes back from the neighbours
+  remember(_self, env.meshId);
+  _stats.originated++;
+}
+
+void MeshRouter::reply(WireMessage& ack, const WireMessage& env, uint8_t inner) {
+  originate(ack, env.meshOrigin, inner, env.seq, env.meshStamp, env.meshHops);
+}
+
+MeshAction MeshRouter::receive(WireMessage& env) {
+  if (!remember(env.meshOrigin, env.meshId)) {
+    _stats.duplicates++;
+    return MESH_DUPLICATE;
+  }
+
+  // Hops counts the re-sends, the first transmission is hop 1
+  env.meshHops++;
+
+  if (memcmp(env.meshDest, _self, 6) == 0) {
+    _stats.received++;
+    _stats.hops[env.meshHops < MESH_MAX_HOPS ? env.meshHops : MESH_MAX_HOPS]++;
+    return MESH_FOR_US;
+  }
+
+  if (env.meshTtl <= 1 || !MESH_RELAY) {
+    _stats.expired++;
+    return MESH_EXPIRED;
+  }
+  env.meshTtl--;
+  _stats.forwarded++;
+  return MESH_FORWARD;
+}
+
+void MeshRouter::recordRoundTrip(const WireMessage& env, uint32_t nowUs) {
+  uint32_t rtt = nowUs - env.meshStamp;
+  uint8_t hops = env.meshArg + env.meshHops;
+  uint32_t perHop = hops ? rtt / hops : rtt;
+
+  _stats.roundTrips++;
+  _stats.rttLastUs = rtt;
+  if (_stats.roundTrips == 1) {
+    _stats.rttAvgUs = rtt;
+    _stats.hopUsAvg = perHop;
+  } else {
+    _stats.rttAvgUs = _stats.rttAvgUs - _stats.rttAvgUs / 8 + rtt / 8;
+    _stats.hopUsAvg = _stats.hopUsAvg - _stats.hopUsAvg / 8 + perHop / 8;
+  }
+}
@@ -0,0 +1,94 @@
+/*
+ * ESP-NOW Mesh Forwarding
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Lets a current alert reach a child out of the parent's radio range by way
+ * of other S31s. The alert is wrapped in a MSG_MESH envelope and broadcast:
+ *
+ *   parent ── MESH(origin=P, dest=C, id, ttl=3) ──► any S31 in range
+ *                                                    │ not seen before, not for it:
+ *                                                    │ ttl-1, hops+1, broadcast again
+ *   child C ◄────────────────────────────────────────┘
+ *      └── MESH(origin=C, dest=P, inner=ACK, seq) ──► back the same way
+ *
+ * Every node remembers the last MESH_CACHE_SLOTS (origin, id) pairs it
+ * handled and drops copies it hears again, so a flood costs at most one
+ * send per node. The envelope carries the alert's ACK sequence number, so
+ * the child orders it against direct copies (SeqWindow) and the mesh ACK
+ * completes the parent's ReliableOutbox entry. The origin's send time is
+ * echoed in the ACK, which gives the round trip and, with the hop counts of
+ * both ways, the latency per hop.
+ *
+ * No ESP-NOW calls here, the caller sends the envelopes; builds on the host.
+ */
+
+#ifndef MESH_H
+#define MESH_H
+
+#include "espnow_wire.h"
+
+#define MESH_MAX_HOPS 8                    // Histogram buckets, and TTL ceiling
+
+enum MeshAction {
+  MESH_DUPLICATE = 0,                      // handled before, drop
+  MESH_FOR_US = 1,                         // addressed to this node, process the inner message
+  MESH_FORWARD = 2,                        // envelope updated, broadcast it again
+  MESH_EXPIRED = 3                         // not for us and out of hops, drop
+};
+
+struct MeshStats {
+  uint32_t originated = 0;                 // envelopes this node started
+  uint32_t forwarded = 0;                  // other nodes' envelopes re-sent
+  uint32_t received = 0;                   // envelopes addressed to this node
+  uint32_t duplicates = 0;                 // copies dropped by the cache
+  uint32_t expired = 0;                    // dropped with no hops left
+  uint32_t hops[MESH_MAX_HOPS + 1] = {0};  // received envelopes by hops taken
+  uint32_t roundTrips = 0;                 // mesh ACKs for our own envelopes
+  uint32_t rttLastUs = 0;
+  uint32_t rttAvgUs = 0;                   // moving average, 1/8 weight
+  uint32_t hopUsAvg = 0;                   // round trip over hops out and back, same weight
+};
+
+class MeshRouter {
+public:
+  MeshRouter();
+
+  // This node's MAC and the first envelope id (random per boot)
+  void begin(const uint8_t* self, uint16_t firstId);
+
+  // Fill env to carry inner (a header-only type, e.g. MSG_CURRENT_HIGH,
+  // with its ACK seq) to dest. arg rides along unchanged.
+  void originate(WireMessage& env, const uint8_t* dest, uint8_t inner, uint16_t seq,
+                 uint32_t nowUs, uint8_t arg = 0);
+
+  // Fill ack to answer env (addressed to us) with inner, echoing its
+  // sequence number and send time and carrying its hop count back
+  void reply(WireMessage& ack, const WireMessage& env, uint8_t inner);
+
+  // An envelope arrived. For MESH_FORWARD env is ready to send again.
+  MeshAction receive(WireMessage& env);
+
+  // A mesh ACK for one of our envelopes: env.meshStamp is our send time,
+  // env.meshArg the hops the envelope took, env.meshHops the way back
+  void recordRoundTrip(const WireMessage& env, uint32_t nowUs);
+
+  const MeshStats& stats() const { return _stats; }
+
+private:
+  struct Seen {
+    uint8_t origin[6];
+    uint16_t id;
+    bool used;
+  };
+
+  // False if (origin, id) is already in the cache, else adds it
+  bool remember(const uint8_t* origin, uint16_t id);
+
+  uint8_t _self[6];
+  uint16_t _nextId;
+  Seen _seen[MESH_CACHE_SLOTS];
+  uint8_t _seenNext = 0;
+  MeshStats _stats;
+};
+
+#endif // MESH_H
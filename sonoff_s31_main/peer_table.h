@@ -0,0 +1,284 @@
+/*
+ * ESP-NOW Peer Table
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Peers keyed by MAC, with constant-time lookup and removal:
+ *   - slots:  fixed array of peers; a peer keeps its slot until it is removed,
+ *             so pointers stay valid while it is in the table
+ *   - index:  open-addressing hash of MAC -> slot, linear probing, at most
+ *             half full; removal shifts the probe run back (no tombstones)
+ *   - timers: min-heap with one entry per peer, the next time it may go
+ *             offline or expire. Seeing a peer only updates lastSeen; when its
+ *             entry comes due it is pushed back to lastSeen + timeout instead.
+ * So receiving a message is one hash probe, and expiry costs O(log n) per
+ * peer per timeout instead of a scan of every peer on every loop pass.
+ *
+ * Times are millis(), compared wrap-safe.
+ */
+
+#ifndef PEER_TABLE_H
+#define PEER_TABLE_H
+
+#include "config.h"
+#include "espnow_reliable.h"
+
+// Peer device structure
+struct ESPNOWPeer {
+  uint8_t mac[6];
+  String deviceId;
+  unsigned long lastSeen;
+  bool isOnline;
+  DeliveryStats delivery;                  // our acknowledged sends to it
+  SeqWindow rxSeq;                         // its sequence numbers we have seen
+  uint8_t wireFormat;                      // highest format it reads, 0 until heard
+  bool registered;                         // registered with the SDK for being in the table
+};
+
+template <uint16_t N>
+class PeerTable {
+public:
+  static_assert(N > 0 && N < 0x8000, "PeerTable capacity out of range");
+
+  PeerTable() { clear(); }
+
+  uint16_t size() const { return _count; }
+  uint16_t capacity() const { return N; }
+
+  // Slot i, nullptr if unused. Slots are not packed, iterate 0..capacity()-1.
+  ESPNOWPeer* slot(uint16_t i) { return _used[i] ? &_peers[i] : nullptr; }
+  const ESPNOWPeer* slot(uint16_t i) const { return _used[i] ? &_peers[i] : nullptr; }
+
+  ESPNOWPeer* find(const uint8_t* mac) {
+    uint16_t pos;
+    return lookup(mac, pos) ? &_peers[_index[pos]] : nullptr;
+  }
+
+  // Find or add the peer and mark it seen at now. Returns nullptr if it is
+  // new and the table is full; added tells whether it was new.
+  ESPNOWPeer* touch(const uint8_t* mac, unsigned long now, bool* added = nullptr) {
+    if (added) *added = false;
+    uint16_t pos;
+    if (lookup(mac, pos)) {
+      uint16_t s = _index[pos];
+      ESPNOWPeer& peer = _peers[s];
+      peer.lastSeen = now;
+      if (!peer.isOnline) {
+        // Its timer is set for expiry, bring the offline check forward
+        peer.isOnline = true;
+        heapUpdate(_heapPos[s], (uint32_t)now + PEER_OFFLINE_MS);
+      }
+      return &peer;
+    }
+    if (_count == N) return nullptr;
+
+    // pos is the empty bucket that ended the probe
+    uint16_t s = _free[--_freeCount];
+    _index[pos] = s;
+    _used[s] = true;
+    _count++;
+    ESPNOWPeer& peer = _peers[s];
+    memcpy(peer.mac, mac, 6);
+    peer.deviceId = "";
+    peer.lastSeen = now;
+    peer.isOnline = true;
+    peer.delivery = DeliveryStats();
+    peer.rxSeq = SeqWindow();
+    peer.wireFormat = 0;
+    peer.registered = false;
+    heapPush(s, (uint32_t)now + PEER_OFFLINE_MS);
+    if (added) *added = true;
+    return &peer;
+  }
+
+  bool remove(const uint8_t* mac) {
+    uint16_t pos;
+    if (!lookup(mac, pos)) return false;
+    uint16_t s = _index[pos];
+    unindex(pos);
+    heapRemove(_heapPos[s]);
+    release(s);
+    return true;
+  }
+
+  // Run the timers that are due: mark peers silent for more than
+  // PEER_OFFLINE_MS offline, remove those silent for more than
+  // PEER_EXPIRE_MS and pass each to onExpired (after it left the table).
+  // Returns the number removed.
+  template <typename F>
+  uint16_t expire(unsigned long now, F onExpired) {
+    uint16_t removed = 0;
+    while (_heapCount && due(_heap[0].due, now)) {
+      uint16_t s = _heap[0].slot;
+      ESPNOWPeer& peer = _peers[s];
+      uint32_t seen = (uint32_t)peer.lastSeen;
+
+      if (due(seen + PEER_EXPIRE_MS, now)) {
+        uint16_t pos;
+        lookup(peer.mac, pos);
+        unindex(pos);
+        heapRemove(0);
+        ESPNOWPeer gone = peer;
+        release(s);
+        removed++;
+        onExpired(gone);
+      } else if (due(seen + PEER_OFFLINE_MS, now)) {
+        peer.isOnline = false;
+        heapUpdate(0, seen + PEER_EXPIRE_MS);
+      } else {
+        heapUpdate(0, seen + PEER_OFFLINE_MS);  // seen since, check again later
+      }
+    }
+    return removed;
+  }
+
+  uint16_t expire(unsigned long now) {
+    return expire(now, [](const ESPNOWPeer&) {});
+  }
+
+  void clear() {
+    memset(_index, 0xFF, sizeof(_index));
+    for (uint16_t i = 0; i < N; i++) {
+      _used[i] = false;
+      _free[i] = N - 1 - i;  // hand out slot 0 first
+    }
+    _freeCount = N;
+    _count = 0;
+    _heapCount = 0;
+  }
+
+private:
+  static constexpr uint16_t EMPTY = 0xFFFF;
+
+  // Power of two at least 2N, so probe runs stay short
+  static constexpr uint32_t indexSize() {
+    uint32_t size = 2;
+    while (size < 2u * N) size <<= 1;
+    return size;
+  }
+  static constexpr uint32_t MASK = indexSize() - 1;
+
+  struct Timer {
+    uint32_t due;
+    uint16_t slot;
+  };
+
+  // now is past at
+  static bool due(uint32_t at, unsigned long now) {
+    return (int32_t)((uint32_t)now - at) > 0;
+  }
+
+  static uint32_t hash(const uint8_t* mac) {
+    // The vendor prefix is shared by most peers, mix in all six bytes
+    uint32_t lo = (uint32_t)mac[2] << 24 | (uint32_t)mac[3] << 16 | (uint32_t)mac[4] << 8 | mac[5];
+    uint32_t hi = (uint32_t)mac[0] << 8 | mac[1];
+    uint32_t h = (lo ^ (hi * 0x85EBCA6B)) * 0x9E3779B1;
+    return h ^ (h >> 16);
+  }
+
+  // Bucket of mac if present (true), else the empty bucket where it goes
+  bool lookup(const uint8_t* mac, uint16_t& pos) const {
+    uint32_t i = hash(mac) & MASK;
+    while (_index[i] != EMPTY) {
+      if (memcmp(_peers[_index[i]].mac, mac, 6) == 0) {
+        pos = i;
+        return true;
+      }
+      i = (i + 1) & MASK;
+    }
+    pos = i;
+    return false;
+  }
+
+  // Empty bucket pos, moving later entries of the run back so every entry
+  // stays reachable from its home bucket
+  void unindex(uint32_t pos) {
+    uint32_t hole = pos;
+    uint32_t i = pos;
+    for (;;) {
+      i = (i + 1) & MASK;
+      if (_index[i] == EMPTY) break;
+      uint32_t home = hash(_peers[_index[i]].mac) & MASK;
+      // Move i into the hole unless its home lies in (hole, i]
+      if (((i - home) & MASK) >= ((i - hole) & MASK)) {
+        _index[hole] = _index[i];
+        hole = i;
+      }
+    }
+    _index[hole] = EMPTY;
+  }
+
+  void release(uint16_t s) {
+    _used[s] = false;
+    _peers[s].deviceId = "";
+    _free[_freeCount++] = s;
+    _count--;
+  }
+
+  // ----- timer heap -----
+
+  static bool earlier(const Timer& a, const Timer& b) {
+    return (int32_t)(a.due - b.due) < 0;
+  }
+
+  void place(uint16_t i, const Timer& t) {
+    _heap[i] = t;
+    _heapPos[t.slot] = i;
+  }
+
+  void siftUp(uint16_t i) {
+    Timer t = _heap[i];
+    while (i > 0) {
+      uint16_t parent = (i - 1) / 2;
+      if (!earlier(t, _heap[parent])) break;
+      place(i, _heap[parent]);
+      i = parent;
+    }
+    place(i, t);
+  }
+
+  void siftDown(uint16_t i) {
+    Timer t = _heap[i];
+    for (;;) {
+      uint16_t child = 2 * i + 1;
+      if (child >= _heapCount) break;
+      if (child + 1 < _heapCount && earlier(_heap[child + 1], _heap[child])) child++;
+      if (!earlier(_heap[child], t)) break;
+      place(i, _heap[child]);
+      i = child;
+    }
+    place(i, t);
+  }
+
+  void heapPush(uint16_t s, uint32_t at) {
+    place(_heapCount, Timer{at, s});
+    siftUp(_heapCount++);
+  }
+
+  void heapUpdate(uint16_t i, uint32_t at) {
+    uint16_t s = _heap[i].slot;
+    _heap[i].due = at;
+    siftDown(i);
+    siftUp(_heapPos[s]);
+  }
+
+  void heapRemove(uint16_t i) {
+    _heapCount--;
+    if (i == _heapCount) return;
+    uint16_t moved = _heap[_heapCount].slot;
+    place(i, _heap[_heapCount]);
+    siftDown(i);
+    siftUp(_heapPos[moved]);
+  }
+
+  ESPNOWPeer _peers[N];
+  bool _used[N];
+  uint16_t _index[indexSize()];
+  uint16_t _free[N];
+  uint16_t _freeCount;
+  uint16_t _count;
+  Timer _heap[N];
+  uint16_t _heapPos[N];
+  uint16_t _heapCount;
+};
+
+#endif // PEER_TABLE_H
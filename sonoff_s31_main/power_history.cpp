@@ -0,0 +1,106 @@
+/*
+ * Power History Implementation
+ * For SONOFF S31 ESP8266 Project
+ */
+
+#include "power_history.h"
+
+static_assert(sizeof(PowerHistory) <= HISTORY_BUDGET_BYTES,
+              "Power history tiers exceed HISTORY_BUDGET_BYTES, shrink HISTORY_*_SAMPLES");
+
+// Global power history instance
+PowerHistory powerHistory;
+
+// Scale to a fixed-point unit, clamped to 16 bits
+static uint16_t quantize(float value, float scale) {
+  float scaled = value * scale + 0.5f;
+  if (!(scaled > 0)) return 0;  // also catches NaN
+  if (scaled > 65535.0f) return 65535;
+  return (uint16_t)scaled;
+}
+
+uint32_t PowerHistory::interval(HistoryTier tier) {
+  switch (tier) {
+    case HISTORY_SECOND: return 1000;
+    case HISTORY_MINUTE: return 60000;
+    default: return 0;
+  }
+}
+
+void PowerHistory::add(uint32_t time, float voltage, float current, float power) {
+  update(time);
+
+  HistorySample sample;
+  sample.time = time;
+  sample.power = quantize(power, 10);
+  sample.voltage = quantize(voltage, 10);
+  sample.current = quantize(current, 1000);
+  _raw.push(sample);
+
+  // A raw sample folds in as a one-frame rollup
+  HistoryRollup one = {time, sample.power, sample.power, sample.power, sample.voltage, sample.current, 1};
+  _accumulate(_second, time - time % 1000, one);
+}
+
+void PowerHistory::update(uint32_t now) {
+  if (_second.samples && now / 1000 != _second.time / 1000) {
+    _closeSecond();
+  }
+  if (_minute.samples && now / 60000 != _minute.time / 60000) {
+    _closeMinute();
+  }
+}
+
+void PowerHistory::clear() {
+  _raw.clear();
+  _seconds.clear();
+  _minutes.clear();
+  _second = {};
+  _minute = {};
+}
+
+// Fold a rollup into an open interval, weighted by its frame count
+void PowerHistory::_accumulate(Accumulator& acc, uint32_t time, const HistoryRollup& r) {
+  if (0 == acc.samples) {
+    acc.time = time;
+    acc.powerSum = acc.voltageSum = acc.currentSum = 0;
+    acc.powerMin = r.powerMin;
+    acc.powerMax = r.powerMax;
+  }
+  acc.powerSum += (uint32_t)r.powerAvg * r.samples;
+  acc.voltageSum += (uint32_t)r.voltage * r.samples;
+  acc.currentSum += (uint32_t)r.current * r.samples;
+  if (r.powerMin < acc.powerMin) acc.powerMin = r.powerMin;
+  if (r.powerMax > acc.powerMax) acc.powerMax = r.powerMax;
+  acc.samples += r.samples;
+}
+
+HistoryRollup PowerHistory::_rollup(const Accumulator& acc) {
+  HistoryRollup r;
+  uint32_t half = acc.samples / 2;
+  r.time = acc.time;
+  r.powerMin = acc.powerMin;
+  r.powerMax = acc.powerMax;
+  r.powerAvg = (acc.powerSum + half) / acc.samples;
+  r.voltage = (acc.voltageSum + half) / acc.samples;
+  r.current = (acc.currentSum + half) / acc.samples;
+  r.samples = acc.samples;
+  return r;
+}
+
+void PowerHistory::_closeSecond() {
+  HistoryRollup second = _rollup(_second);
+  _seconds.push(second);
+  _second.samples = 0;
+
+  // The second may start a new minute if no frame arrived in between
+  if (_minute.samples && second.time / 60000 != _minute.time / 60000) {
+    _closeMinute();
+  }
+  _accumulate(_minute, second.time - second.time % 60000, second);
+}
+
+void PowerHistory::_closeMinute() {
+  _minutes.push(_rollup(_minute));
+  _minute.samples = 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * Power History
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Fixed-size, multi-resolution time series of the CSE7766 readings, kept in
+ * RAM so the dashboard can chart load without an external database:
+ *   - raw:    one sample per sensor frame
+ *   - second: 1-second min/max/avg of the raw samples
+ *   - minute: 1-minute min/max/avg of the second rollups
+ * Every tier is a ring that overwrites its oldest entry, and the whole store
+ * is checked against HISTORY_BUDGET_BYTES at compile time. Rollups are built
+ * incrementally as samples arrive, nothing is recomputed on a query.
+ *
+ * Times are millis(), compared wrap-safe: entries and queries must lie
+ * within 24 days (half the wrap) of each other, the rings span 2 hours.
+ * Values are stored as integers (0.1W, 0.1V, mA) to halve the footprint;
+ * the S31 tops out at 16A / 3840W, well inside 16 bits.
+ */
+
+#ifndef POWER_HISTORY_H
+#define POWER_HISTORY_H
+
+#include "config.h"
+
+// One sensor frame
+struct HistorySample {
+  uint32_t time;        // millis() the frame arrived
+  uint16_t power;       // 0.1 W
+  uint16_t voltage;     // 0.1 V
+  uint16_t current;     // mA
+};
+
+// min/max/avg over one interval
+struct HistoryRollup {
+  uint32_t time;        // millis() at the start of the interval
+  uint16_t powerMin;    // 0.1 W
+  uint16_t powerMax;    // 0.1 W
+  uint16_t powerAvg;    // 0.1 W
+  uint16_t voltage;     // 0.1 V, average
+  uint16_t current;     // mA, average
+  uint16_t samples;     // frames that went into the interval
+};
+
+enum HistoryTier {
+  HISTORY_RAW = 0,
+  HISTORY_SECOND = 1,
+  HISTORY_MINUTE = 2
+};
+
+// Time a is earlier than time b, across the millis() wrap
+inline bool historyBefore(uint32_t a, uint32_t b) {
+  return (int32_t)(a - b) < 0;
+}
+
+// Ring of the N most recent entries, indexed oldest first
+template <typename T, uint16_t N>
+class HistoryRing {
+public:
+  void push(const T& item) {
+    _items[(_start + _count) % N] = item;
+    if (_count < N) {
+      _count++;
+    } else {
+      _start = (_start + 1) % N;
+    }
+  }
+  uint16_t size() const { return _count; }
+  uint16_t capacity() const { return N; }
+  const T& at(uint16_t i) const { return _items[(_start + i) % N]; }
+  void clear() { _start = _count = 0; }
+
+  // Index of the first entry not before from (size() if none). Entries are
+  // in time order, wrap-safe as historyBefore().
+  uint16_t lowerBound(uint32_t from) const {
+    uint16_t lo = 0, hi = _count;
+    while (lo < hi) {
+      uint16_t mid = (lo + hi) / 2;
+      if (historyBefore(at(mid).time, from)) lo = mid + 1;
+      else hi = mid;
+    }
+    return lo;
+  }
+
+private:
+  T _items[N];
+  uint16_t _start = 0;
+  uint16_t _count = 0;
+};
+
+class PowerHistory {
+public:
+  // Record one sensor frame, closing any finished rollups first
+  void add(uint32_t time, float voltage, float current, float power);
+
+  // Close rollups whose interval has passed, so a quiet sensor still shows
+  // up as gaps rather than one long open interval. Call periodically.
+  void update(uint32_t now);
+
+  void clear();
+
+  const HistoryRing<HistorySample, HISTORY_RAW_SAMPLES>& raw() const { return _raw; }
+  const HistoryRing<HistoryRollup, HISTORY_SECOND_SAMPLES>& seconds() const { return _seconds; }
+  const HistoryRing<HistoryRollup, HISTORY_MINUTE_SAMPLES>& minutes() const { return _minutes; }
+
+  static uint32_t interval(HistoryTier tier);  // ms per entry, 0 for raw
+
+private:
+  // Open rollup interval; sums are wide enough for a minute of frames
+  struct Accumulator {
+    uint32_t time;
+    uint32_t powerSum;
+    uint32_t voltageSum;
+    uint32_t currentSum;
+    uint16_t powerMin;
+    uint16_t powerMax;
+    uint16_t samples;
+  };
+
+  HistoryRing<HistorySample, HISTORY_RAW_SAMPLES> _raw;
+  HistoryRing<HistoryRollup, HISTORY_SECOND_SAMPLES> _seconds;
+  HistoryRing<HistoryRollup, HISTORY_MINUTE_SAMPLES> _minutes;
+  Accumulator _second = {};
+  Accumulator _minute = {};
+
+  static void _accumulate(Accumulator& acc, uint32_t time, const HistoryRollup& r);
+  static HistoryRollup _rollup(const Accumulator& acc);
+  void _closeSecond();
+  void _closeMinute();
+};
+
+// Global power history instance
+extern PowerHistory powerHistory;
+
+#endif // POWER_HISTORY_H
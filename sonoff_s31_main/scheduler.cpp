@@ -0,0 +1,128 @@
+/*
+ * Main Loop Task Scheduler Implementation
+ * For SONOFF S31 ESP8266 Project
+ */
+
+#include "scheduler.h"
+
+TaskScheduler::TaskScheduler(unsigned long (*clock)()) : _clock(clock) {}
+
+uint32_t TaskScheduler::now() {
+  uint32_t t = (uint32_t)_clock();
+  if (_count > 0) _elapsedUs += t - _lastNow;
+  _lastNow = t;
+  return t;
+}
+
+int8_t TaskScheduler::add(const char* name, TaskFunction run, uint32_t periodMs, uint32_t deadlineMs) {
+  if (_count >= SCHED_MAX_TASKS || run == nullptr) return -1;
+  uint32_t t = now();
+  uint8_t i = _count++;
+  SchedulerTask& task = _tasks[i];
+  task.name = name;
+  task.run = run;
+  task.periodUs = (periodMs > 0 ? periodMs : 1) * 1000UL;
+  task.deadlineUs = deadlineMs * 1000UL;
+  task.due = t;
+  task.lastStart = t;
+  task.stats = TaskStats();
+  place(i, i);
+  siftUp(i);
+  return (int8_t)i;
+}
+
+void TaskScheduler::setPeriod(int8_t task, uint32_t periodMs) {
+  if (task < 0 || task >= _count) return;
+  SchedulerTask& t = _tasks[task];
+  uint32_t period = (periodMs > 0 ? periodMs : 1) * 1000UL;
+  if (period == t.periodUs) return;
+  t.periodUs = period;
+  // The running task is rescheduled when it returns
+  if (task == _running) return;
+  t.due = t.lastStart + period;
+  siftDown(_heapPos[task]);
+  siftUp(_heapPos[task]);
+}
+
+uint32_t TaskScheduler::runNext() {
+  if (_count == 0) return 0;
+
+  uint32_t start = now();
+  uint8_t i = _heap[0];
+  SchedulerTask& task = _tasks[i];
+  if (!reached(task.due, start)) return task.due - start;
+
+  uint32_t late = start - task.due;
+  _running = i;
+  task.lastStart = start;
+  task.run();
+  _running = -1;
+  uint32_t end = now();
+  uint32_t took = end - start;
+
+  TaskStats& s = task.stats;
+  s.runs++;
+  if (late > task.deadlineUs) s.misses++;
+  if (late > s.lateMaxUs) s.lateMaxUs = late;
+  s.lateTotalUs += late;
+  if (took > s.runMaxUs) s.runMaxUs = took;
+  s.runTotalUs += took;
+  _busyUs += took;
+
+  reschedule(i);
+
+  uint32_t next = _tasks[_heap[0]].due;
+  return reached(next, end) ? 0 : next - end;
+}
+
+// Next run one period after the last was due, dropping runs already missed
+void TaskScheduler::reschedule(uint8_t task) {
+  SchedulerTask& t = _tasks[task];
+  uint32_t next = t.due + t.periodUs;
+  if (reached(next, _lastNow)) {
+    uint32_t missed = (_lastNow - t.due) / t.periodUs;
+    t.stats.skipped += missed;
+    next = t.due + (missed + 1) * t.periodUs;
+  }
+  t.due = next;
+  siftDown(_heapPos[task]);
+}
+
+void TaskScheduler::resetStats() {
+  for (uint8_t i = 0; i < _count; i++) {
+    _tasks[i].stats = TaskStats();
+  }
+  _elapsedUs = 0;
+  _busyUs = 0;
+}
+
+// ----- timer heap -----
+
+void TaskScheduler::place(uint8_t i, uint8_t task) {
+  _heap[i] = task;
+  _heapPos[task] = i;
+}
+
+void TaskScheduler::siftUp(uint8_t i) {
+  uint8_t task = _heap[i];
+  while (i > 0) {
+    uint8_t parent = (i - 1) / 2;
+    if (!earlier(_tasks[task].due, _tasks[_heap[parent]].due)) break;
+    place(i, _heap[parent]);
+    i = parent;
+  }
+  place(i, task);
+}
+
+void TaskScheduler::siftDown(uint8_t i) {
+  uint8_t task = _heap[i];
+  for (;;) {
+    uint8_t child = 2 * i + 1;
+    if (child >= _count) break;
+    if (child + 1 < _count && earlier(_tasks[_heap[child + 1]].due, _tasks[_heap[child]].due)) child++;
+    if (!earlier(_tasks[_heap[child]].due, _tasks[task].due)) break;
+    place(i, _heap[child]);
+    i = child;
+  }
+  place(i, task);
+}
@@ -0,0 +1,104 @@
+/*
+ * Main Loop Task Scheduler
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Cooperative, deadline-ordered scheduling of the work loop() used to do on
+ * every pass. Each task has a period and a deadline, how late a run may
+ * start before it counts as a miss:
+ *   - timers: min-heap of the tasks by next due time, as in peer_table.h;
+ *             runNext() runs the task due first and reports how long until
+ *             the next one, which is all loop() sleeps
+ *   - cadence: a task's next run is due one period after the last was due,
+ *             not after it ran, so a late run does not shift the ones after
+ *             it; a task a whole period behind drops the runs it missed
+ *             (counted as skipped) instead of running back to back
+ *   - stats:  per task, runs, misses, start lateness (jitter) and run time,
+ *             so a task that blocks the others shows up by name
+ * One task runs per call, so loop() returns (and the core services WiFi)
+ * between tasks even when several are due.
+ *
+ * Times are the clock passed in (micros()), compared wrap-safe; periods and
+ * deadlines must stay under half the wrap (35 minutes).
+ *
+ * Host-compilable.
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "config.h"
+
+typedef void (*TaskFunction)();
+
+struct TaskStats {
+  uint32_t runs = 0;
+  uint32_t misses = 0;                     // runs started after their deadline
+  uint32_t skipped = 0;                    // runs dropped, the task fell a period behind
+  uint32_t lateMaxUs = 0;                  // latest start after due
+  uint64_t lateTotalUs = 0;
+  uint32_t runMaxUs = 0;                   // longest run
+  uint64_t runTotalUs = 0;
+};
+
+struct SchedulerTask {
+  const char* name;
+  TaskFunction run;
+  uint32_t periodUs;
+  uint32_t deadlineUs;
+  uint32_t due;                            // next run, clock time
+  uint32_t lastStart;
+  TaskStats stats;
+};
+
+class TaskScheduler {
+public:
+  explicit TaskScheduler(unsigned long (*clock)());
+
+  // A task run every periodMs, first now; a run starting more than
+  // deadlineMs after it was due is a miss. Returns its index, -1 if full.
+  int8_t add(const char* name, TaskFunction run, uint32_t periodMs, uint32_t deadlineMs);
+
+  // Period of task from its last run on; a task may change its own
+  void setPeriod(int8_t task, uint32_t periodMs);
+
+  // Run the task due first, if any is due. Returns microseconds until the
+  // next one is due, 0 if one already is.
+  uint32_t runNext();
+
+  uint8_t size() const { return _count; }
+  const SchedulerTask& task(uint8_t i) const { return _tasks[i]; }
+
+  // Clock time since the stats were reset, and of it spent in tasks
+  uint64_t elapsedUs() const { return _elapsedUs; }
+  uint64_t busyUs() const { return _busyUs; }
+
+  void resetStats();
+
+private:
+  // now is at or past at
+  static bool reached(uint32_t at, uint32_t now) {
+    return (int32_t)(now - at) >= 0;
+  }
+
+  static bool earlier(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+  }
+
+  uint32_t now();
+  void place(uint8_t i, uint8_t task);
+  void siftUp(uint8_t i);
+  void siftDown(uint8_t i);
+  void reschedule(uint8_t task);
+
+  unsigned long (*_clock)();
+  SchedulerTask _tasks[SCHED_MAX_TASKS];
+  uint8_t _heap[SCHED_MAX_TASKS];          // task indices, earliest due first
+  uint8_t _heapPos[SCHED_MAX_TASKS];
+  uint8_t _count = 0;
+  int8_t _running = -1;
+  uint32_t _lastNow = 0;
+  uint64_t _elapsedUs = 0;
+  uint64_t _busyUs = 0;
+};
+
+#endif // SCHEDULER_H
@@ -0,0 +1,169 @@
+/*
+ * Streaming Sensor Statistics Implementation
+ * For SONOFF S31 ESP8266 Project
+ */
+
+#include "sensor_stats.h"
+#include <math.h>
+
+// Global sensor statistics
+SensorStats sensorStats;
+
+// ===== WINDOW STATS =====
+
+void WindowStats::add(float x) {
+  if (_count == STATS_WINDOW) {
+    _sumSquares -= _values[_next] * _values[_next];
+  } else {
+    _count++;
+  }
+  _values[_next] = x;
+  _sumSquares += x * x;
+  _next = (_next + 1) % STATS_WINDOW;
+
+  // Subtracting what was added leaves float rounding behind, start over each lap
+  if (0 == _next) {
+    _sumSquares = 0;
+    for (uint16_t i = 0; i < _count; i++) _sumSquares += _values[i] * _values[i];
+  }
+}
+
+float WindowStats::rms() const {
+  if (0 == _count) return 0;
+  float mean = _sumSquares / _count;
+  return mean > 0 ? sqrtf(mean) : 0;
+}
+
+float WindowStats::min() const {
+  if (0 == _count) return 0;
+  float m = _values[0];
+  for (uint16_t i = 1; i < _count; i++) if (_values[i] < m) m = _values[i];
+  return m;
+}
+
+float WindowStats::max() const {
+  if (0 == _count) return 0;
+  float m = _values[0];
+  for (uint16_t i = 1; i < _count; i++) if (_values[i] > m) m = _values[i];
+  return m;
+}
+
+void WindowStats::reset() {
+  _sumSquares = 0;
+  _next = 0;
+  _count = 0;
+}
+
+// ===== P² QUANTILE =====
+
+void P2Quantile::reset() {
+  _count = 0;
+  for (int i = 0; i < 5; i++) {
+    _q[i] = 0;
+    _n[i] = i;
+  }
+  _np[0] = 0;
+  _np[1] = 2 * _p;
+  _np[2] = 4 * _p;
+  _np[3] = 2 + 2 * _p;
+  _np[4] = 4;
+  _dn[0] = 0;
+  _dn[1] = _p / 2;
+  _dn[2] = _p;
+  _dn[3] = (1 + _p) / 2;
+  _dn[4] = 1;
+}
+
+void P2Quantile::add(float x) {
+  // The first five samples become the markers
+  if (_count < 5) {
+    int i = _count++;
+    while (i > 0 && _q[i - 1] > x) {
+      _q[i] = _q[i - 1];
+      i--;
+    }
+    _q[i] = x;
+    return;
+  }
+  _count++;
+
+  // Cell the sample falls in, stretching the extremes if needed
+  int k;
+  if (x < _q[0]) {
+    _q[0] = x;
+    k = 0;
+  } else if (x >= _q[4]) {
+    _q[4] = x;
+    k = 3;
+  } else {
+    k = 0;
+    while (x >= _q[k + 1]) k++;
+  }
+  for (int i = k + 1; i < 5; i++) _n[i]++;
+  for (int i = 0; i < 5; i++) _np[i] += _dn[i];
+
+  // Move the middle markers towards their desired positions
+  for (int i = 1; i <= 3; i++) {
+    float d = _np[i] - _n[i];
+    if ((d >= 1 && _n[i + 1] - _n[i] > 1) || (d <= -1 && _n[i - 1] - _n[i] < -1)) {
+      int step = d > 0 ? 1 : -1;
+      float q = _parabolic(i, step);
+      if (!(_q[i - 1] < q && q < _q[i + 1])) q = _linear(i, step);
+      _q[i] = q;
+      _n[i] += step;
+    }
+  }
+}
+
+float P2Quantile::_parabolic(int i, int d) const {
+  return _q[i] + (float)d / (_n[i + 1] - _n[i - 1]) *
+         ((_n[i] - _n[i - 1] + d) * (_q[i + 1] - _q[i]) / (_n[i + 1] - _n[i]) +
+          (_n[i + 1] - _n[i] - d) * (_q[i] - _q[i - 1]) / (_n[i] - _n[i - 1]));
+}
+
+float P2Quantile::_linear(int i, int d) const {
+  return _q[i] + d * (_q[i + d] - _q[i]) / (_n[i + d] - _n[i]);
+}
+
+float P2Quantile::value() const {
+  if (0 == _count) return NAN;
+  if (_count < 5) {
+    // Markers are still the sorted samples
+    return _q[(int)(_p * (_count - 1) + 0.5f)];
+  }
+  return _q[2];
+}
+
+// ===== CHANNEL STATS =====
+
+void ChannelStats::add(float x) {
+  _ewma.add(x);
+  _window.add(x);
+  _p50.add(x);
+  _p95.add(x);
+
+  // P² tracks the whole stream; restart it periodically so it follows the load
+  if (_p50.count() >= STATS_QUANTILE_FRAMES) {
+    _p50Last = _p50.value();
+    _p95Last = _p95.value();
+    _p50.reset();
+    _p95.reset();
+  }
+}
+
+float ChannelStats::p50() const {
+  return isnan(_p50Last) ? _p50.value() : _p50Last;
+}
+
+float ChannelStats::p95() const {
+  return isnan(_p95Last) ? _p95.value() : _p95Last;
+}
+
+void ChannelStats::reset() {
+  _ewma.reset();
+  _window.reset();
+  _p50.reset();
+  _p95.reset();
+  _p50Last = NAN;
+  _p95Last = NAN;
+}
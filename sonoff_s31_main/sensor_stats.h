@@ -0,0 +1,115 @@
+/*
+ * Streaming Sensor Statistics
+ * For SONOFF S31 ESP8266 Project
+ *
+ * Constant-memory statistics over every decoded CSE7766 frame, so the
+ * automation can act on smoothed values instead of one noisy reading:
+ *   - EWMA, a one-pole low-pass that follows a real step within a few frames
+ *   - RMS, min and max over the last STATS_WINDOW frames
+ *   - P² (Jain & Chlamtac) median and 95th percentile estimates, five
+ *     markers each, restarted every STATS_QUANTILE_FRAMES frames
+ * Each update is O(1) apart from the windowed min/max, which scans
+ * STATS_WINDOW floats on read.
+ */
+
+#ifndef SENSOR_STATS_H
+#define SENSOR_STATS_H
+
+#include "config.h"
+
+// Exponentially weighted moving average
+class Ewma {
+public:
+  explicit Ewma(float alpha) : _alpha(alpha) {}
+  void add(float x) {
+    _value = _primed ? _value + _alpha * (x - _value) : x;
+    _primed = true;
+  }
+  float value() const { return _value; }
+  void reset() { _primed = false; _value = 0; }
+
+private:
+  float _alpha;
+  float _value = 0;
+  bool _primed = false;
+};
+
+// RMS, min and max over the last STATS_WINDOW values
+class WindowStats {
+public:
+  void add(float x);
+  float rms() const;
+  float min() const;
+  float max() const;
+  uint16_t size() const { return _count; }
+  void reset();
+
+private:
+  float _values[STATS_WINDOW];
+  float _sumSquares = 0;      // running sum, rebuilt once per lap to stop drift
+  uint16_t _next = 0;
+  uint16_t _count = 0;
+};
+
+// P² single-quantile estimator: five markers track the quantile without
+// storing the samples
+class P2Quantile {
+public:
+  explicit P2Quantile(float p) : _p(p) { reset(); }
+  void add(float x);
+  float value() const;        // NAN until the first sample
+  uint32_t count() const { return _count; }
+  void reset();
+
+private:
+  float _p;
+  float _q[5];                // marker heights
+  int32_t _n[5];              // marker positions
+  float _np[5];               // desired positions
+  float _dn[5];               // desired position increments
+  uint32_t _count;
+
+  float _parabolic(int i, int d) const;
+  float _linear(int i, int d) const;
+};
+
+// All statistics for one measured channel
+class ChannelStats {
+public:
+  ChannelStats() : _ewma(STATS_EWMA_ALPHA), _p50(0.5f), _p95(0.95f) {}
+  void add(float x);
+  float ewma() const { return _ewma.value(); }
+  float rms() const { return _window.rms(); }
+  float min() const { return _window.min(); }
+  float max() const { return _window.max(); }
+  float p50() const;          // of the last completed quantile period (live until then)
+  float p95() const;
+  void reset();
+
+private:
+  Ewma _ewma;
+  WindowStats _window;
+  P2Quantile _p50;
+  P2Quantile _p95;
+  float _p50Last = NAN;
+  float _p95Last = NAN;
+};
+
+struct SensorStats {
+  ChannelStats voltage;
+  ChannelStats current;
+  ChannelStats power;
+  uint32_t frames = 0;
+
+  void add(float v, float i, float p) {
+    voltage.add(v);
+    current.add(i);
+    power.add(p);
+    frames++;
+  }
+};
+
+// Global sensor statistics, fed from the CSE7766 frame callback
+extern SensorStats sensorStats;
+
+#endif // SENSOR_STATS_H
@@ -19,6 +19,13 @@
 #include "CSE7766.h"
 #include "web_interface.h"
 #include "espnow_handler.h"
+#include "power_history.h"
+#include "sensor_stats.h"
+#include "current_automation.h"
+#include "scheduler.h"
+#include "loop_profiler.h"
+#include "connection.h"
+#include "button.h"
 #include "Logger.h"
 // Use MQTT just for remote logging, not coordination
 // recommend mosquitto server running locally
@@ -43,34 +50,60 @@ Adafruit_MQTT_Publish sonoff_logging = Adafruit_MQTT_Publish(&mqtt, MQTT_TOPIC);
 // Device state
 DeviceState deviceState;
 
-// Button handling
-unsigned long buttonPressTime = 0;
-bool buttonPressed = false;
+// Button handling: edges from the interrupt, gestures decoded in loop()
+ButtonEdgeQueue buttonEdges;
+ButtonDecoder buttonDecoder;
+LatencyHistogram buttonLatency;                  // button edge to relay switched
 String UNIQUE_ID = String(ESP.getChipId(), HEX);
 String HOSTNAME = "sonoff-s31-" + UNIQUE_ID;
 
 // Current-based automation
 CurrentAutomation currentAutomation;
+
+// Overcurrent protection
+OvercurrentTrip overcurrentTrip;
+
+// Relay state restored at boot
+RelayRestore relayRestore;
 bool childPendingTurnOff = false;       // Flag for pending child turn-off
 
+// WiFi and MQTT, connected in the background by connectTask()
+ConnectionManager wifiLink(WIFI_CONNECT_TIMEOUT_MS, WIFI_RETRY_MIN_MS, WIFI_RETRY_MAX_MS);
+ConnectionManager mqttLink(0, MQTT_RETRY_MIN_MS, MQTT_RETRY_MAX_MS);
+
+// Main loop tasks
+TaskScheduler scheduler(micros);
+int8_t ledTask = -1;                    // sets its own period to the blink rate
+
 // Function declarations
 void saveRelayState();
-void loadRelayState();
+bool loadRelayState();
+void restoreRelayState();
+void saveRelayRtc();
+void recordSensorFrame(CSE7766& sensor);
+void openRelay();
+void handleOvercurrentTrip();
+void initTasks();
+void IRAM_ATTR onButtonEdge();
+void handleButtonGesture(ButtonGesture gesture);
 
 void setup() {
+  // Relay first, back in its last state before anything else starts
+  restoreRelayState();
+  
   // Initialize CSE7766 sensor
   cse7766.begin(); //will call Serial.begin()
+  cse7766.onFrame(recordSensorFrame);
   
   // Initialize device ID
   deviceState.deviceId = "SONOFF_S31_" + UNIQUE_ID;
 
   // Initialize hardware pins
-  pinMode(RELAY_PIN, OUTPUT);
   pinMode(LED_PIN, OUTPUT);
   pinMode(BUTTON_PIN, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(BUTTON_PIN), onButtonEdge, CHANGE);
   
   // Initial state
-  digitalWrite(RELAY_PIN, LOW);
   digitalWrite(LED_PIN, HIGH);  // LED off (inverted)
 
   // Initialize LittleFS for pairing data storage
@@ -80,11 +113,14 @@ void setup() {
     logger.println("LittleFS filesystem mounted successfully");
   }
   
-  // Initialize WiFi
+  logger.printf("Relay restored %s (%s), %.1fms after reset\n", deviceState.relayState ? "ON" : "OFF",
+               relayRestoreSourceName(relayRestore.source), relayRestore.relayUs / 1000.0);
+  
+  // Initialize WiFi (connects in the background)
   initWiFi();
   
-  // initialize MQTT logging
-  MQTT_connect();  // also in loop() for reconnection
+  // initialize MQTT logging, connected by connectTask() once WiFi is up
+  client.setTimeout(MQTT_CONNECT_TIMEOUT_MS);
   logger.setMQTTLogger(&sonoff_logging);
   
   // Load pairing data from flash
@@ -93,18 +129,18 @@ void setup() {
   // Initialize ESP-NOW
   initESPNOW();
   
-  // Load saved relay state from flash (after ESP-NOW is initialized)
-  loadRelayState();
-  
   // Initialize current automation variables
-  currentAutomation.lastCurrentState = false;
+  currentAutomation.state = CURRENT_STATE_LOW;
+  currentAutomation.stateSince = millis();
   currentAutomation.childTurnOffTimer = 0;
   
   // Initialize web server
   initWebServer();
   
-  // Initialize OTA updates
-  initOTA();
+  // OTA updates start once WiFi is connected (connectTask())
+  
+  // Register the main loop tasks
+  initTasks();
   
   // Start mDNS
   if (MDNS.begin(HOSTNAME)) {
@@ -117,62 +153,100 @@ void setup() {
   logger.printf("RESET REASON: ");
   logger.println(ESP.getResetInfo());
   logger.println("Setup completed successfully!");
+  relayRestore.setupUs = micros();
 }
 
 void loop() {
-#if DEBUG_MEMORY
-  // Log memory usage periodically
-  static unsigned long lastMemoryLog = 0;
-  if (millis() - lastMemoryLog > 10000) { // Every 10 seconds
-    uint32_t freeHeap = ESP.getFreeHeap();
-    uint8_t fragmentation = ESP.getHeapFragmentation();
-    logger.printf("Memory: Free=%u bytes, Fragmentation=%u%%\n", freeHeap, fragmentation);
-    lastMemoryLog = millis();
+  // Run the task due first, then sleep until the next one is due. loop()
+  // returns between tasks and delay() yields, so WiFi and the radio
+  // callbacks keep running.
+  uint32_t wait = scheduler.runNext();
+  if (buttonEdges.pending()) {
+    // A button edge: act on it now, not at the button task's next turn
+    PERF_SCOPE(PERF_BUTTON);
+    handleButton();
   }
-#endif
-  
-  // Handle OTA updates
-  ArduinoOTA.handle();
-  
-  // Handle web server
-  server.handleClient();
-  MDNS.update();
-  
-  // MQTT
-  MQTT_connect();
-  
-  // Handle button press
-  handleButton();
-  
-  if (deviceState.isParent) {
-    // Update sensor readings only if parent
+  if (wait >= 1000) {
+    PERF_SCOPE(PERF_SLEEP);
+    delay(wait / 1000);
+  }
+}
+
+// Sensor frames, the automation on them, and the rest of an overcurrent trip.
+// Decoding every slice keeps a trip within a frame of the reading.
+void sensorTask() {
+  {
+    PERF_SCOPE(PERF_SENSOR);
     updateSensorReadings();
   }
-  
-  // Handle ESP-NOW messages
-  handleESPNOWMessages();
-  
-  // Handle current automation timer for children
-  if (currentAutomation.childTurnOffTimer > 0 && millis() >= currentAutomation.childTurnOffTimer) {
-    turnOffRelay();
-    currentAutomation.childTurnOffTimer = 0;
-    logger.println("Child: Turning OFF after 3-second delay");
+  PERF_SCOPE(PERF_OVERCURRENT);
+  handleOvercurrentTrip();
+}
+
+// Received ESP-NOW frames, resends and group repeats, so a child follows
+// its parent within a slice
+void espnowTask() {
+  {
+    PERF_SCOPE(PERF_ESPNOW_DRAIN);
+    drainESPNOWQueue();
   }
-  
-  // Handle pairing mode
-  handlePairingMode();
-  
-  // Update LED status
-  updateLEDStatus();
-  
-  // Send periodic ESP-NOW broadcasts
-  static unsigned long lastBroadcast = 0;
-  if (millis() - lastBroadcast > ESPNOW_BROADCAST_INTERVAL) {
-    broadcastDeviceState();
-    lastBroadcast = millis();
+  PERF_SCOPE(PERF_CHILD_OFF);
+  handleChildTurnOff();
+}
+
+void buttonTask() {
+  PERF_SCOPE(PERF_BUTTON);
+  handleButton();
+}
+
+void webTask() {
+  PERF_SCOPE(PERF_WEB);
+  server.handleClient();
+}
+
+void networkTask() {
+  {
+    PERF_SCOPE(PERF_OTA);
+    ArduinoOTA.handle();
   }
-  
-  delay(100);
+  PERF_SCOPE(PERF_MDNS);
+  MDNS.update();
+}
+
+void peersTask() {
+  PERF_SCOPE(PERF_ESPNOW);
+  handleESPNOWMessages();
+}
+
+void pairingTask() {
+  PERF_SCOPE(PERF_PAIRING);
+  handlePairingMode();
+}
+
+#if DEBUG_MEMORY
+void memoryTask() {
+  uint32_t freeHeap = ESP.getFreeHeap();
+  uint8_t fragmentation = ESP.getHeapFragmentation();
+  logger.printf("Memory: Free=%u bytes, Fragmentation=%u%%\n", freeHeap, fragmentation);
+}
+#endif
+
+// Periods and deadlines in ms, see /api/tasks for how well they are kept
+void initTasks() {
+  scheduler.add("sensor", sensorTask, SENSOR_POLL_SLICE, SENSOR_POLL_SLICE);
+  scheduler.add("espnow", espnowTask, TASK_ESPNOW_MS, TASK_ESPNOW_MS);
+  scheduler.add("button", buttonTask, TASK_INPUT_MS, 2 * TASK_INPUT_MS);
+  scheduler.add("web", webTask, TASK_INPUT_MS, 5 * TASK_INPUT_MS);
+  scheduler.add("network", networkTask, TASK_NETWORK_MS, 2 * TASK_NETWORK_MS);
+  scheduler.add("peers", peersTask, TASK_PEERS_MS, TASK_PEERS_MS);
+  scheduler.add("pairing", pairingTask, TASK_PEERS_MS, TASK_PEERS_MS);
+  ledTask = scheduler.add("led", updateLEDStatus, PAIRING_LED_FAST_BLINK, PAIRING_LED_FAST_BLINK / 2);
+  scheduler.add("readings", updateDeviceReadings, TASK_READINGS_MS, TASK_READINGS_MS / 2);
+  scheduler.add("powerLog", logPowerReadings, TASK_POWER_LOG_MS, TASK_POWER_LOG_MS / 2);
+  scheduler.add("connect", connectTask, TASK_CONNECT_MS, TASK_CONNECT_MS);
+#if DEBUG_MEMORY
+  scheduler.add("memory", memoryTask, 10000, 5000);
+#endif
 }
 
 void initWiFi() {
@@ -188,59 +262,93 @@ void initWiFi() {
   // Load WiFi configuration from flash
   loadWiFiConfig();
   
-  // Connect to WiFi network if configured
+  // Join the WiFi network if configured; connectTask() waits for it
   if (wifiConfig.isConfigured && strlen(wifiConfig.ssid) > 0) {
+    logger.printf("Connecting to WiFi in the background: %s\n", wifiConfig.ssid);
+    wifiLink.start(millis());
+  } else {
+    logger.println("No WiFi configuration found, continuing with AP mode only");
+  }
+}
+
+// WiFi and MQTT (re)connection, a step at a time: only an MQTT attempt
+// blocks, for at most MQTT_CONNECT_TIMEOUT_MS
+void connectTask() {
+  bool wifiUp = WiFi.status() == WL_CONNECTED;
+  ConnectionState before = wifiLink.state();
+  if (wifiLink.update(wifiUp, millis())) {
+    logger.printf("Connecting to WiFi: %s (attempt %u)\n", wifiConfig.ssid, wifiLink.stats().attempts);
     WiFi.begin(wifiConfig.ssid, wifiConfig.password);
-    logger.printf("Connecting to WiFi: %s", wifiConfig.ssid);
-    
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-      delay(500);
-      logger.print(".");
-      attempts++;
-    }
-    
-    if (WiFi.status() == WL_CONNECTED) {
-      deviceState.wifiConnected = true;
-      logger.printf("\nWiFi connected! IP: %s\n", WiFi.localIP().toString().c_str());
+  } else if (before == CONNECTION_CONNECTING && wifiLink.state() == CONNECTION_BACKOFF) {
+    logger.printf("WiFi connection failed, retrying in %lus\n", wifiLink.retryInMs(millis()) / 1000);
+  }
+  
+  if (wifiUp != deviceState.wifiConnected) {
+    deviceState.wifiConnected = wifiUp;
+    if (wifiUp) {
+      logger.printf("WiFi connected! IP: %s\n", WiFi.localIP().toString().c_str());
+      static bool otaStarted = false;
+      if (!otaStarted) {
+        initOTA();
+        otaStarted = true;
+      }
     } else {
-      logger.println("\nWiFi connection failed, continuing with AP mode only");
+      logger.println("WiFi connection lost");
     }
-  } else {
-    logger.println("No WiFi configuration found, continuing with AP mode only");
   }
+  
+  MQTT_connect();
+}
+
+// Button interrupt: stamp the edge, decoding waits for loop()
+void IRAM_ATTR onButtonEdge() {
+  buttonEdges.push(!digitalRead(BUTTON_PIN), micros()); // Inverted logic
 }
 
 void handleButton() {
-  bool currentButtonState = !digitalRead(BUTTON_PIN); // Inverted logic
-  
-  if (currentButtonState && !buttonPressed) {
-    buttonPressed = true;
-    buttonPressTime = millis();
-  } else if (!currentButtonState && buttonPressed) {
-    buttonPressed = false;
-    unsigned long pressDuration = millis() - buttonPressTime;
-    
-    if (pressDuration > 50 && pressDuration < 3000) {
+  ButtonEdge edge;
+  while (buttonEdges.pop(edge)) {
+    handleButtonGesture(buttonDecoder.edge(edge.pressed, edge.time));
+  }
+  handleButtonGesture(buttonDecoder.poll(!digitalRead(BUTTON_PIN), micros(), buttonEdges.lastEdge()));
+}
+
+void handleButtonGesture(ButtonGesture gesture) {
+  switch (gesture) {
+    case BUTTON_NONE:
+      return;
+
+    case BUTTON_PRESS:
       // Short press: toggle relay
       toggleRelay();
-    } else if (pressDuration >= 3000 && pressDuration < PAIRING_BUTTON_HOLD_TIME) {
+      buttonLatency.record(micros() - buttonDecoder.gestureTime());
+      return;
+
+    case BUTTON_DOUBLE_PRESS:
+      // Parent with children: the first press set our relay, the second sets theirs to match
+      if (deviceState.isParent && deviceState.childCount > 0) {
+        for (uint8_t i = 0; i < deviceState.childCount; i++) {
+          sendCommand(deviceState.childMacs[i], "relay", deviceState.relayState ? "on" : "off");
+        }
+        logger.printf("Double press: children set %s\n", deviceState.relayState ? "ON" : "OFF");
+      } else {
+        toggleRelay();
+        buttonLatency.record(micros() - buttonDecoder.gestureTime());
+      }
+      return;
+
+    case BUTTON_LONG_PRESS:
       // Long press (3-10s): reset WiFi settings (for future implementation)
       logger.println("Long press detected - WiFi reset requested");
-    } else if (pressDuration >= PAIRING_BUTTON_HOLD_TIME) {
-      // Very long press (10+ seconds): enter pairing mode
-      logger.println("Pairing mode button press detected");
-      enterPairingMode();
-    }
-  }
-  
-  // Check if button is still being held for pairing mode
-  if (currentButtonState && buttonPressed && !deviceState.pairingMode) {
-    unsigned long holdDuration = millis() - buttonPressTime;
-    if (holdDuration >= PAIRING_BUTTON_HOLD_TIME) {
-      logger.println("Entering pairing mode...");
-      enterPairingMode();
-    }
+      return;
+
+    case BUTTON_HOLD:
+      // Held 10+ seconds: enter pairing mode
+      if (!deviceState.pairingMode) {
+        logger.println("Entering pairing mode...");
+        enterPairingMode();
+      }
+      return;
   }
 }
 
@@ -252,8 +360,8 @@ void toggleRelay() {
   // Save state to flash
   saveRelayState();
   
-  // Broadcast state change via ESP-NOW
-  broadcastDeviceState();
+  // Tell peers now, within the beacon rate limit
+  handleBeacon();
 }
 
 void turnOnRelay() {
@@ -262,21 +370,29 @@ void turnOnRelay() {
     digitalWrite(RELAY_PIN, HIGH);
     logger.println("Relay ON");
     saveRelayState();
-    broadcastDeviceState();
+    handleBeacon();
   }
 }
 
+// Relay off without logging, flash or radio, safe from the sensor frame callback
+void openRelay() {
+  deviceState.relayState = false;
+  digitalWrite(RELAY_PIN, LOW);
+  saveRelayRtc();
+}
+
 void turnOffRelay() {
   if (deviceState.relayState) {
-    deviceState.relayState = false;
-    digitalWrite(RELAY_PIN, LOW);
+    openRelay();
     logger.println("Relay OFF");
     saveRelayState();
-    broadcastDeviceState();
+    handleBeacon();
   }
 }
 
 void saveRelayState() {
+  saveRelayRtc();
+  
   if (!LittleFS.begin()) {
     logger.println("Failed to mount LittleFS for relay state save");
     return;
@@ -295,23 +411,24 @@ void saveRelayState() {
   logger.printf("Relay state saved: %s\n", deviceState.relayState ? "ON" : "OFF");
 }
 
-void loadRelayState() {
+// Saved relay state from flash into deviceState; false if none was saved
+bool loadRelayState() {
   if (!LittleFS.begin()) {
     logger.println("Failed to mount LittleFS for relay state load");
-    return;
+    return false;
   }
   
   if (!LittleFS.exists(RELAY_STATE_FILE)) {
     logger.println("No saved relay state found, defaulting to OFF");
     deviceState.relayState = false;
-    return;
+    return false;
   }
   
   File file = LittleFS.open(RELAY_STATE_FILE, "r");
   if (!file) {
     logger.println("Failed to open relay state file for reading");
     deviceState.relayState = false;
-    return;
+    return false;
   }
   
   // Read relay state (1 byte)
@@ -319,57 +436,128 @@ void loadRelayState() {
   file.close();
   
   deviceState.relayState = (savedState == 1);
-  digitalWrite(RELAY_PIN, deviceState.relayState ? HIGH : LOW);
   
-  logger.printf("Relay state loaded: %s\n", deviceState.relayState ? "ON" : "OFF");
+  // Other devices get it with the first (full) beacon
+  return true;
+}
+
+// RTC user memory keeps the relay state across resets (watchdog, crash, OTA,
+// restart) and is read in microseconds; after a power loss it is garbage and
+// the flash copy is used, which costs mounting LittleFS
+void restoreRelayState() {
+  pinMode(RELAY_PIN, OUTPUT);
+  
+  RelayRtcRecord record;
+  if (ESP.rtcUserMemoryRead(RELAY_RTC_OFFSET, (uint32_t*)&record, sizeof(record)) &&
+      record.magic == RELAY_RTC_MAGIC && record.check == ~(record.magic ^ record.relayState) &&
+      record.relayState <= 1) {
+    deviceState.relayState = record.relayState == 1;
+    relayRestore.source = RELAY_RESTORE_RTC;
+  } else if (loadRelayState()) {
+    relayRestore.source = RELAY_RESTORE_FLASH;
+  } else {
+    relayRestore.source = RELAY_RESTORE_DEFAULT;
+  }
   
-  // Broadcast the loaded state to other devices
-  broadcastDeviceState();
+  digitalWrite(RELAY_PIN, deviceState.relayState ? HIGH : LOW);
+  relayRestore.relayUs = micros();
+  saveRelayRtc();
+}
+
+const char* relayRestoreSourceName(RelayRestoreSource source) {
+  switch (source) {
+    case RELAY_RESTORE_RTC: return "rtc";
+    case RELAY_RESTORE_FLASH: return "flash";
+    default: return "default";
+  }
+}
+
+void saveRelayRtc() {
+  RelayRtcRecord record;
+  record.magic = RELAY_RTC_MAGIC;
+  record.relayState = deviceState.relayState ? 1 : 0;
+  record.check = ~(record.magic ^ record.relayState);
+  ESP.rtcUserMemoryWrite(RELAY_RTC_OFFSET, (uint32_t*)&record, sizeof(record));
 }
 
 void updateSensorReadings() {
-  static unsigned long lastReading = 0;
   logger.withoutSerial([]() { //Skip logging to Serial
-    if (millis() - lastReading > 1000) {  // Update every second
-      cse7766.handle();
-    
-      deviceState.voltage = cse7766.getVoltage();
-      deviceState.current = cse7766.getCurrent();
-      deviceState.power = cse7766.getActivePower();
-      deviceState.energy = cse7766.getEnergy();
-      deviceState.lastUpdate = millis();
-      
-      // Current-based automation for parent devices
-      if (deviceState.isParent && deviceState.childCount > 0) {
-        bool currentIsHigh = (deviceState.current >= CURRENT_THRESHOLD);
-        
-        // Check for threshold crossing
-        if (currentIsHigh != currentAutomation.lastCurrentState) {
-          currentAutomation.lastCurrentState = currentIsHigh;
-          sendCurrentAlert(currentIsHigh);
-          logger.printf("Parent: Current threshold crossed - sending %s alert to children (%.3fA)\n",
-                       currentIsHigh ? "HIGH" : "LOW", deviceState.current);
-        }
-      }
-      
-      // Debug output every 10 seconds
-      static unsigned long lastDebug = 0;
-      if (millis() - lastDebug > 10000) {
-        logger.printf("Power: %.2fW, Voltage: %.1fV, Current: %.3fA, Energy: %.2fWh\n",
-                     deviceState.power, deviceState.voltage, deviceState.current, deviceState.energy);
-        lastDebug = millis();
+    // Decode every frame the UART has buffered since the last pass
+    cse7766.handle();
+    powerHistory.update(millis());
+
+    // Current-based automation for parent devices, on the smoothed current:
+    // checked every pass as new frames arrive, so the EWMA lag (a few
+    // frames) is still shorter than the 1 second poll it replaced.
+    // Hysteresis and debounce live in updateCurrentAutomation().
+    if (deviceState.isParent && deviceState.childCount > 0 && sensorStats.frames > 0) {
+      float current = sensorStats.current.ewma();
+      if (updateCurrentAutomation(currentAutomation, current, cse7766.getFrameTime(), millis())) {
+        bool currentIsHigh = currentAutomationHigh(currentAutomation);
+        sendCurrentAlert(currentIsHigh, currentAutomation.pendingFrameTime);
+        logger.printf("Parent: Current threshold crossed - sending %s alert to children (%.3fA)\n",
+                     currentIsHigh ? "HIGH" : "LOW", current);
       }
-      
-      lastReading = millis();
     }
   }); //end lambda wrapper
 }
 
+// Readings shown by the web interface and sent in beacons
+void updateDeviceReadings() {
+  PERF_SCOPE(PERF_READINGS);
+  deviceState.voltage = cse7766.getVoltage();
+  deviceState.current = cse7766.getCurrent();
+  deviceState.power = cse7766.getActivePower();
+  deviceState.energy = cse7766.getEnergy();
+  deviceState.lastUpdate = millis();
+}
+
+void logPowerReadings() {
+  PERF_SCOPE(PERF_READINGS);
+  logger.withoutSerial([]() {
+    logger.printf("Power: %.2fW, Voltage: %.1fV, Current: %.3fA, Energy: %.2fWh\n",
+                 deviceState.power, deviceState.voltage, deviceState.current, deviceState.energy);
+  });
+}
+
+// Called by cse7766.handle() for every valid frame
+void recordSensorFrame(CSE7766& sensor) {
+  // Overcurrent first: open the relay now, the rest of the turn-off path
+  // (log, flash, broadcast) runs from loop() in handleOvercurrentTrip()
+  if (deviceState.relayState &&
+      (sensor.getCurrent() > OVERCURRENT_LIMIT || sensor.getActivePower() > OVERPOWER_LIMIT)) {
+    openRelay();
+    uint32_t latency = micros() - sensor.getFrameTime();
+    overcurrentTrip.count++;
+    overcurrentTrip.lastTrip = millis();
+    overcurrentTrip.lastLatencyUs = latency;
+    if (latency > overcurrentTrip.maxLatencyUs) overcurrentTrip.maxLatencyUs = latency;
+    overcurrentTrip.current = sensor.getCurrent();
+    overcurrentTrip.power = sensor.getActivePower();
+    overcurrentTrip.pending = true;
+  }
+
+  // Frames drained in one pass arrived up to a second apart, stamp each one
+  unsigned long age = (micros() - sensor.getFrameTime()) / 1000;
+  powerHistory.add(millis() - age, sensor.getVoltage(), sensor.getCurrent(), sensor.getActivePower());
+  sensorStats.add(sensor.getVoltage(), sensor.getCurrent(), sensor.getActivePower());
+}
+
+// Deferred part of an overcurrent trip
+void handleOvercurrentTrip() {
+  if (!overcurrentTrip.pending) return;
+  overcurrentTrip.pending = false;
+  logger.printf("OVERCURRENT: Relay opened at %.3fA / %.1fW, %.1fms after the frame arrived\n",
+               overcurrentTrip.current, overcurrentTrip.power, overcurrentTrip.lastLatencyUs / 1000.0);
+  saveRelayState();
+  handleBeacon();
+}
+
+// Runs at the blink rate, or every fast blink while the LED is solid
 void updateLEDStatus() {
-  static unsigned long lastBlink = 0;
+  PERF_SCOPE(PERF_LED);
   static bool ledState = false;
   
-  unsigned long currentTime = millis();
   unsigned long blinkInterval;
   
   // Determine LED behavior based on device state
@@ -379,18 +567,16 @@ void updateLEDStatus() {
   } else if (deviceState.wifiConnected) {
     // Solid on when WiFi connected and not pairing
     digitalWrite(LED_PIN, LOW);
+    scheduler.setPeriod(ledTask, PAIRING_LED_FAST_BLINK);
     return;
   } else {
     // Normal blink when no WiFi
     blinkInterval = 500;
   }
   
-  // Blink LED based on determined interval
-  if (currentTime - lastBlink > blinkInterval) {
-    ledState = !ledState;
-    digitalWrite(LED_PIN, ledState ? LOW : HIGH);
-    lastBlink = currentTime;
-  }
+  ledState = !ledState;
+  digitalWrite(LED_PIN, ledState ? LOW : HIGH);
+  scheduler.setPeriod(ledTask, blinkInterval);
 }
 
 void initOTA() {
@@ -470,36 +656,29 @@ void initOTA() {
   Serial.println("OTA: Use Arduino IDE -> Tools -> Port -> Network Port");
 }
 
-// Function to connect and reconnect as necessary to the MQTT server.
-// Should be called in the loop function and it will take care if connecting.
+// Connect and reconnect as necessary to the MQTT server, called from
+// connectTask(). One attempt when due: the TCP connect gives up after
+// MQTT_CONNECT_TIMEOUT_MS, and failures back off exponentially.
 void MQTT_connect() {
-  int8_t ret;
-  static unsigned long lastMQTTAttempt = 0;
-  // Stop if already connected.
-  if (mqtt.connected()) {
+  PERF_SCOPE(PERF_MQTT);
+  if (!deviceState.wifiConnected) {
+    mqttLink.stop();
     return;
   }
-
-  if (lastMQTTAttempt != 0 && millis() - lastMQTTAttempt < 10000) {  // attempt every 10 seconds
+  mqttLink.start(millis());
+  
+  if (!mqttLink.update(mqtt.connected(), millis())) {
     return;
   }
-  lastMQTTAttempt = millis();
 
   Serial.print("Connecting to MQTT... ");
-
-  uint8_t retries = 3;
-  char* lastSSLErrorString;
-  while ((ret = mqtt.connect()) != 0) {  // connect will return 0 for connected
+  int8_t ret = mqtt.connect();  // connect will return 0 for connected
+  if (ret != 0) {
     Serial.println(mqtt.connectErrorString(ret));
-
-    Serial.println("Retrying ...");
-    //mqtt.disconnect();
-    delay(100);  // wait 100 ms
-    retries--;
-    if (retries == 0) {
-      Serial.println("Gave up on MQTT connection");
-      return;
-    }
+    mqttLink.failed(millis());
+    Serial.printf("MQTT retry in %lus\n", mqttLink.retryInMs(millis()) / 1000);
+    return;
   }
+  mqttLink.update(true, millis());
   Serial.println("MQTT Connected!");
-}
\ No newline at end of file
+}
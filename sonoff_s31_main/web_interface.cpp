@@ -6,11 +6,29 @@
 #include "config.h"
 #include "web_interface.h"
 #include "espnow_handler.h"
+#include "power_history.h"
+#include "sensor_stats.h"
+#include "current_automation.h"
+#include "CSE7766.h"
+#include "scheduler.h"
+#include "loop_profiler.h"
+#include "connection.h"
+#include "button.h"
 #include "Logger.h"
 #include <LittleFS.h>
 
 extern ESP8266WebServer server;
 extern struct DeviceState deviceState;
+extern CurrentAutomation currentAutomation;
+extern CSE7766 cse7766;
+extern OvercurrentTrip overcurrentTrip;
+extern RelayRestore relayRestore;
+extern TaskScheduler scheduler;
+extern ConnectionManager wifiLink;
+extern ConnectionManager mqttLink;
+extern ButtonEdgeQueue buttonEdges;
+extern ButtonDecoder buttonDecoder;
+extern LatencyHistogram buttonLatency;
 extern const char* HOSTNAME;
 
 // Global WiFi configuration
@@ -25,9 +43,14 @@ void initWebServer() {
   server.on("/js/relay.js", handleRelayJS);
   server.on("/js/wifi.js", handleWiFiJS);
   server.on("/js/pairing.js", handlePairingJS);
+  server.on("/js/history.js", handleHistoryJS);
   
   // API endpoints
   server.on("/api/status", HTTP_GET, handleGetStatus);
+  server.on("/api/history", HTTP_GET, handleGetHistory);
+  server.on("/api/automation", HTTP_GET, handleGetAutomation);
+  server.on("/api/tasks", HTTP_GET, handleGetTasks);
+  server.on("/api/perf", HTTP_GET, handleGetPerf);
   server.on("/api/relay", HTTP_POST, handleSetRelay);
   server.on("/api/peers", HTTP_GET, handleGetPeers);
   server.on("/api/command", HTTP_POST, handleSendCommand);
@@ -209,6 +232,22 @@ body {
   background: #1976D2;
 }
 
+.history-controls {
+  display: flex;
+  justify-content: space-between;
+  align-items: center;
+  margin-bottom: 10px;
+  font-size: 0.9em;
+  color: #666;
+}
+
+.history-chart {
+  width: 100%;
+  height: 200px;
+  background: #f8f9fa;
+  border-radius: 8px;
+}
+
 .status-indicator {
   display: inline-block;
   width: 10px;
@@ -591,10 +630,343 @@ async function clearPairingData() {
   server.send(200, "application/javascript", js);
 }
 
+void handleHistoryJS() {
+  String js = R"HISTORYJSDATA(
+document.addEventListener('DOMContentLoaded', function() {
+  document.getElementById('historyTier').addEventListener('change', updateHistory);
+  updateHistory();
+
+  // Update history every 5 seconds
+  setInterval(updateHistory, 5000);
+});
+
+async function updateHistory() {
+  try {
+    const tier = document.getElementById('historyTier').value;
+    const response = await fetch('/api/history?tier=' + tier);
+    const data = await response.json();
+    drawHistory(data);
+  } catch (error) {
+    console.error('Error updating history:', error);
+  }
+}
+
+// Power over time; rollup tiers also shade the min/max band
+function drawHistory(data) {
+  const canvas = document.getElementById('historyChart');
+  const ctx = canvas.getContext('2d');
+  canvas.width = canvas.clientWidth;
+  canvas.height = canvas.clientHeight;
+  ctx.clearRect(0, 0, canvas.width, canvas.height);
+
+  const rows = data.samples;
+  const summary = document.getElementById('historySummary');
+  if (rows.length === 0) {
+    summary.textContent = 'No samples yet';
+    return;
+  }
+
+  const raw = data.tier === 'raw';
+  const avg = r => r[1];
+  const min = r => raw ? r[1] : r[2];
+  const max = r => raw ? r[1] : r[3];
+  const t0 = rows[0][0];
+  const span = Math.max(data.now - t0, 1);
+  const peak = Math.max(...rows.map(max), 1);
+  const pad = 4;
+  const x = t => pad + (t - t0) / span * (canvas.width - 2 * pad);
+  const y = p => canvas.height - pad - p / peak * (canvas.height - 2 * pad);
+
+  if (!raw) {
+    ctx.fillStyle = 'rgba(102, 126, 234, 0.25)';
+    ctx.beginPath();
+    rows.forEach((r, i) => i ? ctx.lineTo(x(r[0]), y(max(r))) : ctx.moveTo(x(r[0]), y(max(r))));
+    rows.slice().reverse().forEach(r => ctx.lineTo(x(r[0]), y(min(r))));
+    ctx.closePath();
+    ctx.fill();
+  }
+
+  ctx.strokeStyle = '#667eea';
+  ctx.lineWidth = 2;
+  ctx.beginPath();
+  rows.forEach((r, i) => i ? ctx.lineTo(x(r[0]), y(avg(r))) : ctx.moveTo(x(r[0]), y(avg(r))));
+  ctx.stroke();
+
+  const minutes = Math.round(span / 60000);
+  summary.textContent = `Peak ${peak.toFixed(1)}W over ${minutes > 0 ? minutes + ' min' : Math.round(span / 1000) + ' s'}`;
+}
+)HISTORYJSDATA";
+  server.send(200, "application/javascript", js);
+}
+
 void handleGetStatus() {
   server.send(200, "application/json", getStatusJSON());
 }
 
+// Fixed-point history units to JSON numbers without going through float
+static void appendTenths(char*& out, size_t& room, uint16_t value) {
+  int n = snprintf(out, room, "%u.%u,", value / 10, value % 10);
+  out += n;
+  room -= n;
+}
+
+static void appendRow(String& chunk, const HistorySample& s) {
+  char row[48];
+  char* out = row;
+  size_t room = sizeof(row);
+  int n = snprintf(out, room, "[%lu,", (unsigned long)s.time);
+  out += n;
+  room -= n;
+  appendTenths(out, room, s.power);
+  appendTenths(out, room, s.voltage);
+  snprintf(out, room, "%u.%03u],", s.current / 1000, s.current % 1000);
+  chunk += row;
+}
+
+static void appendRow(String& chunk, const HistoryRollup& r) {
+  char row[80];
+  char* out = row;
+  size_t room = sizeof(row);
+  int n = snprintf(out, room, "[%lu,", (unsigned long)r.time);
+  out += n;
+  room -= n;
+  appendTenths(out, room, r.powerAvg);
+  appendTenths(out, room, r.powerMin);
+  appendTenths(out, room, r.powerMax);
+  appendTenths(out, room, r.voltage);
+  snprintf(out, room, "%u.%03u,%u],", r.current / 1000, r.current % 1000, r.samples);
+  chunk += row;
+}
+
+// Stream the rows of one tier within [from, to] in small chunks, so a full
+// tier never has to fit in the heap as one String
+template <typename Ring>
+static void sendHistoryRows(const Ring& ring, uint32_t from, uint32_t to, String& chunk) {
+  bool any = false;
+  for (uint16_t i = ring.lowerBound(from); i < ring.size() && !historyBefore(to, ring.at(i).time); i++) {
+    appendRow(chunk, ring.at(i));
+    any = true;
+    if (chunk.length() > 1024) {
+      server.sendContent(chunk);
+      chunk = "";
+    }
+  }
+  if (any) chunk.remove(chunk.length() - 1);  // trailing comma
+}
+
+void handleGetHistory() {
+  String tierName = server.hasArg("tier") ? server.arg("tier") : "second";
+  HistoryTier tier;
+  const char* fields;
+  if (tierName == "raw") {
+    tier = HISTORY_RAW;
+    fields = "[\"time\",\"power\",\"voltage\",\"current\"]";
+  } else if (tierName == "second" || tierName == "minute") {
+    tier = tierName == "second" ? HISTORY_SECOND : HISTORY_MINUTE;
+    fields = "[\"time\",\"power\",\"powerMin\",\"powerMax\",\"voltage\",\"current\",\"samples\"]";
+  } else {
+    server.send(400, "application/json", "{\"error\":\"Invalid tier\"}");
+    return;
+  }
+
+  // Times compare wrap-safe, so "all" is the 24 days before now, not 0 to ~0
+  uint32_t now = millis();
+  uint32_t from = server.hasArg("from") ? strtoul(server.arg("from").c_str(), nullptr, 10) : now - 0x7FFFFFFFUL;
+  uint32_t to = server.hasArg("to") ? strtoul(server.arg("to").c_str(), nullptr, 10) : now;
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "application/json", "");
+
+  String chunk;
+  chunk.reserve(1100);
+  chunk = "{\"tier\":\"" + tierName + "\",\"interval\":" + String(PowerHistory::interval(tier)) +
+          ",\"now\":" + String(now) + ",\"fields\":" + fields + ",\"samples\":[";
+  switch (tier) {
+    case HISTORY_RAW: sendHistoryRows(powerHistory.raw(), from, to, chunk); break;
+    case HISTORY_SECOND: sendHistoryRows(powerHistory.seconds(), from, to, chunk); break;
+    case HISTORY_MINUTE: sendHistoryRows(powerHistory.minutes(), from, to, chunk); break;
+  }
+  chunk += "]}";
+  server.sendContent(chunk);
+  server.sendContent("");  // end of chunked response
+}
+
+// Count, average, maximum and bucket counts; edges are in bucketLtMs
+static void addLatencySummary(JsonObject obj, const LatencyHistogram& h) {
+  obj["count"] = h.count();
+  obj["avgMs"] = h.averageUs() / 1000.0;
+  obj["maxMs"] = h.maxUs() / 1000.0;
+  JsonArray counts = obj.createNestedArray("buckets");
+  for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+    counts.add(h.bucket(i));
+  }
+}
+
+void handleGetAutomation() {
+  DynamicJsonDocument doc(2560);
+  
+  doc["state"] = currentAutomationStateName(currentAutomation.state);
+  doc["current"] = sensorStats.current.ewma();
+  doc["onLevel"] = CURRENT_THRESHOLD;
+  doc["offLevel"] = CURRENT_THRESHOLD - CURRENT_HYSTERESIS;
+  doc["debounceMs"] = CURRENT_DEBOUNCE_MS;
+  doc["minDwellMs"] = CURRENT_MIN_DWELL_MS;
+  doc["stateAge"] = millis() - currentAutomation.stateSince;
+  
+  // Frame arrival to alert sent, per child send
+  JsonObject latency = doc.createNestedObject("alertLatency");
+  latency["count"] = alertLatency.count();
+  latency["avgMs"] = alertLatency.averageUs() / 1000.0;
+  latency["maxMs"] = alertLatency.maxUs() / 1000.0;
+  JsonArray buckets = latency.createNestedArray("buckets");
+  for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+    JsonObject bucket = buckets.createNestedObject();
+    uint32_t limit = LatencyHistogram::bucketLimitMs(i);
+    if (limit) {
+      bucket["ltMs"] = limit;
+    }
+    bucket["count"] = alertLatency.bucket(i);
+  }
+  
+  // Sensing on the parent to a child's relay switching (past the turn-off
+  // delay), timed by the child against the parent's clock
+  JsonArray edges = doc.createNestedArray("bucketLtMs");
+  for (uint8_t i = 0; i + 1 < LATENCY_BUCKETS; i++) {
+    edges.add(LatencyHistogram::bucketLimitMs(i));
+  }
+  if (deviceState.hasParent) {
+    const ClockSyncStats& cs = parentClock.stats();
+    JsonObject clock = doc.createNestedObject("parentClock");
+    clock["synced"] = parentClock.synced();
+    if (parentClock.synced()) {
+      clock["offsetUs"] = parentClock.offsetUs(micros());
+      clock["driftPpm"] = parentClock.driftPpm();
+      clock["sampleAgeMs"] = (micros() - parentClock.lastSample()) / 1000;
+    }
+    clock["samples"] = cs.samples;
+    clock["rejected"] = cs.rejected;
+    clock["rttLastUs"] = cs.lastDelayUs;
+    clock["rttBestUs"] = cs.bestDelayUs;
+    addLatencySummary(doc.createNestedObject("alertDelay"), alertDelay);
+    addLatencySummary(doc.createNestedObject("follow"), followLatency);
+  }
+  
+  String output;
+  serializeJson(doc, output);
+  if (!deviceState.isParent) {
+    server.send(200, "application/json", output);
+    return;
+  }
+  
+  // Children one at a time in chunks, so the heap never holds all of them
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "application/json", "");
+  output.remove(output.length() - 1);  // closing brace
+  output += ",\"childFollow\":[";
+  for (int i = 0; i < deviceState.childCount; i++) {
+    StaticJsonDocument<512> childDoc;
+    JsonObject child = childDoc.to<JsonObject>();
+    child["mac"] = macToString(deviceState.childMacs[i]);
+    addLatencySummary(child, childFollow[i]);
+    if (i) output += ',';
+    serializeJson(childDoc, output);
+    server.sendContent(output);
+    output = "";
+  }
+  output += "]}";
+  server.sendContent(output);
+  server.sendContent("");  // end of chunked response
+}
+
+// Main loop tasks: lateness and run time per task, ?reset=1 starts over
+void handleGetTasks() {
+  StaticJsonDocument<512> doc;
+  doc["elapsedMs"] = (uint32_t)(scheduler.elapsedUs() / 1000);
+  doc["busyPct"] = scheduler.elapsedUs() ? 100.0 * scheduler.busyUs() / scheduler.elapsedUs() : 0.0;
+  String output;
+  serializeJson(doc, output);
+  
+  // Tasks one at a time in chunks, as for /api/automation
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "application/json", "");
+  output.remove(output.length() - 1);  // closing brace
+  output += ",\"tasks\":[";
+  for (uint8_t i = 0; i < scheduler.size(); i++) {
+    const SchedulerTask& task = scheduler.task(i);
+    const TaskStats& s = task.stats;
+    JsonObject t = doc.to<JsonObject>();  // reused, one task at a time
+    t["name"] = task.name;
+    t["periodMs"] = task.periodUs / 1000;
+    t["deadlineMs"] = task.deadlineUs / 1000;
+    t["runs"] = s.runs;
+    t["misses"] = s.misses;
+    t["skipped"] = s.skipped;
+    t["lateAvgMs"] = s.runs ? s.lateTotalUs / 1000.0 / s.runs : 0.0;
+    t["lateMaxMs"] = s.lateMaxUs / 1000.0;
+    t["runAvgMs"] = s.runs ? s.runTotalUs / 1000.0 / s.runs : 0.0;
+    t["runMaxMs"] = s.runMaxUs / 1000.0;
+    if (i) output += ',';
+    serializeJson(doc, output);
+    server.sendContent(output);
+    output = "";
+  }
+  output += "]}";
+  server.sendContent(output);
+  server.sendContent("");  // end of chunked response
+
+  if (server.hasArg("reset")) {
+    scheduler.resetStats();
+  }
+}
+
+// Time per loop() stage in CPU cycles, ?reset=1 starts over
+void handleGetPerf() {
+  StaticJsonDocument<512> doc;
+  uint32_t mhz = ESP.getCpuFreqMHz();
+  unsigned long elapsedMs = millis() - loopProfiler.resetAt();
+
+  doc["enabled"] = LOOP_PROFILER != 0;
+  doc["cpuMHz"] = mhz;
+  doc["elapsedMs"] = elapsedMs;
+  JsonArray edges = doc.createNestedArray("bucketLtUs");
+  for (uint8_t i = 0; i + 1 < PERF_BUCKETS; i++) {
+    edges.add((float)LoopProfiler::bucketLimit(i) / mhz);
+  }
+  String output;
+  serializeJson(doc, output);
+  
+  // Stages one at a time in chunks, as for /api/automation
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "application/json", "");
+  output.remove(output.length() - 1);  // closing brace
+  output += ",\"stages\":[";
+  for (uint8_t i = 0; i < PERF_STAGES; i++) {
+    const PerfStageStats& s = loopProfiler.stage(i);
+    JsonObject stage = doc.to<JsonObject>();  // reused, one stage at a time
+    stage["name"] = LoopProfiler::stageName(i);
+    stage["count"] = s.count;
+    stage["totalMs"] = s.totalCycles / 1000.0 / mhz;
+    stage["avgUs"] = s.count ? (float)s.totalCycles / s.count / mhz : 0.0;
+    stage["maxUs"] = (float)s.maxCycles / mhz;
+    stage["sharePct"] = elapsedMs ? s.totalCycles / 10.0 / mhz / elapsedMs : 0.0;
+    JsonArray counts = stage.createNestedArray("buckets");
+    for (uint8_t b = 0; b < PERF_BUCKETS; b++) {
+      counts.add(s.buckets[b]);
+    }
+    if (i) output += ',';
+    serializeJson(doc, output);
+    server.sendContent(output);
+    output = "";
+  }
+  output += "]}";
+  server.sendContent(output);
+  server.sendContent("");  // end of chunked response
+
+  if (server.hasArg("reset")) {
+    loopProfiler.reset();
+  }
+}
+
 void handleSetRelay() {
   if (server.hasArg("plain")) {
     DynamicJsonDocument doc(200);
@@ -666,8 +1038,20 @@ void handleNotFound() {
   server.send(404, "text/plain", "File Not Found");
 }
 
+static void addChannelStats(JsonObject obj, const ChannelStats& stats) {
+  obj["avg"] = stats.ewma();
+  obj["rms"] = stats.rms();
+  obj["min"] = stats.min();
+  obj["max"] = stats.max();
+  // Quantiles are NAN until the first frame, which is not valid JSON
+  if (!isnan(stats.p50())) {
+    obj["p50"] = stats.p50();
+    obj["p95"] = stats.p95();
+  }
+}
+
 String getStatusJSON() {
-  DynamicJsonDocument doc(300);
+  DynamicJsonDocument doc(2560 + MAX_CHILDREN * 40);
   
   doc["deviceId"] = deviceState.deviceId;
   doc["relay"] = deviceState.relayState;
@@ -676,6 +1060,10 @@ String getStatusJSON() {
   doc["power"] = deviceState.power;
   doc["energy"] = deviceState.energy;
   doc["wifi"] = deviceState.wifiConnected;
+  doc["wifiState"] = connectionStateName(wifiLink.state());
+  doc["wifiAttempts"] = wifiLink.stats().attempts;
+  doc["mqttState"] = connectionStateName(mqttLink.state());
+  doc["mqttAttempts"] = mqttLink.stats().attempts;
   doc["uptime"] = millis();
   doc["freeHeap"] = ESP.getFreeHeap();
   doc["chipId"] = ESP.getChipId();
@@ -683,9 +1071,11 @@ String getStatusJSON() {
   doc["otaHostname"] = String(HOSTNAME) + ".local";
   doc["firmwareVersion"] = FIRMWARE_VERSION;
   doc["pairingMode"] = deviceState.pairingMode;
+  doc["pairingPhase"] = pairingPhaseName(deviceState.pairingPhase);
   doc["isParent"] = deviceState.isParent;
   doc["hasParent"] = deviceState.hasParent;
   doc["childCount"] = deviceState.childCount;
+  doc["groupId"] = deviceState.groupId;
   
   if (deviceState.hasParent) {
     doc["parentMac"] = macToString(deviceState.parentMac);
@@ -696,22 +1086,158 @@ String getStatusJSON() {
     children.add(macToString(deviceState.childMacs[i]));
   }
   
+  // Sensor health: counters are cumulative, a falling fps or growing
+  // lastGoodAgeMs shows throughput degrading
+  const CSE7766Stats& health = cse7766.getStats();
+  JsonObject sensor = doc.createNestedObject("sensor");
+  sensor["fps"] = cse7766.getFrameRate();
+  unsigned long lastGoodAge = cse7766.getLastGoodFrameAge();
+  if (lastGoodAge != 0xFFFFFFFFUL) {
+    sensor["lastGoodAgeMs"] = lastGoodAge;
+  }
+  sensor["frames"] = health.frames;
+  sensor["good"] = health.good;
+  sensor["crcErrors"] = health.crcErrors;
+  sensor["calibrationErrors"] = health.calibrationErrors;
+  sensor["otherErrors"] = health.otherErrors;
+  sensor["syncLosses"] = health.syncLosses;
+  sensor["bytesDiscarded"] = health.bytesDiscarded;
+  sensor["decodeCycles"] = cse7766.getDecodeCycles();
+  
+  // Overcurrent protection, latency is from frame arrival to relay open
+  JsonObject protection = doc.createNestedObject("protection");
+  protection["currentLimit"] = OVERCURRENT_LIMIT;
+  protection["powerLimit"] = OVERPOWER_LIMIT;
+  protection["trips"] = overcurrentTrip.count;
+  if (overcurrentTrip.count > 0) {
+    protection["lastTripAgeMs"] = millis() - overcurrentTrip.lastTrip;
+    protection["lastLatencyMs"] = overcurrentTrip.lastLatencyUs / 1000.0;
+    protection["maxLatencyMs"] = overcurrentTrip.maxLatencyUs / 1000.0;
+    protection["tripCurrent"] = overcurrentTrip.current;
+    protection["tripPower"] = overcurrentTrip.power;
+  }
+  
+  // Relay restore at the last boot, times from reset
+  JsonObject boot = doc.createNestedObject("boot");
+  boot["relaySource"] = relayRestoreSourceName(relayRestore.source);
+  boot["relayMs"] = relayRestore.relayUs / 1000.0;
+  boot["setupMs"] = relayRestore.setupUs / 1000.0;
+  boot["resetReason"] = ESP.getResetReason();
+  
+  // Button edges and gestures, latency is from the edge to the relay switching
+  JsonObject button = doc.createNestedObject("button");
+  button["edges"] = buttonEdges.edges();
+  button["bounces"] = buttonEdges.bounces();
+  button["dropped"] = buttonEdges.dropped();
+  button["resyncs"] = buttonDecoder.stats().resyncs;
+  button["noise"] = buttonDecoder.stats().noise;
+  JsonObject gestures = button.createNestedObject("gestures");
+  for (uint8_t g = BUTTON_PRESS; g <= BUTTON_HOLD; g++) {
+    gestures[buttonGestureName((ButtonGesture)g)] = buttonDecoder.stats().gestures[g];
+  }
+  JsonObject latency = button.createNestedObject("latency");
+  latency["count"] = buttonLatency.count();
+  latency["avgMs"] = buttonLatency.averageUs() / 1000.0;
+  latency["maxMs"] = buttonLatency.maxUs() / 1000.0;
+  
+  // Smoothed readings over recent frames (avg is the EWMA used by automation)
+  JsonObject stats = doc.createNestedObject("stats");
+  stats["frames"] = sensorStats.frames;
+  addChannelStats(stats.createNestedObject("voltage"), sensorStats.voltage);
+  addChannelStats(stats.createNestedObject("current"), sensorStats.current);
+  addChannelStats(stats.createNestedObject("power"), sensorStats.power);
+  
   String output;
   serializeJson(doc, output);
   return output;
 }
 
 String getPeersJSON() {
-  DynamicJsonDocument doc(1000);
+  DynamicJsonDocument doc(1536 + MAX_ESPNOW_PEERS * 256);
   JsonArray peers = doc.createNestedArray("peers");
   
-  for (int i = 0; i < espnowPeerCount; i++) {
+  for (uint16_t i = 0; i < espnowPeers.capacity(); i++) {
+    ESPNOWPeer* entry = espnowPeers.slot(i);
+    if (!entry) continue;
     JsonObject peer = peers.createNestedObject();
-    peer["mac"] = macToString(espnowPeers[i].mac);
-    peer["deviceId"] = espnowPeers[i].deviceId;
-    peer["online"] = espnowPeers[i].isOnline;
-    peer["lastSeen"] = espnowPeers[i].lastSeen;
+    peer["mac"] = macToString(entry->mac);
+    peer["deviceId"] = entry->deviceId;
+    peer["online"] = entry->isOnline;
+    peer["lastSeen"] = entry->lastSeen;
+    if (entry->wireFormat) {
+      peer["format"] = entry->wireFormat;
+    }
+    
+    const DeliveryStats& d = entry->delivery;
+    if (d.sent) {
+      JsonObject delivery = peer.createNestedObject("delivery");
+      delivery["sent"] = d.sent;
+      delivery["delivered"] = d.delivered;
+      delivery["failed"] = d.failed;
+      delivery["superseded"] = d.superseded;
+      delivery["retries"] = d.retries;
+      if (d.delivered + d.failed) {
+        delivery["ratio"] = (float)d.delivered / (d.delivered + d.failed);
+      }
+      delivery["rttLastMs"] = d.rttLastUs / 1000.0;
+      delivery["rttAvgMs"] = d.rttAvgUs / 1000.0;
+      delivery["rttMaxMs"] = d.rttMaxUs / 1000.0;
+    }
+  }
+  
+  JsonObject wire = doc.createNestedObject("wire");
+  wire["format"] = ESPNOW_WIRE_FORMAT;
+  wire["legacyNearby"] = legacyPeersNearby();
+  wire["txMessages"] = wireStats.txMessages;
+  wire["txBytes"] = wireStats.txBytes;
+  wire["rxMessages"] = wireStats.rxMessages;
+  wire["rxBytes"] = wireStats.rxBytes;
+  wire["rxLegacy"] = wireStats.rxLegacy;
+  wire["rxMalformed"] = wireStats.rxMalformed;
+  wire["rxDuplicates"] = wireStats.rxDuplicates;
+  wire["rxUntracked"] = wireStats.rxUntracked;
+  wire["alertNacks"] = wireStats.alertNacks;
+  wire["awaitingAck"] = reliableOutbox.pending();
+  wire["outboxFull"] = reliableOutbox.overflows();
+  wire["encodeCycles"] = wireStats.txMessages ? (uint32_t)(wireStats.encodeCycles / wireStats.txMessages) : 0;
+  wire["decodeCycles"] = wireStats.rxMessages ? (uint32_t)(wireStats.decodeCycles / wireStats.rxMessages) : 0;
+  
+  const ESPNOWQueueStats& rx = espnowRxQueue.stats();
+  JsonObject queue = doc.createNestedObject("rxQueue");
+  queue["slots"] = espnowRxQueue.capacity();
+  queue["depth"] = espnowRxQueue.size();
+  queue["highWater"] = rx.highWater;
+  queue["avgDepth"] = rx.drains ? (float)rx.depthSum / rx.drains : 0;
+  queue["received"] = rx.received;
+  queue["dropped"] = rx.dropped;
+  queue["processed"] = rx.processed;
+  queue["callbackCyclesMax"] = rx.callbackCyclesMax;
+  
+  const BeaconStats& bs = stateBeacon.stats();
+  JsonObject beaconObj = doc.createNestedObject("beacon");
+  beaconObj["deltas"] = bs.deltas;
+  beaconObj["full"] = bs.full;
+  beaconObj["heartbeats"] = bs.heartbeats;
+  beaconObj["deferred"] = bs.deferred;
+  beaconObj["fieldsSent"] = bs.fieldsSent;
+  beaconObj["idleIntervalMs"] = stateBeacon.idleInterval();
+  
+  const MeshStats& ms = meshRouter.stats();
+  JsonObject mesh = doc.createNestedObject("mesh");
+  mesh["ttl"] = MESH_TTL;
+  mesh["originated"] = ms.originated;
+  mesh["forwarded"] = ms.forwarded;
+  mesh["received"] = ms.received;
+  mesh["duplicates"] = ms.duplicates;
+  mesh["expired"] = ms.expired;
+  JsonArray hops = mesh.createNestedArray("hops");
+  for (int i = 1; i <= MESH_MAX_HOPS; i++) {
+    hops.add(ms.hops[i]);
   }
+  mesh["roundTrips"] = ms.roundTrips;
+  mesh["rttLastUs"] = ms.rttLastUs;
+  mesh["rttAvgUs"] = ms.rttAvgUs;
+  mesh["hopLatencyUs"] = ms.hopUsAvg;
   
   String output;
   serializeJson(doc, output);
@@ -759,6 +1285,20 @@ String generateWebPage() {
                 </div>
             </div>
             
+            <!-- Power History Card -->
+            <div class="card">
+                <h3>Power History</h3>
+                <div class="history-controls">
+                    <select id="historyTier">
+                        <option value="raw">Last frames</option>
+                        <option value="second" selected>Per second</option>
+                        <option value="minute">Per minute</option>
+                    </select>
+                    <span id="historySummary">Loading...</span>
+                </div>
+                <canvas id="historyChart" class="history-chart"></canvas>
+            </div>
+            
             <!-- Device Control Card -->
             <div class="card">
                 <h3>Device Control</h3>
@@ -857,6 +1397,7 @@ String generateWebPage() {
         <script src="/js/relay.js"></script>
         <script src="/js/wifi.js"></script>
         <script src="/js/pairing.js"></script>
+        <script src="/js/history.js"></script>
 </body>
 </html>
   )HTMLDATA";
@@ -14,12 +14,17 @@ void initWebServer();
 void handleRoot();
 void handleAPI();
 void handleGetStatus();
+void handleGetHistory();
+void handleGetAutomation();
+void handleGetTasks();
+void handleGetPerf();
 void handleSetRelay();
 
 // External relay control functions (defined in main .ino file)
 extern void turnOnRelay();
 extern void turnOffRelay();
 extern void toggleRelay();
+extern const char* relayRestoreSourceName(RelayRestoreSource source);
 void handleGetPeers();
 void handleSendCommand();
 void handlePairing();
@@ -32,6 +37,7 @@ void handlePeersJS();
 void handleRelayJS();
 void handleWiFiJS();
 void handlePairingJS();
+void handleHistoryJS();
 
 // Utility functions
 String getStatusJSON();